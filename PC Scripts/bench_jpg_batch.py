@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+"""Frames per second of decoding what the PC ingests: cv2.imdecode() one frame after the other, as the scripts do
+now, against jpg2fmt_batch() at 1, 2, 4 and 8 threads.
+
+A batch holds one frame of each camera, images of the detector training set scaled to their sizes and encoded at
+quality 80: the ESP32 stream (SVGA), the laptop camera (HD) and the UVC arm camera (VGA). Output is CSV:
+path,threads,batch,fps,ms_per_frame, then the mean decode time of each camera and the largest difference to cv2.
+
+    python3 bench_jpg_batch.py [--images DIR] [--max-images N] [--batches N]
+"""
+
+import argparse
+import os
+import time
+
+import cv2
+import numpy as np
+
+from jpg_batch import JpgBatch
+
+CAMERAS = {"esp32": (800, 600), "laptop": (1280, 720), "uvc": (640, 480)}
+
+
+def timed(fn, batches, min_s=1.0):
+    n = 0
+    start = time.perf_counter()
+    while n < 3 * len(batches[0]) or time.perf_counter() - start < min_s:
+        for batch in batches:
+            fn(batch)
+            n += len(batch)
+    return n / (time.perf_counter() - start)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--images", default=os.path.join(here, "..", "fine-tuning", "dataset", "valid", "images"))
+    parser.add_argument("--max-images", type=int, default=8)
+    parser.add_argument("--batches", type=int, default=4, help="batches of 3 frames per decode call")
+    args = parser.parse_args()
+
+    names = sorted(f for f in os.listdir(args.images) if f.lower().endswith(".jpg"))[:args.max_images]
+    images = [cv2.imread(os.path.join(args.images, f)) for f in names]
+    frames = [(cam, cv2.imencode(".jpg", cv2.resize(img, size, interpolation=cv2.INTER_AREA),
+                                 [cv2.IMWRITE_JPEG_QUALITY, 80])[1].tobytes())
+              for img in images for cam, size in CAMERAS.items()]
+    size = args.batches * len(CAMERAS)
+    batches = [[jpg for _, jpg in frames[i:i + size]] for i in range(0, len(frames), size)]
+
+    print("path,threads,batch,fps,ms_per_frame")
+    fps = timed(lambda batch: [cv2.imdecode(np.frombuffer(j, np.uint8), cv2.IMREAD_COLOR) for j in batch], batches)
+    print("opencv,1,%d,%.1f,%.3f" % (size, fps, 1000 / fps))
+    for threads in (1, 2, 4, 8):
+        decoder = JpgBatch(workers=threads)
+        fps = timed(decoder, batches)
+        print("jpg2fmt_batch,%d,%d,%.1f,%.3f" % (threads, size, fps, 1000 / fps))
+
+    decoder = JpgBatch(workers=1)
+    per_camera = {cam: [] for cam in CAMERAS}
+    worst = 0
+    for cam, jpg in frames:
+        (img,), ms = decoder([jpg])
+        per_camera[cam].append(ms[0])
+        ref = cv2.imdecode(np.frombuffer(jpg, np.uint8), cv2.IMREAD_COLOR)
+        worst = max(worst, np.abs(img.astype(np.int16) - ref).mean())
+    for cam, ms in per_camera.items():
+        print("# %s %dx%d: %.2f ms per frame" % ((cam,) + CAMERAS[cam] + (np.mean(ms),)))
+    print("# largest mean difference to cv2: %.2f of 255" % worst)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Time to turn an ESP32 frame into a YOLO input tensor: jpg2tensor() against the OpenCV path of yolo_display.py
+(cv2 decode, then the Ultralytics letterbox resize and the conversion to a float CHW tensor).
+
+Frames are images of the detector training set scaled to QVGA and SVGA, as the camera sends them, and encoded at
+quality 80. Output is CSV: frame,tensor,path,ms_per_frame, then the mean difference of the two tensors per frame size.
+
+    python3 bench_jpg_tensor.py [--images DIR] [--max-images N] [--size 640]
+"""
+
+import argparse
+import os
+import time
+
+import cv2
+import numpy as np
+
+from jpg_tensor import JpgTensor
+
+FRAMES = {"QVGA": (320, 240), "SVGA": (800, 600)}
+
+
+def opencv_tensor(jpg, size):
+    """What the current PC pipeline does to a frame before inference."""
+    img = cv2.imdecode(np.frombuffer(jpg, np.uint8), cv2.IMREAD_COLOR)
+    h, w = img.shape[:2]
+    r = min(size / h, size / w)
+    nw, nh = int(round(w * r)), int(round(h * r))
+    if (nw, nh) != (w, h):
+        img = cv2.resize(img, (nw, nh), interpolation=cv2.INTER_LINEAR)
+    dw, dh = (size - nw) / 2, (size - nh) / 2
+    top, bottom = int(round(dh - 0.1)), int(round(dh + 0.1))
+    left, right = int(round(dw - 0.1)), int(round(dw + 0.1))
+    img = cv2.copyMakeBorder(img, top, bottom, left, right, cv2.BORDER_CONSTANT, value=(114, 114, 114))
+    img = np.ascontiguousarray(img[..., ::-1].transpose(2, 0, 1)[None])
+    return img.astype(np.float32) / 255.0
+
+
+def timed(fn, jpgs, min_s=0.5):
+    n = 0
+    start = time.perf_counter()
+    while n < 3 or time.perf_counter() - start < min_s:
+        for jpg in jpgs:
+            fn(jpg)
+        n += len(jpgs)
+    return (time.perf_counter() - start) * 1000 / n
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--images", default=os.path.join(here, "..", "fine-tuning", "dataset", "valid", "images"))
+    parser.add_argument("--max-images", type=int, default=8)
+    parser.add_argument("--size", type=int, default=640)
+    args = parser.parse_args()
+
+    names = sorted(f for f in os.listdir(args.images) if f.lower().endswith(".jpg"))[:args.max_images]
+    images = [cv2.imread(os.path.join(args.images, f)) for f in names]
+    native = JpgTensor(args.size, args.size)
+    out = np.empty(native.shape, np.float32)
+
+    print("frame,tensor,path,ms_per_frame")
+    diffs = {}
+    for frame, (w, h) in FRAMES.items():
+        jpgs = [cv2.imencode(".jpg", cv2.resize(img, (w, h), interpolation=cv2.INTER_AREA),
+                             [cv2.IMWRITE_JPEG_QUALITY, 80])[1].tobytes() for img in images]
+        ms = timed(lambda jpg: opencv_tensor(jpg, args.size), jpgs)
+        print("%s,%d,opencv,%.3f" % (frame, args.size, ms))
+        ms = timed(lambda jpg: native(jpg, out), jpgs)
+        print("%s,%d,jpg2tensor,%.3f" % (frame, args.size, ms))
+        diffs[frame] = np.mean([np.abs(opencv_tensor(j, args.size) - native(j)[0]).mean() * 255 for j in jpgs])
+    for frame, d in diffs.items():
+        print("# %s: mean difference %.2f of 255" % (frame, d))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""Batch decoding of the JPEG frames the PC ingests (ESP32 stream, laptop and UVC cameras), with jpg2fmt_batch() of
+the camera component on native threads instead of one cv2.imdecode() after the other.
+
+Build the library as described in jpg_tensor.py.
+"""
+
+import ctypes
+
+import numpy as np
+
+from jpg_tensor import load_library
+
+# pixformat_t of each output and its bytes per pixel
+_FORMATS = {"bgr": (5, 3), "gray": (3, 1), "yuyv": (1, 2)}
+_PAGE = 4096
+
+
+class _Frame(ctypes.Structure):
+    _fields_ = [("src", ctypes.c_char_p), ("src_len", ctypes.c_size_t), ("out", ctypes.c_void_p),
+                ("width", ctypes.c_uint16), ("height", ctypes.c_uint16), ("ok", ctypes.c_bool),
+                ("decode_us", ctypes.c_uint32)]
+
+
+class JpgBatch:
+    """Decodes lists of JPEGs of any sizes into one output slab, B, G, R as cv2.imdecode() by default.
+
+    The slab and the frame table are kept from batch to batch and only grow, steady ingest allocates nothing. The
+    slab is page aligned and contiguous, it can be registered once for GPU transfers (pinned), again only when
+    slab_grown is set after a batch.
+    """
+
+    def __init__(self, workers=4, fmt="bgr", scale=0, lib=None):
+        if fmt not in _FORMATS:
+            raise ValueError("fmt must be one of %s" % ", ".join(_FORMATS))
+        self._lib = load_library(lib)
+        self._lib.jpg2fmt_batch.restype = ctypes.c_bool
+        self._lib.jpg2fmt_batch.argtypes = [ctypes.POINTER(_Frame), ctypes.c_size_t, ctypes.c_int, ctypes.c_int,
+                                            ctypes.c_uint8]
+        self._lib.esp_jpg_get_size.restype = ctypes.c_int
+        self._lib.esp_jpg_get_size.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint16),
+                                               ctypes.POINTER(ctypes.c_uint16)]
+        self.workers = workers
+        self.scale = scale
+        self._format, self._bpp = _FORMATS[fmt]
+        self._frames = (_Frame * 0)()
+        self._raw = np.empty(0, np.uint8)
+        self.slab = self._raw
+        self.slab_grown = False
+
+    def _size(self, jpg):
+        w, h = ctypes.c_uint16(), ctypes.c_uint16()
+        if self._lib.esp_jpg_get_size(jpg, len(jpg), ctypes.byref(w), ctypes.byref(h)) != 0:
+            return 0, 0
+        return w.value >> self.scale, h.value >> self.scale
+
+    def _reserve(self, n, nbytes):
+        if len(self._frames) < n:
+            self._frames = (_Frame * n)()
+        self.slab_grown = nbytes > len(self.slab)
+        if self.slab_grown:
+            self._raw = np.empty(nbytes + _PAGE, np.uint8)
+            start = -self._raw.ctypes.data % _PAGE
+            self.slab = self._raw[start:start + nbytes]
+
+    def __call__(self, jpgs):
+        """Returns the images, None for the JPEGs that could not be decoded, and the decode time of each in ms.
+        The images are views of the slab, the next batch overwrites them."""
+        jpgs = [bytes(j) for j in jpgs]
+        sizes = [self._size(j) for j in jpgs]
+        offsets = np.cumsum([0] + [(w * h * self._bpp + 63) & ~63 for w, h in sizes])
+        self._reserve(len(jpgs), int(offsets[-1]))
+        base = self.slab.ctypes.data
+        for i, (jpg, (w, h)) in enumerate(zip(jpgs, sizes)):
+            f = self._frames[i]
+            f.src, f.src_len = jpg, len(jpg)
+            f.out = base + int(offsets[i]) if w and h else None
+        self._lib.jpg2fmt_batch(self._frames, len(jpgs), self._format, self.scale, self.workers)
+
+        images, ms = [], np.empty(len(jpgs))
+        for i, (w, h) in enumerate(sizes):
+            f = self._frames[i]
+            ms[i] = f.decode_us / 1000
+            if not f.ok:
+                images.append(None)
+                continue
+            img = self.slab[offsets[i]:offsets[i] + w * h * self._bpp]
+            images.append(img.reshape((h, w, self._bpp)) if self._bpp != 1 else img.reshape((h, w)))
+        return images, ms
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""YOLO input tensors straight from the JPEG frames of the ESP32, with jpg2tensor() of the camera component.
+
+The JPEG is decoded, letterboxed and normalized in one pass, without an intermediate image. Build the library with
+
+    cmake -S esp32-HighRes/managed_components/espressif__esp32-camera/test/host -B build
+    cmake --build build --target conversions_shared
+
+and point ESP32_CAMERA_LIB at build/libesp32_camera_conversions.so if it is not in the default build directory.
+"""
+
+import ctypes
+import os
+
+import numpy as np
+
+_DEFAULT_LIB = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "esp32-HighRes", "managed_components",
+                            "espressif__esp32-camera", "test", "host", "build", "libesp32_camera_conversions.so")
+
+
+def load_library(lib=None):
+    """The conversions library: lib, else ESP32_CAMERA_LIB, else the default host build."""
+    return ctypes.CDLL(lib or os.environ.get("ESP32_CAMERA_LIB", _DEFAULT_LIB))
+
+
+# jpg_tensor_layout_t and jpg_tensor_type_t
+NCHW, NHWC = 0, 1
+_UINT8, _FLOAT32 = 0, 1
+
+
+class _Config(ctypes.Structure):
+    _fields_ = [("width", ctypes.c_uint16), ("height", ctypes.c_uint16), ("layout", ctypes.c_int),
+                ("type", ctypes.c_int), ("bgr", ctypes.c_bool), ("pad_value", ctypes.c_uint8),
+                ("mean", ctypes.c_float * 3), ("std", ctypes.c_float * 3)]
+
+
+class _Letterbox(ctypes.Structure):
+    _fields_ = [("scale", ctypes.c_float), ("left", ctypes.c_uint16), ("top", ctypes.c_uint16),
+                ("width", ctypes.c_uint16), ("height", ctypes.c_uint16), ("decode_scale", ctypes.c_int)]
+
+
+class JpgTensor:
+    """Decodes JPEGs into tensors of one size, layout and type, as Ultralytics prepares them by default:
+    RGB, letterboxed with gray (114), float32 of 0-1."""
+
+    def __init__(self, width=640, height=640, layout=NCHW, dtype=np.float32, bgr=False, pad_value=114,
+                 mean=(0.0, 0.0, 0.0), std=(1.0, 1.0, 1.0), lib=None):
+        self._lib = load_library(lib)
+        self._lib.jpg2tensor.restype = ctypes.c_bool
+        self._lib.jpg2tensor.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.POINTER(_Config), ctypes.c_void_p,
+                                         ctypes.POINTER(_Letterbox)]
+        if dtype not in (np.float32, np.uint8):
+            raise ValueError("dtype must be float32 or uint8")
+        self.dtype = dtype
+        self.shape = (1, 3, height, width) if layout == NCHW else (1, height, width, 3)
+        self._config = _Config(width, height, layout, _FLOAT32 if dtype == np.float32 else _UINT8, bgr, pad_value,
+                               (ctypes.c_float * 3)(*mean), (ctypes.c_float * 3)(*std))
+
+    def __call__(self, jpg, out=None):
+        """Returns the tensor, in out if given, and (scale, left, top): a point (x, y) of the tensor is at
+        ((x - left) / scale, (y - top) / scale) in the frame."""
+        if out is None:
+            out = np.empty(self.shape, dtype=self.dtype)
+        elif out.shape != self.shape or out.dtype != self.dtype or not out.flags["C_CONTIGUOUS"]:
+            raise ValueError("out must be a contiguous %s array of shape %s" % (np.dtype(self.dtype), self.shape))
+        jpg = bytes(jpg)
+        lb = _Letterbox()
+        if not self._lib.jpg2tensor(jpg, len(jpg), ctypes.byref(self._config), out.ctypes.data, ctypes.byref(lb)):
+            raise ValueError("JPEG could not be decoded")
+        return out, (lb.scale, lb.left, lb.top)
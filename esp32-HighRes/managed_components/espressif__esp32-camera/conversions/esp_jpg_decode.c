@@ -12,23 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include "esp_jpg_decode.h"
-
-#include "esp_system.h"
-#if ESP_IDF_VERSION_MAJOR >= 4 // IDF 4+
-#if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
-#include "esp32/rom/tjpgd.h"
-#elif CONFIG_IDF_TARGET_ESP32S3
-#include "esp32s3/rom/tjpgd.h"
-#elif CONFIG_IDF_TARGET_ESP32C3
-#include "esp32c3/rom/tjpgd.h"
-#elif CONFIG_ESP_ROM_HAS_JPEG_DECODE // available since IDF 4.4
-#include "rom/tjpgd.h"  // latest IDFs have `rom/` includes available
-#else
-#include "tjpgd.h"  // using software decoder
-#endif
-#else // ESP32 Before IDF 4.0
-#include "rom/tjpgd.h"
-#endif
+#include <string.h>
+#include <pthread.h>
+#include "img_buf_pool.h"
+#include "esp_jpg_decode_rom.h"
+#include "tjpgd.h"  // the software decoder, also on chips with the decoder in ROM
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -40,14 +28,23 @@ static const char* TAG = "esp_jpg_decode";
 
 typedef struct {
         jpg_scale_t scale;
+        jpg_output_t output;
         jpg_reader_cb reader;
         jpg_writer_cb writer;
         void * arg;
+        const uint8_t *src;     // JPEG in memory, read without the reader callback
         size_t len;
         size_t index;
+        const jpg_rect_t *rois; // rectangles to output, NULL for the whole image
+        size_t num_rois;
+        JRECT roi[ESP_JPG_DECODE_MAX_ROIS];     // rois in pixels of the image, inclusive and clipped
+        size_t nroi;
+        uint8_t workers;        // tasks decoding restart intervals in parallel, the calling one included
 } esp_jpg_decoder_t;
 
-static const char * jd_errors[] = {
+#define JPG_POOL_WORK_SIZE ESP_JPG_DECODE_FAST_WORK_SIZE
+
+const char * const esp_jpg_decode_errors[] = {
     "Succeeded",
     "Interrupted by output function",
     "Device error or wrong termination of input stream",
@@ -81,54 +78,350 @@ static unsigned int _jpg_read(JDEC *decoder, uint8_t *buf, unsigned int len)
     if (jpeg->len && len > (jpeg->len - jpeg->index)) {
         len = jpeg->len - jpeg->index;
     }
-    if (len) {
+    if (len && jpeg->src) {
+        if (buf) {
+            memcpy(buf, jpeg->src + jpeg->index, len);
+        }
+        jpeg->index += len;
+    } else if (len) {
         len = jpeg->reader(jpeg->arg, jpeg->index, buf, len);
         if (!len) {
-            ESP_LOGE(TAG, "Read Fail at %u/%u", jpeg->index, jpeg->len);
+            ESP_LOGE(TAG, "Read Fail at %u/%u", (unsigned)jpeg->index, (unsigned)jpeg->len);
         }
         jpeg->index += len;
     }
     return len;
 }
 
-esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+// The decoder keeps little on the stack, most of it is left to the writer.
+#define JPG_WORKER_STACK_SIZE 6144
+
+typedef struct jpg_worker jpg_worker_t;
+
+typedef struct {
+    esp_jpg_decoder_t *jpeg;
+    const uint8_t *start;       // bit stream of the first interval
+    const uint8_t **ends;       // end of each interval: the RST marker after it, the end of the data for the last
+    size_t num_intervals;
+    size_t next_interval;
+    JRESULT result;             // first error of a worker
+} jpg_interval_job_t;
+
+struct jpg_worker {
+    jpg_interval_job_t *job;
+    pthread_t thread;
+    JDEC decoder;               // shares the tables of the prepared decoder
+    uint8_t pool[JD_COPY_POOL];
+};
+
+// Finds the end of each of the n restart intervals of the bit stream from p. Fails unless all RST markers
+// are there, in sequence.
+static bool _find_intervals(const uint8_t *p, const uint8_t *end, const uint8_t **ends, size_t n)
 {
-    static uint8_t work[3100];
-    JDEC decoder;
-    esp_jpg_decoder_t jpeg;
+    for (size_t i = 0; i + 1 < n; i++) {
+        for (;;) {
+            p = (const uint8_t *)memchr(p, 0xFF, end - p);
+            if (!p || p + 1 >= end) {
+                return false;
+            }
+            if (p[1] == 0xD0 + (i & 7)) {
+                break;
+            }
+            if (p[1] != 0x00 && p[1] != 0xFF) {     // any other marker, the intervals are not as the DRI says
+                return false;
+            }
+            p++;
+        }
+        ends[i] = p;
+        p += 2;
+    }
+    ends[n - 1] = end;
+    return true;
+}
 
-    jpeg.len = len;
-    jpeg.reader = reader;
-    jpeg.writer = writer;
-    jpeg.arg = arg;
-    jpeg.scale = scale;
-    jpeg.index = 0;
+static void *decode_intervals_task(void *arg)
+{
+    jpg_worker_t *worker = (jpg_worker_t *)arg;
+    jpg_interval_job_t *job = worker->job;
+    size_t n;
+
+    while ((n = __atomic_fetch_add(&job->next_interval, 1, __ATOMIC_RELAXED)) < job->num_intervals) {
+        if (__atomic_load_n(&job->result, __ATOMIC_RELAXED) != JDR_OK) {
+            break;
+        }
+        const uint8_t *data = n ? job->ends[n - 1] + 2 : job->start;
+        JRESULT jres = jd_decomp_rst(&worker->decoder, _jpg_write, (uint8_t)job->jpeg->scale,
+                                     (uint8_t)job->jpeg->output, n, data, job->ends[n] - data);
+        if (jres != JDR_OK) {
+            __atomic_store_n(&job->result, jres, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Decodes the restart intervals of a prepared in memory JPEG on jpeg->workers tasks, the calling one included.
+// Without restart markers, or when they could not all be found, the image is decoded on the calling task.
+static JRESULT jpg_decode_intervals(esp_jpg_decoder_t *jpeg, JDEC *decoder)
+{
+    size_t mcu_w = decoder->msx * 8, mcu_h = decoder->msy * 8;
+    size_t mcus = ((decoder->width + mcu_w - 1) / mcu_w) * ((decoder->height + mcu_h - 1) / mcu_h);
+    size_t num_intervals = decoder->nrst ? (mcus + decoder->nrst - 1) / decoder->nrst : 0;
+    int workers = jpeg->workers;
+    if (workers > (int)num_intervals) {
+        workers = num_intervals;
+    }
+    if (workers < 2) {
+        return jd_decomp_roi(decoder, _jpg_write, (uint8_t)jpeg->scale, (uint8_t)jpeg->output, NULL, 0);
+    }
 
-    JRESULT jres = jd_prepare(&decoder, _jpg_read, work, 3100, &jpeg);
+    size_t job_len = num_intervals * sizeof(const uint8_t *) + workers * sizeof(jpg_worker_t);
+    uint8_t *buf = (uint8_t *)img_buf_acquire(job_len);
+    if (!buf) {
+        ESP_LOGW(TAG, "JPG interval table malloc failed, decoding on one task");
+        return jd_decomp_roi(decoder, _jpg_write, (uint8_t)jpeg->scale, (uint8_t)jpeg->output, NULL, 0);
+    }
+    jpg_worker_t *w = (jpg_worker_t *)buf;
+    jpg_interval_job_t job;
+    job.jpeg = jpeg;
+    job.start = decoder->dptr + 1;  // where jd_prepare_mem() left the bit stream
+    job.ends = (const uint8_t **)(w + workers);
+    job.num_intervals = num_intervals;
+    job.next_interval = 0;
+    job.result = JDR_OK;
+    if (!_find_intervals(job.start, jpeg->src + jpeg->len, job.ends, num_intervals)) {
+        ESP_LOGW(TAG, "JPG restart markers not found, decoding on one task");
+        img_buf_release(buf, job_len);
+        return jd_decomp_roi(decoder, _jpg_write, (uint8_t)jpeg->scale, (uint8_t)jpeg->output, NULL, 0);
+    }
+    for (int i = 0; i < workers; i++) {
+        w[i].job = &job;
+        JRESULT jres = jd_prepare_copy(&w[i].decoder, decoder, w[i].pool, sizeof(w[i].pool));
+        if (jres != JDR_OK) {
+            img_buf_release(buf, job_len);
+            return jres;
+        }
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // may fail where the minimum stack is larger, the default size is fine there
+    pthread_attr_setstacksize(&attr, JPG_WORKER_STACK_SIZE);
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&w[i].thread, &attr, decode_intervals_task, &w[i]) != 0) {
+            ESP_LOGW(TAG, "JPG worker %d could not be started", i);
+            break;
+        }
+        started = i;
+    }
+    pthread_attr_destroy(&attr);
+
+    decode_intervals_task(&w[0]);
+    for (int i = 1; i <= started; i++) {
+        pthread_join(w[i].thread, NULL);
+    }
+    img_buf_release(buf, job_len);
+    return job.result;
+}
+
+// Decodes with the given workspace, or one from the image buffer pool when work is NULL.
+static esp_err_t jpg_decode(esp_jpg_decoder_t *jpeg, void * work, size_t work_len)
+{
+    // the workspace holds all decoder state besides JDEC, so decodes with their own workspaces never interfere
+    if (!work) {
+        if (!(work = img_buf_acquire(JPG_POOL_WORK_SIZE))) {
+            ESP_LOGE(TAG, "JPG workspace malloc failed");
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t ret = jpg_decode(jpeg, work, JPG_POOL_WORK_SIZE);
+        img_buf_release(work, JPG_POOL_WORK_SIZE);
+        return ret;
+    }
+    if (work_len < ESP_JPG_DECODE_WORK_SIZE) {
+        ESP_LOGE(TAG, "JPG workspace of %u bytes is too small", (unsigned)work_len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    JDEC decoder;
+    JRESULT jres;
+    // the bit stream of an in memory JPEG is walked in place
+    if (jpeg->src) {
+        jres = jd_prepare_mem(&decoder, jpeg->src, jpeg->len, work, work_len, jpeg);
+    } else {
+        jres = jd_prepare(&decoder, _jpg_read, work, work_len, jpeg);
+    }
     if(jres != JDR_OK){
-        ESP_LOGE(TAG, "JPG Header Parse Failed! %s", jd_errors[jres]);
+        ESP_LOGE(TAG, "JPG Header Parse Failed! %s", esp_jpg_decode_errors[jres]);
         return ESP_FAIL;
     }
 
-    uint16_t output_width = decoder.width / (1 << (uint8_t)(jpeg.scale));
-    uint16_t output_height = decoder.height / (1 << (uint8_t)(jpeg.scale));
+    uint16_t output_width = decoder.width / (1 << (uint8_t)(jpeg->scale));
+    uint16_t output_height = decoder.height / (1 << (uint8_t)(jpeg->scale));
 
-    //output start
-    writer(arg, 0, 0, output_width, output_height, NULL);
+    // the rectangles inside the image, in the inclusive coordinates of the decoder
+    jpeg->nroi = 0;
+    for (size_t i = 0; jpeg->rois && i < jpeg->num_rois; i++) {
+        const jpg_rect_t *r = &jpeg->rois[i];
+        uint32_t right = r->width ? (uint32_t)r->x + r->width : decoder.width;
+        uint32_t bottom = r->height ? (uint32_t)r->y + r->height : decoder.height;
+        if (r->x >= decoder.width || r->y >= decoder.height) {
+            continue;
+        }
+        JRECT *roi = &jpeg->roi[jpeg->nroi++];
+        roi->left = r->x;
+        roi->top = r->y;
+        roi->right = (right < decoder.width ? right : decoder.width) - 1;
+        roi->bottom = (bottom < decoder.height ? bottom : decoder.height) - 1;
+    }
+
+    //output start, the writer may refuse the size or have no buffer for it
+    if (!jpeg->writer(jpeg->arg, 0, 0, output_width, output_height, NULL)) {
+        ESP_LOGE(TAG, "JPG output of %ux%u refused", output_width, output_height);
+        return ESP_FAIL;
+    }
     //output write
-    jres = jd_decomp(&decoder, _jpg_write, (uint8_t)jpeg.scale);
+    if (jpeg->rois && !jpeg->nroi) {
+        jres = JDR_OK;  // nothing of the image to output
+    } else {
+        if (jpeg->workers > 1) {
+            jres = jpg_decode_intervals(jpeg, &decoder);
+        } else {
+            jres = jd_decomp_roi(&decoder, _jpg_write, (uint8_t)jpeg->scale, (uint8_t)jpeg->output, jpeg->roi, jpeg->nroi);
+        }
+    }
     //output end
-    writer(arg, output_width, output_height, output_width, output_height, NULL);
+    jpeg->writer(jpeg->arg, output_width, output_height, output_width, output_height, NULL);
 
     if (jres != JDR_OK) {
-        ESP_LOGE(TAG, "JPG Decompression Failed! %s", jd_errors[jres]);
+        ESP_LOGE(TAG, "JPG Decompression Failed! %s", esp_jpg_decode_errors[jres]);
         return ESP_FAIL;
     }
     //check if all data has been consumed.
-    if (len && jpeg.index < len) {
-        _jpg_read(&decoder, NULL, len - jpeg.index);
+    if (!jpeg->src && jpeg->len && jpeg->index < jpeg->len) {
+        _jpg_read(&decoder, NULL, jpeg->len - jpeg->index);
     }
 
     return ESP_OK;
 }
 
+esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg)
+{
+    return esp_jpg_decode_ex(len, scale, reader, writer, arg, NULL, 0);
+}
+
+esp_err_t esp_jpg_decode_ex(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg, void * work, size_t work_len)
+{
+#if ESP_JPG_DECODE_ROM
+    return esp_jpg_decode_rom(len, scale, reader, writer, arg, work, work_len);
+#else
+    esp_jpg_decoder_t jpeg;
+
+    jpeg.len = len;
+    jpeg.reader = reader;
+    jpeg.writer = writer;
+    jpeg.arg = arg;
+    jpeg.scale = scale;
+    jpeg.output = JPG_OUT_RGB888;
+    jpeg.src = NULL;
+    jpeg.index = 0;
+    jpeg.rois = NULL;
+    jpeg.num_rois = 0;
+    jpeg.workers = 1;
+    return jpg_decode(&jpeg, work, work_len);
+#endif
+}
+
+esp_err_t esp_jpg_decode_mem(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_writer_cb writer, void * arg, void * work, size_t work_len)
+{
+    return esp_jpg_decode_mem_fmt(src, len, scale, JPG_OUT_RGB888, writer, arg, work, work_len);
+}
+
+esp_err_t esp_jpg_decode_mem_fmt(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, jpg_writer_cb writer, void * arg, void * work, size_t work_len)
+{
+    return esp_jpg_decode_mem_roi(src, len, scale, output, NULL, 0, writer, arg, work, work_len);
+}
+
+esp_err_t esp_jpg_decode_mem_roi(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, const jpg_rect_t *rois, size_t num_rois, jpg_writer_cb writer, void * arg, void * work, size_t work_len)
+{
+    esp_jpg_decoder_t jpeg;
+
+    if (!src || !len) {
+        ESP_LOGE(TAG, "JPG buffer is empty");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!rois != !num_rois || num_rois > ESP_JPG_DECODE_MAX_ROIS) {
+        ESP_LOGE(TAG, "Invalid JPG decode rectangles");
+        return ESP_ERR_INVALID_ARG;
+    }
+    jpeg.len = len;
+    jpeg.reader = NULL;
+    jpeg.writer = writer;
+    jpeg.arg = arg;
+    jpeg.scale = scale;
+    jpeg.output = output;
+    jpeg.src = src;
+    jpeg.index = 0;
+    jpeg.rois = rois;
+    jpeg.num_rois = num_rois;
+    jpeg.workers = 1;
+    return jpg_decode(&jpeg, work, work_len);
+}
+
+esp_err_t esp_jpg_decode_mem_parallel(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, jpg_writer_cb writer, void * arg, uint8_t workers)
+{
+    esp_jpg_decoder_t jpeg;
+
+    if (!src || !len) {
+        ESP_LOGE(TAG, "JPG buffer is empty");
+        return ESP_ERR_INVALID_ARG;
+    }
+    jpeg.len = len;
+    jpeg.reader = NULL;
+    jpeg.writer = writer;
+    jpeg.arg = arg;
+    jpeg.scale = scale;
+    jpeg.output = output;
+    jpeg.src = src;
+    jpeg.index = 0;
+    jpeg.rois = NULL;
+    jpeg.num_rois = 0;
+    jpeg.workers = workers;
+    return jpg_decode(&jpeg, NULL, 0);
+}
+
+esp_err_t esp_jpg_get_size(const uint8_t *src, size_t len, uint16_t *width, uint16_t *height)
+{
+    if (!src || len < 4 || src[0] != 0xFF || src[1] != 0xD8) {
+        return ESP_FAIL;
+    }
+    size_t i = 2;
+    while (i + 4 <= len) {
+        if (src[i] != 0xFF) {
+            return ESP_FAIL;
+        }
+        uint8_t marker = src[i + 1];
+        if (marker == 0xFF) {   // fill byte
+            i++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {  // no length
+            i += 2;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {     // EOI or SOS before any frame header
+            return ESP_FAIL;
+        }
+        size_t seg_len = ((size_t)src[i + 2] << 8) | src[i + 3];
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (seg_len < 7 || i + 9 > len) {
+                return ESP_FAIL;
+            }
+            *height = ((uint16_t)src[i + 5] << 8) | src[i + 6];
+            *width = ((uint16_t)src[i + 7] << 8) | src[i + 8];
+            return ESP_OK;
+        }
+        i += 2 + seg_len;
+    }
+    return ESP_FAIL;
+}
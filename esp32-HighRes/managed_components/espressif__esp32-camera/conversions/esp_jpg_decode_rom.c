@@ -0,0 +1,130 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include "esp_jpg_decode_rom.h"
+
+#if ESP_JPG_DECODE_ROM
+#include "img_buf_pool.h"
+
+#if ESP_IDF_VERSION_MAJOR >= 4 // IDF 4+
+#if CONFIG_IDF_TARGET_ESP32 // ESP32/PICO-D4
+#include "esp32/rom/tjpgd.h"
+#elif CONFIG_IDF_TARGET_ESP32S3
+#include "esp32s3/rom/tjpgd.h"
+#elif CONFIG_IDF_TARGET_ESP32C3
+#include "esp32c3/rom/tjpgd.h"
+#else
+#include "rom/tjpgd.h"  // latest IDFs have `rom/` includes available
+#endif
+#else // ESP32 Before IDF 4.0
+#include "rom/tjpgd.h"
+#endif
+
+#if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
+#include "esp32-hal-log.h"
+#define TAG ""
+#else
+#include "esp_log.h"
+static const char* TAG = "esp_jpg_decode";
+#endif
+
+typedef struct {
+        jpg_reader_cb reader;
+        jpg_writer_cb writer;
+        void * arg;
+        size_t len;
+        size_t index;
+} esp_jpg_rom_decoder_t;
+
+static unsigned int _jpg_write(JDEC *decoder, void *bitmap, JRECT *rect)
+{
+    esp_jpg_rom_decoder_t * jpeg = (esp_jpg_rom_decoder_t *)decoder->device;
+    if (jpeg->writer) {
+        return jpeg->writer(jpeg->arg, rect->left, rect->top, rect->right + 1 - rect->left,
+                            rect->bottom + 1 - rect->top, (uint8_t *)bitmap);
+    }
+    return 0;
+}
+
+static unsigned int _jpg_read(JDEC *decoder, uint8_t *buf, unsigned int len)
+{
+    esp_jpg_rom_decoder_t * jpeg = (esp_jpg_rom_decoder_t *)decoder->device;
+    if (jpeg->len && len > (jpeg->len - jpeg->index)) {
+        len = jpeg->len - jpeg->index;
+    }
+    if (len) {
+        len = jpeg->reader(jpeg->arg, jpeg->index, buf, len);
+        if (!len) {
+            ESP_LOGE(TAG, "Read Fail at %u/%u", (unsigned)jpeg->index, (unsigned)jpeg->len);
+        }
+        jpeg->index += len;
+    }
+    return len;
+}
+
+esp_err_t esp_jpg_decode_rom(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg, void * work, size_t work_len)
+{
+    // the decoder in ROM has no lookup tables, the smallest workspace is all it uses
+    if (!work) {
+        if (!(work = img_buf_acquire(ESP_JPG_DECODE_WORK_SIZE))) {
+            ESP_LOGE(TAG, "JPG workspace malloc failed");
+            return ESP_ERR_NO_MEM;
+        }
+        esp_err_t ret = esp_jpg_decode_rom(len, scale, reader, writer, arg, work, ESP_JPG_DECODE_WORK_SIZE);
+        img_buf_release(work, ESP_JPG_DECODE_WORK_SIZE);
+        return ret;
+    }
+    if (work_len < ESP_JPG_DECODE_WORK_SIZE) {
+        ESP_LOGE(TAG, "JPG workspace of %u bytes is too small", (unsigned)work_len);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_jpg_rom_decoder_t jpeg;
+    jpeg.len = len;
+    jpeg.reader = reader;
+    jpeg.writer = writer;
+    jpeg.arg = arg;
+    jpeg.index = 0;
+
+    JDEC decoder;
+    JRESULT jres = jd_prepare(&decoder, _jpg_read, work, work_len, &jpeg);
+    if(jres != JDR_OK){
+        ESP_LOGE(TAG, "JPG Header Parse Failed! %s", esp_jpg_decode_errors[jres]);
+        return ESP_FAIL;
+    }
+
+    uint16_t output_width = decoder.width / (1 << (uint8_t)(scale));
+    uint16_t output_height = decoder.height / (1 << (uint8_t)(scale));
+
+    //output start, the writer may refuse the size or have no buffer for it
+    if (!writer(arg, 0, 0, output_width, output_height, NULL)) {
+        ESP_LOGE(TAG, "JPG output of %ux%u refused", output_width, output_height);
+        return ESP_FAIL;
+    }
+    //output write
+    jres = jd_decomp(&decoder, _jpg_write, (uint8_t)scale);
+    //output end
+    writer(arg, output_width, output_height, output_width, output_height, NULL);
+
+    if (jres != JDR_OK) {
+        ESP_LOGE(TAG, "JPG Decompression Failed! %s", esp_jpg_decode_errors[jres]);
+        return ESP_FAIL;
+    }
+    //check if all data has been consumed.
+    if (len && jpeg.index < len) {
+        _jpg_read(&decoder, NULL, len - jpeg.index);
+    }
+
+    return ESP_OK;
+}
+#endif
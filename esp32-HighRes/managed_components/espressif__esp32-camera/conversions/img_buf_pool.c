@@ -0,0 +1,210 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#include "img_buf_pool.h"
+
+#ifdef CONFIG_CAMERA_CONVERTER_BUF_POOL_KB
+#define IMG_BUF_POOL_DEFAULT_LIMIT (CONFIG_CAMERA_CONVERTER_BUF_POOL_KB * 1024)
+#else
+#define IMG_BUF_POOL_DEFAULT_LIMIT (1024 * 1024)
+#endif
+
+// Classes from 256 bytes: four per power of two up to 64KB, where a quarter of a large buffer would be a lot to
+// leave unused, then sixteen per power of two up to 64MB. Larger buffers are allocated exactly and not kept.
+#define IMG_BUF_MIN_SIZE 256
+#define IMG_BUF_FINE_SIZE (64 * 1024)
+#define IMG_BUF_COARSE_CLASSES (4 * 8)
+#define IMG_BUF_NUM_CLASSES (IMG_BUF_COARSE_CLASSES + 16 * 10)
+// Buffers from this size on are allocated in SPIRAM first, as ESP-IDF malloc() does by default.
+#define IMG_BUF_SPIRAM_SIZE (16 * 1024)
+
+// Free buffers are chained through their first bytes.
+typedef struct img_buf_free {
+    struct img_buf_free *next;
+} img_buf_free_t;
+
+static pthread_mutex_t s_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static img_buf_free_t *s_free[IMG_BUF_NUM_CLASSES];
+static size_t s_limit = IMG_BUF_POOL_DEFAULT_LIMIT;
+static img_buf_pool_stats_t s_stats;
+
+// Capacity of class n: a power of two times 1, 1.25, 1.5 and 1.75 below 64KB, so at most a quarter of a buffer is
+// unused, and times 1 to 1.9375 in sixteenths from 64KB, so at most a sixteenth is.
+static inline size_t img_buf_class_size(int n)
+{
+    if (n < IMG_BUF_COARSE_CLASSES) {
+        return (size_t)(4 + (n & 3)) * (IMG_BUF_MIN_SIZE / 4) << (n >> 2);
+    }
+    n -= IMG_BUF_COARSE_CLASSES;
+    return (size_t)(16 + (n & 15)) * (IMG_BUF_FINE_SIZE / 16) << (n >> 4);
+}
+
+// Smallest class holding size bytes, -1 if there is none.
+static int img_buf_class(size_t size)
+{
+    if (size <= IMG_BUF_MIN_SIZE) {
+        return 0;
+    }
+    // size is in (2^k, 2^(k + 1)], the class is the step of its power of two that holds it
+    int k = 8 * (int)sizeof(unsigned long long) - 1 - __builtin_clzll((unsigned long long)(size - 1));
+    int n;
+    if (size <= IMG_BUF_FINE_SIZE) {
+        size_t step = ((size_t)1 << k) / 4;
+        n = 4 * (k - 8) + (int)((size + step - 1) / step) - 4;
+    } else {
+        size_t step = ((size_t)1 << k) / 16;
+        n = IMG_BUF_COARSE_CLASSES + 16 * (k - 16) + (int)((size + step - 1) / step) - 16;
+    }
+    return n < IMG_BUF_NUM_CLASSES ? n : -1;
+}
+
+static void *img_buf_alloc(size_t size)
+{
+#if (CONFIG_SPIRAM_SUPPORT && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
+    if (size >= IMG_BUF_SPIRAM_SIZE) {
+        void *buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buf) {
+            return buf;
+        }
+        return malloc(size);
+    }
+    void *buf = malloc(size);
+    if (buf) {
+        return buf;
+    }
+    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+#else
+    return malloc(size);
+#endif
+}
+
+static void img_buf_note_high_water(void)
+{
+    if (s_stats.cached_bytes + s_stats.in_use_bytes > s_stats.high_water_bytes) {
+        s_stats.high_water_bytes = s_stats.cached_bytes + s_stats.in_use_bytes;
+    }
+}
+
+size_t img_buf_capacity(size_t size)
+{
+    int n = img_buf_class(size ? size : 1);
+    return n < 0 ? size : img_buf_class_size(n);
+}
+
+void *img_buf_acquire(size_t size)
+{
+    int n = img_buf_class(size ? size : 1);
+    size_t cap = n < 0 ? size : img_buf_class_size(n);
+
+    pthread_mutex_lock(&s_pool_lock);
+    img_buf_free_t *buf = n < 0 ? NULL : s_free[n];
+    if (buf) {
+        s_free[n] = buf->next;
+        s_stats.cached_bytes -= cap;
+        s_stats.hits++;
+    } else {
+        s_stats.misses++;
+    }
+    s_stats.in_use_bytes += cap;
+    img_buf_note_high_water();
+    pthread_mutex_unlock(&s_pool_lock);
+
+    if (!buf && !(buf = (img_buf_free_t *)img_buf_alloc(cap))) {
+        pthread_mutex_lock(&s_pool_lock);
+        s_stats.in_use_bytes -= cap;
+        pthread_mutex_unlock(&s_pool_lock);
+    }
+    return buf;
+}
+
+void img_buf_release(void *buf, size_t size)
+{
+    if (!buf) {
+        return;
+    }
+    // a buffer released with a smaller size than it was acquired with goes to that smaller class, which it can hold
+    int n = img_buf_class(size ? size : 1);
+    size_t cap = n < 0 ? size : img_buf_class_size(n);
+
+    pthread_mutex_lock(&s_pool_lock);
+    s_stats.in_use_bytes = s_stats.in_use_bytes > cap ? s_stats.in_use_bytes - cap : 0;
+    if (n >= 0 && s_stats.cached_bytes + cap <= s_limit) {
+        img_buf_free_t *node = (img_buf_free_t *)buf;
+        node->next = s_free[n];
+        s_free[n] = node;
+        s_stats.cached_bytes += cap;
+        buf = NULL;
+    } else {
+        s_stats.drops++;
+    }
+    pthread_mutex_unlock(&s_pool_lock);
+    free(buf);
+}
+
+void *img_buf_shrink_to(void *buf, size_t size, size_t new_size)
+{
+    size_t cap = img_buf_capacity(size), new_cap = img_buf_capacity(new_size);
+    if (!buf || new_cap >= cap) {
+        return buf;
+    }
+    // any 8 bit capable heap, so a SPIRAM buffer shrinks in place instead of moving to internal RAM
+    void *fitted = heap_caps_realloc(buf, new_cap, MALLOC_CAP_8BIT);
+    if (!fitted) {
+        return buf;
+    }
+    pthread_mutex_lock(&s_pool_lock);
+    s_stats.in_use_bytes = s_stats.in_use_bytes > cap - new_cap ? s_stats.in_use_bytes - (cap - new_cap) : 0;
+    pthread_mutex_unlock(&s_pool_lock);
+    return fitted;
+}
+
+// Frees cached buffers, largest first, until at most max_bytes are left. Called with the lock held.
+static void img_buf_shrink(size_t max_bytes)
+{
+    for (int n = IMG_BUF_NUM_CLASSES - 1; n >= 0 && s_stats.cached_bytes > max_bytes; n--) {
+        while (s_free[n] && s_stats.cached_bytes > max_bytes) {
+            img_buf_free_t *buf = s_free[n];
+            s_free[n] = buf->next;
+            s_stats.cached_bytes -= img_buf_class_size(n);
+            free(buf);
+        }
+    }
+}
+
+void img_buf_pool_set_limit(size_t max_bytes)
+{
+    pthread_mutex_lock(&s_pool_lock);
+    s_limit = max_bytes;
+    img_buf_shrink(max_bytes);
+    pthread_mutex_unlock(&s_pool_lock);
+}
+
+void img_buf_pool_trim(void)
+{
+    pthread_mutex_lock(&s_pool_lock);
+    img_buf_shrink(0);
+    pthread_mutex_unlock(&s_pool_lock);
+}
+
+void img_buf_pool_get_stats(img_buf_pool_stats_t *stats)
+{
+    pthread_mutex_lock(&s_pool_lock);
+    *stats = s_stats;
+    pthread_mutex_unlock(&s_pool_lock);
+}
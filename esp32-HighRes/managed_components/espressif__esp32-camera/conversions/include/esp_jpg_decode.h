@@ -31,11 +31,137 @@ typedef enum {
     JPG_SCALE_MAX = JPG_SCALE_8X
 } jpg_scale_t;
 
+/**
+ * @brief Rectangle inside a frame, in pixels
+ */
+typedef struct {
+    uint16_t x;         /*!< Left edge */
+    uint16_t y;         /*!< Top edge */
+    uint16_t width;     /*!< Width, 0 for up to the right edge of the frame */
+    uint16_t height;    /*!< Height, 0 for up to the bottom edge of the frame */
+} jpg_rect_t;
+
+/**
+ * @brief Pixel format handed to the writer callback
+ */
+typedef enum {
+    JPG_OUT_RGB888,     // R, G, B bytes per pixel
+    JPG_OUT_GRAY,       // Y byte per pixel, full range. The software decoder does not reconstruct the chroma
+    JPG_OUT_YCBCR,      // Y, Cb, Cr bytes per pixel, full range as in JFIF
+} jpg_output_t;
+
 typedef size_t (* jpg_reader_cb)(void * arg, size_t index, uint8_t *buf, size_t len);
+// The writer is called with data NULL at the start, x and y 0 and the output size in w and h, and at the end. Returning
+// false at the start aborts the decode, later it stops the decode with an error.
 typedef bool (* jpg_writer_cb)(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data);
 
+/**
+ * @brief Bytes of the workspace of one decode, see esp_jpg_decode_ex()
+ */
+#define ESP_JPG_DECODE_WORK_SIZE 3100
+
+/**
+ * @brief Bytes of a workspace with room for the Huffman lookup tables of the software decoder. Pooled workspaces
+ *        have this size, smaller ones decode the bit stream code by code
+ */
+#define ESP_JPG_DECODE_FAST_WORK_SIZE (ESP_JPG_DECODE_WORK_SIZE + 4096)
+
+/**
+ * @brief Decode a JPEG, its workspace taken from the image buffer pool. Any number of decodes may run at once
+ *
+ * On the ESP32, ESP32-S3 and ESP32-C3 the decoder in ROM decodes these, without lookup tables. The JPEGs in
+ * memory, esp_jpg_decode_mem() and the functions after it, use the software decoder on all chips.
+ */
 esp_err_t esp_jpg_decode(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg);
 
+/**
+ * @brief Decode a JPEG in the given workspace
+ *
+ * @param work      Workspace of at least ESP_JPG_DECODE_WORK_SIZE bytes (ESP_JPG_DECODE_FAST_WORK_SIZE to decode with
+ *                  lookup tables), used by this decode only until it returns. NULL takes one from the image buffer
+ *                  pool, as esp_jpg_decode() does
+ * @param work_len  Size of the workspace in bytes
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if no workspace could be had, ESP_ERR_INVALID_ARG if it is too small,
+ *         ESP_FAIL if the JPEG could not be decoded
+ */
+esp_err_t esp_jpg_decode_ex(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg, void * work, size_t work_len);
+
+/**
+ * @brief Decode a JPEG held in memory, without reader callback
+ *
+ * The compressed data is read in place, the buffer is never written.
+ *
+ * @param src       JPEG data
+ * @param len       Size of the JPEG data in bytes
+ * @param work      Workspace of at least ESP_JPG_DECODE_WORK_SIZE bytes (ESP_JPG_DECODE_FAST_WORK_SIZE to decode with
+ *                  lookup tables), NULL takes one from the image buffer pool
+ * @param work_len  Size of the workspace in bytes
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if no workspace could be had, ESP_ERR_INVALID_ARG if it is too small
+ *         or src is empty, ESP_FAIL if the JPEG could not be decoded
+ */
+esp_err_t esp_jpg_decode_mem(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_writer_cb writer, void * arg, void * work, size_t work_len);
+
+/**
+ * @brief Decode a JPEG held in memory to the given pixel format, as esp_jpg_decode_mem() does to RGB888
+ *
+ * @param output    Pixel format of the data passed to the writer
+ */
+esp_err_t esp_jpg_decode_mem_fmt(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, jpg_writer_cb writer, void * arg, void * work, size_t work_len);
+
+/**
+ * @brief Most rectangles of esp_jpg_decode_mem_roi()
+ */
+#define ESP_JPG_DECODE_MAX_ROIS 16
+
+/**
+ * @brief Decode the parts of a JPEG held in memory inside the given rectangles, as esp_jpg_decode_mem_fmt() does
+ *        the whole image
+ *
+ * The writer gets the MCUs (8 or 16 pixel squares, scaled) touching a rectangle, whole, and the start and end calls
+ * with the full output size. Other MCUs are only entropy decoded, and only until the bottom of the lowest rectangle.
+ * When the JPEG has restart markers, intervals without an MCU to output are skipped by their marker.
+ *
+ * @param rois      Rectangles in pixels of the JPEG, before scaling. Rectangles outside the image are ignored.
+ *                  NULL decodes the whole image
+ * @param num_rois  Number of rectangles, up to ESP_JPG_DECODE_MAX_ROIS, 0 with rois NULL
+ *
+ * @return ESP_OK on success, also when no rectangle is inside the image, ESP_ERR_INVALID_ARG if rois and num_rois
+ *         do not match or there are too many, else as esp_jpg_decode_mem()
+ */
+esp_err_t esp_jpg_decode_mem_roi(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, const jpg_rect_t *rois, size_t num_rois, jpg_writer_cb writer, void * arg, void * work, size_t work_len);
+
+/**
+ * @brief Decode a JPEG held in memory on several tasks, as esp_jpg_decode_mem_fmt() does on one
+ *
+ * The bit stream is split at its restart markers (the JPEG encoders of this component write them when encoding
+ * with more than one worker) and the intervals are decoded in parallel, each task with its own small decoder state
+ * sharing the tables parsed once from the headers. JPEGs without restart markers are decoded on the calling task.
+ *
+ * The writer gets the start and end calls on the calling task, in between it is called from all tasks at once,
+ * with MCUs of different intervals in no particular order. MCUs never overlap, a writer filling a frame buffer
+ * needs no lock, but anything it counts or accumulates must be thread safe.
+ *
+ * @param workers   Number of tasks decoding, the calling task included, at most one per restart interval
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if no workspace could be had, ESP_ERR_INVALID_ARG if src is empty,
+ *         ESP_FAIL if the JPEG could not be decoded
+ */
+esp_err_t esp_jpg_decode_mem_parallel(const uint8_t *src, size_t len, jpg_scale_t scale, jpg_output_t output, jpg_writer_cb writer, void * arg, uint8_t workers);
+
+/**
+ * @brief Get the size of a JPEG held in memory from its frame header, without decoding it
+ *
+ * @param src       JPEG data
+ * @param len       Size of the JPEG data in bytes
+ * @param width     Set to the width in pixels
+ * @param height    Set to the height in pixels
+ *
+ * @return ESP_OK on success, ESP_FAIL if no frame header was found
+ */
+esp_err_t esp_jpg_get_size(const uint8_t *src, size_t len, uint16_t *width, uint16_t *height);
+
 #ifdef __cplusplus
 }
 #endif
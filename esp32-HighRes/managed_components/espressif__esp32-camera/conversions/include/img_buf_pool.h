@@ -0,0 +1,109 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _IMG_BUF_POOL_H_
+#define _IMG_BUF_POOL_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Statistics of the image buffer pool, see img_buf_pool_get_stats()
+ */
+typedef struct {
+    uint32_t hits;              /*!< Acquires served with a pooled buffer */
+    uint32_t misses;            /*!< Acquires that had to allocate */
+    uint32_t drops;             /*!< Releases freed because the pool was full */
+    size_t cached_bytes;        /*!< Bytes of free buffers held by the pool */
+    size_t in_use_bytes;        /*!< Bytes of buffers acquired and not released. Buffers freed with free() stay counted,
+                                     those released with a smaller size leave the difference of their classes */
+    size_t high_water_bytes;    /*!< Largest cached_bytes + in_use_bytes so far */
+} img_buf_pool_stats_t;
+
+/**
+ * @brief Get a buffer of at least size bytes from the pool of the image converters
+ *
+ * Buffers come in size classes, four per power of two up to 64KB and sixteen from there, so buffers of similar
+ * sizes are reused instead of reallocated and the heap does not fragment. Buffers over 64MB are allocated exactly
+ * and freed on release. Large buffers prefer SPIRAM, where available.
+ * All converters take their buffers from this pool, including the output buffers they return.
+ *
+ * @param size      Bytes needed
+ *
+ * @return the buffer, NULL on out of memory
+ */
+void *img_buf_acquire(size_t size);
+
+/**
+ * @brief Bytes a buffer from img_buf_acquire(size) can hold, at least size
+ *
+ * @param size      Bytes needed
+ *
+ * @return the capacity of the class of size
+ */
+size_t img_buf_capacity(size_t size);
+
+/**
+ * @brief Give a buffer back to the pool, or free it if the pool is full
+ *
+ * Output buffers of the converters may be released like this instead of being freed, so the next conversion
+ * can reuse them. Buffers of the pool may also be freed with free(), they are then just not reused.
+ *
+ * @param buf       Buffer from img_buf_acquire(), may be NULL
+ * @param size      The size it was acquired with, or any smaller size (e.g. the length of a returned JPEG)
+ */
+void img_buf_release(void *buf, size_t size);
+
+/**
+ * @brief Shrink a buffer of the pool that holds less than it was acquired for
+ *
+ * The buffer keeps the capacity of the class of new_size, so it can still be released with new_size or freed.
+ *
+ * @param buf       Buffer from img_buf_acquire()
+ * @param size      The size it was acquired with
+ * @param new_size  Bytes it needs to hold from now on, at most size
+ *
+ * @return the buffer, possibly moved, or buf unchanged if it could not be shrunk
+ */
+void *img_buf_shrink_to(void *buf, size_t size, size_t new_size);
+
+/**
+ * @brief Set the most bytes of free buffers the pool keeps, 0 to free every released buffer
+ *
+ * The default is CONFIG_CAMERA_CONVERTER_BUF_POOL_KB. Cached buffers over the new limit are freed.
+ *
+ * @param max_bytes Pool limit in bytes
+ */
+void img_buf_pool_set_limit(size_t max_bytes);
+
+/**
+ * @brief Free all buffers held by the pool
+ */
+void img_buf_pool_trim(void);
+
+/**
+ * @brief Get the statistics of the pool
+ *
+ * @param stats     Filled with the current statistics
+ */
+void img_buf_pool_get_stats(img_buf_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IMG_BUF_POOL_H_ */
@@ -23,13 +23,146 @@ extern "C" {
 #include <stdbool.h>
 #include "esp_camera.h"
 #include "esp_jpg_decode.h"
+#include "img_buf_pool.h"
 
 typedef size_t (* jpg_out_cb)(void * arg, size_t index, const void* data, size_t len);
 
 /**
- * @brief Convert image buffer to JPEG
+ * @brief JPEG chroma subsampling. GRAYSCALE sources are always encoded as luma only
+ */
+typedef enum {
+    JPG_SUBSAMPLING_420,    /*!< Chroma halved in both directions (default) */
+    JPG_SUBSAMPLING_422,    /*!< Chroma halved horizontally, the native layout of YUV422 sources */
+    JPG_SUBSAMPLING_444,    /*!< Full resolution chroma */
+} jpg_subsampling_t;
+
+/**
+ * @brief JPEG encoder configuration, used by the *_ex converters
+ */
+typedef struct {
+    uint8_t quality;                /*!< JPEG quality of the resulting image (1-100) */
+    uint8_t workers;                /*!< Number of tasks encoding in parallel, the calling task included. With more than one
+                                         worker the image is split into horizontal slices separated by restart markers */
+    jpg_subsampling_t subsampling;  /*!< Chroma subsampling of the resulting image */
+    size_t stride;                  /*!< Bytes from one source row to the next, 0 for rows of exactly width pixels */
+    jpg_rect_t crop;                /*!< Part of the source to encode, all zero for the whole frame.
+                                         x must be even for YUV422 sources */
+    bool optimize_huffman;          /*!< Build Huffman tables for each image instead of using the standard ones. The output is
+                                         a few percent smaller, at the cost of a second pass over the image */
+    size_t out_block_size;          /*!< Bytes handed to the output (e.g. the jpg_out_cb callback) at once (16 bytes - 1MB),
+                                         0 for the default of 4KB. Larger blocks mean fewer callbacks and a larger encoder buffer */
+    const jpg_rect_t *rois;         /*!< Regions of interest, in pixels of the encoded (cropped) image. The MCUs they touch
+                                         are coded at full quality and the rest of the image as set by roi_background */
+    uint8_t num_rois;               /*!< Number of entries in rois, 0 codes the whole image at full quality */
+    uint8_t roi_background;         /*!< Importance of the image outside the rois: 255 codes it at full quality, lower values
+                                         keep less detail, down to the average colour of each 8x8 block at 0 */
+    bool grayscale;                 /*!< Encode the luma only, whatever the source format. YUV422 sources are then coded straight
+                                         from their Y bytes, without colour conversion or copy. subsampling is ignored */
+} jpg_encode_config_t;
+
+#define JPG_ENCODE_CONFIG_DEFAULT() { \
+    .quality = 80, \
+    .workers = 1, \
+    .subsampling = JPG_SUBSAMPLING_420, \
+    .stride = 0, \
+    .crop = { 0, 0, 0, 0 }, \
+    .optimize_huffman = false, \
+    .out_block_size = 0, \
+    .rois = NULL, \
+    .num_rois = 0, \
+    .roi_background = 0, \
+    .grayscale = false, \
+}
+
+/**
+ * @brief Memory layout of a tensor made by jpg2tensor()
+ */
+typedef enum {
+    JPG_TENSOR_NCHW,    /*!< One plane per channel */
+    JPG_TENSOR_NHWC,    /*!< Channels interleaved per pixel */
+} jpg_tensor_layout_t;
+
+/**
+ * @brief Element type of a tensor made by jpg2tensor()
+ */
+typedef enum {
+    JPG_TENSOR_UINT8,   /*!< Pixel values as they are, mean and std unused */
+    JPG_TENSOR_FLOAT32, /*!< Normalized pixel values, (value / 255 - mean) / std */
+} jpg_tensor_type_t;
+
+/**
+ * @brief Tensor made by jpg2tensor(), the input of a detector
+ */
+typedef struct {
+    uint16_t width;                 /*!< Width of the tensor in pixels */
+    uint16_t height;                /*!< Height of the tensor in pixels */
+    jpg_tensor_layout_t layout;     /*!< Memory layout */
+    jpg_tensor_type_t type;         /*!< Element type */
+    bool bgr;                       /*!< Channels in B, G, R order instead of R, G, B */
+    uint8_t pad_value;              /*!< Pixel value of the letterbox padding, normalized like the image */
+    float mean[3];                  /*!< Subtracted from each channel of float tensors, in tensor channel order */
+    float std[3];                   /*!< Divides each channel of float tensors after the mean, 0 for 1 */
+} jpg_tensor_config_t;
+
+/* Input of the YOLO detectors: 640x640 RGB planes of 0-1, padded with gray */
+#define JPG_TENSOR_CONFIG_DEFAULT() { \
+    .width = 640, \
+    .height = 640, \
+    .layout = JPG_TENSOR_NCHW, \
+    .type = JPG_TENSOR_FLOAT32, \
+    .bgr = false, \
+    .pad_value = 114, \
+    .mean = { 0, 0, 0 }, \
+    .std = { 1, 1, 1 }, \
+}
+
+/**
+ * @brief Where jpg2tensor() placed the image. A point (x, y) of the tensor is at
+ *        ((x - left) / scale, (y - top) / scale) in the JPEG
+ */
+typedef struct {
+    float scale;                /*!< Tensor pixels per JPEG pixel */
+    uint16_t left;              /*!< Left edge of the image in the tensor */
+    uint16_t top;               /*!< Top edge of the image in the tensor */
+    uint16_t width;             /*!< Width of the image in the tensor */
+    uint16_t height;            /*!< Height of the image in the tensor */
+    jpg_scale_t decode_scale;   /*!< Scaling the decoder applied before the resize */
+} jpg_letterbox_t;
+
+/**
+ * @brief Rate control state of a JPEG stream, used by fmt2jpg_rc() and frame2jpg_rc()
  *
- * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * Keep one per stream and pass it with every frame: the quality of the next frame is predicted from the
+ * size and quality of the last one.
+ */
+typedef struct {
+    size_t max_bytes;       /*!< Size budget of one JPEG frame, at least JPG_RATE_CONTROL_MIN_BYTES */
+    uint8_t min_quality;    /*!< Lowest quality that may be chosen (1-100) */
+    uint8_t max_quality;    /*!< Highest quality that may be chosen (1-100) */
+    uint8_t max_encodes;    /*!< Encodes per frame at most, the first one included. A frame over budget is
+                                 encoded again at a lower quality until this limit is reached */
+    uint8_t quality;        /*!< Set by the encoder: quality of the last frame, 0 before the first one */
+    size_t bytes;           /*!< Set by the encoder: size of the last frame at that quality, even when over budget */
+    uint8_t encodes;        /*!< Set by the encoder: number of encodes the last frame took */
+} jpg_rate_control_t;
+
+/**
+ * @brief Smallest budget of jpg_rate_control_t, below it not even the headers of a frame fit
+ */
+#define JPG_RATE_CONTROL_MIN_BYTES 128
+
+#define JPG_RATE_CONTROL_DEFAULT(budget) { \
+    .max_bytes = (budget), \
+    .min_quality = 10, \
+    .max_quality = 90, \
+    .max_encodes = 3, \
+    .quality = 0, \
+    .bytes = 0, \
+    .encodes = 0, \
+}
+
+/**
+ * @brief Convert image buffer to JPEG
  * @param src_len   Length in bytes of the source buffer
  * @param width     Width in pixels of the source image
  * @param height    Height in pixels of the source image
@@ -64,7 +197,7 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg);
  * @param format    Format of the source image
  * @param quality   JPEG quality of the resulting image
  * @param out       Pointer to be populated with the address of the resulting buffer.
- *                  You MUST free the pointer once you are done with it.
+ *                  You MUST free the pointer once you are done with it, or img_buf_release(*out, *out_len) it for reuse.
  * @param out_len   Pointer to be populated with the length of the output buffer
  *
  * @return true on success
@@ -83,6 +216,241 @@ bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
  */
 bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len);
 
+/**
+ * @brief Convert image buffer to JPEG, using the given encoder configuration
+ *
+ * The source is read in place, config->stride bytes per row, and may be cropped with config->crop.
+ * The resulting buffer is allocated to the exact size of the JPEG.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the whole source frame
+ * @param height    Height in pixels of the whole source frame
+ * @param format    Format of the source image
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT()
+ * @param cb        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool fmt2jpg_cb_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Convert camera frame buffer to JPEG, using the given encoder configuration
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT()
+ * @param cb        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool frame2jpg_cb_ex(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Convert image buffer to JPEG buffer, using the given encoder configuration
+ *
+ * The source is read in place, config->stride bytes per row, and may be cropped with config->crop.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the whole source frame
+ * @param height    Height in pixels of the whole source frame
+ * @param format    Format of the source image
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it, or img_buf_release(*out, *out_len) it for reuse.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffer, using the given encoder configuration
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_ex(camera_fb_t * fb, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert image buffer to a JPEG buffer of at most rc->max_bytes, choosing the quality
+ *
+ * The first frame of a stream is encoded at config->quality, clamped to the rc range, and later ones at the
+ * quality predicted from the previous frame. The chosen quality is returned in rc->quality.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the whole source frame
+ * @param height    Height in pixels of the whole source frame
+ * @param format    Format of the source image
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT(). config->quality is only the starting point
+ * @param rc        Rate control state of the stream, see JPG_RATE_CONTROL_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it, or img_buf_release(*out, *out_len) it for reuse.
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success, false also if the frame does not fit the budget within rc->max_encodes encodes
+ */
+bool fmt2jpg_rc(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_rate_control_t *rc, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Convert camera frame buffer to a JPEG buffer of at most rc->max_bytes, choosing the quality
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT(). config->quality is only the starting point
+ * @param rc        Rate control state of the stream, see JPG_RATE_CONTROL_DEFAULT()
+ * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out_len   Pointer to be populated with the length of the output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_rc(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_rate_control_t *rc, uint8_t ** out, size_t * out_len);
+
+/**
+ * @brief Most renditions of one multi-rendition encode, see fmt2jpg_multi()
+ */
+#define JPG_MAX_RENDITIONS 4
+
+/**
+ * @brief One rendition of a multi-rendition encode, see fmt2jpg_multi_cb()
+ */
+typedef struct {
+    uint8_t quality;    /*!< JPEG quality of this rendition (1-100) */
+    jpg_out_cb cb;      /*!< Callback to be called to write the bytes of this rendition */
+    void * arg;         /*!< Pointer to be passed to the callback */
+} jpg_rendition_t;
+
+/**
+ * @brief Convert image buffer to JPEG at several qualities at once, e.g. a preview and a recording copy
+ *
+ * Colour conversion and the DCT of every block are done once for all renditions, each one only adds its
+ * quantization and entropy coding.
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the whole source frame
+ * @param height    Height in pixels of the whole source frame
+ * @param format    Format of the source image
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT(). config->quality is not used, workers must
+ *                  be 1 and optimize_huffman false. The rois apply to all renditions
+ * @param renditions     Quality and output callback of each rendition
+ * @param num_renditions Number of entries in renditions, 1 - JPG_MAX_RENDITIONS
+ *
+ * @return true on success
+ */
+bool fmt2jpg_multi_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const jpg_rendition_t *renditions, size_t num_renditions);
+
+/**
+ * @brief Convert camera frame buffer to JPEG at several qualities at once
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder configuration, see fmt2jpg_multi_cb()
+ * @param renditions     Quality and output callback of each rendition
+ * @param num_renditions Number of entries in renditions, 1 - JPG_MAX_RENDITIONS
+ *
+ * @return true on success
+ */
+bool frame2jpg_multi_cb(camera_fb_t * fb, const jpg_encode_config_t *config, const jpg_rendition_t *renditions, size_t num_renditions);
+
+/**
+ * @brief Convert image buffer to JPEG buffers at several qualities at once
+ *
+ * @param src       Source buffer in RGB565, RGB888, YUYV or GRAYSCALE format
+ * @param src_len   Length in bytes of the source buffer
+ * @param width     Width in pixels of the whole source frame
+ * @param height    Height in pixels of the whole source frame
+ * @param format    Format of the source image
+ * @param config    Encoder configuration, see fmt2jpg_multi_cb()
+ * @param qualities JPEG quality of each rendition (1-100)
+ * @param num_renditions Number of entries in qualities, outs and out_lens, 1 - JPG_MAX_RENDITIONS
+ * @param outs      Populated with the address of each resulting buffer.
+ *                  You MUST free the pointers once you are done with them, or img_buf_release(outs[i], out_lens[i]) them for reuse.
+ * @param out_lens  Populated with the length of each output buffer
+ *
+ * @return true on success
+ */
+bool fmt2jpg_multi(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const uint8_t *qualities, size_t num_renditions, uint8_t ** outs, size_t * out_lens);
+
+/**
+ * @brief Convert camera frame buffer to JPEG buffers at several qualities at once
+ *
+ * @param fb        Source camera frame buffer
+ * @param config    Encoder configuration, see fmt2jpg_multi_cb()
+ * @param qualities JPEG quality of each rendition (1-100)
+ * @param num_renditions Number of entries in qualities, outs and out_lens, 1 - JPG_MAX_RENDITIONS
+ * @param outs      Populated with the address of each resulting buffer
+ * @param out_lens  Populated with the length of each output buffer
+ *
+ * @return true on success
+ */
+bool frame2jpg_multi(camera_fb_t * fb, const jpg_encode_config_t *config, const uint8_t *qualities, size_t num_renditions, uint8_t ** outs, size_t * out_lens);
+
+/**
+ * @brief JPEG encoder fed with the rows of a frame as they are captured, see jpg_stream_encoder_create()
+ */
+typedef struct jpg_stream_encoder jpg_stream_encoder_t;
+
+/**
+ * @brief Create an encoder for frames that arrive in pieces, e.g. DMA buffers during capture
+ *
+ * Each MCU row is encoded as soon as its source rows have been written, so the JPEG is done right after the
+ * last piece of the frame and no more than one source row is ever buffered. The encoder is reused for every
+ * frame of the given size and format.
+ *
+ * @param width     Width in pixels of the frames
+ * @param height    Height in pixels of the frames
+ * @param format    Format of the frames: RGB565, RGB888, YUYV or GRAYSCALE
+ * @param config    Encoder configuration, see JPG_ENCODE_CONFIG_DEFAULT(). Only single pass encoding of whole
+ *                  frames is possible: workers must be 1, optimize_huffman false, stride and crop all zero
+ *
+ * @return the encoder, NULL if the configuration is not supported or on out of memory
+ */
+jpg_stream_encoder_t *jpg_stream_encoder_create(uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config);
+
+/**
+ * @brief Start encoding a frame. A frame that was not ended is dropped
+ *
+ * @param enc       Stream encoder
+ * @param cb        Callback to be called to write the bytes of the output JPEG
+ * @param arg       Pointer to be passed to the callback
+ *
+ * @return true on success
+ */
+bool jpg_stream_encoder_start(jpg_stream_encoder_t *enc, jpg_out_cb cb, void * arg);
+
+/**
+ * @brief Write the next bytes of the frame, in any amount. Whole rows are encoded in place
+ *
+ * @param enc       Stream encoder
+ * @param data      Next bytes of the source frame
+ * @param len       Number of bytes
+ *
+ * @return true on success, false if the frame is not started, has failed or would grow beyond width x height
+ */
+bool jpg_stream_encoder_write(jpg_stream_encoder_t *enc, const uint8_t *data, size_t len);
+
+/**
+ * @brief Finish the frame, writing the end of the JPEG to the callback
+ *
+ * @param enc       Stream encoder
+ *
+ * @return true if the whole frame was written and encoded, false for a short or failed frame
+ */
+bool jpg_stream_encoder_end(jpg_stream_encoder_t *enc);
+
+/**
+ * @brief Free the stream encoder
+ *
+ * @param enc       Stream encoder, may be NULL
+ */
+void jpg_stream_encoder_delete(jpg_stream_encoder_t *enc);
+
 /**
  * @brief Convert image buffer to BMP buffer
  *
@@ -91,7 +459,8 @@ bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_l
  * @param width     Width in pixels of the source image
  * @param height    Height in pixels of the source image
  * @param format    Format of the source image
- * @param out       Pointer to be populated with the address of the resulting buffer
+ * @param out       Pointer to be populated with the address of the resulting buffer.
+ *                  You MUST free the pointer once you are done with it, or img_buf_release(*out, *out_len) it for reuse.
  * @param out_len   Pointer to be populated with the length of the output buffer
  *
  * @return true on success
@@ -121,8 +490,131 @@ bool frame2bmp(camera_fb_t * fb, uint8_t ** out, size_t * out_len);
  */
 bool fmt2rgb888(const uint8_t *src_buf, size_t src_len, pixformat_t format, uint8_t * rgb_buf);
 
+/**
+ * @brief Decode a JPEG to RGB888, B, G, R bytes per pixel as PIXFORMAT_RGB888
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param out       Pointer to the output buffer ((width >> scale) * (height >> scale) * 3), allocated by the caller
+ * @param scale     Output scaling
+ *
+ * @return true on success, false if out is NULL or the JPEG could not be decoded
+ */
+bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
+
+/**
+ * @brief Decode a JPEG to RGB565, as jpg2rgb888() does to RGB888
+ *
+ * @param out       Pointer to the output buffer ((width >> scale) * (height >> scale) * 2), allocated by the caller
+ *
+ * @return true on success, false if out is NULL or the JPEG could not be decoded
+ */
 bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
 
+/**
+ * @brief Decode the luma of a JPEG, one full range byte per pixel as PIXFORMAT_GRAYSCALE.
+ *        Faster than the RGB decodes, the chroma is neither transformed nor converted
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param out       Pointer to the output buffer ((width >> scale) * (height >> scale))
+ * @param scale     Output scaling
+ *
+ * @return true on success
+ */
+bool jpg2gray(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
+
+/**
+ * @brief Decode a JPEG to YUYV, limited range BT.601 as PIXFORMAT_YUV422 from the sensor
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param out       Pointer to the output buffer ((width >> scale) * (height >> scale) * 2)
+ * @param scale     Output scaling
+ *
+ * @return true on success
+ */
+bool jpg2yuv422(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
+
+/**
+ * @brief Decode a JPEG to planar I420, limited range BT.601: the Y plane, then the U and V planes of
+ *        ((width + 1) / 2) * ((height + 1) / 2) each, width and height after scaling
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param out       Pointer to the output buffer
+ * @param scale     Output scaling
+ *
+ * @return true on success
+ */
+bool jpg2yuv420(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale);
+
+/**
+ * @brief Decode a JPEG to the given pixel format
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param format    PIXFORMAT_RGB888, PIXFORMAT_RGB565, PIXFORMAT_GRAYSCALE, PIXFORMAT_YUV422 (YUYV) or
+ *                  PIXFORMAT_YUV420 (planar I420), see the jpg2 functions above
+ * @param scale     Output scaling
+ * @param out       Pointer to the output buffer, sized for the format
+ *
+ * @return true on success, false for other formats
+ */
+bool jpg2fmt(const uint8_t *src, size_t src_len, pixformat_t format, jpg_scale_t scale, uint8_t * out);
+
+/**
+ * @brief A JPEG of a batch decoded by jpg2fmt_batch()
+ */
+typedef struct {
+    const uint8_t *src;     /*!< Source JPEG buffer */
+    size_t src_len;         /*!< Length in bytes of the source buffer */
+    uint8_t *out;           /*!< Output buffer, sized for the format and the scaled size of this JPEG, see
+                                 esp_jpg_get_size() */
+    uint16_t width;         /*!< Set to the width of the output, 0 if the JPEG could not be decoded */
+    uint16_t height;        /*!< Set to the height of the output, 0 if the JPEG could not be decoded */
+    bool ok;                /*!< Set when the JPEG was decoded */
+    uint32_t decode_us;     /*!< Set to the time its decode took, in microseconds */
+} jpg_batch_frame_t;
+
+/**
+ * @brief Decode a batch of JPEGs of any sizes on several tasks, as jpg2fmt() does one
+ *
+ * The JPEGs are handed out one at a time to whichever task is free, the largest first so that a long decode does
+ * not start last. A JPEG that fails does not stop the others.
+ *
+ * The tasks are started by the first batch that needs them and then wait for the next one, each keeping its decoder
+ * workspace: a task costs its stack and ESP_JPG_DECODE_FAST_WORK_SIZE bytes for as long as the program runs. One
+ * batch is decoded at a time, a batch called from another task waits for the current one to finish.
+ *
+ * @param frames        JPEGs and their output buffers, the results are set in each
+ * @param num_frames    Number of JPEGs
+ * @param format        Output format, as jpg2fmt()
+ * @param scale         Output scaling
+ * @param workers       Number of tasks decoding, the calling task included
+ *
+ * @return true if all JPEGs were decoded
+ */
+bool jpg2fmt_batch(jpg_batch_frame_t *frames, size_t num_frames, pixformat_t format, jpg_scale_t scale, uint8_t workers);
+
+/**
+ * @brief Decode a JPEG straight into a detector input tensor
+ *
+ * The image is fit into the tensor keeping its aspect ratio and centred, the rest is padded. The decoder scales it
+ * down by 2, 4 or 8 as far as it stays at least as large as in the tensor, the remaining resize is bilinear with
+ * pixel centres aligned as cv2.resize() does. Each tensor element is written once and no RGB image is made in
+ * between, only the rows of one MCU row are buffered.
+ *
+ * @param src       Source JPEG buffer
+ * @param src_len   Length in bytes of the source buffer
+ * @param config    Tensor size, layout, type and normalization
+ * @param out       Pointer to the tensor (width * height * 3 elements of the type)
+ * @param letterbox Set to where the image was placed, may be NULL
+ *
+ * @return true on success
+ */
+bool jpg2tensor(const uint8_t *src, size_t src_len, const jpg_tensor_config_t *config, void *out, jpg_letterbox_t *letterbox);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,6 +9,7 @@
 //                       Code review revealed method load_block_16_8_8() (used for the non-default H2V1 sampling mode to downsample chroma) somehow didn't get the rounding factor fix from v1.02.
 
 #include "jpge.h"
+#include "jpge_dsp.h"
 
 #include <stdint.h>
 #include <stdarg.h>
@@ -17,7 +18,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <malloc.h>
+#include <pthread.h>
+#ifdef JPGE_PROFILE
+#include <time.h>
+#endif
 #include "esp_heap_caps.h"
+#include "img_buf_pool.h"
 
 #define JPGE_MAX(a,b) (((a)>(b))?(a):(b))
 #define JPGE_MIN(a,b) (((a)<(b))?(a):(b))
@@ -38,11 +44,59 @@ namespace jpge {
     }
     static inline void jpge_free(void *p) { free(p); }
 
+    // Stage timing: JPGE_PROFILE_MARK() starts timing, JPGE_PROFILE_LAP() adds the time since the last mark or lap
+    // to a stage. Both compile to nothing without JPGE_PROFILE. The mark is per thread, so encoders on other tasks
+    // (slices of one frame, or other frames) keep their own laps and add them to the totals atomically; renditions
+    // lap on the mark of their primary encoder, which runs them.
+#ifdef JPGE_PROFILE
+    static bool s_profiling;
+    static profile_stats s_profile;
+    static thread_local uint64 s_profile_mark;
+
+    static inline uint64 profile_now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+#define JPGE_PROFILE_MARK() do { if (__atomic_load_n(&s_profiling, __ATOMIC_RELAXED)) s_profile_mark = profile_now(); } while (0)
+#define JPGE_PROFILE_LAP(stage) do { if (__atomic_load_n(&s_profiling, __ATOMIC_RELAXED)) { uint64 t = profile_now(); __atomic_fetch_add(&s_profile.ns[stage], t - s_profile_mark, __ATOMIC_RELAXED); s_profile_mark = t; } } while (0)
+
+    bool set_profiling(bool enable)
+    {
+        if (enable)
+            for (int i = 0; i < PROFILE_STAGES; i++)
+                __atomic_store_n(&s_profile.ns[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s_profiling, enable, __ATOMIC_RELAXED);
+        return true;
+    }
+
+    void get_profile(profile_stats *stats)
+    {
+        for (int i = 0; i < PROFILE_STAGES; i++)
+            stats->ns[i] = __atomic_load_n(&s_profile.ns[i], __ATOMIC_RELAXED);
+    }
+#else
+#define JPGE_PROFILE_MARK() do { } while (0)
+#define JPGE_PROFILE_LAP(stage) do { } while (0)
+
+    bool set_profiling(bool enable)
+    {
+        (void)enable;
+        return false;
+    }
+
+    void get_profile(profile_stats *stats)
+    {
+        memset(stats, 0, sizeof(*stats));
+    }
+#endif
+
     // Various JPEG enums and tables.
-    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_APP0 = 0xE0 };
+    enum { M_SOF0 = 0xC0, M_DHT = 0xC4, M_RST0 = 0xD0, M_SOI = 0xD8, M_EOI = 0xD9, M_SOS = 0xDA, M_DQT = 0xDB, M_DRI = 0xDD, M_APP0 = 0xE0 };
     enum { DC_LUM_CODES = 12, AC_LUM_CODES = 256, DC_CHROMA_CODES = 12, AC_CHROMA_CODES = 256, MAX_HUFF_SYMBOLS = 257, MAX_HUFF_CODESIZE = 32 };
 
-    static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
     static const int16 s_std_lum_quant[64] = { 16,11,12,14,12,10,16,14,13,14,18,17,16,19,24,40,26,24,22,22,24,49,35,37,29,40,58,51,61,60,57,51,56,55,64,72,92,78,64,68,87,69,55,56,80,109,81,87,95,98,103,104,103,62,77,113,121,112,100,120,92,101,103,99 };
     static const int16 s_std_croma_quant[64] = { 17,18,18,24,21,24,47,26,26,47,99,66,56,66,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
     static const uint8 s_dc_lum_bits[17] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
@@ -68,16 +122,39 @@ namespace jpge {
         0xf9,0xfa
     };
 
-    const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
+    // YUYV camera data is limited range BT.601 (Y 16..235, Cb/Cr 16..240), JFIF expects full range YCbCr.
+    static const uint8 s_yuv_y_full[256] = {
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,2,3,5,6,7,8,9,10,12,13,14,15,16,17,
+        19,20,21,22,23,24,26,27,28,29,30,31,33,34,35,36,37,38,40,41,42,43,44,45,47,48,49,50,51,52,54,55,
+        56,57,58,59,61,62,63,64,65,66,68,69,70,71,72,73,75,76,77,78,79,80,82,83,84,85,86,87,88,90,91,92,
+        93,94,95,97,98,99,100,101,102,104,105,106,107,108,109,111,112,113,114,115,116,118,119,120,121,122,123,125,126,127,128,129,
+        130,132,133,134,135,136,137,139,140,141,142,143,144,146,147,148,149,150,151,153,154,155,156,157,158,160,161,162,163,164,165,167,
+        168,169,170,171,172,173,175,176,177,178,179,180,182,183,184,185,186,187,189,190,191,192,193,194,196,197,198,199,200,201,203,204,
+        205,206,207,208,210,211,212,213,214,215,217,218,219,220,221,222,224,225,226,227,228,229,231,232,233,234,235,236,238,239,240,241,
+        242,243,245,246,247,248,249,250,252,253,254,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255
+    };
+    static const uint8 s_yuv_c_full[256] = {
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,2,3,4,5,6,7,8,10,11,12,13,14,15,16,18,
+        19,20,21,22,23,24,26,27,28,29,30,31,32,34,35,36,37,38,39,40,41,43,44,45,46,47,48,49,51,52,53,54,
+        55,56,57,59,60,61,62,63,64,65,67,68,69,70,71,72,73,74,76,77,78,79,80,81,82,84,85,86,87,88,89,90,
+        92,93,94,95,96,97,98,100,101,102,103,104,105,106,108,109,110,111,112,113,114,115,117,118,119,120,121,122,123,125,126,127,
+        128,129,130,131,133,134,135,136,137,138,139,141,142,143,144,145,146,147,148,150,151,152,153,154,155,156,158,159,160,161,162,163,
+        164,166,167,168,169,170,171,172,174,175,176,177,178,179,180,182,183,184,185,186,187,188,189,191,192,193,194,195,196,197,199,200,
+        201,202,203,204,205,207,208,209,210,211,212,213,215,216,217,218,219,220,221,222,224,225,226,227,228,229,230,232,233,234,235,236,
+        237,238,240,241,242,243,244,245,246,248,249,250,251,252,253,254,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255,255
+    };
 
-    static int32 m_last_quality = 0;
-    static int32 m_quantization_tables[2][64];
+    const int YR = 19595, YG = 38470, YB = 7471, CB_R = -11059, CB_G = -21709, CB_B = 32768, CR_R = 32768, CR_G = -27439, CR_B = -5329;
 
-    static bool m_huff_initialized = false;
-    static uint m_huff_codes[4][256];
-    static uint8 m_huff_code_sizes[4][256];
-    static uint8 m_huff_bits[4][17];
-    static uint8 m_huff_val[4][256];
+    // Bytes per pixel of a source format, 0 if the format is not supported.
+    static inline int source_bpp(int src_format) {
+        switch (src_format) {
+            case SRC_Y: return 1;
+            case SRC_YUYV: case SRC_RGB565: return 2;
+            case SRC_RGB: case SRC_BGR: return 3;
+            default: return 0;
+        }
+    }
 
     static inline uint8 clamp(int i) {
         if (i < 0) {
@@ -88,18 +165,69 @@ namespace jpge {
         return static_cast<uint8>(i);
     }
 
+    static inline void rgb_to_ycc(uint8 *pDst, const int r, const int g, const int b) {
+        pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+        pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
+        pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+    }
+
+    static inline uint8 rgb_to_y(const int r, const int g, const int b) {
+        return static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
+    }
+
     static void RGB_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
         for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
-            const int r = pSrc[0], g = pSrc[1], b = pSrc[2];
-            pDst[0] = static_cast<uint8>((r * YR + g * YG + b * YB + 32768) >> 16);
-            pDst[1] = clamp(128 + ((r * CB_R + g * CB_G + b * CB_B + 32768) >> 16));
-            pDst[2] = clamp(128 + ((r * CR_R + g * CR_G + b * CR_B + 32768) >> 16));
+            rgb_to_ycc(pDst, pSrc[0], pSrc[1], pSrc[2]);
         }
     }
 
     static void RGB_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
         for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
-            pDst[0] = static_cast<uint8>((pSrc[0] * YR + pSrc[1] * YG + pSrc[2] * YB + 32768) >> 16);
+            pDst[0] = rgb_to_y(pSrc[0], pSrc[1], pSrc[2]);
+        }
+    }
+
+    static void BGR_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 3, num_pixels--) {
+            rgb_to_ycc(pDst, pSrc[2], pSrc[1], pSrc[0]);
+        }
+    }
+
+    static void BGR_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 3, num_pixels--) {
+            pDst[0] = rgb_to_y(pSrc[2], pSrc[1], pSrc[0]);
+        }
+    }
+
+    // RGB565 as the camera sends it: big endian, RRRRRGGG GGGBBBBB.
+    static void RGB565_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst += 3, pSrc += 2, num_pixels--) {
+            rgb_to_ycc(pDst, pSrc[0] & 0xF8, ((pSrc[0] & 0x07) << 5) | ((pSrc[1] & 0xE0) >> 3), (pSrc[1] & 0x1F) << 3);
+        }
+    }
+
+    static void RGB565_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = rgb_to_y(pSrc[0] & 0xF8, ((pSrc[0] & 0x07) << 5) | ((pSrc[1] & 0xE0) >> 3), (pSrc[1] & 0x1F) << 3);
+        }
+    }
+
+    // YUYV: Y0 U Y1 V, one chroma pair for every two pixels.
+    static void YUYV_to_YCC(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels >= 2; pDst += 6, pSrc += 4, num_pixels -= 2) {
+            const uint8 cb = s_yuv_c_full[pSrc[1]], cr = s_yuv_c_full[pSrc[3]];
+            pDst[0] = s_yuv_y_full[pSrc[0]]; pDst[1] = cb; pDst[2] = cr;
+            pDst[3] = s_yuv_y_full[pSrc[2]]; pDst[4] = cb; pDst[5] = cr;
+        }
+        if (num_pixels) {
+            // odd width, the last pixel has no V sample
+            pDst[0] = s_yuv_y_full[pSrc[0]]; pDst[1] = s_yuv_c_full[pSrc[1]]; pDst[2] = 128;
+        }
+    }
+
+    static void YUYV_to_Y(uint8* pDst, const uint8 *pSrc, int num_pixels) {
+        for ( ; num_pixels; pDst++, pSrc += 2, num_pixels--) {
+            pDst[0] = s_yuv_y_full[pSrc[0]];
         }
     }
 
@@ -111,85 +239,258 @@ namespace jpge {
         }
     }
 
-    // Forward DCT - DCT derived from jfdctint.
-    enum { CONST_BITS = 13, ROW_BITS = 2 };
-#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
-#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
-#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
-    int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
-    int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
-    int32 u1 = DCT_MUL(t12 + t13, 4433); \
-    s2 = u1 + DCT_MUL(t13, 6270); \
-    s6 = u1 + DCT_MUL(t12, -15137); \
-    u1 = t4 + t7; \
-    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
-    int32 z5 = DCT_MUL(u3 + u4, 9633); \
-    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
-    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
-    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
-    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
-    u3 += z5; u4 += z5; \
-    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
-
-    static void DCT2D(int32 *p) {
-        int32 c, *q = p;
-        for (c = 7; c >= 0; c--, q += 8) {
-            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
-            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
-        }
-        for (q = p, c = 7; c >= 0; c--, q++) {
-            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
-            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
-            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
-            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+    // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
+    static void compute_huffman_table(uint *codes, uint8 *code_sizes, const uint8 *bits, const uint8 *val)
+    {
+        uint code = 0;
+        int p = 0;
+
+        memset(codes, 0, sizeof(codes[0])*256);
+        memset(code_sizes, 0, sizeof(code_sizes[0])*256);
+        for (int l = 1; l <= 16; l++) {
+            for (int i = 1; i <= bits[l]; i++, p++) {
+                codes[val[p]]      = code++;
+                code_sizes[val[p]] = static_cast<uint8>(l);
+            }
+            code <<= 1;
         }
     }
 
-    // Compute the actual canonical Huffman codes/code sizes given the JPEG huff bits and val arrays.
-    static void compute_huffman_table(uint *codes, uint8 *code_sizes, uint8 *bits, uint8 *val)
+    // The standard tables never change: they are built once and shared read-only by all encoders.
+    static const huffman_tables *std_huffman_tables()
     {
-        int i, l, last_p, si;
-        static uint8 huff_size[257];
-        static uint huff_code[257];
-        uint code;
+        static huffman_tables s_tables;
+        static const bool s_ready = [] {
+            s_tables.bits[0+0] = s_dc_lum_bits;    s_tables.val[0+0] = s_dc_lum_val;
+            s_tables.bits[2+0] = s_ac_lum_bits;    s_tables.val[2+0] = s_ac_lum_val;
+            s_tables.bits[0+1] = s_dc_chroma_bits; s_tables.val[0+1] = s_dc_chroma_val;
+            s_tables.bits[2+1] = s_ac_chroma_bits; s_tables.val[2+1] = s_ac_chroma_val;
+            for (int i = 0; i < 4; i++) {
+                compute_huffman_table(s_tables.codes[i], s_tables.code_sizes[i], s_tables.bits[i], s_tables.val[i]);
+            }
+            return true;
+        }();
+        (void)s_ready;
+        return &s_tables;
+    }
 
-        int p = 0;
-        for (l = 1; l <= 16; l++) {
-            for (i = 1; i <= bits[l]; i++) {
-                huff_size[p++] = (char)l;
+    // Radix sorts sym_freq[] array by 32-bit key m_key. Returns ptr to sorted values.
+    struct sym_freq { uint m_key, m_sym_index; };
+    static inline sym_freq* radix_sort_syms(uint num_syms, sym_freq* pSyms0, sym_freq* pSyms1)
+    {
+        sym_freq* pCur_syms = pSyms0, *pNew_syms = pSyms1;
+        for (uint pass_shift = 0; pass_shift < 32; pass_shift += 8) {
+            uint offsets[256], cur_ofs = 0;
+            memset(offsets, 0, sizeof(offsets));
+            for (uint i = 0; i < num_syms; i++) {
+                offsets[(pCur_syms[i].m_key >> pass_shift) & 0xFF]++;
+            }
+            if (offsets[(pCur_syms[0].m_key >> pass_shift) & 0xFF] == num_syms) {
+                continue; // all keys share this byte, the order is unchanged
             }
+            for (uint i = 0; i < 256; i++) {
+                uint n = offsets[i]; offsets[i] = cur_ofs; cur_ofs += n;
+            }
+            for (uint i = 0; i < num_syms; i++) {
+                pNew_syms[offsets[(pCur_syms[i].m_key >> pass_shift) & 0xFF]++] = pCur_syms[i];
+            }
+            sym_freq* t = pCur_syms; pCur_syms = pNew_syms; pNew_syms = t;
+        }
+        return pCur_syms;
+    }
+
+    // calculate_minimum_redundancy() originally written by: Alistair Moffat, alistair@cs.mu.oz.au, Jyrki Katajainen, jyrki@diku.dk, November 1996.
+    static void calculate_minimum_redundancy(sym_freq *A, int n)
+    {
+        int root, leaf, next, avbl, used, dpth;
+        if (n==0) return; else if (n==1) { A[0].m_key = 1; return; }
+        A[0].m_key += A[1].m_key; root = 0; leaf = 2;
+        for (next=1; next < n-1; next++)
+        {
+            if (leaf>=n || A[root].m_key<A[leaf].m_key) { A[next].m_key = A[root].m_key; A[root++].m_key = next; } else A[next].m_key = A[leaf++].m_key;
+            if (leaf>=n || (root<next && A[root].m_key<A[leaf].m_key)) { A[next].m_key += A[root].m_key; A[root++].m_key = next; } else A[next].m_key += A[leaf++].m_key;
         }
+        A[n-2].m_key = 0;
+        for (next=n-3; next>=0; next--) A[next].m_key = A[A[next].m_key].m_key+1;
+        avbl = 1; used = dpth = 0; root = n-2; next = n-1;
+        while (avbl>0)
+        {
+            while (root>=0 && (int)A[root].m_key==dpth) { used++; root--; }
+            while (avbl>used) { A[next--].m_key = dpth; avbl--; }
+            avbl = 2*used; dpth++; used = 0;
+        }
+    }
 
-        huff_size[p] = 0;
-        last_p = p; // write sentinel
+    // Limits canonical Huffman code table's max code size to max_code_size.
+    static void huffman_enforce_max_code_size(int *pNum_codes, int code_list_len, int max_code_size)
+    {
+        if (code_list_len <= 1) return;
+
+        for (int i = max_code_size + 1; i <= MAX_HUFF_CODESIZE; i++) pNum_codes[max_code_size] += pNum_codes[i];
 
-        code = 0; si = huff_size[0]; p = 0;
+        uint32 total = 0;
+        for (int i = max_code_size; i > 0; i--)
+            total += (((uint32)pNum_codes[i]) << (max_code_size - i));
 
-        while (huff_size[p]) {
-            while (huff_size[p] == si) {
-                huff_code[p++] = code++;
+        while (total != (1UL << max_code_size))
+        {
+            pNum_codes[max_code_size]--;
+            for (int i = max_code_size - 1; i > 0; i--)
+            {
+                if (pNum_codes[i]) { pNum_codes[i]--; pNum_codes[i + 1] += 2; break; }
             }
-            code <<= 1;
-            si++;
+            total--;
         }
+    }
 
-        memset(codes, 0, sizeof(codes[0])*256);
-        memset(code_sizes, 0, sizeof(code_sizes[0])*256);
-        for (p = 0; p < last_p; p++) {
-            codes[val[p]]      = huff_code[p];
-            code_sizes[val[p]] = huff_size[p];
+    // Symbol counts and the tables built from them. Kept on the heap, only allocated when optimized tables are used.
+    struct jpeg_encoder::optimized_huffman {
+        huffman_counts counts;
+        huffman_tables tables;
+        uint8 bits[4][17];
+        uint8 val[4][256];
+        sym_freq syms[2][MAX_HUFF_SYMBOLS];
+    };
+
+    // Cached headers, SOI up to SOS, with the quantization tables they hold. A block is immutable once cached and
+    // reference counted, so an encoder can write it out without holding the lock while the cache evicts it.
+    // Headers with optimized Huffman tables depend on the image and are never cached.
+    enum { JPGE_HEADER_CACHE_SIZE = 4, JPGE_MAX_HEADER_SIZE = 640 };
+
+    struct header_key {
+        int width, height, quality, subsampling, restart_interval;
+    };
+
+    struct header_block {
+        header_key key;
+        uint refs;
+        uint32 last_use;
+        int32 quant[2][64];
+        uint len;
+        uint8 bytes[JPGE_MAX_HEADER_SIZE];
+    };
+
+    static pthread_mutex_t s_header_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+    static header_block *s_header_cache[JPGE_HEADER_CACHE_SIZE];
+    static uint32 s_header_cache_clock;
+
+    static inline header_key make_header_key(int width, int height, const params &comp_params)
+    {
+        header_key key = { width, height, comp_params.m_quality, comp_params.m_subsampling, comp_params.m_restart_interval };
+        return key;
+    }
+
+    static inline bool same_header_key(const header_key &a, const header_key &b)
+    {
+        return (a.width == b.width) && (a.height == b.height) && (a.quality == b.quality) && (a.subsampling == b.subsampling) && (a.restart_interval == b.restart_interval);
+    }
+
+    // Drops a reference, the cache lock must be held.
+    static inline void unref_header(header_block *pBlock)
+    {
+        if (--pBlock->refs == 0) {
+            jpge_free(pBlock);
+        }
+    }
+
+    // Returns a reference to the cached header for key, NULL if there is none.
+    static header_block *acquire_cached_header(const header_key &key)
+    {
+        header_block *pBlock = NULL;
+        pthread_mutex_lock(&s_header_cache_lock);
+        for (int i = 0; i < JPGE_HEADER_CACHE_SIZE; i++) {
+            if (s_header_cache[i] && same_header_key(s_header_cache[i]->key, key)) {
+                pBlock = s_header_cache[i];
+                pBlock->refs++;
+                pBlock->last_use = ++s_header_cache_clock;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&s_header_cache_lock);
+        return pBlock;
+    }
+
+    static void release_header(header_block *pBlock)
+    {
+        pthread_mutex_lock(&s_header_cache_lock);
+        unref_header(pBlock);
+        pthread_mutex_unlock(&s_header_cache_lock);
+    }
+
+    // Caches pBlock, only referenced by the caller, in place of the least recently used header. Returns the block
+    // to use instead of pBlock: the same one, or the one another encoder cached for the same key in the meantime.
+    static header_block *insert_header(header_block *pBlock)
+    {
+        header_block *pCached = NULL;
+        int slot = -1;
+        pthread_mutex_lock(&s_header_cache_lock);
+        for (int i = 0; i < JPGE_HEADER_CACHE_SIZE; i++) {
+            header_block *pEntry = s_header_cache[i];
+            if (pEntry && same_header_key(pEntry->key, pBlock->key)) {
+                pCached = pEntry;
+                break;
+            }
+            if ((slot < 0) || (s_header_cache[slot] && (!pEntry || (pEntry->last_use < s_header_cache[slot]->last_use)))) {
+                slot = i;
+            }
+        }
+        if (pCached) {
+            pCached->refs++;
+            pCached->last_use = ++s_header_cache_clock;
+            unref_header(pBlock);
+            pBlock = pCached;
+        } else {
+            if (s_header_cache[slot]) {
+                unref_header(s_header_cache[slot]);
+            }
+            pBlock->refs++;
+            pBlock->last_use = ++s_header_cache_clock;
+            s_header_cache[slot] = pBlock;
+        }
+        pthread_mutex_unlock(&s_header_cache_lock);
+        return pBlock;
+    }
+
+    void clear_header_cache()
+    {
+        pthread_mutex_lock(&s_header_cache_lock);
+        for (int i = 0; i < JPGE_HEADER_CACHE_SIZE; i++) {
+            if (s_header_cache[i]) {
+                unref_header(s_header_cache[i]);
+                s_header_cache[i] = NULL;
+            }
         }
+        pthread_mutex_unlock(&s_header_cache_lock);
     }
 
+    // Collects the bytes of a header being serialized for the cache.
+    class header_stream : public output_stream {
+        public:
+            header_stream(uint8 *pBuf, uint capacity) : m_pBuf(pBuf), m_size(0), m_capacity(capacity) { }
+            virtual bool put_buf(const void* Pbuf, int len) {
+                if (!Pbuf) {
+                    return true;
+                }
+                if (m_size + len > m_capacity) {
+                    return false;
+                }
+                memcpy(m_pBuf + m_size, Pbuf, len);
+                m_size += len;
+                return true;
+            }
+            virtual uint get_size() const { return m_size; }
+        private:
+            uint8 *m_pBuf;
+            uint m_size, m_capacity;
+    };
+
     void jpeg_encoder::flush_output_buffer()
     {
-        if (m_out_buf_left != JPGE_OUT_BUF_SIZE) {
-            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_out_buf, JPGE_OUT_BUF_SIZE - m_out_buf_left);
+        if (m_out_buf_left != (uint)m_params.m_out_buf_size) {
+            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_out_buf, m_params.m_out_buf_size - m_out_buf_left);
         }
         m_pOut_buf = m_out_buf;
-        m_out_buf_left = JPGE_OUT_BUF_SIZE;
+        m_out_buf_left = m_params.m_out_buf_size;
     }
 
     void jpeg_encoder::emit_byte(uint8 i)
@@ -200,19 +501,46 @@ namespace jpge {
         }
     }
 
+    // Writes one byte of entropy coded data, a 0xFF is followed by a stuffed zero byte.
+    inline void jpeg_encoder::emit_coded_byte(uint8 c)
+    {
+        emit_byte(c);
+        if (c == 0xFF) {
+            emit_byte(0);
+        }
+    }
+
+    // Bits are collected in the low end of a 64-bit accumulator and written out 32 at a time.
     void jpeg_encoder::put_bits(uint bits, uint len)
     {
-        uint8 c = 0;
-        m_bit_buffer |= ((uint32)bits << (24 - (m_bits_in += len)));
+        m_bit_buffer = (m_bit_buffer << len) | bits;
+        if ((m_bits_in += len) < 32) {
+            return;
+        }
+        m_bits_in -= 32;
+        const uint32 c = static_cast<uint32>(m_bit_buffer >> m_bits_in);
+        // No byte of c is 0xFF (no byte of ~c is zero), so nothing needs stuffing and the word is stored as is.
+        if (((((~c) - 0x01010101U) & c & 0x80808080U) == 0) && (m_out_buf_left > 4)) {
+            m_pOut_buf[0] = static_cast<uint8>(c >> 24); m_pOut_buf[1] = static_cast<uint8>(c >> 16);
+            m_pOut_buf[2] = static_cast<uint8>(c >> 8);  m_pOut_buf[3] = static_cast<uint8>(c);
+            m_pOut_buf += 4;
+            m_out_buf_left -= 4;
+        } else {
+            emit_coded_byte(static_cast<uint8>(c >> 24)); emit_coded_byte(static_cast<uint8>(c >> 16));
+            emit_coded_byte(static_cast<uint8>(c >> 8));  emit_coded_byte(static_cast<uint8>(c));
+        }
+    }
+
+    // Pads the entropy coded data to a byte boundary with 1 bits and writes out the pending whole bytes.
+    void jpeg_encoder::flush_bits()
+    {
+        put_bits(0x7F, 7);
         while (m_bits_in >= 8) {
-            c = (uint8)((m_bit_buffer >> 16) & 0xFF);
-            emit_byte(c);
-            if (c == 0xFF) {
-                emit_byte(0);
-            }
-            m_bit_buffer <<= 8;
             m_bits_in -= 8;
+            emit_coded_byte(static_cast<uint8>(m_bit_buffer >> m_bits_in));
         }
+        m_bit_buffer = 0;
+        m_bits_in = 0;
     }
 
     void jpeg_encoder::emit_word(uint i)
@@ -273,7 +601,7 @@ namespace jpge {
     }
 
     // Emit Huffman table.
-    void jpeg_encoder::emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag)
+    void jpeg_encoder::emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag)
     {
         emit_marker(M_DHT);
 
@@ -294,11 +622,11 @@ namespace jpge {
     // Emit all Huffman tables.
     void jpeg_encoder::emit_dhts()
     {
-        emit_dht(m_huff_bits[0+0], m_huff_val[0+0], 0, false);
-        emit_dht(m_huff_bits[2+0], m_huff_val[2+0], 0, true);
+        emit_dht(m_huff->bits[0+0], m_huff->val[0+0], 0, false);
+        emit_dht(m_huff->bits[2+0], m_huff->val[2+0], 0, true);
         if (m_num_components == 3) {
-            emit_dht(m_huff_bits[0+1], m_huff_val[0+1], 1, false);
-            emit_dht(m_huff_bits[2+1], m_huff_val[2+1], 1, true);
+            emit_dht(m_huff->bits[0+1], m_huff->val[0+1], 1, false);
+            emit_dht(m_huff->bits[2+1], m_huff->val[2+1], 1, true);
         }
     }
 
@@ -321,6 +649,101 @@ namespace jpge {
         emit_byte(0);
     }
 
+    // Emit all markers at beginning of image file.
+    void jpeg_encoder::emit_markers()
+    {
+        emit_marker(M_SOI);
+        emit_jfif_app0();
+        emit_dqt();
+        emit_sof();
+        emit_dhts();
+        if (m_params.m_restart_interval) {
+            emit_dri();
+        }
+        emit_sos();
+    }
+
+    // Serializes the header into a new block and caches it. Returns a reference to the block, NULL on out of memory.
+    header_block *jpeg_encoder::cache_header()
+    {
+        header_block *pBlock = static_cast<header_block*>(jpge_malloc(sizeof(header_block)));
+        if (!pBlock) {
+            return NULL;
+        }
+        pBlock->key = make_header_key(m_image_x, m_image_y, m_params);
+        pBlock->refs = 1;
+        memcpy(pBlock->quant, m_quantization_tables, sizeof(pBlock->quant));
+
+        header_stream stream(pBlock->bytes, JPGE_MAX_HEADER_SIZE);
+        output_stream *pStream = m_pStream;
+        bool all_stream_writes_succeeded = m_all_stream_writes_succeeded;
+        m_pStream = &stream;
+        m_all_stream_writes_succeeded = true;
+        emit_markers();
+        flush_output_buffer();
+        bool serialized = m_all_stream_writes_succeeded;
+        m_pStream = pStream;
+        m_all_stream_writes_succeeded = all_stream_writes_succeeded;
+        if (!serialized) {
+            jpge_free(pBlock);
+            return NULL;
+        }
+        pBlock->len = stream.get_size();
+        return insert_header(pBlock);
+    }
+
+    // Emits the markers at the beginning of the file, copied from the header cache when possible.
+    void jpeg_encoder::emit_header()
+    {
+        if (!m_pHeader && !m_pOpt_huff) {
+            m_pHeader = cache_header();
+        }
+        if (!m_pHeader) {
+            emit_markers();
+            return;
+        }
+        m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(m_pHeader->bytes, m_pHeader->len);
+        release_header(m_pHeader);
+        m_pHeader = NULL;
+    }
+
+    // Emit restart interval
+    void jpeg_encoder::emit_dri()
+    {
+        emit_marker(M_DRI);
+        emit_word(4);
+        emit_word(m_params.m_restart_interval);
+    }
+
+    // Called before each MCU. At the start of a new restart interval, pad the bit stream to a byte
+    // boundary with 1 bits, emit RSTn and reset the DC predictions.
+    void jpeg_encoder::emit_restart_if_due()
+    {
+        if (!m_params.m_restart_interval) {
+            return;
+        }
+        if (m_mcus_to_restart == 0) {
+            if (m_pass_num == 2) {
+                flush_bits();
+                emit_marker(M_RST0 + m_next_restart_num);
+            }
+            m_next_restart_num = (m_next_restart_num + 1) & 7;
+            memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+            m_mcus_to_restart = m_params.m_restart_interval;
+        }
+        m_mcus_to_restart--;
+    }
+
+    // Called before each MCU of the primary encoder, for itself and its renditions.
+    void jpeg_encoder::begin_mcu(uint8 importance)
+    {
+        for (jpeg_encoder *pEnc = this; pEnc; pEnc = pEnc->m_pNext_rendition)
+        {
+            pEnc->emit_restart_if_due();
+            pEnc->m_mcu_importance = importance;
+        }
+    }
+
     void jpeg_encoder::load_block_8_8_grey(int x)
     {
         uint8 *pSrc;
@@ -334,6 +757,29 @@ namespace jpge {
         }
     }
 
+    // Luma of an 8x8 block read from the Y bytes of the YUYV rows at m_pYuyv_rows, right edge pixels repeated.
+    void jpeg_encoder::load_block_8_8_yuyv_y(int x)
+    {
+        const uint8 *pSrc;
+        sample_array_t *pDst = m_sample_array;
+        x <<= 3;
+        const int n = m_image_x - x;
+        for (int i = 0; i < 8; i++, pDst += 8)
+        {
+            pSrc = m_pYuyv_rows + i * m_yuyv_stride + x * 2;
+            if (n >= 8) {
+                pDst[0] = s_yuv_y_full[pSrc[0]] - 128; pDst[1] = s_yuv_y_full[pSrc[2]] - 128;
+                pDst[2] = s_yuv_y_full[pSrc[4]] - 128; pDst[3] = s_yuv_y_full[pSrc[6]] - 128;
+                pDst[4] = s_yuv_y_full[pSrc[8]] - 128; pDst[5] = s_yuv_y_full[pSrc[10]] - 128;
+                pDst[6] = s_yuv_y_full[pSrc[12]] - 128; pDst[7] = s_yuv_y_full[pSrc[14]] - 128;
+            } else {
+                for (int j = 0; j < 8; j++) {
+                    pDst[j] = s_yuv_y_full[pSrc[(j < n ? j : n - 1) * 2]] - 128;
+                }
+            }
+        }
+    }
+
     void jpeg_encoder::load_block_8_8(int x, int y, int c)
     {
         uint8 *pSrc;
@@ -381,47 +827,63 @@ namespace jpge {
         }
     }
 
-    void jpeg_encoder::load_quantized_coefficients(int component_num)
+    void jpeg_encoder::code_coefficients_pass_one(int component_num)
     {
-        int32 *q = m_quantization_tables[component_num > 0];
-        int16 *pDst = m_coefficient_array;
-        for (int i = 0; i < 64; i++)
+        int i, run_len, nbits, temp1;
+        int16 *pSrc = m_coefficient_array;
+        uint32 *dc_count = m_pOpt_huff->counts.count[0 + (component_num > 0)];
+        uint32 *ac_count = m_pOpt_huff->counts.count[2 + (component_num > 0)];
+
+        temp1 = pSrc[0] - m_last_dc_val[component_num];
+        m_last_dc_val[component_num] = pSrc[0];
+        if (temp1 < 0) temp1 = -temp1;
+
+        nbits = 0;
+        while (temp1)
         {
-            sample_array_t j = m_sample_array[s_zag[i]];
-            if (j < 0)
-            {
-                if ((j = -j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>(-(j / *q));
-            }
+            nbits++; temp1 >>= 1;
+        }
+
+        dc_count[nbits]++;
+        for (run_len = 0, i = 1; i < 64; i++)
+        {
+            if ((temp1 = m_coefficient_array[i]) == 0)
+                run_len++;
             else
             {
-                if ((j = j + (*q >> 1)) < *q)
-                    *pDst++ = 0;
-                else
-                    *pDst++ = static_cast<int16>((j / *q));
+                while (run_len >= 16)
+                {
+                    ac_count[0xF0]++;
+                    run_len -= 16;
+                }
+                if (temp1 < 0) temp1 = -temp1;
+                nbits = 1;
+                while (temp1 >>= 1)
+                    nbits++;
+                ac_count[(run_len << 4) + nbits]++;
+                run_len = 0;
             }
-            q++;
         }
+        if (run_len)
+            ac_count[0]++;
     }
 
     void jpeg_encoder::code_coefficients_pass_two(int component_num)
     {
         int i, j, run_len, nbits, temp1, temp2;
         int16 *pSrc = m_coefficient_array;
-        uint *codes[2];
-        uint8 *code_sizes[2];
+        const uint *codes[2];
+        const uint8 *code_sizes[2];
 
         if (component_num == 0)
         {
-            codes[0] = m_huff_codes[0 + 0]; codes[1] = m_huff_codes[2 + 0];
-            code_sizes[0] = m_huff_code_sizes[0 + 0]; code_sizes[1] = m_huff_code_sizes[2 + 0];
+            codes[0] = m_huff->codes[0 + 0]; codes[1] = m_huff->codes[2 + 0];
+            code_sizes[0] = m_huff->code_sizes[0 + 0]; code_sizes[1] = m_huff->code_sizes[2 + 0];
         }
         else
         {
-            codes[0] = m_huff_codes[0 + 1]; codes[1] = m_huff_codes[2 + 1];
-            code_sizes[0] = m_huff_code_sizes[0 + 1]; code_sizes[1] = m_huff_code_sizes[2 + 1];
+            codes[0] = m_huff->codes[0 + 1]; codes[1] = m_huff->codes[2 + 1];
+            code_sizes[0] = m_huff->code_sizes[0 + 1]; code_sizes[1] = m_huff->code_sizes[2 + 1];
         }
 
         temp1 = temp2 = pSrc[0] - m_last_dc_val[component_num];
@@ -470,26 +932,64 @@ namespace jpge {
             put_bits(codes[1][0], code_sizes[1][0]);
     }
 
+    // Drops detail from a block of an MCU below full importance: AC coefficients past a zig-zag position that
+    // follows the importance are zeroed, and the ones kept are quantized up to 4 times coarser towards zero.
+    void jpeg_encoder::reduce_coefficients()
+    {
+        const int keep = 1 + (m_mcu_importance * 63 + 127) / 255;
+        const int step = 1 + ((255 - m_mcu_importance) >> 6);
+        for (int i = 1; i < keep; i++) {
+            m_coefficient_array[i] = static_cast<int16>((m_coefficient_array[i] / step) * step);
+        }
+        for (int i = keep; i < 64; i++) {
+            m_coefficient_array[i] = 0;
+        }
+    }
+
     void jpeg_encoder::code_block(int component_num)
     {
-        DCT2D(m_sample_array);
-        load_quantized_coefficients(component_num);
-        code_coefficients_pass_two(component_num);
+        JPGE_PROFILE_LAP(PROFILE_COLOUR);
+        m_dsp->fdct(m_sample_array);
+        JPGE_PROFILE_LAP(PROFILE_DCT);
+        for (jpeg_encoder *pEnc = this; pEnc; pEnc = pEnc->m_pNext_rendition)
+            pEnc->code_dct_block(component_num, m_sample_array);
+    }
+
+    // Quantizes and codes the DCT coefficients of a block, computed by this encoder or by its primary.
+    void jpeg_encoder::code_dct_block(int component_num, const sample_array_t *pDct)
+    {
+        m_dsp->quantize(m_coefficient_array, pDct, m_quantization_tables[component_num > 0]);
+        if (m_mcu_importance != 255)
+            reduce_coefficients();
+        JPGE_PROFILE_LAP(PROFILE_QUANTIZE);
+        if (m_pass_num == 1)
+            code_coefficients_pass_one(component_num);
+        else
+            code_coefficients_pass_two(component_num);
+        JPGE_PROFILE_LAP(PROFILE_HUFFMAN);
     }
 
     void jpeg_encoder::process_mcu_row()
     {
+        const uint8 *pImportance = m_params.m_pMcu_importance ? m_params.m_pMcu_importance + m_mcu_row_num * m_mcus_per_row : NULL;
+        JPGE_PROFILE_MARK();
         if (m_num_components == 1)
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
-                load_block_8_8_grey(i); code_block(0);
+                begin_mcu(pImportance ? pImportance[i] : 255);
+                if (m_pYuyv_rows)
+                    load_block_8_8_yuyv_y(i);
+                else
+                    load_block_8_8_grey(i);
+                code_block(0);
             }
         }
         else if ((m_comp_h_samp[0] == 1) && (m_comp_v_samp[0] == 1))
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                begin_mcu(pImportance ? pImportance[i] : 255);
                 load_block_8_8(i, 0, 0); code_block(0); load_block_8_8(i, 0, 1); code_block(1); load_block_8_8(i, 0, 2); code_block(2);
             }
         }
@@ -497,6 +997,7 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                begin_mcu(pImportance ? pImportance[i] : 255);
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_16_8_8(i, 1); code_block(1); load_block_16_8_8(i, 2); code_block(2);
             }
@@ -505,11 +1006,15 @@ namespace jpge {
         {
             for (int i = 0; i < m_mcus_per_row; i++)
             {
+                begin_mcu(pImportance ? pImportance[i] : 255);
                 load_block_8_8(i * 2 + 0, 0, 0); code_block(0); load_block_8_8(i * 2 + 1, 0, 0); code_block(0);
                 load_block_8_8(i * 2 + 0, 1, 0); code_block(0); load_block_8_8(i * 2 + 1, 1, 0); code_block(0);
                 load_block_16_8(i, 1); code_block(1); load_block_16_8(i, 2); code_block(2);
             }
         }
+        m_mcu_row_num++;
+        for (jpeg_encoder *pEnc = m_pNext_rendition; pEnc; pEnc = pEnc->m_pNext_rendition)
+            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && pEnc->m_all_stream_writes_succeeded;
     }
 
     void jpeg_encoder::load_mcu(const void *pSrc)
@@ -517,17 +1022,24 @@ namespace jpge {
         const uint8* Psrc = reinterpret_cast<const uint8*>(pSrc);
 
         uint8* pDst = m_mcu_lines[m_mcu_y_ofs]; // OK to write up to m_image_bpl_xlt bytes to pDst
+        JPGE_PROFILE_MARK();
 
         if (m_num_components == 1) {
-            if (m_image_bpp == 3)
-                RGB_to_Y(pDst, Psrc, m_image_x);
-            else
-                memcpy(pDst, Psrc, m_image_x);
+            switch (m_src_format) {
+                case SRC_RGB: RGB_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_BGR: BGR_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_RGB565: RGB565_to_Y(pDst, Psrc, m_image_x); break;
+                case SRC_YUYV: YUYV_to_Y(pDst, Psrc, m_image_x); break;
+                default: memcpy(pDst, Psrc, m_image_x); break;
+            }
         } else {
-            if (m_image_bpp == 3)
-                RGB_to_YCC(pDst, Psrc, m_image_x);
-            else
-                Y_to_YCC(pDst, Psrc, m_image_x);
+            switch (m_src_format) {
+                case SRC_RGB: RGB_to_YCC(pDst, Psrc, m_image_x); break;
+                case SRC_BGR: BGR_to_YCC(pDst, Psrc, m_image_x); break;
+                case SRC_RGB565: RGB565_to_YCC(pDst, Psrc, m_image_x); break;
+                case SRC_YUYV: YUYV_to_YCC(pDst, Psrc, m_image_x); break;
+                default: Y_to_YCC(pDst, Psrc, m_image_x); break;
+            }
         }
 
         // Possibly duplicate pixels at end of scanline if not a multiple of 8 or 16
@@ -543,6 +1055,7 @@ namespace jpge {
             }
         }
 
+        JPGE_PROFILE_LAP(PROFILE_COLOUR);
         if (++m_mcu_y_ofs == m_mcu_y)
         {
             process_mcu_row();
@@ -565,8 +1078,88 @@ namespace jpge {
         }
     }
 
+    // Generates an optimized Huffman table from the symbol counts.
+    void jpeg_encoder::optimize_huffman_table(int table_num, int table_len)
+    {
+        sym_freq *syms0 = m_pOpt_huff->syms[0], *syms1 = m_pOpt_huff->syms[1];
+        syms0[0].m_key = 1; syms0[0].m_sym_index = 0;  // dummy symbol, assures that no valid code contains all 1's
+        int num_used_syms = 1;
+        const uint32 *pSym_count = m_pOpt_huff->counts.count[table_num];
+        for (int i = 0; i < table_len; i++)
+            if (pSym_count[i]) { syms0[num_used_syms].m_key = pSym_count[i]; syms0[num_used_syms++].m_sym_index = i + 1; }
+        sym_freq* pSyms = radix_sort_syms(num_used_syms, syms0, syms1);
+        calculate_minimum_redundancy(pSyms, num_used_syms);
+
+        // Count the # of symbols of each code size.
+        int num_codes[1 + MAX_HUFF_CODESIZE];
+        memset(num_codes, 0, sizeof(num_codes));
+        for (int i = 0; i < num_used_syms; i++)
+            num_codes[pSyms[i].m_key]++;
+
+        const uint JPGE_CODE_SIZE_LIMIT = 16; // the maximum possible size of a JPEG Huffman code (valid range is [9,16] - 9 vs. 8 because of the dummy symbol)
+        huffman_enforce_max_code_size(num_codes, num_used_syms, JPGE_CODE_SIZE_LIMIT);
+
+        // Compute the bits array, which contains the # of symbols per code size.
+        uint8 *bits = m_pOpt_huff->bits[table_num], *val = m_pOpt_huff->val[table_num];
+        memset(bits, 0, 17);
+        for (int i = 1; i <= (int)JPGE_CODE_SIZE_LIMIT; i++)
+            bits[i] = static_cast<uint8>(num_codes[i]);
+
+        // Remove the dummy symbol added above, which must be in largest bucket.
+        for (int i = JPGE_CODE_SIZE_LIMIT; i >= 1; i--)
+        {
+            if (bits[i]) { bits[i]--; break; }
+        }
+
+        // Compute the val array, which contains the symbol indices sorted by code size (smallest to largest).
+        for (int i = num_used_syms - 1; i >= 1; i--)
+            val[num_used_syms - 1 - i] = static_cast<uint8>(pSyms[i].m_sym_index - 1);
+
+        huffman_tables *pTables = &m_pOpt_huff->tables;
+        pTables->bits[table_num] = bits;
+        pTables->val[table_num] = val;
+        compute_huffman_table(pTables->codes[table_num], pTables->code_sizes[table_num], bits, val);
+    }
+
+    // Replaces the standard tables with ones built from the gathered counts.
+    void jpeg_encoder::build_optimized_tables()
+    {
+        optimize_huffman_table(0+0, DC_LUM_CODES); optimize_huffman_table(2+0, AC_LUM_CODES);
+        if (m_num_components > 1)
+        {
+            optimize_huffman_table(0+1, DC_CHROMA_CODES); optimize_huffman_table(2+1, AC_CHROMA_CODES);
+        }
+        m_huff = &m_pOpt_huff->tables;
+    }
+
+    // Resets the coder for a pass over the image. The second pass writes the file, starting with its headers.
+    bool jpeg_encoder::start_pass(uint8 pass_num)
+    {
+        m_pass_num = pass_num;
+        m_out_buf_left = m_params.m_out_buf_size;
+        m_pOut_buf = m_out_buf;
+        m_bit_buffer = 0;
+        m_bits_in = 0;
+        m_mcu_y_ofs = 0;
+        m_mcu_row_num = m_first_mcu_row;
+        m_mcu_importance = 255;
+        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
+
+        // A slice starting past the first row begins with the RSTn that precedes its first MCU.
+        if (m_params.m_restart_interval) {
+            int first_interval = (m_first_mcu_row * m_mcus_per_row) / m_params.m_restart_interval;
+            m_mcus_to_restart = first_interval ? 0 : m_params.m_restart_interval;
+            m_next_restart_num = (first_interval + 7) & 7;
+        }
+
+        if ((m_pass_num == 2) && !m_first_mcu_row) {
+            emit_header();
+        }
+        return m_all_stream_writes_succeeded;
+    }
+
     // Higher-level methods.
-    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_channels)
+    bool jpeg_encoder::jpg_open(int p_x_res, int p_y_res, int src_format, int first_mcu_row, int num_mcu_rows, bool line_buffer)
     {
         m_num_components = 3;
         switch (m_params.m_subsampling)
@@ -604,57 +1197,66 @@ namespace jpge {
         }
 
         m_image_x        = p_x_res; m_image_y = p_y_res;
-        m_image_bpp      = src_channels;
-        m_image_bpl      = m_image_x * src_channels;
+        m_src_format     = static_cast<source_format_t>(src_format);
+        m_image_bpp      = source_bpp(m_src_format);
+        m_image_bpl      = m_image_x * m_image_bpp;
         m_image_x_mcu    = (m_image_x + m_mcu_x - 1) & (~(m_mcu_x - 1));
         m_image_y_mcu    = (m_image_y + m_mcu_y - 1) & (~(m_mcu_y - 1));
         m_image_bpl_xlt  = m_image_x * m_num_components;
         m_image_bpl_mcu  = m_image_x_mcu * m_num_components;
         m_mcus_per_row   = m_image_x_mcu / m_mcu_x;
+        m_total_mcu_rows = m_image_y_mcu / m_mcu_y;
 
-        if ((m_mcu_lines[0] = static_cast<uint8*>(jpge_malloc(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+        if (!num_mcu_rows) {
+            num_mcu_rows = m_total_mcu_rows - first_mcu_row;
+        }
+        if ((first_mcu_row < 0) || (num_mcu_rows < 1) || (first_mcu_row + num_mcu_rows > m_total_mcu_rows)) {
+            return false;
+        }
+        if (first_mcu_row && (!m_params.m_restart_interval || ((first_mcu_row * m_mcus_per_row) % m_params.m_restart_interval))) {
+            return false;
+        }
+        m_first_mcu_row = first_mcu_row;
+        m_end_mcu_row = first_mcu_row + num_mcu_rows;
+
+        // per image buffers come from the pool shared with the converters, so a stream of frames reuses them
+        // renditions are never fed scanlines, their primary loads the blocks
+        if (line_buffer) {
+            if ((m_mcu_lines[0] = static_cast<uint8*>(img_buf_acquire(m_image_bpl_mcu * m_mcu_y))) == NULL) {
+                return false;
+            }
+            for (int i = 1; i < m_mcu_y; i++)
+                m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
+        }
+        if ((m_out_buf = static_cast<uint8*>(img_buf_acquire(m_params.m_out_buf_size))) == NULL) {
             return false;
         }
-        for (int i = 1; i < m_mcu_y; i++)
-            m_mcu_lines[i] = m_mcu_lines[i-1] + m_image_bpl_mcu;
 
-        if(m_last_quality != m_params.m_quality){
-            m_last_quality = m_params.m_quality;
+        if (!m_params.m_two_pass_flag && !m_params.m_pHuff_counts) {
+            m_pHeader = acquire_cached_header(make_header_key(m_image_x, m_image_y, m_params));
+        }
+        if (m_pHeader) {
+            memcpy(m_quantization_tables, m_pHeader->quant, sizeof(m_quantization_tables));
+        } else {
             compute_quant_table(m_quantization_tables[0], s_std_lum_quant);
             compute_quant_table(m_quantization_tables[1], s_std_croma_quant);
         }
+        m_huff = std_huffman_tables();
 
-        if(!m_huff_initialized){
-            m_huff_initialized = true;
-
-            memcpy(m_huff_bits[0+0], s_dc_lum_bits, 17);    memcpy(m_huff_val[0+0], s_dc_lum_val, DC_LUM_CODES);
-            memcpy(m_huff_bits[2+0], s_ac_lum_bits, 17);    memcpy(m_huff_val[2+0], s_ac_lum_val, AC_LUM_CODES);
-            memcpy(m_huff_bits[0+1], s_dc_chroma_bits, 17); memcpy(m_huff_val[0+1], s_dc_chroma_val, DC_CHROMA_CODES);
-            memcpy(m_huff_bits[2+1], s_ac_chroma_bits, 17); memcpy(m_huff_val[2+1], s_ac_chroma_val, AC_CHROMA_CODES);
-
-            compute_huffman_table(&m_huff_codes[0+0][0], &m_huff_code_sizes[0+0][0], m_huff_bits[0+0], m_huff_val[0+0]);
-            compute_huffman_table(&m_huff_codes[2+0][0], &m_huff_code_sizes[2+0][0], m_huff_bits[2+0], m_huff_val[2+0]);
-            compute_huffman_table(&m_huff_codes[0+1][0], &m_huff_code_sizes[0+1][0], m_huff_bits[0+1], m_huff_val[0+1]);
-            compute_huffman_table(&m_huff_codes[2+1][0], &m_huff_code_sizes[2+1][0], m_huff_bits[2+1], m_huff_val[2+1]);
+        if (m_params.m_two_pass_flag || m_params.m_pHuff_counts) {
+            if ((m_pOpt_huff = static_cast<optimized_huffman*>(img_buf_acquire(sizeof(optimized_huffman)))) == NULL) {
+                return false;
+            }
+            if (m_params.m_pHuff_counts) {
+                m_pOpt_huff->counts = *m_params.m_pHuff_counts;
+                m_params.m_pHuff_counts = NULL;
+                build_optimized_tables();
+            } else {
+                memset(&m_pOpt_huff->counts, 0, sizeof(m_pOpt_huff->counts));
+            }
         }
 
-        m_out_buf_left = JPGE_OUT_BUF_SIZE;
-        m_pOut_buf = m_out_buf;
-        m_bit_buffer = 0;
-        m_bits_in = 0;
-        m_mcu_y_ofs = 0;
-        m_pass_num = 2;
-        memset(m_last_dc_val, 0, 3 * sizeof(m_last_dc_val[0]));
-
-        // Emit all markers at beginning of image file.
-        emit_marker(M_SOI);
-        emit_jfif_app0();
-        emit_dqt();
-        emit_sof();
-        emit_dhts();
-        emit_sos();
-
-        return m_all_stream_writes_succeeded;
+        return start_pass(m_params.m_two_pass_flag ? 1 : 2);
     }
 
     bool jpeg_encoder::process_end_of_image()
@@ -668,17 +1270,39 @@ namespace jpge {
             process_mcu_row();
         }
 
-        put_bits(0x7F, 7);
-        emit_marker(M_EOI);
+        if (m_pass_num == 1) {
+            build_optimized_tables();
+            return start_pass(2);
+        }
+
+        for (jpeg_encoder *pEnc = m_pNext_rendition; pEnc; pEnc = pEnc->m_pNext_rendition) {
+            pEnc->finish_output();
+            m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && pEnc->m_all_stream_writes_succeeded;
+        }
+        finish_output();
+        return true;
+    }
+
+    // Writes the end of the last pass: the remaining bits, EOI if the image ends here, and flushes the stream.
+    void jpeg_encoder::finish_output()
+    {
+        flush_bits();
+        if (m_end_mcu_row == m_total_mcu_rows) {
+            emit_marker(M_EOI);
+        }
         flush_output_buffer();
         m_all_stream_writes_succeeded = m_all_stream_writes_succeeded && m_pStream->put_buf(NULL, 0);
         m_pass_num++; // purposely bump up m_pass_num, for debugging
-        return true;
     }
 
     void jpeg_encoder::clear()
     {
         m_mcu_lines[0] = NULL;
+        m_pYuyv_rows = NULL;
+        m_out_buf = NULL;
+        m_pOpt_huff = NULL;
+        m_pHeader = NULL;
+        m_pNext_rendition = NULL;
         m_pass_num = 0;
         m_all_stream_writes_succeeded = true;
     }
@@ -693,24 +1317,65 @@ namespace jpge {
         deinit();
     }
 
-    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params)
+    bool jpeg_encoder::init(output_stream *pStream, int width, int height, int src_format, const params &comp_params)
+    {
+        return init_slice(pStream, width, height, src_format, comp_params, 0, 0);
+    }
+
+    bool jpeg_encoder::init_slice(output_stream *pStream, int width, int height, int src_format, const params &comp_params, int first_mcu_row, int num_mcu_rows)
+    {
+        deinit();
+        if (((!pStream) || (width < 1) || (height < 1)) || (!source_bpp(src_format)) || (!comp_params.check())) return false;
+        m_pStream = pStream;
+        m_params = comp_params;
+        m_dsp = dsp_select_kernels();
+        return jpg_open(width, height, src_format, first_mcu_row, num_mcu_rows, true);
+    }
+
+    bool jpeg_encoder::init_rendition(output_stream *pStream, jpeg_encoder *pPrimary, const params &comp_params)
     {
         deinit();
-        if (((!pStream) || (width < 1) || (height < 1)) || ((src_channels != 1) && (src_channels != 3) && (src_channels != 4)) || (!comp_params.check())) return false;
+        if ((!pStream) || (!pPrimary) || (pPrimary == this) || (!comp_params.check()) || comp_params.m_two_pass_flag) return false;
+        // the primary must be in its only pass and not have loaded a scanline yet
+        if ((pPrimary->m_pass_num != 2) || pPrimary->m_params.m_two_pass_flag || (!pPrimary->m_mcu_lines[0])
+            || (pPrimary->m_mcu_row_num != pPrimary->m_first_mcu_row) || pPrimary->m_mcu_y_ofs
+            || (comp_params.m_subsampling != pPrimary->m_params.m_subsampling)) return false;
         m_pStream = pStream;
         m_params = comp_params;
-        return jpg_open(width, height, src_channels);
+        m_params.m_pMcu_importance = NULL;
+        m_dsp = pPrimary->m_dsp;
+        if (!jpg_open(pPrimary->m_image_x, pPrimary->m_image_y, pPrimary->m_src_format, pPrimary->m_first_mcu_row,
+                      pPrimary->m_end_mcu_row - pPrimary->m_first_mcu_row, false)) {
+            deinit();
+            return false;
+        }
+        m_pNext_rendition = pPrimary->m_pNext_rendition;
+        pPrimary->m_pNext_rendition = this;
+        return true;
     }
 
     void jpeg_encoder::deinit()
     {
-        jpge_free(m_mcu_lines[0]);
+        if (m_mcu_lines[0]) {
+            // the dimensions are only set once init() got that far
+            img_buf_release(m_mcu_lines[0], m_image_bpl_mcu * m_mcu_y);
+        }
+        img_buf_release(m_out_buf, m_params.m_out_buf_size);
+        img_buf_release(m_pOpt_huff, sizeof(optimized_huffman));
+        if (m_pHeader) {
+            release_header(m_pHeader);
+        }
         clear();
     }
 
+    const huffman_counts *jpeg_encoder::get_huffman_counts() const
+    {
+        return (m_params.m_two_pass_flag && m_pOpt_huff) ? &m_pOpt_huff->counts : NULL;
+    }
+
     bool jpeg_encoder::process_scanline(const void* pScanline)
     {
-        if ((m_pass_num < 1) || (m_pass_num > 2)) {
+        if ((m_pass_num < 1) || (m_pass_num > 2) || (!m_mcu_lines[0])) {
             return false;
         }
         if (m_all_stream_writes_succeeded) {
@@ -725,4 +1390,31 @@ namespace jpge {
         return m_all_stream_writes_succeeded;
     }
 
+    bool jpeg_encoder::process_scanlines(const void* pFirst, int stride, int num_scanlines)
+    {
+        const uint8 *pSrc = static_cast<const uint8 *>(pFirst);
+        const bool yuyv_y = (m_src_format == SRC_YUYV) && (m_num_components == 1) && m_mcu_lines[0] && (m_pass_num >= 1) && (m_pass_num <= 2);
+        for (int i = 0; i < num_scanlines; ) {
+            // Whole MCU rows of luma from YUYV skip the line buffer, the blocks are loaded from the source.
+            if (yuyv_y && (m_mcu_y_ofs == 0) && (num_scanlines - i >= m_mcu_y)) {
+                if (!m_all_stream_writes_succeeded) {
+                    return false;
+                }
+                m_pYuyv_rows = pSrc;
+                m_yuyv_stride = stride;
+                process_mcu_row();
+                m_pYuyv_rows = NULL;
+                i += m_mcu_y;
+                pSrc += stride * m_mcu_y;
+                continue;
+            }
+            if (!process_scanline(pSrc)) {
+                return false;
+            }
+            i++;
+            pSrc += stride;
+        }
+        return m_all_stream_writes_succeeded;
+    }
+
 } // namespace jpge
@@ -0,0 +1,304 @@
+// jpge_dsp.cpp - Forward DCT and quantization kernels used by jpge::jpeg_encoder.
+// The scalar kernels are the original jpge code. The SIMD kernels perform the exact same integer
+// arithmetic, so all kernel sets produce bit-identical coefficients.
+//
+// On Xtensa targets only the scalar kernels are built: the ESP32-S3 PIE extension is not exposed
+// through compiler intrinsics, so a vector kernel there has to be written in assembly.
+
+#include "jpge_dsp.h"
+
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JPGE_DSP_X86 1
+#include <immintrin.h>
+#else
+#define JPGE_DSP_X86 0
+#endif
+
+namespace jpge {
+
+    static const uint8 s_zag[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+
+    // Forward DCT - DCT derived from jfdctint.
+    enum { CONST_BITS = 13, ROW_BITS = 2 };
+#define DCT_DESCALE(x, n) (((x) + (((int32)1) << ((n) - 1))) >> (n))
+#define DCT_MUL(var, c) (static_cast<int16>(var) * static_cast<int32>(c))
+#define DCT1D(s0, s1, s2, s3, s4, s5, s6, s7) \
+    int32 t0 = s0 + s7, t7 = s0 - s7, t1 = s1 + s6, t6 = s1 - s6, t2 = s2 + s5, t5 = s2 - s5, t3 = s3 + s4, t4 = s3 - s4; \
+    int32 t10 = t0 + t3, t13 = t0 - t3, t11 = t1 + t2, t12 = t1 - t2; \
+    int32 u1 = DCT_MUL(t12 + t13, 4433); \
+    s2 = u1 + DCT_MUL(t13, 6270); \
+    s6 = u1 + DCT_MUL(t12, -15137); \
+    u1 = t4 + t7; \
+    int32 u2 = t5 + t6, u3 = t4 + t6, u4 = t5 + t7; \
+    int32 z5 = DCT_MUL(u3 + u4, 9633); \
+    t4 = DCT_MUL(t4, 2446); t5 = DCT_MUL(t5, 16819); \
+    t6 = DCT_MUL(t6, 25172); t7 = DCT_MUL(t7, 12299); \
+    u1 = DCT_MUL(u1, -7373); u2 = DCT_MUL(u2, -20995); \
+    u3 = DCT_MUL(u3, -16069); u4 = DCT_MUL(u4, -3196); \
+    u3 += z5; u4 += z5; \
+    s0 = t10 + t11; s1 = t7 + u1 + u4; s3 = t6 + u2 + u3; s4 = t10 - t11; s5 = t5 + u2 + u4; s7 = t4 + u1 + u3;
+
+    static void fdct_scalar(int32 *p)
+    {
+        int32 c, *q = p;
+        for (c = 7; c >= 0; c--, q += 8) {
+            int32 s0 = q[0], s1 = q[1], s2 = q[2], s3 = q[3], s4 = q[4], s5 = q[5], s6 = q[6], s7 = q[7];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0] = s0 << ROW_BITS; q[1] = DCT_DESCALE(s1, CONST_BITS-ROW_BITS); q[2] = DCT_DESCALE(s2, CONST_BITS-ROW_BITS); q[3] = DCT_DESCALE(s3, CONST_BITS-ROW_BITS);
+            q[4] = s4 << ROW_BITS; q[5] = DCT_DESCALE(s5, CONST_BITS-ROW_BITS); q[6] = DCT_DESCALE(s6, CONST_BITS-ROW_BITS); q[7] = DCT_DESCALE(s7, CONST_BITS-ROW_BITS);
+        }
+        for (q = p, c = 7; c >= 0; c--, q++) {
+            int32 s0 = q[0*8], s1 = q[1*8], s2 = q[2*8], s3 = q[3*8], s4 = q[4*8], s5 = q[5*8], s6 = q[6*8], s7 = q[7*8];
+            DCT1D(s0, s1, s2, s3, s4, s5, s6, s7);
+            q[0*8] = DCT_DESCALE(s0, ROW_BITS+3); q[1*8] = DCT_DESCALE(s1, CONST_BITS+ROW_BITS+3); q[2*8] = DCT_DESCALE(s2, CONST_BITS+ROW_BITS+3); q[3*8] = DCT_DESCALE(s3, CONST_BITS+ROW_BITS+3);
+            q[4*8] = DCT_DESCALE(s4, ROW_BITS+3); q[5*8] = DCT_DESCALE(s5, CONST_BITS+ROW_BITS+3); q[6*8] = DCT_DESCALE(s6, CONST_BITS+ROW_BITS+3); q[7*8] = DCT_DESCALE(s7, CONST_BITS+ROW_BITS+3);
+        }
+    }
+
+    static void quantize_scalar(int16 *pDst, const int32 *pSrc, const int32 *q)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            int32 j = pSrc[s_zag[i]];
+            if (j < 0)
+            {
+                if ((j = -j + (*q >> 1)) < *q)
+                    *pDst++ = 0;
+                else
+                    *pDst++ = static_cast<int16>(-(j / *q));
+            }
+            else
+            {
+                if ((j = j + (*q >> 1)) < *q)
+                    *pDst++ = 0;
+                else
+                    *pDst++ = static_cast<int16>((j / *q));
+            }
+            q++;
+        }
+    }
+
+    static const dsp_kernels s_scalar_kernels = { "scalar", fdct_scalar, quantize_scalar };
+
+#if JPGE_DSP_X86
+    // Vector form of DCT1D. Every lane carries one independent 1-D transform.
+    // MUL must truncate its first operand to 16 bits and widen the product to 32 bits, exactly like DCT_MUL.
+#define DCT1D_VEC(VEC, ADD, SUB, MUL, s) \
+    VEC t0 = ADD(s[0], s[7]), t7 = SUB(s[0], s[7]), t1 = ADD(s[1], s[6]), t6 = SUB(s[1], s[6]); \
+    VEC t2 = ADD(s[2], s[5]), t5 = SUB(s[2], s[5]), t3 = ADD(s[3], s[4]), t4 = SUB(s[3], s[4]); \
+    VEC t10 = ADD(t0, t3), t13 = SUB(t0, t3), t11 = ADD(t1, t2), t12 = SUB(t1, t2); \
+    VEC u1 = MUL(ADD(t12, t13), 4433); \
+    s[2] = ADD(u1, MUL(t13, 6270)); \
+    s[6] = ADD(u1, MUL(t12, -15137)); \
+    u1 = ADD(t4, t7); \
+    VEC u2 = ADD(t5, t6), u3 = ADD(t4, t6), u4 = ADD(t5, t7); \
+    VEC z5 = MUL(ADD(u3, u4), 9633); \
+    t4 = MUL(t4, 2446); t5 = MUL(t5, 16819); \
+    t6 = MUL(t6, 25172); t7 = MUL(t7, 12299); \
+    u1 = MUL(u1, -7373); u2 = MUL(u2, -20995); \
+    u3 = MUL(u3, -16069); u4 = MUL(u4, -3196); \
+    u3 = ADD(u3, z5); u4 = ADD(u4, z5); \
+    s[0] = ADD(t10, t11); s[1] = ADD(ADD(t7, u1), u4); s[3] = ADD(ADD(t6, u2), u3); \
+    s[4] = SUB(t10, t11); s[5] = ADD(ADD(t5, u2), u4); s[7] = ADD(ADD(t4, u1), u3);
+
+    // pmaddwd with a zero high half multiplies the low 16 bits of each lane by c, which is DCT_MUL.
+#define SSE2_MUL(v, c) _mm_madd_epi16((v), _mm_set1_epi32((c) & 0xFFFF))
+#define SSE2_DESCALE(v, n) _mm_srai_epi32(_mm_add_epi32((v), _mm_set1_epi32(1 << ((n) - 1))), (n))
+
+    __attribute__((target("sse2")))
+    static inline void transpose_4x4_sse2(__m128i &a, __m128i &b, __m128i &c, __m128i &d)
+    {
+        __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);
+        a = _mm_unpacklo_epi64(t0, t1); b = _mm_unpackhi_epi64(t0, t1);
+        c = _mm_unpacklo_epi64(t2, t3); d = _mm_unpackhi_epi64(t2, t3);
+    }
+
+    // v[row][half] <-> v[col][half], half 0 holds elements 0..3 and half 1 elements 4..7.
+    __attribute__((target("sse2")))
+    static inline void transpose_8x8_sse2(__m128i v[8][2])
+    {
+        transpose_4x4_sse2(v[0][0], v[1][0], v[2][0], v[3][0]);
+        transpose_4x4_sse2(v[4][1], v[5][1], v[6][1], v[7][1]);
+        transpose_4x4_sse2(v[0][1], v[1][1], v[2][1], v[3][1]);
+        transpose_4x4_sse2(v[4][0], v[5][0], v[6][0], v[7][0]);
+        for (int i = 0; i < 4; i++) {
+            __m128i t = v[i][1]; v[i][1] = v[i + 4][0]; v[i + 4][0] = t;
+        }
+    }
+
+    __attribute__((target("sse2")))
+    static void fdct_sse2(int32 *p)
+    {
+        __m128i v[8][2], s[8];
+        for (int i = 0; i < 8; i++) {
+            v[i][0] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 8));
+            v[i][1] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i * 8 + 4));
+        }
+
+        // Rows: after the transpose v[k] holds element k of every row.
+        transpose_8x8_sse2(v);
+        for (int h = 0; h < 2; h++) {
+            for (int k = 0; k < 8; k++) s[k] = v[k][h];
+            DCT1D_VEC(__m128i, _mm_add_epi32, _mm_sub_epi32, SSE2_MUL, s);
+            v[0][h] = _mm_slli_epi32(s[0], ROW_BITS); v[4][h] = _mm_slli_epi32(s[4], ROW_BITS);
+            v[1][h] = SSE2_DESCALE(s[1], CONST_BITS-ROW_BITS); v[2][h] = SSE2_DESCALE(s[2], CONST_BITS-ROW_BITS);
+            v[3][h] = SSE2_DESCALE(s[3], CONST_BITS-ROW_BITS); v[5][h] = SSE2_DESCALE(s[5], CONST_BITS-ROW_BITS);
+            v[6][h] = SSE2_DESCALE(s[6], CONST_BITS-ROW_BITS); v[7][h] = SSE2_DESCALE(s[7], CONST_BITS-ROW_BITS);
+        }
+
+        // Columns: back in raster order v[k] holds row k.
+        transpose_8x8_sse2(v);
+        for (int h = 0; h < 2; h++) {
+            for (int k = 0; k < 8; k++) s[k] = v[k][h];
+            DCT1D_VEC(__m128i, _mm_add_epi32, _mm_sub_epi32, SSE2_MUL, s);
+            v[0][h] = SSE2_DESCALE(s[0], ROW_BITS+3); v[4][h] = SSE2_DESCALE(s[4], ROW_BITS+3);
+            v[1][h] = SSE2_DESCALE(s[1], CONST_BITS+ROW_BITS+3); v[2][h] = SSE2_DESCALE(s[2], CONST_BITS+ROW_BITS+3);
+            v[3][h] = SSE2_DESCALE(s[3], CONST_BITS+ROW_BITS+3); v[5][h] = SSE2_DESCALE(s[5], CONST_BITS+ROW_BITS+3);
+            v[6][h] = SSE2_DESCALE(s[6], CONST_BITS+ROW_BITS+3); v[7][h] = SSE2_DESCALE(s[7], CONST_BITS+ROW_BITS+3);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * 8), v[i][0]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(p + i * 8 + 4), v[i][1]);
+        }
+    }
+
+    // |j| + q/2 is below 2^16 and q is at most 255, so the single precision quotient always
+    // truncates to the same integer as the scalar division.
+    __attribute__((target("sse2")))
+    static inline __m128i quantize_4_sse2(__m128i j, __m128i q)
+    {
+        __m128i sign = _mm_srai_epi32(j, 31);
+        __m128i a = _mm_add_epi32(_mm_sub_epi32(_mm_xor_si128(j, sign), sign), _mm_srai_epi32(q, 1));
+        __m128i r = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(a), _mm_cvtepi32_ps(q)));
+        return _mm_sub_epi32(_mm_xor_si128(r, sign), sign);
+    }
+
+    __attribute__((target("sse2")))
+    static void quantize_sse2(int16 *pDst, const int32 *pSrc, const int32 *pQuant)
+    {
+        alignas(16) int32 zz[64];
+        for (int i = 0; i < 64; i++) {
+            zz[i] = pSrc[s_zag[i]];
+        }
+        for (int i = 0; i < 64; i += 8) {
+            __m128i lo = quantize_4_sse2(_mm_load_si128(reinterpret_cast<const __m128i *>(zz + i)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(pQuant + i)));
+            __m128i hi = quantize_4_sse2(_mm_load_si128(reinterpret_cast<const __m128i *>(zz + i + 4)),
+                                         _mm_loadu_si128(reinterpret_cast<const __m128i *>(pQuant + i + 4)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pDst + i), _mm_packs_epi32(lo, hi));
+        }
+    }
+
+#define AVX2_MUL(v, c) _mm256_madd_epi16((v), _mm256_set1_epi32((c) & 0xFFFF))
+#define AVX2_DESCALE(v, n) _mm256_srai_epi32(_mm256_add_epi32((v), _mm256_set1_epi32(1 << ((n) - 1))), (n))
+
+    __attribute__((target("avx2")))
+    static inline void transpose_8x8_avx2(__m256i v[8])
+    {
+        __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]), t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+        __m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]), t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+        __m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]), t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+        __m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]), t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+        __m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+        __m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+        __m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+        __m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+        v[0] = _mm256_permute2x128_si256(u0, u4, 0x20); v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+        v[1] = _mm256_permute2x128_si256(u1, u5, 0x20); v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+        v[2] = _mm256_permute2x128_si256(u2, u6, 0x20); v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+        v[3] = _mm256_permute2x128_si256(u3, u7, 0x20); v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+    }
+
+    __attribute__((target("avx2")))
+    static void fdct_avx2(int32 *p)
+    {
+        __m256i s[8];
+        for (int i = 0; i < 8; i++) {
+            s[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i * 8));
+        }
+
+        transpose_8x8_avx2(s);
+        {
+            DCT1D_VEC(__m256i, _mm256_add_epi32, _mm256_sub_epi32, AVX2_MUL, s);
+            s[0] = _mm256_slli_epi32(s[0], ROW_BITS); s[4] = _mm256_slli_epi32(s[4], ROW_BITS);
+            s[1] = AVX2_DESCALE(s[1], CONST_BITS-ROW_BITS); s[2] = AVX2_DESCALE(s[2], CONST_BITS-ROW_BITS);
+            s[3] = AVX2_DESCALE(s[3], CONST_BITS-ROW_BITS); s[5] = AVX2_DESCALE(s[5], CONST_BITS-ROW_BITS);
+            s[6] = AVX2_DESCALE(s[6], CONST_BITS-ROW_BITS); s[7] = AVX2_DESCALE(s[7], CONST_BITS-ROW_BITS);
+        }
+
+        transpose_8x8_avx2(s);
+        {
+            DCT1D_VEC(__m256i, _mm256_add_epi32, _mm256_sub_epi32, AVX2_MUL, s);
+            s[0] = AVX2_DESCALE(s[0], ROW_BITS+3); s[4] = AVX2_DESCALE(s[4], ROW_BITS+3);
+            s[1] = AVX2_DESCALE(s[1], CONST_BITS+ROW_BITS+3); s[2] = AVX2_DESCALE(s[2], CONST_BITS+ROW_BITS+3);
+            s[3] = AVX2_DESCALE(s[3], CONST_BITS+ROW_BITS+3); s[5] = AVX2_DESCALE(s[5], CONST_BITS+ROW_BITS+3);
+            s[6] = AVX2_DESCALE(s[6], CONST_BITS+ROW_BITS+3); s[7] = AVX2_DESCALE(s[7], CONST_BITS+ROW_BITS+3);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(p + i * 8), s[i]);
+        }
+    }
+
+    __attribute__((target("avx2")))
+    static void quantize_avx2(int16 *pDst, const int32 *pSrc, const int32 *pQuant)
+    {
+        static const int32 s_zag32[64] = { 0,1,8,16,9,2,3,10,17,24,32,25,18,11,4,5,12,19,26,33,40,48,41,34,27,20,13,6,7,14,21,28,35,42,49,56,57,50,43,36,29,22,15,23,30,37,44,51,58,59,52,45,38,31,39,46,53,60,61,54,47,55,62,63 };
+        __m256i r[2];
+        for (int i = 0; i < 64; i += 16) {
+            for (int k = 0; k < 2; k++) {
+                __m256i j = _mm256_i32gather_epi32(reinterpret_cast<const int *>(pSrc), _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s_zag32 + i + k * 8)), 4);
+                __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pQuant + i + k * 8));
+                __m256i sign = _mm256_srai_epi32(j, 31);
+                __m256i a = _mm256_add_epi32(_mm256_sub_epi32(_mm256_xor_si256(j, sign), sign), _mm256_srai_epi32(q, 1));
+                __m256i t = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(a), _mm256_cvtepi32_ps(q)));
+                r[k] = _mm256_sub_epi32(_mm256_xor_si256(t, sign), sign);
+            }
+            // packs works per 128-bit lane, put the four quadwords back in order.
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(r[0], r[1]), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(pDst + i), packed);
+        }
+    }
+
+    static const dsp_kernels s_sse2_kernels = { "sse2", fdct_sse2, quantize_sse2 };
+    static const dsp_kernels s_avx2_kernels = { "avx2", fdct_avx2, quantize_avx2 };
+#endif // JPGE_DSP_X86
+
+    const dsp_kernels *dsp_get_kernels(dsp_kernel_id_t id)
+    {
+        switch (id) {
+            case DSP_SCALAR:
+                return &s_scalar_kernels;
+#if JPGE_DSP_X86
+            case DSP_SSE2:
+                return __builtin_cpu_supports("sse2") ? &s_sse2_kernels : NULL;
+            case DSP_AVX2:
+                return __builtin_cpu_supports("avx2") ? &s_avx2_kernels : NULL;
+#endif
+            default:
+                return NULL;
+        }
+    }
+
+    static const dsp_kernels *dsp_best_kernels()
+    {
+        for (int id = DSP_KERNEL_COUNT - 1; id > DSP_SCALAR; id--) {
+            const dsp_kernels *k = dsp_get_kernels(static_cast<dsp_kernel_id_t>(id));
+            if (k) {
+                return k;
+            }
+        }
+        return &s_scalar_kernels;
+    }
+
+    const dsp_kernels *dsp_select_kernels()
+    {
+        static const dsp_kernels *s_selected = dsp_best_kernels();
+        return s_selected;
+    }
+
+} // namespace jpge
@@ -0,0 +1,48 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef _ESP_JPG_DECODE_ROM_H_
+#define _ESP_JPG_DECODE_ROM_H_
+
+#include "esp_jpg_decode.h"
+#include "esp_system.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The ESP32, ESP32-S3 and ESP32-C3 have TJpgDec in ROM. It decodes esp_jpg_decode() and esp_jpg_decode_ex(), the
+// JPEGs in memory always go to the software decoder in target/, which has the pixel formats, rectangles and
+// parallel intervals. The two decoders have different JDEC layouts, the ROM one is only used by esp_jpg_decode_rom.c.
+#if ESP_IDF_VERSION_MAJOR < 4 || CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S3 || CONFIG_IDF_TARGET_ESP32C3 \
+    || CONFIG_ESP_ROM_HAS_JPEG_DECODE
+#define ESP_JPG_DECODE_ROM 1
+#else
+#define ESP_JPG_DECODE_ROM 0
+#endif
+
+/**
+ * @brief Messages of the JRESULT codes, the same in both decoders
+ */
+extern const char * const esp_jpg_decode_errors[];
+
+/**
+ * @brief esp_jpg_decode_ex() with the decoder in ROM, only built when ESP_JPG_DECODE_ROM is set
+ */
+esp_err_t esp_jpg_decode_rom(size_t len, jpg_scale_t scale, jpg_reader_cb reader, jpg_writer_cb writer, void * arg, void * work, size_t work_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESP_JPG_DECODE_ROM_H_ */
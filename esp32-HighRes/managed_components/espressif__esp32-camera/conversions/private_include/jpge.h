@@ -4,6 +4,8 @@
 #ifndef JPEG_ENCODER_H
 #define JPEG_ENCODER_H
 
+#include <stddef.h>
+
 namespace jpge
 {
     typedef unsigned char  uint8;
@@ -12,13 +14,20 @@ namespace jpge
     typedef unsigned short uint16;
     typedef unsigned int   uint32;
     typedef unsigned int   uint;
+    typedef unsigned long long uint64;
 
     // JPEG chroma subsampling factors. Y_ONLY (grayscale images) and H2V2 (color images) are the most common.
     enum subsampling_t { Y_ONLY = 0, H1V1 = 1, H2V1 = 2, H2V2 = 3 };
 
+    // Huffman symbol frequencies of an image, indexed 0 = DC luma, 1 = DC chroma, 2 = AC luma, 3 = AC chroma.
+    // Counts of several slices of the same image can be summed to build one set of tables for all of them.
+    struct huffman_counts {
+        uint32 count[4][256];
+    };
+
     // JPEG compression parameters structure.
     struct params {
-            inline params() : m_quality(85), m_subsampling(H2V2) { }
+            inline params() : m_quality(85), m_subsampling(H2V2), m_restart_interval(0), m_two_pass_flag(false), m_pHuff_counts(NULL), m_out_buf_size(4096), m_pMcu_importance(NULL) { }
 
             inline bool check() const {
                 if ((m_quality < 1) || (m_quality > 100)) {
@@ -27,6 +36,15 @@ namespace jpge
                 if ((uint)m_subsampling > (uint)H2V2) {
                     return false;
                 }
+                if ((m_restart_interval < 0) || (m_restart_interval > 0xFFFF)) {
+                    return false;
+                }
+                if (m_two_pass_flag && m_pHuff_counts) {
+                    return false;
+                }
+                if ((m_out_buf_size < 16) || (m_out_buf_size > 0x100000)) {
+                    return false;
+                }
                 return true;
             }
 
@@ -39,10 +57,75 @@ namespace jpge
             // 2 = H2V1 subsampling (YCbCr 2x1x1, 4 blocks per MCU)
             // 3 = H2V2 subsampling (YCbCr 4x1x1, 6 blocks per MCU-- very common)
             subsampling_t m_subsampling;
+
+            // Number of MCUs between RSTn markers, 0 disables restart markers.
+            // Each restart interval can be entropy coded independently, see jpeg_encoder::init_slice().
+            int m_restart_interval;
+
+            // Disables (default) or enables two pass encoding. The first pass gathers the symbol statistics of
+            // the image and optimized Huffman tables are built from them, the second pass writes the file.
+            // The source must be fed once per pass, see jpeg_encoder::get_total_passes().
+            bool m_two_pass_flag;
+
+            // Single pass encoding with optimized Huffman tables built from these counts, typically the summed
+            // first pass counts of all slices of the image. Every symbol of the image must have a count.
+            // Only read by init(), may not be combined with m_two_pass_flag.
+            const huffman_counts *m_pHuff_counts;
+
+            // Size in bytes of the blocks handed to output_stream::put_buf(), 16 bytes - 1MB.
+            // Larger blocks mean fewer, cheaper calls to the sink at the cost of a larger heap buffer.
+            int m_out_buf_size;
+
+            // Optional importance of every MCU of the image, row by row (mcus per row * MCU rows bytes), NULL codes
+            // all of them alike. 255 codes an MCU normally, lower values drop more of its detail: fewer AC coefficients
+            // are kept and those are quantized coarser, down to only the average colour of each block at 0.
+            // The output stays baseline. The map must stay valid until the encoder is done.
+            const uint8 *m_pMcu_importance;
     };
+
+    // Source scanline formats. SRC_Y and SRC_RGB are the original channel counts 1 and 3.
+    // SRC_YUYV is limited range YUV 4:2:2 (Y0 U Y1 V), SRC_RGB565 is big endian, both as sent by the camera.
+    enum source_format_t { SRC_Y = 1, SRC_YUYV = 2, SRC_RGB = 3, SRC_BGR = 5, SRC_RGB565 = 6 };
+
+    // MCU dimensions in pixels for a given subsampling.
+    inline int mcu_width(subsampling_t subsampling) { return ((subsampling == H2V1) || (subsampling == H2V2)) ? 16 : 8; }
+    inline int mcu_height(subsampling_t subsampling) { return (subsampling == H2V2) ? 16 : 8; }
     
+    struct dsp_kernels;
+    struct header_block;
+
+    // Canonical Huffman code tables, indexed 0 = DC luma, 1 = DC chroma, 2 = AC luma, 3 = AC chroma.
+    // bits[] (17 entries, counts in 1..16) and val[] are the arrays emitted in the DHT segment.
+    struct huffman_tables {
+        uint codes[4][256];
+        uint8 code_sizes[4][256];
+        const uint8 *bits[4];
+        const uint8 *val[4];
+    };
+
+    // Frees the cached headers of finished encoders. Headers are cached per (width, height, quality, subsampling,
+    // restart interval) so a stream of frames sharing them only copies its header, see jpeg_encoder::init().
+    void clear_header_cache();
+
+    // Encoder stages timed by builds with JPGE_PROFILE defined. Colour conversion includes loading the 8x8 blocks,
+    // Huffman coding includes writing the output stream.
+    enum profile_stage_t { PROFILE_COLOUR = 0, PROFILE_DCT, PROFILE_QUANTIZE, PROFILE_HUFFMAN, PROFILE_STAGES };
+
+    struct profile_stats {
+        uint64 ns[PROFILE_STAGES];
+    };
+
+    // Starts (clearing the times so far) or stops timing the stages of all encoders. Encoders running at once on
+    // several tasks, e.g. the slices of a parallel encode, add their times up, so the totals are CPU time rather than
+    // elapsed time. An encode running while profiling starts may add a partial lap. Returns false if JPGE_PROFILE is
+    // not defined.
+    bool set_profiling(bool enable);
+
+    // Times gathered while profiling was on.
+    void get_profile(profile_stats *stats);
+
     // Output stream abstract class - used by the jpeg_encoder class to write to the output stream.
-    // put_buf() is generally called with len==JPGE_OUT_BUF_SIZE bytes, but for headers it'll be called with smaller amounts.
+    // put_buf() is generally called with len==params::m_out_buf_size bytes, but for headers it'll be called with smaller amounts.
     class output_stream {
         public:
             virtual ~output_stream() { };
@@ -60,53 +143,102 @@ namespace jpge
             // pStream: The stream object to use for writing compressed data.
             // params - Compression parameters structure, defined above.
             // width, height  - Image dimensions.
-            // channels - May be 1, or 3. 1 indicates grayscale, 3 indicates RGB source data.
+            // src_format - One of source_format_t, 1 indicates grayscale and 3 RGB source data.
             // Returns false on out of memory or if a stream write fails.
-            bool init(output_stream *pStream, int width, int height, int src_channels, const params &comp_params = params());
+            bool init(output_stream *pStream, int width, int height, int src_format, const params &comp_params = params());
+
+            // Initializes the compressor for one horizontal slice of the image, so slices can be encoded in parallel.
+            // The slice covers MCU rows first_mcu_row .. first_mcu_row + num_mcu_rows - 1 (num_mcu_rows 0 = up to the
+            // last row) and process_scanline() is only called with the scanlines of those rows.
+            // A slice not starting at row 0 must start on a restart interval boundary (comp_params.m_restart_interval).
+            // The first slice writes the headers and the last one the EOI marker, so the outputs of all slices
+            // concatenated in order form one complete JPEG file.
+            bool init_slice(output_stream *pStream, int width, int height, int src_format, const params &comp_params, int first_mcu_row, int num_mcu_rows);
+
+            // Initializes the compressor as one more rendition of the image pPrimary encodes, e.g. at another quality.
+            // pPrimary must be initialized, single pass, with no scanline fed yet. It converts the colours and runs the
+            // DCT of every block once, this encoder only quantizes and entropy codes the result into pStream.
+            // comp_params must have the subsampling of pPrimary and no two pass flag, its importance map is not used:
+            // the one of pPrimary applies to all renditions. Scanlines are only fed to pPrimary, which also finishes
+            // this encoder. It must stay initialized until pPrimary is finished or deinitialized.
+            bool init_rendition(output_stream *pStream, jpeg_encoder *pPrimary, const params &comp_params);
 
             // Call this method with each source scanline.
-            // width * src_channels bytes per scanline is expected (RGB or Y format).
+            // width * bytes per pixel of src_format bytes per scanline is expected.
             // You must call with NULL after all scanlines are processed to finish compression.
             // Returns false on out of memory or if a stream write fails.
             bool process_scanline(const void* pScanline);
 
+            // Processes num_scanlines consecutive scanlines stride bytes apart, typically a band of a frame buffer.
+            // Scanlines are read in place, no copy is made. Luma only images of SRC_YUYV sources are even coded
+            // straight from the Y bytes of the source for every MCU row that lies wholly within the band.
+            bool process_scanlines(const void* pFirst, int stride, int num_scanlines);
+
             // Deinitializes the compressor, freeing any allocated memory. May be called at any time.
             void deinit();
 
+            // With params::m_two_pass_flag all scanlines, followed by NULL, must be fed once per pass.
+            // Nothing is written to the stream during the first pass.
+            inline uint get_total_passes() const { return m_params.m_two_pass_flag ? 2 : 1; }
+            inline uint get_cur_pass() const { return m_pass_num; }
+
+            // Symbol counts gathered by the first pass, valid once it has been finished by process_scanline(NULL).
+            // NULL unless params::m_two_pass_flag is set.
+            const huffman_counts *get_huffman_counts() const;
+
         private:
             jpeg_encoder(const jpeg_encoder &);
             jpeg_encoder &operator =(const jpeg_encoder &);
 
             typedef int32 sample_array_t;
-            enum { JPGE_OUT_BUF_SIZE = 512 };
 
             output_stream *m_pStream;
             params m_params;
+            const dsp_kernels *m_dsp;
+            const huffman_tables *m_huff;
+            struct optimized_huffman;
+            optimized_huffman *m_pOpt_huff;
+            header_block *m_pHeader;
+            int32 m_quantization_tables[2][64];
             uint8 m_num_components;
             uint8 m_comp_h_samp[3], m_comp_v_samp[3];
+            source_format_t m_src_format;
             int m_image_x, m_image_y, m_image_bpp, m_image_bpl;
             int m_image_x_mcu, m_image_y_mcu;
             int m_image_bpl_xlt, m_image_bpl_mcu;
             int m_mcus_per_row;
             int m_mcu_x, m_mcu_y;
+            int m_mcu_row_num;
+            uint8 m_mcu_importance;
             uint8 *m_mcu_lines[16];
+            const uint8 *m_pYuyv_rows;
+            int m_yuyv_stride;
             uint8 m_mcu_y_ofs;
             sample_array_t m_sample_array[64];
             int16 m_coefficient_array[64];
 
             int m_last_dc_val[3];
-            uint8 m_out_buf[JPGE_OUT_BUF_SIZE];
+            uint8 *m_out_buf;
             uint8 *m_pOut_buf;
             uint m_out_buf_left;
-            uint32 m_bit_buffer;
+            uint64 m_bit_buffer;
             uint m_bits_in;
             uint8 m_pass_num;
+            int m_first_mcu_row, m_end_mcu_row, m_total_mcu_rows;
+            int m_mcus_to_restart;
+            uint8 m_next_restart_num;
             bool m_all_stream_writes_succeeded;
+            jpeg_encoder *m_pNext_rendition;
 
-            bool jpg_open(int p_x_res, int p_y_res, int src_channels);
+            bool jpg_open(int p_x_res, int p_y_res, int src_format, int first_mcu_row, int num_mcu_rows, bool line_buffer);
+            bool start_pass(uint8 pass_num);
+            void optimize_huffman_table(int table_num, int table_len);
+            void build_optimized_tables();
 
             void flush_output_buffer();
             void put_bits(uint bits, uint len);
+            void emit_coded_byte(uint8 c);
+            void flush_bits();
 
             void emit_byte(uint8 i);
             void emit_word(uint i);
@@ -115,23 +247,33 @@ namespace jpge
             void emit_jfif_app0();
             void emit_dqt();
             void emit_sof();
-            void emit_dht(uint8 *bits, uint8 *val, int index, bool ac_flag);
+            void emit_dht(const uint8 *bits, const uint8 *val, int index, bool ac_flag);
             void emit_dhts();
             void emit_sos();
+            void emit_markers();
+            void emit_header();
+            header_block *cache_header();
+            void emit_dri();
+            void emit_restart_if_due();
+            void begin_mcu(uint8 importance);
 
             void compute_quant_table(int32 *dst, const int16 *src);
-            void load_quantized_coefficients(int component_num);
 
             void load_block_8_8_grey(int x);
+            void load_block_8_8_yuyv_y(int x);
             void load_block_8_8(int x, int y, int c);
             void load_block_16_8(int x, int c);
             void load_block_16_8_8(int x, int c);
 
+            void code_coefficients_pass_one(int component_num);
             void code_coefficients_pass_two(int component_num);
+            void reduce_coefficients();
             void code_block(int component_num);
+            void code_dct_block(int component_num, const sample_array_t *pDct);
 
             void process_mcu_row();
             bool process_end_of_image();
+            void finish_output();
             void load_mcu(const void* src);
             void clear();
             void init();
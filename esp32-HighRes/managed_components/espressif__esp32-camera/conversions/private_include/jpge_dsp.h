@@ -0,0 +1,33 @@
+// jpge_dsp.h - Forward DCT and quantization kernels used by jpge::jpeg_encoder.
+// The scalar kernels are the reference; every other kernel set must produce bit-exact output.
+#ifndef JPEG_ENCODER_DSP_H
+#define JPEG_ENCODER_DSP_H
+
+#include "jpge.h"
+
+namespace jpge
+{
+    // In-place forward DCT of one 8x8 block of level shifted (-128..127) samples in raster order.
+    typedef void (*fdct_func_t)(int32 *pBlock);
+
+    // Quantizes a raster order DCT block into zigzag order coefficients.
+    // pQuant is the zigzag order quantization table, as emitted in the DQT segment.
+    typedef void (*quantize_func_t)(int16 *pDst, const int32 *pSrc, const int32 *pQuant);
+
+    enum dsp_kernel_id_t { DSP_SCALAR = 0, DSP_SSE2 = 1, DSP_AVX2 = 2, DSP_KERNEL_COUNT };
+
+    struct dsp_kernels {
+        const char *name;
+        fdct_func_t fdct;
+        quantize_func_t quantize;
+    };
+
+    // Returns the kernel set with the given id, or NULL if it is not built in or not supported by this CPU.
+    const dsp_kernels *dsp_get_kernels(dsp_kernel_id_t id);
+
+    // Returns the fastest kernel set supported by this CPU. The selection is made once, on first use.
+    const dsp_kernels *dsp_select_kernels();
+
+} // namespace jpge
+
+#endif // JPEG_ENCODER_DSP_H
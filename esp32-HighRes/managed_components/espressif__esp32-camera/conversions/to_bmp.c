@@ -13,6 +13,9 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 #include "img_converters.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
@@ -53,20 +56,9 @@ typedef struct {
         uint16_t width;
         uint16_t height;
         uint16_t data_offset;
-        const uint8_t *input;
         uint8_t *output;
 } rgb_jpg_decoder;
 
-static void *_malloc(size_t size)
-{
-    // check if SPIRAM is enabled and allocate on SPIRAM if allocatable
-#if (CONFIG_SPIRAM_SUPPORT && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
-    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-#endif
-    // try allocating in internal memory
-    return malloc(size);
-}
-
 //output buffer and image width
 static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
 {
@@ -78,7 +70,7 @@ static bool _rgb_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t
             jpeg->height = h;
             //if output is null, this is BMP
             if(!jpeg->output){
-                jpeg->output = (uint8_t *)_malloc((w*h*3)+jpeg->data_offset);
+                jpeg->output = (uint8_t *)img_buf_acquire((w*h*3)+jpeg->data_offset);
                 if(!jpeg->output){
                     return false;
                 }
@@ -121,7 +113,7 @@ static bool _rgb565_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16
             jpeg->height = h;
             //if output is null, this is BMP
             if(!jpeg->output){
-                jpeg->output = (uint8_t *)_malloc((w*h*3)+jpeg->data_offset);
+                jpeg->output = (uint8_t *)img_buf_acquire((w*h*3)+jpeg->data_offset);
                 if(!jpeg->output){
                     return false;
                 }
@@ -159,26 +151,100 @@ static bool _rgb565_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16
     return true;
 }
 
-//input buffer
-static unsigned int _jpg_read(void * arg, size_t index, uint8_t *buf, size_t len)
+// Start of a decode into a caller buffer, the writers below have no BMP variant
+static bool _plane_start(rgb_jpg_decoder * jpeg, uint16_t x, uint16_t y, uint16_t w, uint16_t h)
+{
+    if(x == 0 && y == 0){
+        jpeg->width = w;
+        jpeg->height = h;
+        return jpeg->output != NULL;
+    }
+    return true;
+}
+
+// Full range JFIF luma and chroma to the limited range of BT.601, as the sensor sends YUV
+static inline uint8_t _limited_y(uint8_t y)
+{
+    return 16 + ((y * 220 + 128) >> 8);
+}
+
+static inline uint8_t _limited_c(uint8_t c)
+{
+    return (c * 225 + 4096) >> 8;
+}
+
+static bool _gray_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
 {
     rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
-    if(buf) {
-        memcpy(buf, jpeg->input + index, len);
+    if(!data){
+        return _plane_start(jpeg, x, y, w, h);
     }
-    return len;
+
+    uint8_t *o = jpeg->output + (size_t)y * jpeg->width + x;
+    for(size_t iy=0; iy<h; iy++) {
+        memcpy(o, data, w);
+        o += jpeg->width;
+        data += w;
+    }
+    return true;
+}
+
+// YUYV: U from the Cb of the even pixel of each pair, V from the Cr of the odd one
+static bool _yuyv_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
+    if(!data){
+        return _plane_start(jpeg, x, y, w, h);
+    }
+
+    for(size_t iy=0; iy<h; iy++) {
+        uint8_t *o = jpeg->output + ((size_t)(y + iy) * jpeg->width + x) * 2;
+        for(size_t ix=0; ix<w; ix++, data+=3, o+=2) {
+            o[0] = _limited_y(data[0]);
+            o[1] = _limited_c(data[((x + ix) & 1) ? 2 : 1]);
+        }
+    }
+    return true;
 }
 
-static bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
+// Planar I420: chroma planes of ((width + 1) / 2) * ((height + 1) / 2), sampled at the even rows and columns
+static bool _yuv420_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
 {
+    rgb_jpg_decoder * jpeg = (rgb_jpg_decoder *)arg;
+    if(!data){
+        return _plane_start(jpeg, x, y, w, h);
+    }
+
+    size_t cw = (jpeg->width + 1) / 2;
+    uint8_t *py = jpeg->output;
+    uint8_t *pu = py + (size_t)jpeg->width * jpeg->height;
+    uint8_t *pv = pu + cw * ((jpeg->height + 1) / 2);
+    for(size_t iy=y; iy<(size_t)y+h; iy++) {
+        uint8_t *o = py + iy * jpeg->width + x;
+        for(size_t ix=x; ix<(size_t)x+w; ix++, data+=3) {
+            *o++ = _limited_y(data[0]);
+            if(!((ix | iy) & 1)) {
+                pu[(iy / 2) * cw + ix / 2] = _limited_c(data[1]);
+                pv[(iy / 2) * cw + ix / 2] = _limited_c(data[2]);
+            }
+        }
+    }
+    return true;
+}
+
+bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
+{
+    if(!out){
+        ESP_LOGE(TAG, "JPG output buffer is NULL");
+        return false;
+    }
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = out;
     jpeg.data_offset = 0;
 
-    if(esp_jpg_decode(src_len, scale, _jpg_read, _rgb_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem(src, src_len, scale, _rgb_write, (void*)&jpeg, NULL, 0) != ESP_OK){
         return false;
     }
     return true;
@@ -186,30 +252,311 @@ static bool jpg2rgb888(const uint8_t *src, size_t src_len, uint8_t * out, jpg_sc
 
 bool jpg2rgb565(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
 {
+    if(!out){
+        ESP_LOGE(TAG, "JPG output buffer is NULL");
+        return false;
+    }
+    rgb_jpg_decoder jpeg;
+    jpeg.width = 0;
+    jpeg.height = 0;
+    jpeg.output = out;
+    jpeg.data_offset = 0;
+
+    if(esp_jpg_decode_mem(src, src_len, scale, _rgb565_write, (void*)&jpeg, NULL, 0) != ESP_OK){
+        return false;
+    }
+    return true;
+}
+
+static bool jpg2plane(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale, jpg_output_t output, jpg_writer_cb writer)
+{
+    if(!out){
+        ESP_LOGE(TAG, "JPG output buffer is NULL");
+        return false;
+    }
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = out;
     jpeg.data_offset = 0;
 
-    if(esp_jpg_decode(src_len, scale, _jpg_read, _rgb565_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem_fmt(src, src_len, scale, output, writer, (void*)&jpeg, NULL, 0) != ESP_OK){
+        return false;
+    }
+    return true;
+}
+
+bool jpg2gray(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
+{
+    return jpg2plane(src, src_len, out, scale, JPG_OUT_GRAY, _gray_write);
+}
+
+bool jpg2yuv422(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
+{
+    return jpg2plane(src, src_len, out, scale, JPG_OUT_YCBCR, _yuyv_write);
+}
+
+bool jpg2yuv420(const uint8_t *src, size_t src_len, uint8_t * out, jpg_scale_t scale)
+{
+    return jpg2plane(src, src_len, out, scale, JPG_OUT_YCBCR, _yuv420_write);
+}
+
+// Decodes to one of the jpg2 formats, with the given workspace or a pooled one when work is NULL
+static bool _jpg2fmt_work(const uint8_t *src, size_t src_len, pixformat_t format, jpg_scale_t scale, uint8_t * out, void * work, size_t work_len, rgb_jpg_decoder *jpeg)
+{
+    jpg_output_t output;
+    jpg_writer_cb writer;
+    if(!out){
+        ESP_LOGE(TAG, "JPG output buffer is NULL");
+        return false;
+    }
+    switch(format) {
+    case PIXFORMAT_RGB888:
+        output = JPG_OUT_RGB888;
+        writer = _rgb_write;
+        break;
+    case PIXFORMAT_RGB565:
+        output = JPG_OUT_RGB888;
+        writer = _rgb565_write;
+        break;
+    case PIXFORMAT_GRAYSCALE:
+        output = JPG_OUT_GRAY;
+        writer = _gray_write;
+        break;
+    case PIXFORMAT_YUV422:
+        output = JPG_OUT_YCBCR;
+        writer = _yuyv_write;
+        break;
+    case PIXFORMAT_YUV420:
+        output = JPG_OUT_YCBCR;
+        writer = _yuv420_write;
+        break;
+    default:
+        ESP_LOGE(TAG, "JPEG can not be decoded to format %d", format);
+        return false;
+    }
+
+    jpeg->width = 0;
+    jpeg->height = 0;
+    jpeg->output = out;
+    jpeg->data_offset = 0;
+
+    if(esp_jpg_decode_mem_fmt(src, src_len, scale, output, writer, (void*)jpeg, work, work_len) != ESP_OK){
         return false;
     }
     return true;
 }
 
+bool jpg2fmt(const uint8_t *src, size_t src_len, pixformat_t format, jpg_scale_t scale, uint8_t * out)
+{
+    rgb_jpg_decoder jpeg;
+    return _jpg2fmt_work(src, src_len, format, scale, out, NULL, 0, &jpeg);
+}
+
+// The decode itself keeps about 1KB on the stack.
+#define JPG_BATCH_WORKER_STACK_SIZE 4096
+
+typedef struct {
+    jpg_batch_frame_t **order;  // frames by decreasing JPEG size
+    size_t num_frames;
+    size_t next_frame;
+    pixformat_t format;
+    jpg_scale_t scale;
+} jpg_batch_job_t;
+
+typedef struct {
+    pthread_t thread;
+    uint8_t index;              // 1 to UINT8_MAX - 1, the calling task is 0
+    unsigned batch;             // last batch seen
+    uint8_t work[ESP_JPG_DECODE_FAST_WORK_SIZE];  // decoder workspace, reused for every frame and batch
+} jpg_batch_worker_t;
+
+// Workers are started on the first batch that needs them and then wait for the next one, one batch runs at a time.
+static struct {
+    pthread_mutex_t call_lock;  // held for a whole batch
+    pthread_mutex_t lock;       // the fields below
+    pthread_cond_t start;
+    pthread_cond_t done;
+    jpg_batch_job_t *job;
+    unsigned batch;             // counts the batches
+    uint8_t workers;            // workers of the batch, the calling task included
+    int running;                // workers still decoding the batch
+    int started;                // workers started
+    jpg_batch_worker_t *worker[UINT8_MAX];  // worker[0] only holds the workspace of the calling task
+} s_batch = {
+    .call_lock = PTHREAD_MUTEX_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static int _larger_first(const void *a, const void *b)
+{
+    size_t la = (*(jpg_batch_frame_t * const *)a)->src_len;
+    size_t lb = (*(jpg_batch_frame_t * const *)b)->src_len;
+    return la < lb ? 1 : (la > lb ? -1 : 0);
+}
+
+static void decode_batch_frames(jpg_batch_job_t *job, uint8_t *work)
+{
+    size_t n;
+
+    while((n = __atomic_fetch_add(&job->next_frame, 1, __ATOMIC_RELAXED)) < job->num_frames){
+        jpg_batch_frame_t *frame = job->order[n];
+        rgb_jpg_decoder jpeg;
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        // a NULL output would make the RGB888 writer allocate one, as for a BMP
+        frame->ok = frame->out && _jpg2fmt_work(frame->src, frame->src_len, job->format, job->scale, frame->out,
+                                                work, ESP_JPG_DECODE_FAST_WORK_SIZE, &jpeg);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        frame->width = frame->ok ? jpeg.width : 0;
+        frame->height = frame->ok ? jpeg.height : 0;
+        frame->decode_us = (uint32_t)((end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+    }
+}
+
+static void *decode_batch_task(void *arg)
+{
+    jpg_batch_worker_t *worker = (jpg_batch_worker_t *)arg;
+
+    pthread_mutex_lock(&s_batch.lock);
+    while(true){
+        while(worker->batch == s_batch.batch){
+            pthread_cond_wait(&s_batch.start, &s_batch.lock);
+        }
+        worker->batch = s_batch.batch;
+        if(worker->index >= s_batch.workers){
+            // not needed for this batch, s_batch.job may be gone already
+            continue;
+        }
+        jpg_batch_job_t *job = s_batch.job;
+        pthread_mutex_unlock(&s_batch.lock);
+        decode_batch_frames(job, worker->work);
+        pthread_mutex_lock(&s_batch.lock);
+        if(--s_batch.running == 0){
+            pthread_cond_signal(&s_batch.done);
+        }
+    }
+    return NULL;
+}
+
+// Allocates the workspaces and starts the workers missing for a batch. Returns how many can decode it.
+static uint8_t start_batch_workers(uint8_t workers)
+{
+    if(!s_batch.worker[0]){
+        s_batch.worker[0] = (jpg_batch_worker_t *)malloc(sizeof(jpg_batch_worker_t));
+        if(!s_batch.worker[0]){
+            return 0;
+        }
+    }
+    if(s_batch.started + 1 >= workers){
+        return workers;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // may fail where the minimum stack is larger, the default size is fine there
+    pthread_attr_setstacksize(&attr, JPG_BATCH_WORKER_STACK_SIZE);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while(s_batch.started + 1 < workers){
+        uint8_t i = s_batch.started + 1;
+        jpg_batch_worker_t *worker = (jpg_batch_worker_t *)malloc(sizeof(jpg_batch_worker_t));
+        if(!worker){
+            break;
+        }
+        worker->index = i;
+        worker->batch = s_batch.batch;
+        if(pthread_create(&worker->thread, &attr, decode_batch_task, worker) != 0){
+            free(worker);
+            break;
+        }
+        s_batch.worker[i] = worker;
+        s_batch.started = i;
+    }
+    pthread_attr_destroy(&attr);
+    if(s_batch.started + 1 < workers){
+        ESP_LOGW(TAG, "JPG batch decodes on %d of %d tasks", s_batch.started + 1, workers);
+    }
+    return s_batch.started + 1;
+}
+
+bool jpg2fmt_batch(jpg_batch_frame_t *frames, size_t num_frames, pixformat_t format, jpg_scale_t scale, uint8_t workers)
+{
+    if(!frames || !num_frames){
+        return false;
+    }
+    if(workers < 1){
+        workers = 1;
+    }
+    if(workers > num_frames){
+        workers = num_frames;
+    }
+
+    size_t buf_len = num_frames * sizeof(jpg_batch_frame_t *);
+    jpg_batch_frame_t **order = (jpg_batch_frame_t **)img_buf_acquire(buf_len);
+    if(!order){
+        ESP_LOGE(TAG, "img_buf_acquire failed! %u", (unsigned)buf_len);
+        return false;
+    }
+    jpg_batch_job_t job;
+    job.order = order;
+    job.num_frames = num_frames;
+    job.next_frame = 0;
+    job.format = format;
+    job.scale = scale;
+    for(size_t i=0; i<num_frames; i++){
+        order[i] = &frames[i];
+    }
+    // the largest last would leave the other tasks idle while it decodes
+    qsort(order, num_frames, sizeof(order[0]), _larger_first);
+
+    pthread_mutex_lock(&s_batch.call_lock);
+    workers = start_batch_workers(workers);
+    if(!workers){
+        pthread_mutex_unlock(&s_batch.call_lock);
+        img_buf_release(order, buf_len);
+        ESP_LOGE(TAG, "JPG batch workspace could not be allocated");
+        return false;
+    }
+    if(workers > 1){
+        pthread_mutex_lock(&s_batch.lock);
+        s_batch.job = &job;
+        s_batch.workers = workers;
+        s_batch.running = workers - 1;
+        s_batch.batch++;
+        pthread_cond_broadcast(&s_batch.start);
+        pthread_mutex_unlock(&s_batch.lock);
+    }
+    decode_batch_frames(&job, s_batch.worker[0]->work);
+    if(workers > 1){
+        pthread_mutex_lock(&s_batch.lock);
+        while(s_batch.running){
+            pthread_cond_wait(&s_batch.done, &s_batch.lock);
+        }
+        s_batch.job = NULL;
+        pthread_mutex_unlock(&s_batch.lock);
+    }
+    pthread_mutex_unlock(&s_batch.call_lock);
+    img_buf_release(order, buf_len);
+
+    bool ok = true;
+    for(size_t i=0; i<num_frames; i++){
+        ok = ok && frames[i].ok;
+    }
+    return ok;
+}
+
 bool jpg2bmp(const uint8_t *src, size_t src_len, uint8_t ** out, size_t * out_len)
 {
 
     rgb_jpg_decoder jpeg;
     jpeg.width = 0;
     jpeg.height = 0;
-    jpeg.input = src;
     jpeg.output = NULL;
     jpeg.data_offset = BMP_HEADER_LEN;
 
-    if(esp_jpg_decode(src_len, JPG_SCALE_NONE, _jpg_read, _rgb_write, (void*)&jpeg) != ESP_OK){
+    if(esp_jpg_decode_mem(src, src_len, JPG_SCALE_NONE, _rgb_write, (void*)&jpeg, NULL, 0) != ESP_OK){
+        img_buf_release(jpeg.output, (jpeg.width*jpeg.height*3)+jpeg.data_offset);
         return false;
     }
 
@@ -309,9 +656,9 @@ bool fmt2bmp(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixf
     int bpp = (format == PIXFORMAT_GRAYSCALE) ? 1 : 3;
     int palette_size = (format == PIXFORMAT_GRAYSCALE) ? 4 * 256 : 0;
     size_t out_size = (pix_count * bpp) + BMP_HEADER_LEN + palette_size;
-    uint8_t * out_buf = (uint8_t *)_malloc(out_size);
+    uint8_t * out_buf = (uint8_t *)img_buf_acquire(out_size);
     if(!out_buf) {
-        ESP_LOGE(TAG, "_malloc failed! %u", out_size);
+        ESP_LOGE(TAG, "img_buf_acquire failed! %u", (unsigned)out_size);
         return false;
     }
 
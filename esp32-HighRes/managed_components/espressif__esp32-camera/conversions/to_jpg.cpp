@@ -13,13 +13,15 @@
 // limitations under the License.
 #include <stddef.h>
 #include <string.h>
+#include <math.h>
+#include <new>
+#include <pthread.h>
 #include "esp_attr.h"
 #include "soc/efuse_reg.h"
 #include "esp_heap_caps.h"
 #include "esp_camera.h"
 #include "img_converters.h"
 #include "jpge.h"
-#include "yuv.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -29,73 +31,95 @@
 static const char* TAG = "to_jpg";
 #endif
 
-static void *_malloc(size_t size)
+// Source image as the encoder reads it, in place from the frame buffer.
+typedef struct {
+    const uint8_t *base;    // first pixel of the (cropped) image
+    size_t stride;          // bytes from one row to the next
+    uint16_t width, height;
+    int src_format;         // jpge::source_format_t
+} jpg_source_t;
+
+// jpge::source_format_t and bytes per pixel of a frame format.
+static bool jpg_source_format(pixformat_t format, int *src_format, size_t *bpp)
 {
-    void * res = malloc(size);
-    if(res) {
-        return res;
+    switch (format) {
+        case PIXFORMAT_GRAYSCALE: *src_format = jpge::SRC_Y; *bpp = 1; break;
+        case PIXFORMAT_YUV422: *src_format = jpge::SRC_YUYV; *bpp = 2; break;
+        case PIXFORMAT_RGB565: *src_format = jpge::SRC_RGB565; *bpp = 2; break;
+        case PIXFORMAT_RGB888: *src_format = jpge::SRC_BGR; *bpp = 3; break;
+        default:
+            ESP_LOGE(TAG, "Format %d is not supported", format);
+            return false;
     }
+    return true;
+}
 
-    // check if SPIRAM is enabled and is allocatable
-#if (CONFIG_SPIRAM_SUPPORT && (CONFIG_SPIRAM_USE_CAPS_ALLOC || CONFIG_SPIRAM_USE_MALLOC))
-    return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-#endif
-    return NULL;
+static bool jpg_source_init(jpg_source_t *source, uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config)
+{
+    size_t bpp;
+    if (!jpg_source_format(format, &source->src_format, &bpp)) {
+        return false;
+    }
+
+    const jpg_rect_t *crop = &config->crop;
+    source->stride = config->stride ? config->stride : width * bpp;
+    source->width = crop->width ? crop->width : width - crop->x;
+    source->height = crop->height ? crop->height : height - crop->y;
+    if (!src || crop->x >= width || crop->y >= height || source->width > width - crop->x || source->height > height - crop->y) {
+        ESP_LOGE(TAG, "Crop %ux%u at %u,%u is outside the %ux%u frame", source->width, source->height, crop->x, crop->y, width, height);
+        return false;
+    }
+    if (format == PIXFORMAT_YUV422 && (crop->x & 1)) {
+        ESP_LOGE(TAG, "YUV422 crop must start on an even column");
+        return false;
+    }
+    if (source->stride < width * bpp || src_len < (crop->y + source->height - 1) * source->stride + (crop->x + source->width) * bpp) {
+        ESP_LOGE(TAG, "Source buffer of %u bytes is too small", (unsigned)src_len);
+        return false;
+    }
+    source->base = src + crop->y * source->stride + crop->x * bpp;
+    return true;
 }
 
-static IRAM_ATTR void convert_line_format(uint8_t * src, pixformat_t format, uint8_t * dst, size_t width, size_t in_channels, size_t line)
+// Feeds source rows first_line .. end_line - 1 to the encoder, straight from the frame buffer, and finishes the pass.
+static bool encode_pass(jpge::jpeg_encoder &dst_image, const jpg_source_t *source, int first_line, int end_line)
 {
-    int i=0, o=0, l=0;
-    if(format == PIXFORMAT_GRAYSCALE) {
-        memcpy(dst, src + line * width, width);
-    } else if(format == PIXFORMAT_RGB888) {
-        l = width * 3;
-        src += l * line;
-        for(i=0; i<l; i+=3) {
-            dst[o++] = src[i+2];
-            dst[o++] = src[i+1];
-            dst[o++] = src[i];
-        }
-    } else if(format == PIXFORMAT_RGB565) {
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=2) {
-            dst[o++] = src[i] & 0xF8;
-            dst[o++] = (src[i] & 0x07) << 5 | (src[i+1] & 0xE0) >> 3;
-            dst[o++] = (src[i+1] & 0x1F) << 3;
-        }
-    } else if(format == PIXFORMAT_YUV422) {
-        uint8_t y0, y1, u, v;
-        uint8_t r, g, b;
-        l = width * 2;
-        src += l * line;
-        for(i=0; i<l; i+=4) {
-            y0 = src[i];
-            u = src[i+1];
-            y1 = src[i+2];
-            v = src[i+3];
+    if (!dst_image.process_scanlines(source->base + first_line * source->stride, source->stride, end_line - first_line)) {
+        ESP_LOGE(TAG, "JPG process lines %d-%d failed", first_line, end_line - 1);
+        return false;
+    }
 
-            yuv2rgb(y0, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
+    if (!dst_image.process_scanline(NULL)) {
+        ESP_LOGE(TAG, "JPG image finish failed");
+        return false;
+    }
+    return true;
+}
 
-            yuv2rgb(y1, u, v, &r, &g, &b);
-            dst[o++] = r;
-            dst[o++] = g;
-            dst[o++] = b;
+// Runs all passes of the encoder over source rows first_line .. end_line - 1 and finishes it.
+static bool encode_lines(jpge::jpeg_encoder &dst_image, const jpg_source_t *source, int first_line, int end_line)
+{
+    for (jpge::uint pass = 0; pass < dst_image.get_total_passes(); pass++) {
+        if (!encode_pass(dst_image, source, first_line, end_line)) {
+            return false;
         }
     }
+    dst_image.deinit();
+    return true;
 }
 
-bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpge::output_stream *dst_stream)
+static void jpg_encoder_params(pixformat_t format, const jpg_encode_config_t *config, jpge::params *comp_params)
 {
-    int num_channels = 3;
-    jpge::subsampling_t subsampling = jpge::H2V2;
+    uint8_t quality = config->quality;
 
-    if(format == PIXFORMAT_GRAYSCALE) {
-        num_channels = 1;
-        subsampling = jpge::Y_ONLY;
+    switch (config->subsampling) {
+        case JPG_SUBSAMPLING_444: comp_params->m_subsampling = jpge::H1V1; break;
+        case JPG_SUBSAMPLING_422: comp_params->m_subsampling = jpge::H2V1; break;
+        default: comp_params->m_subsampling = jpge::H2V2; break;
+    }
+
+    if(format == PIXFORMAT_GRAYSCALE || config->grayscale) {
+        comp_params->m_subsampling = jpge::Y_ONLY;
     }
 
     if(!quality) {
@@ -103,40 +127,395 @@ bool convert_image(uint8_t *src, uint16_t width, uint16_t height, pixformat_t fo
     } else if(quality > 100) {
         quality = 100;
     }
+    comp_params->m_quality = quality;
+    comp_params->m_two_pass_flag = config->optimize_huffman;
+    if (config->out_block_size) {
+        comp_params->m_out_buf_size = config->out_block_size;
+    }
+}
 
-    jpge::params comp_params = jpge::params();
-    comp_params.m_subsampling = subsampling;
-    comp_params.m_quality = quality;
+// Bytes of the importance map of an image, one per MCU.
+static size_t jpg_importance_map_size(const jpg_source_t *source, jpge::subsampling_t subsampling)
+{
+    int mcu_x = jpge::mcu_width(subsampling), mcu_y = jpge::mcu_height(subsampling);
+    return ((source->width + mcu_x - 1) / mcu_x) * ((source->height + mcu_y - 1) / mcu_y);
+}
 
-    jpge::jpeg_encoder dst_image;
+// Importance of every MCU of the image for config->rois: 255 inside any of them, config->roi_background elsewhere.
+// Release with img_buf_release(map, jpg_importance_map_size()).
+static uint8_t *jpg_importance_map(const jpg_source_t *source, const jpg_encode_config_t *config, jpge::subsampling_t subsampling)
+{
+    if (!config->rois) {
+        ESP_LOGE(TAG, "JPG regions of interest missing");
+        return NULL;
+    }
+    int mcu_x = jpge::mcu_width(subsampling), mcu_y = jpge::mcu_height(subsampling);
+    int mcus_per_row = (source->width + mcu_x - 1) / mcu_x;
+    size_t size = jpg_importance_map_size(source, subsampling);
+    uint8_t *importance = (uint8_t *)img_buf_acquire(size);
+    if (!importance) {
+        ESP_LOGE(TAG, "JPG importance map malloc failed");
+        return NULL;
+    }
+    memset(importance, config->roi_background, size);
+    for (int r = 0; r < config->num_rois; r++) {
+        const jpg_rect_t *roi = &config->rois[r];
+        if (!roi->width || !roi->height || roi->x >= source->width || roi->y >= source->height) {
+            continue;
+        }
+        int x_end = (roi->x + roi->width < source->width) ? roi->x + roi->width : source->width;
+        int y_end = (roi->y + roi->height < source->height) ? roi->y + roi->height : source->height;
+        for (int my = roi->y / mcu_y; my <= (y_end - 1) / mcu_y; my++) {
+            memset(importance + my * mcus_per_row + roi->x / mcu_x, 255, (x_end - 1) / mcu_x - roi->x / mcu_x + 1);
+        }
+    }
+    return importance;
+}
 
-    if (!dst_image.init(dst_stream, width, height, num_channels, comp_params)) {
-        ESP_LOGE(TAG, "JPG encoder init failed");
+// First and largest chunk sizes of a chunk_stream: small frames waste little, large ones need few allocations.
+#define JPG_CHUNK_MIN_SIZE (4 * 1024)
+#define JPG_CHUNK_MAX_SIZE (32 * 1024)
+
+// Encoded bytes kept in a chain of chunks, so memory use follows the size of the JPEG without ever moving it.
+class chunk_stream : public jpge::output_stream {
+protected:
+    struct chunk_t {
+        chunk_t *next;
+        size_t len, cap;
+        uint8_t *data() { return reinterpret_cast<uint8_t *>(this + 1); }
+    };
+    chunk_t *head, *tail;
+    size_t index;
+    size_t first_cap;
+
+public:
+    static const size_t CHUNK_HEADER_SIZE = sizeof(chunk_t);
+
+    chunk_stream(size_t first_size = JPG_CHUNK_MIN_SIZE) : head(NULL), tail(NULL), index(0), first_cap(first_size) { }
+    virtual ~chunk_stream()
+    {
+        while (head) {
+            chunk_t *next = head->next;
+            img_buf_release(head, sizeof(chunk_t) + head->cap);
+            head = next;
+        }
+    }
+
+    // Capacity of the first chunk, set before anything is written.
+    void set_first_size(size_t size)
+    {
+        first_cap = size;
+    }
+
+    virtual bool put_buf(const void* data, int len)
+    {
+        if (!data) {
+            return true;
+        }
+        const uint8_t *src = static_cast<const uint8_t *>(data);
+        while (len) {
+            if (!tail || tail->len == tail->cap) {
+                size_t cap = first_cap;
+                if (tail) {
+                    cap = tail->cap * 2 > JPG_CHUNK_MAX_SIZE ? JPG_CHUNK_MAX_SIZE : tail->cap * 2;
+                }
+                chunk_t *chunk = (chunk_t *)img_buf_acquire(sizeof(chunk_t) + cap);
+                if (!chunk && cap > JPG_CHUNK_MIN_SIZE) {
+                    // an estimated first chunk may not fit the heap, the JPEG may still fit in smaller ones
+                    cap = JPG_CHUNK_MIN_SIZE;
+                    chunk = (chunk_t *)img_buf_acquire(sizeof(chunk_t) + cap);
+                }
+                if (!chunk) {
+                    ESP_LOGE(TAG, "JPG output chunk malloc failed");
+                    return false;
+                }
+                chunk->next = NULL;
+                chunk->len = 0;
+                chunk->cap = cap;
+                if (tail) {
+                    tail->next = chunk;
+                } else {
+                    head = chunk;
+                }
+                tail = chunk;
+            }
+            size_t n = tail->cap - tail->len;
+            if (n > (size_t)len) {
+                n = len;
+            }
+            memcpy(tail->data() + tail->len, src, n);
+            tail->len += n;
+            index += n;
+            src += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    virtual jpge::uint get_size() const
+    {
+        return index;
+    }
+
+    // Writes all bytes to dst, without ending its image.
+    bool write_to(jpge::output_stream *dst) const
+    {
+        for (chunk_t *chunk = head; chunk; chunk = chunk->next) {
+            if (!dst->put_buf(chunk->data(), chunk->len)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Copies all bytes to dst, which holds at least get_size() bytes.
+    void copy_to(uint8_t *dst) const
+    {
+        for (chunk_t *chunk = head; chunk; chunk = chunk->next) {
+            memcpy(dst, chunk->data(), chunk->len);
+            dst += chunk->len;
+        }
+    }
+
+    // Hands all bytes out in one buffer of the pool, which the caller owns. A single chunk is moved to the start of
+    // its own buffer and shrunk, without a second buffer; several are copied into a new one. NULL on out of memory.
+    uint8_t *take()
+    {
+        if (head && !head->next) {
+            size_t size = sizeof(chunk_t) + head->cap;
+            uint8_t *buf = reinterpret_cast<uint8_t *>(head);
+            memmove(buf, head->data(), index);
+            head = tail = NULL;
+            return (uint8_t *)img_buf_shrink_to(buf, size, index);
+        }
+        uint8_t *buf = (uint8_t *)img_buf_acquire(index);
+        if (buf) {
+            copy_to(buf);
+        }
+        return buf;
+    }
+};
+
+// Slices per worker: more, smaller slices balance the load when some image regions compress slower than others.
+#define JPG_SLICES_PER_WORKER 4
+// The encoder keeps about 1.2KB of state on the stack.
+#define JPG_WORKER_STACK_SIZE 6144
+
+typedef struct {
+    jpg_source_t source;
+    jpge::params comp_params;
+    int mcu_rows, mcu_rows_per_slice, num_slices;
+    int next_slice;
+    bool failed;
+    chunk_stream *slices;
+    jpge::huffman_counts *counts;   // when set, only the first pass is run and each slice's symbol counts are kept
+} jpg_slice_job_t;
+
+// Discards the output of first pass encoders, which write nothing.
+class null_stream : public jpge::output_stream {
+public:
+    virtual bool put_buf(const void*, int)
+    {
+        return true;
+    }
+    virtual jpge::uint get_size() const
+    {
+        return 0;
+    }
+};
+
+static void *encode_slices_task(void *arg)
+{
+    jpg_slice_job_t *job = (jpg_slice_job_t *)arg;
+    int mcu_y = jpge::mcu_height(job->comp_params.m_subsampling);
+    int n;
+
+    while ((n = __atomic_fetch_add(&job->next_slice, 1, __ATOMIC_RELAXED)) < job->num_slices) {
+        if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+            break;
+        }
+        int first_mcu_row = n * job->mcu_rows_per_slice;
+        int num_mcu_rows = job->mcu_rows - first_mcu_row;
+        if (num_mcu_rows > job->mcu_rows_per_slice) {
+            num_mcu_rows = job->mcu_rows_per_slice;
+        }
+        int end_line = (first_mcu_row + num_mcu_rows) * mcu_y;
+        if (end_line > job->source.height) {
+            end_line = job->source.height;
+        }
+
+        jpge::jpeg_encoder dst_image;
+        if (job->counts) {
+            null_stream count_stream;
+            if (!dst_image.init_slice(&count_stream, job->source.width, job->source.height, job->source.src_format, job->comp_params, first_mcu_row, num_mcu_rows)) {
+                ESP_LOGE(TAG, "JPG encoder init failed");
+                __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+                break;
+            }
+            if (!encode_pass(dst_image, &job->source, first_mcu_row * mcu_y, end_line)) {
+                __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+                break;
+            }
+            job->counts[n] = *dst_image.get_huffman_counts();
+            continue;
+        }
+        if (!dst_image.init_slice(&job->slices[n], job->source.width, job->source.height, job->source.src_format, job->comp_params, first_mcu_row, num_mcu_rows)) {
+            ESP_LOGE(TAG, "JPG encoder init failed");
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+        if (!encode_lines(dst_image, &job->source, first_mcu_row * mcu_y, end_line)) {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Runs encode_slices_task() on `workers` tasks, the calling one included, until all slices of the job are done.
+static void run_slice_workers(jpg_slice_job_t *job, pthread_t *threads, int workers)
+{
+    job->next_slice = 0;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    // may fail where the minimum stack is larger, the default size is fine there
+    pthread_attr_setstacksize(&attr, JPG_WORKER_STACK_SIZE);
+    int started = 0;
+    for (int i = 1; i < workers; i++) {
+        if (pthread_create(&threads[i], &attr, encode_slices_task, job) != 0) {
+            ESP_LOGW(TAG, "JPG worker %d could not be started", i);
+            break;
+        }
+        started = i;
+    }
+    pthread_attr_destroy(&attr);
+
+    encode_slices_task(job);
+    for (int i = 1; i <= started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+// Splits the image into horizontal slices separated by restart markers, encodes them on `workers` tasks
+// (the calling one included) and writes them to dst_stream in order.
+static bool convert_image_parallel(const jpg_source_t *source, const jpge::params *comp_params, int workers, jpge::output_stream *dst_stream)
+{
+    jpg_slice_job_t job;
+    job.source = *source;
+    job.comp_params = *comp_params;
+
+    int mcus_per_row = (source->width + jpge::mcu_width(job.comp_params.m_subsampling) - 1) / jpge::mcu_width(job.comp_params.m_subsampling);
+    job.mcu_rows = (source->height + jpge::mcu_height(job.comp_params.m_subsampling) - 1) / jpge::mcu_height(job.comp_params.m_subsampling);
+    int num_slices = workers * JPG_SLICES_PER_WORKER;
+    if (num_slices > job.mcu_rows) {
+        num_slices = job.mcu_rows;
+    }
+    job.mcu_rows_per_slice = (job.mcu_rows + num_slices - 1) / num_slices;
+    // DRI holds the restart interval in 16 bits
+    if (job.mcu_rows_per_slice * mcus_per_row > 0xFFFF) {
+        job.mcu_rows_per_slice = 0xFFFF / mcus_per_row;
+    }
+    job.num_slices = (job.mcu_rows + job.mcu_rows_per_slice - 1) / job.mcu_rows_per_slice;
+    job.comp_params.m_restart_interval = job.mcu_rows_per_slice * mcus_per_row;
+    job.failed = false;
+    job.counts = NULL;
+
+    job.slices = new (std::nothrow) chunk_stream[job.num_slices];
+    if (!job.slices) {
+        ESP_LOGE(TAG, "JPG slice array malloc failed");
         return false;
     }
 
-    uint8_t* line = (uint8_t*)_malloc(width * num_channels);
-    if(!line) {
-        ESP_LOGE(TAG, "Scan line malloc failed");
+    if (workers > job.num_slices) {
+        workers = job.num_slices;
+    }
+    pthread_t *threads = (pthread_t *)calloc(workers, sizeof(pthread_t));
+    if (!threads) {
+        ESP_LOGE(TAG, "JPG worker array malloc failed");
+        delete[] job.slices;
         return false;
     }
 
-    for (int i = 0; i < height; i++) {
-        convert_line_format(src, format, line, width, num_channels, i);
-        if (!dst_image.process_scanline(line)) {
-            ESP_LOGE(TAG, "JPG process line %u failed", i);
-            free(line);
+    // Optimized Huffman tables: every slice is counted first, then all slices are coded with tables built
+    // from the summed counts, as the tables are only written once in the headers of the first slice.
+    jpge::huffman_counts *slice_counts = NULL;
+    if (job.comp_params.m_two_pass_flag) {
+        // one entry per slice, followed by the sum
+        slice_counts = (jpge::huffman_counts *)img_buf_acquire((job.num_slices + 1) * sizeof(jpge::huffman_counts));
+        if (!slice_counts) {
+            ESP_LOGE(TAG, "JPG slice counts malloc failed");
+            free(threads);
+            delete[] job.slices;
             return false;
         }
+        job.counts = slice_counts;
+        run_slice_workers(&job, threads, workers);
+        jpge::huffman_counts *total = &slice_counts[job.num_slices];
+        memset(total, 0, sizeof(*total));
+        for (int n = 0; n < job.num_slices; n++) {
+            for (int t = 0; t < 4; t++) {
+                for (int i = 0; i < 256; i++) {
+                    total->count[t][i] += slice_counts[n].count[t][i];
+                }
+            }
+        }
+        job.counts = NULL;
+        job.comp_params.m_two_pass_flag = false;
+        job.comp_params.m_pHuff_counts = total;
     }
-    free(line);
+    if (!job.failed) {
+        run_slice_workers(&job, threads, workers);
+    }
+    img_buf_release(slice_counts, (job.num_slices + 1) * sizeof(jpge::huffman_counts));
+    free(threads);
 
-    if (!dst_image.process_scanline(NULL)) {
-        ESP_LOGE(TAG, "JPG image finish failed");
+    bool ok = !job.failed;
+    for (int i = 0; ok && i < job.num_slices; i++) {
+        ok = job.slices[i].write_to(dst_stream);
+    }
+    if (ok) {
+        ok = dst_stream->put_buf(NULL, 0);
+    }
+    delete[] job.slices;
+    return ok;
+}
+
+static bool convert_image_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpge::output_stream *dst_stream)
+{
+    if (!config) {
+        ESP_LOGE(TAG, "JPG encoder config missing");
         return false;
     }
-    dst_image.deinit();
-    return true;
+    jpg_source_t source;
+    if (!jpg_source_init(&source, src, src_len, width, height, format, config)) {
+        return false;
+    }
+
+    jpge::params comp_params = jpge::params();
+    jpg_encoder_params(format, config, &comp_params);
+    uint8_t *importance = NULL;
+    if (config->num_rois) {
+        if (!(importance = jpg_importance_map(&source, config, comp_params.m_subsampling))) {
+            return false;
+        }
+        comp_params.m_pMcu_importance = importance;
+    }
+
+    bool ok;
+    if (config->workers > 1) {
+        ok = convert_image_parallel(&source, &comp_params, config->workers, dst_stream);
+    } else {
+        jpge::jpeg_encoder dst_image;
+        ok = dst_image.init(dst_stream, source.width, source.height, source.src_format, comp_params);
+        if (!ok) {
+            ESP_LOGE(TAG, "JPG encoder init failed");
+        } else {
+            ok = encode_lines(dst_image, &source, 0, source.height);
+        }
+    }
+    img_buf_release(importance, jpg_importance_map_size(&source, comp_params.m_subsampling));
+    return ok;
 }
 
 class callback_stream : public jpge::output_stream {
@@ -146,14 +525,14 @@ protected:
     size_t index;
 
 public:
-    callback_stream(jpg_out_cb cb, void * arg) : ocb(cb), oarg(arg), index(0) { }
+    callback_stream(jpg_out_cb cb = NULL, void * arg = NULL) : ocb(cb), oarg(arg), index(0) { }
     virtual ~callback_stream() { }
     virtual bool put_buf(const void* data, int len)
     {
         index += ocb(oarg, index, data, len);
         return true;
     }
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
@@ -161,8 +540,9 @@ public:
 
 bool fmt2jpg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, jpg_out_cb cb, void * arg)
 {
-    callback_stream dst_stream(cb, arg);
-    return convert_image(src, width, height, format, quality, &dst_stream);
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+    return fmt2jpg_cb_ex(src, src_len, width, height, format, &config, cb, arg);
 }
 
 bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
@@ -170,17 +550,136 @@ bool frame2jpg_cb(camera_fb_t * fb, uint8_t quality, jpg_out_cb cb, void * arg)
     return fmt2jpg_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, cb, arg);
 }
 
+bool fmt2jpg_cb_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_out_cb cb, void * arg)
+{
+    callback_stream dst_stream(cb, arg);
+    return convert_image_ex(src, src_len, width, height, format, config, &dst_stream);
+}
+
+bool frame2jpg_cb_ex(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_out_cb cb, void * arg)
+{
+    return fmt2jpg_cb_ex(fb->buf, fb->len, fb->width, fb->height, fb->format, config, cb, arg);
+}
+
+
+
+// Frame size is modelled as scale^-exponent, see jpg_rc_predict(). Measured exponents range from about 0.4
+// (noisy scenes) to 1.2 (flat scenes at high quality); two encodes of one frame measure it for that frame.
+#define JPG_RC_DEFAULT_EXPONENT 0.75f
+#define JPG_RC_MIN_EXPONENT 0.25f
+#define JPG_RC_MAX_EXPONENT 1.5f
+
+// Quantization table scale in percent, as jpge derives it from the quality.
+static int jpg_quality_scale(int quality)
+{
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    return scale < 1 ? 1 : scale;
+}
+
+// Camera frames take about 1.5 bits per pixel at quality 50, until a JPEG of the same size and quality was made.
+#define JPG_ESTIMATE_BITS_AT_50 1.5f
+// Sizes of the last JPEGs returned in a buffer, by resolution and quality.
+#define JPG_SIZE_HISTORY 4
+
+typedef struct {
+    uint16_t width, height;
+    uint8_t quality;
+    size_t bytes;
+} jpg_size_entry_t;
 
+static jpg_size_entry_t s_jpg_sizes[JPG_SIZE_HISTORY];
+static unsigned s_jpg_sizes_next;
+static pthread_mutex_t s_jpg_sizes_lock = PTHREAD_MUTEX_INITIALIZER;
 
-class memory_stream : public jpge::output_stream {
+// First chunk size for a JPEG: the capacity of the pool class the last JPEG of the same resolution and quality was
+// released to, so the next frame of a stream reuses that buffer and usually fits it.
+static size_t jpg_estimate_size(uint16_t width, uint16_t height, uint8_t quality)
+{
+    size_t bytes = 0;
+    pthread_mutex_lock(&s_jpg_sizes_lock);
+    for (int i = 0; i < JPG_SIZE_HISTORY; i++) {
+        if (s_jpg_sizes[i].width == width && s_jpg_sizes[i].height == height && s_jpg_sizes[i].quality == quality) {
+            bytes = s_jpg_sizes[i].bytes;
+        }
+    }
+    pthread_mutex_unlock(&s_jpg_sizes_lock);
+    if (!bytes) {
+        size_t pixels = (size_t)width * height;
+        float bits = JPG_ESTIMATE_BITS_AT_50 * powf(100.0f / jpg_quality_scale(quality ? quality : 1), JPG_RC_DEFAULT_EXPONENT);
+        // never more than 3 bytes per pixel, which only noise at the highest qualities reaches
+        bytes = bits < 24.0f ? (size_t)(pixels * bits / 8) : pixels * 3;
+    }
+    if (bytes < JPG_CHUNK_MIN_SIZE) {
+        bytes = JPG_CHUNK_MIN_SIZE;
+    }
+    return img_buf_capacity(bytes) - chunk_stream::CHUNK_HEADER_SIZE;
+}
+
+static void jpg_estimate_update(uint16_t width, uint16_t height, uint8_t quality, size_t bytes)
+{
+    pthread_mutex_lock(&s_jpg_sizes_lock);
+    int n = -1;
+    for (int i = 0; i < JPG_SIZE_HISTORY; i++) {
+        if (s_jpg_sizes[i].width == width && s_jpg_sizes[i].height == height && s_jpg_sizes[i].quality == quality) {
+            n = i;
+        }
+    }
+    if (n < 0) {
+        n = s_jpg_sizes_next++ % JPG_SIZE_HISTORY;
+        s_jpg_sizes[n].width = width;
+        s_jpg_sizes[n].height = height;
+        s_jpg_sizes[n].quality = quality;
+    }
+    s_jpg_sizes[n].bytes = bytes;
+    pthread_mutex_unlock(&s_jpg_sizes_lock);
+}
+
+bool fmt2jpg_ex(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len)
+{
+    chunk_stream dst_stream(jpg_estimate_size(width, height, config ? config->quality : 0));
+    if(!convert_image_ex(src, src_len, width, height, format, config, &dst_stream)) {
+        return false;
+    }
+
+    uint8_t * jpg_buf = dst_stream.take();
+    if(jpg_buf == NULL) {
+        ESP_LOGE(TAG, "JPG buffer malloc failed");
+        return false;
+    }
+    jpg_estimate_update(width, height, config ? config->quality : 0, dst_stream.get_size());
+
+    *out = jpg_buf;
+    *out_len = dst_stream.get_size();
+    return true;
+}
+
+bool frame2jpg_ex(camera_fb_t * fb, const jpg_encode_config_t *config, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg_ex(fb->buf, fb->len, fb->width, fb->height, fb->format, config, out, out_len);
+}
+
+bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+    return fmt2jpg_ex(src, src_len, width, height, format, &config, out, out_len);
+}
+
+bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+{
+    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+}
+
+// Keeps the first max_len bytes of the JPEG and counts all of them, so a frame over budget still reports its size.
+class budget_stream : public jpge::output_stream {
 protected:
     uint8_t *out_buf;
     size_t max_len, index;
 
 public:
-    memory_stream(void *pBuf, uint buf_size) : out_buf(static_cast<uint8_t*>(pBuf)), max_len(buf_size), index(0) { }
+    budget_stream(uint8_t *pBuf, size_t buf_size) : out_buf(pBuf), max_len(buf_size), index(0) { }
 
-    virtual ~memory_stream() { }
+    virtual ~budget_stream() { }
 
     virtual bool put_buf(const void* pBuf, int len)
     {
@@ -188,48 +687,375 @@ public:
             //end of image
             return true;
         }
-        if ((size_t)len > (max_len - index)) {
-            //ESP_LOGW(TAG, "JPG output overflow: %d bytes (%d,%d,%d)", len - (max_len - index), len, index, max_len);
-            len = max_len - index;
-        }
-        if (len) {
-            memcpy(out_buf + index, pBuf, len);
-            index += len;
+        if (index < max_len) {
+            memcpy(out_buf + index, pBuf, ((size_t)len < max_len - index) ? len : max_len - index);
         }
+        index += len;
         return true;
     }
 
-    virtual size_t get_size() const
+    virtual jpge::uint get_size() const
     {
         return index;
     }
+
+    void reset()
+    {
+        index = 0;
+    }
 };
 
-bool fmt2jpg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, uint8_t quality, uint8_t ** out, size_t * out_len)
+// Rate control aims below the budget, so a frame a little busier than the previous one still fits.
+#define JPG_RC_TARGET_PERCENT 90
+
+// Highest quality in the rc range expected to give at most target bytes, given a frame of `bytes` at `quality`.
+static uint8_t jpg_rc_predict(const jpg_rate_control_t *rc, uint8_t quality, size_t bytes, size_t target, float exponent)
 {
-    //todo: allocate proper buffer for holding JPEG data
-    //this should be enough for CIF frame size
-    int jpg_buf_len = 128*1024;
+    float min_scale = jpg_quality_scale(quality) * powf((float)bytes / target, 1.0f / exponent);
+    uint8_t q = rc->max_quality;
+    while (q > rc->min_quality && jpg_quality_scale(q) < min_scale) {
+        q--;
+    }
+    return q;
+}
 
+bool fmt2jpg_rc(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, jpg_rate_control_t *rc, uint8_t ** out, size_t * out_len)
+{
+    if (!config || !rc || rc->max_bytes < JPG_RATE_CONTROL_MIN_BYTES || !rc->min_quality || rc->min_quality > rc->max_quality || rc->max_quality > 100) {
+        ESP_LOGE(TAG, "JPG rate control config invalid");
+        return false;
+    }
 
-    uint8_t * jpg_buf = (uint8_t *)_malloc(jpg_buf_len);
+    uint8_t * jpg_buf = (uint8_t *)img_buf_acquire(rc->max_bytes);
     if(jpg_buf == NULL) {
         ESP_LOGE(TAG, "JPG buffer malloc failed");
         return false;
     }
-    memory_stream dst_stream(jpg_buf, jpg_buf_len);
+    budget_stream dst_stream(jpg_buf, rc->max_bytes);
+
+    size_t target = (size_t)((uint64_t)rc->max_bytes * JPG_RC_TARGET_PERCENT / 100);
+    float exponent = JPG_RC_DEFAULT_EXPONENT;
+    jpg_encode_config_t attempt = *config;
+    if (rc->quality && rc->bytes) {
+        attempt.quality = jpg_rc_predict(rc, rc->quality, rc->bytes, target, exponent);
+    } else if (attempt.quality < rc->min_quality) {
+        attempt.quality = rc->min_quality;
+    } else if (attempt.quality > rc->max_quality) {
+        attempt.quality = rc->max_quality;
+    }
 
-    if(!convert_image(src, width, height, format, quality, &dst_stream)) {
-        free(jpg_buf);
+    uint8_t last_quality = 0;
+    size_t last_bytes = 0;
+    for (rc->encodes = 1; ; rc->encodes++) {
+        dst_stream.reset();
+        if (!convert_image_ex(src, src_len, width, height, format, &attempt, &dst_stream)) {
+            img_buf_release(jpg_buf, rc->max_bytes);
+            return false;
+        }
+        rc->quality = attempt.quality;
+        rc->bytes = dst_stream.get_size();
+        if (rc->bytes <= rc->max_bytes || rc->encodes >= rc->max_encodes || rc->quality == rc->min_quality) {
+            break;
+        }
+
+        // Over budget: fit the exponent to both encodes of this frame once there are two, and try again lower.
+        if (last_bytes && last_bytes > rc->bytes) {
+            float fit = logf((float)last_bytes / rc->bytes) / logf((float)jpg_quality_scale(rc->quality) / jpg_quality_scale(last_quality));
+            exponent = fit < JPG_RC_MIN_EXPONENT ? JPG_RC_MIN_EXPONENT : (fit > JPG_RC_MAX_EXPONENT ? JPG_RC_MAX_EXPONENT : fit);
+        }
+        last_quality = rc->quality;
+        last_bytes = rc->bytes;
+        uint8_t quality = jpg_rc_predict(rc, rc->quality, rc->bytes, target, exponent);
+        attempt.quality = quality < rc->quality ? quality : rc->quality - 1;
+    }
+
+    if (rc->bytes > rc->max_bytes) {
+        ESP_LOGW(TAG, "JPG frame of %u bytes at quality %u is over the %u byte budget", (unsigned)rc->bytes, rc->quality, (unsigned)rc->max_bytes);
+        img_buf_release(jpg_buf, rc->max_bytes);
         return false;
     }
 
-    *out = jpg_buf;
-    *out_len = dst_stream.get_size();
+    // the budget sized buffer is shrunk to the frame, copying it to another would need both at once
+    *out = (uint8_t *)img_buf_shrink_to(jpg_buf, rc->max_bytes, rc->bytes);
+    *out_len = rc->bytes;
     return true;
 }
 
-bool frame2jpg(camera_fb_t * fb, uint8_t quality, uint8_t ** out, size_t * out_len)
+bool frame2jpg_rc(camera_fb_t * fb, const jpg_encode_config_t *config, jpg_rate_control_t *rc, uint8_t ** out, size_t * out_len)
 {
-    return fmt2jpg(fb->buf, fb->len, fb->width, fb->height, fb->format, quality, out, out_len);
+    return fmt2jpg_rc(fb->buf, fb->len, fb->width, fb->height, fb->format, config, rc, out, out_len);
+}
+
+// Encodes the image once per quality into dst_streams[i]. The first encoder converts the colours and runs the
+// DCT of every block, the others only quantize and entropy code the coefficients it computed.
+static bool convert_image_multi(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config,
+                                const uint8_t *qualities, jpge::output_stream **dst_streams, size_t num_renditions)
+{
+    if (!config || !qualities || !num_renditions || num_renditions > JPG_MAX_RENDITIONS) {
+        ESP_LOGE(TAG, "JPG renditions invalid");
+        return false;
+    }
+    if (config->workers > 1 || config->optimize_huffman) {
+        ESP_LOGE(TAG, "JPG renditions only support single pass encoding by one worker");
+        return false;
+    }
+    jpg_source_t source;
+    if (!jpg_source_init(&source, src, src_len, width, height, format, config)) {
+        return false;
+    }
+
+    jpge::jpeg_encoder *encoders = new (std::nothrow) jpge::jpeg_encoder[num_renditions];
+    if (!encoders) {
+        ESP_LOGE(TAG, "JPG rendition encoders malloc failed");
+        return false;
+    }
+    jpg_encode_config_t rendition = *config;
+    jpge::params comp_params = jpge::params();
+    uint8_t *importance = NULL;
+    bool ok = true;
+    for (size_t i = 0; ok && i < num_renditions; i++) {
+        rendition.quality = qualities[i];
+        jpge::params rendition_params = jpge::params();
+        jpg_encoder_params(format, &rendition, &rendition_params);
+        if (i) {
+            ok = encoders[i].init_rendition(dst_streams[i], &encoders[0], rendition_params);
+            continue;
+        }
+        comp_params = rendition_params;
+        if (config->num_rois) {
+            if (!(importance = jpg_importance_map(&source, config, comp_params.m_subsampling))) {
+                delete[] encoders;
+                return false;
+            }
+            comp_params.m_pMcu_importance = importance;
+        }
+        ok = encoders[0].init(dst_streams[0], source.width, source.height, source.src_format, comp_params);
+    }
+    if (!ok) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+    } else {
+        ok = encode_lines(encoders[0], &source, 0, source.height);
+    }
+    delete[] encoders;
+    img_buf_release(importance, jpg_importance_map_size(&source, comp_params.m_subsampling));
+    return ok;
+}
+
+bool fmt2jpg_multi_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const jpg_rendition_t *renditions, size_t num_renditions)
+{
+    if (!renditions || num_renditions > JPG_MAX_RENDITIONS) {
+        ESP_LOGE(TAG, "JPG renditions invalid");
+        return false;
+    }
+    callback_stream streams[JPG_MAX_RENDITIONS];
+    jpge::output_stream *dst_streams[JPG_MAX_RENDITIONS];
+    uint8_t qualities[JPG_MAX_RENDITIONS];
+    for (size_t i = 0; i < num_renditions; i++) {
+        streams[i] = callback_stream(renditions[i].cb, renditions[i].arg);
+        dst_streams[i] = &streams[i];
+        qualities[i] = renditions[i].quality;
+    }
+    return convert_image_multi(src, src_len, width, height, format, config, qualities, dst_streams, num_renditions);
+}
+
+bool frame2jpg_multi_cb(camera_fb_t * fb, const jpg_encode_config_t *config, const jpg_rendition_t *renditions, size_t num_renditions)
+{
+    return fmt2jpg_multi_cb(fb->buf, fb->len, fb->width, fb->height, fb->format, config, renditions, num_renditions);
+}
+
+bool fmt2jpg_multi(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config, const uint8_t *qualities, size_t num_renditions, uint8_t ** outs, size_t * out_lens)
+{
+    if (num_renditions > JPG_MAX_RENDITIONS) {
+        ESP_LOGE(TAG, "JPG renditions invalid");
+        return false;
+    }
+    chunk_stream streams[JPG_MAX_RENDITIONS];
+    jpge::output_stream *dst_streams[JPG_MAX_RENDITIONS];
+    for (size_t i = 0; i < num_renditions; i++) {
+        streams[i].set_first_size(qualities ? jpg_estimate_size(width, height, qualities[i]) : JPG_CHUNK_MIN_SIZE);
+        dst_streams[i] = &streams[i];
+    }
+    if (!convert_image_multi(src, src_len, width, height, format, config, qualities, dst_streams, num_renditions)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < num_renditions; i++) {
+        out_lens[i] = streams[i].get_size();
+        outs[i] = streams[i].take();
+        if (outs[i] == NULL) {
+            ESP_LOGE(TAG, "JPG buffer malloc failed");
+            while (i--) {
+                img_buf_release(outs[i], out_lens[i]);
+                outs[i] = NULL;
+            }
+            return false;
+        }
+    }
+    jpg_estimate_update(width, height, qualities[0], out_lens[0]);
+    return true;
+}
+
+bool frame2jpg_multi(camera_fb_t * fb, const jpg_encode_config_t *config, const uint8_t *qualities, size_t num_renditions, uint8_t ** outs, size_t * out_lens)
+{
+    return fmt2jpg_multi(fb->buf, fb->len, fb->width, fb->height, fb->format, config, qualities, num_renditions, outs, out_lens);
+}
+
+struct jpg_stream_encoder {
+    jpge::jpeg_encoder encoder;
+    jpge::params comp_params;
+    callback_stream stream;
+    uint8_t *importance;
+    int src_format;
+    uint16_t width, height;
+    uint16_t lines;         // rows of the frame encoded so far
+    size_t row_bytes;
+    size_t row_fill;        // bytes of the next row held in row, when a write ended inside it
+    uint8_t *row;
+    bool active;            // a frame is started and has not failed
+
+    jpg_stream_encoder() : stream(NULL, NULL), importance(NULL), row(NULL), active(false) { }
+};
+
+jpg_stream_encoder_t *jpg_stream_encoder_create(uint16_t width, uint16_t height, pixformat_t format, const jpg_encode_config_t *config)
+{
+    if (!config) {
+        ESP_LOGE(TAG, "JPG encoder config missing");
+        return NULL;
+    }
+    const jpg_rect_t *crop = &config->crop;
+    if (config->workers > 1 || config->optimize_huffman || config->stride || crop->x || crop->y || crop->width || crop->height) {
+        ESP_LOGE(TAG, "JPG stream encoder only supports single pass encoding of whole frames");
+        return NULL;
+    }
+    int src_format;
+    size_t bpp;
+    if (!jpg_source_format(format, &src_format, &bpp)) {
+        return NULL;
+    }
+    if (!width || !height) {
+        ESP_LOGE(TAG, "JPG stream frame of %ux%u is empty", width, height);
+        return NULL;
+    }
+
+    jpg_stream_encoder_t *enc = new (std::nothrow) jpg_stream_encoder_t;
+    if (!enc) {
+        ESP_LOGE(TAG, "JPG stream encoder malloc failed");
+        return NULL;
+    }
+    enc->src_format = src_format;
+    enc->width = width;
+    enc->height = height;
+    enc->row_bytes = width * bpp;
+    jpg_encoder_params(format, config, &enc->comp_params);
+    enc->row = (uint8_t *)img_buf_acquire(enc->row_bytes);
+    if (!enc->row) {
+        ESP_LOGE(TAG, "JPG stream row malloc failed");
+        jpg_stream_encoder_delete(enc);
+        return NULL;
+    }
+    if (config->num_rois) {
+        jpg_source_t source;
+        source.width = width;
+        source.height = height;
+        if (!(enc->importance = jpg_importance_map(&source, config, enc->comp_params.m_subsampling))) {
+            jpg_stream_encoder_delete(enc);
+            return NULL;
+        }
+        enc->comp_params.m_pMcu_importance = enc->importance;
+    }
+    return enc;
+}
+
+bool jpg_stream_encoder_start(jpg_stream_encoder_t *enc, jpg_out_cb cb, void * arg)
+{
+    enc->stream = callback_stream(cb, arg);
+    enc->lines = 0;
+    enc->row_fill = 0;
+    enc->active = enc->encoder.init(&enc->stream, enc->width, enc->height, enc->src_format, enc->comp_params);
+    if (!enc->active) {
+        ESP_LOGE(TAG, "JPG encoder init failed");
+    }
+    return enc->active;
+}
+
+// Encodes num_rows rows of the frame, stride row_bytes. Rows are converted as they are read, so they need not outlive the call.
+static bool jpg_stream_encode_rows(jpg_stream_encoder_t *enc, const uint8_t *rows, size_t num_rows)
+{
+    if (!enc->encoder.process_scanlines(rows, enc->row_bytes, num_rows)) {
+        ESP_LOGE(TAG, "JPG process lines %u-%u failed", enc->lines, (unsigned)(enc->lines + num_rows - 1));
+        enc->active = false;
+        enc->encoder.deinit();
+        return false;
+    }
+    enc->lines += num_rows;
+    return true;
+}
+
+bool jpg_stream_encoder_write(jpg_stream_encoder_t *enc, const uint8_t *data, size_t len)
+{
+    if (!enc->active) {
+        return false;
+    }
+    if (len > (enc->height - enc->lines) * enc->row_bytes - enc->row_fill) {
+        ESP_LOGE(TAG, "JPG stream frame is larger than %ux%u", enc->width, enc->height);
+        enc->active = false;
+        enc->encoder.deinit();
+        return false;
+    }
+
+    // complete the row split over the previous writes
+    if (enc->row_fill) {
+        size_t n = enc->row_bytes - enc->row_fill;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(enc->row + enc->row_fill, data, n);
+        enc->row_fill += n;
+        data += n;
+        len -= n;
+        if (enc->row_fill < enc->row_bytes) {
+            return true;
+        }
+        enc->row_fill = 0;
+        if (!jpg_stream_encode_rows(enc, enc->row, 1)) {
+            return false;
+        }
+    }
+
+    size_t num_rows = len / enc->row_bytes;
+    if (num_rows && !jpg_stream_encode_rows(enc, data, num_rows)) {
+        return false;
+    }
+    enc->row_fill = len - num_rows * enc->row_bytes;
+    memcpy(enc->row, data + num_rows * enc->row_bytes, enc->row_fill);
+    return true;
+}
+
+bool jpg_stream_encoder_end(jpg_stream_encoder_t *enc)
+{
+    if (!enc->active) {
+        return false;
+    }
+    enc->active = false;
+    bool ok = enc->lines == enc->height;
+    if (ok && !(ok = enc->encoder.process_scanline(NULL))) {
+        ESP_LOGE(TAG, "JPG image finish failed");
+    }
+    enc->encoder.deinit();
+    return ok;
+}
+
+void jpg_stream_encoder_delete(jpg_stream_encoder_t *enc)
+{
+    if (!enc) {
+        return;
+    }
+    if (enc->importance) {
+        jpg_source_t source;
+        source.width = enc->width;
+        source.height = enc->height;
+        img_buf_release(enc->importance, jpg_importance_map_size(&source, enc->comp_params.m_subsampling));
+    }
+    img_buf_release(enc->row, enc->row_bytes);
+    delete enc;
 }
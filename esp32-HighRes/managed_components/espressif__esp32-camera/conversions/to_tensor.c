@@ -0,0 +1,284 @@
+// Copyright 2015-2016 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stddef.h>
+#include <string.h>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+
+#include "esp_system.h"
+
+#if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
+#include "esp32-hal-log.h"
+#define TAG ""
+#else
+#include "esp_log.h"
+static const char* TAG = "to_tensor";
+#endif
+
+// The decoder hands out the image MCU by MCU, in raster order. The rows of one MCU row are kept in a strip, with
+// the last row of the MCU row above in front of them, and each tensor row is interpolated as soon as both its
+// source rows are in the strip. The decoded image is never held whole.
+typedef struct {
+    const jpg_tensor_config_t *config;
+    void *out;
+    uint16_t src_w, src_h;      // decoded image, after the decoder scaling
+    uint16_t dst_w, dst_h;      // image in the tensor
+    uint16_t left, top;         // its offset in the tensor
+    uint16_t strip_lines;       // rows in the strip, the first one carried over from the MCU row above
+    uint16_t strip_y;           // image row of the second line of the strip
+    uint16_t next_row;          // next image row of the tensor to interpolate
+    uint8_t *strip;
+    uint32_t *x0, *x1;          // byte offsets of the source pixels left and right of each tensor column
+    uint16_t *fx;               // weight of the right one, 0-256
+    uint8_t *row;               // interpolated R, G, B of one tensor row
+    float *lut;                 // normalized value of each byte, per output channel, float tensors only
+} tensor_decoder_t;
+
+// Source position of a tensor pixel with pixel centres aligned, as cv2.resize() does, in 1/256 pixels
+static int32_t _src_pos(uint32_t d, uint32_t src, uint32_t dst)
+{
+    int64_t p = ((int64_t)(2 * d + 1) * src * 256) / (2 * dst) - 128;
+    return p < 0 ? 0 : (int32_t)p;
+}
+
+// Writes value v of channel c (in R, G, B order) at pixel (x, y) of the tensor
+static inline void _put(tensor_decoder_t *t, size_t x, size_t y, int c, uint8_t v)
+{
+    const jpg_tensor_config_t *config = t->config;
+    if(config->bgr){
+        c = 2 - c;
+    }
+    size_t i = (config->layout == JPG_TENSOR_NCHW)
+               ? ((size_t)c * config->height + y) * config->width + x
+               : (y * config->width + x) * 3 + c;
+    if(config->type == JPG_TENSOR_FLOAT32){
+        ((float *)t->out)[i] = t->lut[c * 256 + v];
+    } else {
+        ((uint8_t *)t->out)[i] = v;
+    }
+}
+
+// Writes a run of pixels of tensor row y, from R, G, B bytes, or all of pad value if rgb is NULL
+static void _put_run(tensor_decoder_t *t, size_t x, size_t y, size_t n, const uint8_t *rgb)
+{
+    const jpg_tensor_config_t *config = t->config;
+    if(!n){
+        return;
+    }
+    if(config->layout == JPG_TENSOR_NHWC && config->type == JPG_TENSOR_UINT8 && !config->bgr){
+        uint8_t *o = (uint8_t *)t->out + (y * config->width + x) * 3;
+        if(rgb){
+            memcpy(o, rgb, n * 3);
+        } else {
+            memset(o, config->pad_value, n * 3);
+        }
+        return;
+    }
+    if(config->layout == JPG_TENSOR_NCHW){
+        // one plane after the other, the writes stay sequential
+        for(int c=0; c<3; c++){
+            int oc = config->bgr ? 2 - c : c;
+            size_t i = ((size_t)oc * config->height + y) * config->width + x;
+            if(config->type == JPG_TENSOR_FLOAT32){
+                const float *lut = t->lut + oc * 256;
+                float *o = (float *)t->out + i;
+                for(size_t k=0; k<n; k++){
+                    o[k] = lut[rgb ? rgb[k * 3 + c] : config->pad_value];
+                }
+            } else {
+                uint8_t *o = (uint8_t *)t->out + i;
+                for(size_t k=0; k<n; k++){
+                    o[k] = rgb ? rgb[k * 3 + c] : config->pad_value;
+                }
+            }
+        }
+        return;
+    }
+    for(size_t k=0; k<n; k++){
+        for(int c=0; c<3; c++){
+            _put(t, x + k, y, c, rgb ? rgb[k * 3 + c] : config->pad_value);
+        }
+    }
+}
+
+// Interpolates the tensor rows whose source rows are all in the strip, up to image row last
+static void _emit_rows(tensor_decoder_t *t, uint16_t last)
+{
+    const size_t stride = (size_t)t->src_w * 3;
+    while(t->next_row < t->dst_h){
+        int32_t sy = _src_pos(t->next_row, t->src_h, t->dst_h);
+        uint32_t y0 = sy >> 8, fy = sy & 0xFF;
+        uint32_t y1 = y0 + 1;
+        if(y1 >= t->src_h){
+            y1 = y0 = t->src_h - 1;
+            fy = 0;
+        }
+        if(y1 > last){
+            break;
+        }
+        const uint8_t *r0 = t->strip + (y0 + 1 - t->strip_y) * stride;
+        const uint8_t *r1 = t->strip + (y1 + 1 - t->strip_y) * stride;
+        uint8_t *o = t->row;
+        for(size_t x=0; x<t->dst_w; x++){
+            const uint8_t *a = r0 + t->x0[x], *b = r0 + t->x1[x];
+            const uint8_t *c = r1 + t->x0[x], *d = r1 + t->x1[x];
+            uint32_t wx = t->fx[x];
+            for(int ch=0; ch<3; ch++){
+                uint32_t top = a[ch] * (256 - wx) + b[ch] * wx;
+                uint32_t bottom = c[ch] * (256 - wx) + d[ch] * wx;
+                *o++ = (uint8_t)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+            }
+        }
+        size_t y = t->top + t->next_row;
+        _put_run(t, 0, y, t->left, NULL);
+        _put_run(t, t->left, y, t->dst_w, t->row);
+        _put_run(t, t->left + t->dst_w, y, t->config->width - t->left - t->dst_w, NULL);
+        t->next_row++;
+    }
+}
+
+static bool _tensor_write(void * arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    tensor_decoder_t * t = (tensor_decoder_t *)arg;
+    if(!data){
+        if(x == 0 && y == 0){
+            // the size the scaling was chosen for
+            return w == t->src_w && h == t->src_h;
+        }
+        return true;
+    }
+
+    const size_t stride = (size_t)t->src_w * 3;
+    if(y + h + 1 - t->strip_y > t->strip_lines){
+        return false;
+    }
+    for(size_t iy=0; iy<h; iy++){
+        memcpy(t->strip + (y + iy + 1 - t->strip_y) * stride + (size_t)x * 3, data, (size_t)w * 3);
+        data += (size_t)w * 3;
+    }
+    if(x + w == t->src_w){
+        // MCU row complete: interpolate what it allows and carry its last row over to the next strip
+        uint16_t last = y + h - 1;
+        _emit_rows(t, last);
+        memcpy(t->strip, t->strip + (last + 1 - t->strip_y) * stride, stride);
+        t->strip_y = last + 1;
+    }
+    return true;
+}
+
+bool jpg2tensor(const uint8_t *src, size_t src_len, const jpg_tensor_config_t *config, void *out, jpg_letterbox_t *letterbox)
+{
+    uint16_t w, h;
+    if(!config || !out || !config->width || !config->height){
+        return false;
+    }
+    if(esp_jpg_get_size(src, src_len, &w, &h) != ESP_OK || !w || !h){
+        ESP_LOGE(TAG, "JPEG header not found");
+        return false;
+    }
+
+    tensor_decoder_t t;
+    memset(&t, 0, sizeof(t));
+    t.config = config;
+    t.out = out;
+
+    // fit the image in the tensor, keeping its aspect ratio
+    if((uint32_t)config->width * h <= (uint32_t)config->height * w){
+        t.dst_w = config->width;
+        t.dst_h = ((uint32_t)h * config->width + w / 2) / w;
+    } else {
+        t.dst_h = config->height;
+        t.dst_w = ((uint32_t)w * config->height + h / 2) / h;
+    }
+    if(!t.dst_w){
+        t.dst_w = 1;
+    }
+    if(!t.dst_h){
+        t.dst_h = 1;
+    }
+    t.left = (config->width - t.dst_w) / 2;
+    t.top = (config->height - t.dst_h) / 2;
+
+    // let the decoder shrink the image as far as it stays at least as large as in the tensor
+    int scale = JPG_SCALE_NONE;
+    while(scale < JPG_SCALE_MAX && (w >> (scale + 1)) >= t.dst_w && (h >> (scale + 1)) >= t.dst_h){
+        scale++;
+    }
+    t.src_w = w >> scale;
+    t.src_h = h >> scale;
+    t.strip_lines = (16 >> scale) + 1;
+    t.strip_y = 0;
+
+    size_t lut_len = config->type == JPG_TENSOR_FLOAT32 ? 3 * 256 * sizeof(float) : 0;
+    size_t strip_len = (size_t)t.strip_lines * t.src_w * 3;
+    size_t work_len = lut_len + (size_t)t.dst_w * (2 * sizeof(uint32_t) + sizeof(uint16_t) + 3) + strip_len;
+    uint8_t *work = (uint8_t *)img_buf_acquire(work_len);
+    if(!work){
+        ESP_LOGE(TAG, "img_buf_acquire failed! %u", (unsigned)work_len);
+        return false;
+    }
+    t.lut = (float *)work;
+    t.x0 = (uint32_t *)(work + lut_len);
+    t.x1 = t.x0 + t.dst_w;
+    t.fx = (uint16_t *)(t.x1 + t.dst_w);
+    t.row = (uint8_t *)(t.fx + t.dst_w);
+    t.strip = t.row + (size_t)t.dst_w * 3;
+
+    for(size_t x=0; x<t.dst_w; x++){
+        int32_t sx = _src_pos(x, t.src_w, t.dst_w);
+        uint32_t x0 = sx >> 8, fx = sx & 0xFF;
+        uint32_t x1 = x0 + 1;
+        if(x1 >= t.src_w){
+            x1 = x0 = t.src_w - 1;
+            fx = 0;
+        }
+        t.x0[x] = x0 * 3;
+        t.x1[x] = x1 * 3;
+        t.fx[x] = fx;
+    }
+    if(lut_len){
+        for(int c=0; c<3; c++){
+            float std = config->std[c] ? config->std[c] : 1.0f;
+            for(int v=0; v<256; v++){
+                t.lut[c * 256 + v] = (v / 255.0f - config->mean[c]) / std;
+            }
+        }
+    }
+
+    // the bands above and below the image, the sides are written with each row
+    for(size_t y=0; y<t.top; y++){
+        _put_run(&t, 0, y, config->width, NULL);
+    }
+    for(size_t y=t.top + t.dst_h; y<config->height; y++){
+        _put_run(&t, 0, y, config->width, NULL);
+    }
+
+    bool ok = esp_jpg_decode_mem(src, src_len, (jpg_scale_t)scale, _tensor_write, (void*)&t, NULL, 0) == ESP_OK
+              && t.next_row == t.dst_h;
+    img_buf_release(work, work_len);
+    if(!ok){
+        return false;
+    }
+
+    if(letterbox){
+        float sx = (float)config->width / w, sy = (float)config->height / h;
+        letterbox->scale = sx < sy ? sx : sy;
+        letterbox->left = t.left;
+        letterbox->top = t.top;
+        letterbox->width = t.dst_w;
+        letterbox->height = t.dst_h;
+        letterbox->decode_scale = (jpg_scale_t)scale;
+    }
+    return true;
+}
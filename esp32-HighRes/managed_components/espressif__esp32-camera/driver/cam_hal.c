@@ -38,6 +38,8 @@
 #else
 #define CAM_TASK_STACK             (2*1024)
 #endif
+// JPEG encoding during capture runs in the camera task
+#define CAM_STREAM_TASK_STACK      (4*1024)
 
 static const char *TAG = "cam_hal";
 static cam_obj_t *cam_obj = NULL;
@@ -111,6 +113,38 @@ void IRAM_ATTR ll_cam_send_event(cam_obj_t *cam, cam_event_t cam_event, BaseType
     }
 }
 
+#if CONFIG_CAMERA_STREAM_JPEG
+//Write the JPEG of the stream encoder to the frame buffer
+static size_t cam_stream_out(void *arg, size_t index, const void *data, size_t len)
+{
+    camera_fb_t *fb = (camera_fb_t *)arg;
+    if (data) {
+        if (cam_obj->fb_size < index + len) {
+            cam_obj->stream_ovf = true;
+        } else {
+            memcpy(&fb->buf[index], data, len);
+            fb->len = index + len;
+        }
+    }
+    return len;
+}
+
+static void cam_stream_start(int frame_pos)
+{
+    cam_obj->stream_ovf = false;
+    jpg_stream_encoder_start(cam_obj->stream_enc, cam_stream_out, &cam_obj->frames[frame_pos].fb);
+}
+
+//Encode the rows of a DMA buffer right away, the frame buffer only receives the JPEG
+static void cam_stream_write(int cnt)
+{
+    size_t len = ll_cam_memcpy(cam_obj, cam_obj->stream_buf,
+        &cam_obj->dma_buffer[(cnt % cam_obj->dma_half_buffer_cnt) * cam_obj->dma_half_buffer_size],
+        cam_obj->dma_half_buffer_size);
+    jpg_stream_encoder_write(cam_obj->stream_enc, cam_obj->stream_buf, len);
+}
+#endif
+
 //Copy fram from DMA dma_buffer to fram dma_buffer
 static void cam_task(void *arg)
 {
@@ -131,6 +165,11 @@ static void cam_task(void *arg)
                     //DBG_PIN_SET(1);
                     if(cam_start_frame(&frame_pos)){
                         cam_obj->frames[frame_pos].fb.len = 0;
+#if CONFIG_CAMERA_STREAM_JPEG
+                        if (cam_obj->stream_mode) {
+                            cam_stream_start(frame_pos);
+                        }
+#endif
                         cam_obj->state = CAM_STATE_READ_BUF;
                     }
                     cnt = 0;
@@ -143,6 +182,11 @@ static void cam_task(void *arg)
                 size_t pixels_per_dma = (cam_obj->dma_half_buffer_size * cam_obj->fb_bytes_per_pixel) / (cam_obj->dma_bytes_per_item * cam_obj->in_bytes_per_pixel);
 
                 if (cam_event == CAM_IN_SUC_EOF_EVENT) {
+#if CONFIG_CAMERA_STREAM_JPEG
+                    if (cam_obj->stream_mode) {
+                        cam_stream_write(cnt);
+                    } else
+#endif
                     if(!cam_obj->psram_mode){
                         if (cam_obj->fb_size < (frame_buffer_event->len + pixels_per_dma)) {
                             ESP_LOGW(TAG, "FB-OVF");
@@ -184,6 +228,18 @@ static void cam_task(void *arg)
 
                         cam_obj->frames[frame_pos].en = 0;
 
+#if CONFIG_CAMERA_STREAM_JPEG
+                        if (cam_obj->stream_mode) {
+                            if (!jpg_stream_encoder_end(cam_obj->stream_enc) || cam_obj->stream_ovf) {
+                                cam_obj->frames[frame_pos].en = 1;
+                                if (cam_obj->stream_ovf) {
+                                    ESP_LOGW(TAG, "FB-OVF");
+                                } else {
+                                    ESP_LOGE(TAG, "FB-JPG: frame incomplete or encoding failed");
+                                }
+                            }
+                        } else
+#endif
                         if (cam_obj->psram_mode) {
                             if (cam_obj->jpeg_mode) {
                                 frame_buffer_event->len = cnt * cam_obj->dma_half_buffer_size;
@@ -220,6 +276,11 @@ static void cam_task(void *arg)
                         cam_obj->state = CAM_STATE_IDLE;
                     } else {
                         cam_obj->frames[frame_pos].fb.len = 0;
+#if CONFIG_CAMERA_STREAM_JPEG
+                        if (cam_obj->stream_mode) {
+                            cam_stream_start(frame_pos);
+                        }
+#endif
                     }
                     cnt = 0;
                 }
@@ -369,26 +430,56 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     cam_obj->psram_mode = false;
 #else
     cam_obj->psram_mode = (config->xclk_freq_hz == 16000000);
+#endif
+#if CONFIG_CAMERA_STREAM_JPEG
+    cam_obj->stream_mode = !cam_obj->jpeg_mode;
+#if CONFIG_CAMERA_CONVERTER_ENABLED
+    cam_obj->stream_mode = cam_obj->stream_mode && config->conv_mode == CONV_DISABLE;
+#endif
+    if (cam_obj->stream_mode) {
+        //DMA buffers are encoded as they arrive, they never go straight to the frame buffer
+        cam_obj->psram_mode = false;
+    }
 #endif
     cam_obj->frame_cnt = config->fb_count;
     cam_obj->width = resolution[frame_size].width;
     cam_obj->height = resolution[frame_size].height;
 
-    if(cam_obj->jpeg_mode){
 #ifdef CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE_AUTO
-        cam_obj->recv_size = cam_obj->width * cam_obj->height / 5;
+    size_t jpeg_size = cam_obj->width * cam_obj->height / 5;
 #else
-        cam_obj->recv_size = CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
+    size_t jpeg_size = CONFIG_CAMERA_JPEG_MODE_FRAME_SIZE;
 #endif
+    if(cam_obj->jpeg_mode){
+        cam_obj->recv_size = jpeg_size;
         cam_obj->fb_size = cam_obj->recv_size;
     } else {
         cam_obj->recv_size = cam_obj->width * cam_obj->height * cam_obj->in_bytes_per_pixel;
         cam_obj->fb_size = cam_obj->width * cam_obj->height * cam_obj->fb_bytes_per_pixel;
     }
+#if CONFIG_CAMERA_STREAM_JPEG
+    if (cam_obj->stream_mode) {
+        //frame buffers only hold the JPEG
+        cam_obj->fb_size = jpeg_size;
+    }
+#endif
 
     ret = cam_dma_config(config);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam_dma_config failed", err);
 
+#if CONFIG_CAMERA_STREAM_JPEG
+    if (cam_obj->stream_mode) {
+        jpg_encode_config_t jpg_config = JPG_ENCODE_CONFIG_DEFAULT();
+        jpg_config.quality = CONFIG_CAMERA_STREAM_JPEG_QUALITY;
+        cam_obj->stream_enc = jpg_stream_encoder_create(cam_obj->width, cam_obj->height, (pixformat_t)config->pixel_format, &jpg_config);
+        CAM_CHECK_GOTO(cam_obj->stream_enc != NULL, "stream encoder create failed", err);
+        //one DMA half buffer, as ll_cam_memcpy() writes it
+        size_t stream_buf_size = (cam_obj->dma_half_buffer_size * cam_obj->fb_bytes_per_pixel) / (cam_obj->dma_bytes_per_item * cam_obj->in_bytes_per_pixel);
+        cam_obj->stream_buf = (uint8_t *)heap_caps_malloc(stream_buf_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        CAM_CHECK_GOTO(cam_obj->stream_buf != NULL, "stream buffer malloc failed", err);
+    }
+#endif
+
     size_t queue_size = cam_obj->dma_half_buffer_cnt - 1;
     if (queue_size == 0) {
         queue_size = 1;
@@ -406,13 +497,17 @@ esp_err_t cam_config(const camera_config_t *config, framesize_t frame_size, uint
     ret = ll_cam_init_isr(cam_obj);
     CAM_CHECK_GOTO(ret == ESP_OK, "cam intr alloc failed", err);
 
+    uint32_t task_stack = CAM_TASK_STACK;
+    if (cam_obj->stream_mode && task_stack < CAM_STREAM_TASK_STACK) {
+        task_stack = CAM_STREAM_TASK_STACK;
+    }
 
 #if CONFIG_CAMERA_CORE0
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
+    xTaskCreatePinnedToCore(cam_task, "cam_task", task_stack, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 0);
 #elif CONFIG_CAMERA_CORE1
-    xTaskCreatePinnedToCore(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
+    xTaskCreatePinnedToCore(cam_task, "cam_task", task_stack, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle, 1);
 #else
-    xTaskCreate(cam_task, "cam_task", CAM_TASK_STACK, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
+    xTaskCreate(cam_task, "cam_task", task_stack, NULL, configMAX_PRIORITIES - 2, &cam_obj->task_handle);
 #endif
 
     ESP_LOGI(TAG, "cam config ok");
@@ -442,6 +537,13 @@ esp_err_t cam_deinit(void)
 
     ll_cam_deinit(cam_obj);
 
+#if CONFIG_CAMERA_STREAM_JPEG
+    jpg_stream_encoder_delete(cam_obj->stream_enc);
+    if (cam_obj->stream_buf) {
+        free(cam_obj->stream_buf);
+    }
+#endif
+
     if (cam_obj->dma) {
         free(cam_obj->dma);
     }
@@ -530,6 +632,15 @@ void cam_give(camera_fb_t *dma_buffer)
     }
 }
 
+bool cam_is_stream_jpeg(void)
+{
+#if CONFIG_CAMERA_STREAM_JPEG
+    return cam_obj->stream_mode;
+#else
+    return false;
+#endif
+}
+
 void cam_give_all(void) {
     for (int x = 0; x < cam_obj->frame_cnt; x++) {
         cam_obj->frames[x].en = 1;
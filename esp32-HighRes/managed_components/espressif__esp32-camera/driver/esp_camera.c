@@ -374,7 +374,7 @@ camera_fb_t *esp_camera_fb_get()
     if (fb) {
         fb->width = resolution[s_state->sensor.status.framesize].width;
         fb->height = resolution[s_state->sensor.status.framesize].height;
-        fb->format = s_state->sensor.pixformat;
+        fb->format = cam_is_stream_jpeg() ? PIXFORMAT_JPEG : s_state->sensor.pixformat;
     }
     return fb;
 }
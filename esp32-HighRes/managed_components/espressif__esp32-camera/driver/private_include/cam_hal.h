@@ -57,6 +57,13 @@ void cam_give(camera_fb_t *dma_buffer);
 
 void cam_give_all(void);
 
+/**
+ * @brief Whether raw frames are encoded to JPEG during capture (CONFIG_CAMERA_STREAM_JPEG)
+ *
+ * @return true if the frame buffers hold JPEG while the sensor sends RGB565/YUV422/GRAYSCALE
+ */
+bool cam_is_stream_jpeg(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,9 +10,13 @@
 #define JD_FORMAT		0	/* Output pixel format 0:RGB888 (3 BYTE/pix), 1:RGB565 (1 WORD/pix) */
 #define	JD_USE_SCALE	1	/* Use descaling feature for output */
 #define JD_TBLCLIP		1	/* Use table for saturation (might be a bit faster but increases 1K bytes of code size) */
+#define JD_MEM_INPUT	1	/* jd_prepare_mem() is available: the bit stream is read in place from a buffer */
+#define JD_HUFF_LUT		9	/* Bits of the huffman lookup tables built when the pool has room for them (0:Code by code only) */
 
 /*---------------------------------------------------------------------------*/
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,9 +37,9 @@ typedef unsigned short	WORD;
 typedef unsigned short	WCHAR;
 
 /* These types must be 32-bit integer */
-typedef long			LONG;
-typedef unsigned long	ULONG;
-typedef unsigned long	DWORD;
+typedef int32_t			LONG;
+typedef uint32_t		ULONG;
+typedef uint32_t		DWORD;
 
 
 /* Error code */
@@ -53,6 +57,16 @@ typedef enum {
 
 
 
+/* Output formats of jd_decomp_fmt() */
+#define JD_OUT_RGB		0	/* JD_FORMAT */
+#define JD_OUT_GRAY		1	/* Y only (1 BYTE/pix), the chroma is parsed but neither transformed nor converted */
+#define JD_OUT_YCC		2	/* Y, Cb, Cr (3 BYTE/pix), full range as coded */
+
+/* Working buffer of jd_prepare_copy() for the largest MCU (IDCT and MCU buffers of 4 Y blocks) */
+#define JD_COPY_POOL	(4 * 64 * 2 + 64 + 6 * 64)
+
+
+
 /* Rectangular structure */
 typedef struct {
 	WORD left, right, top, bottom;
@@ -66,8 +80,13 @@ struct JDEC {
 	UINT dctr;				/* Number of bytes available in the input buffer */
 	BYTE* dptr;				/* Current data read ptr */
 	BYTE* inbuf;			/* Bit stream input buffer */
-	BYTE dmsk;				/* Current bit in the current read byte */
+	DWORD wreg;				/* Bit stream read ahead, next bit at MSB and zeros below the valid bits */
+	BYTE dbit;				/* Number of valid bits in wreg */
+	WORD marker;			/* Marker that stopped the read ahead (0xFFnn), 1 at end of input, 0 for none */
 	BYTE scale;				/* Output scaling ratio */
+	BYTE outfmt;			/* Output format (JD_OUT_*) */
+	const JRECT* roi;		/* Rectangles to output, image pixels */
+	UINT nroi;				/* Number of rectangles, 0 for the whole image */
 	BYTE msx, msy;			/* MCU size in unit of block (width, height) */
 	BYTE qtid[3];			/* Quantization table ID of each component */
 	SHORT dcv[3];			/* Previous DC element of each component */
@@ -76,20 +95,34 @@ struct JDEC {
 	BYTE* huffbits[2][2];	/* Huffman bit distribution tables [id][dcac] */
 	WORD* huffcode[2][2];	/* Huffman code word tables [id][dcac] */
 	BYTE* huffdata[2][2];	/* Huffman decoded data tables [id][dcac] */
+	WORD* hufflut[2][2];	/* Huffman lookup tables [id][dcac], (code length << 8 | data) by the leading bits, 0 for longer codes */
 	LONG* qttbl[4];			/* Dequaitizer tables [id] */
+	const struct jd_dsp_kernels* dsp;	/* IDCT and colour conversion kernels, see tjpgd_dsp.h */
 	void* workbuf;			/* Working buffer for IDCT and RGB output */
 	BYTE* mcubuf;			/* Working buffer for the MCU */
 	void* pool;				/* Pointer to available memory pool */
 	UINT sz_pool;			/* Size of momory pool (bytes available) */
 	UINT (*infunc)(JDEC*, BYTE*, UINT);/* Pointer to jpeg stream input function */
 	void* device;			/* Pointer to I/O device identifiler for the session */
+	const BYTE* mem;		/* JPEG data of jd_prepare_mem(), NULL for the input function */
+	UINT mem_len, mem_ofs;	/* Its size and the bytes read so far */
 };
 
 
 
 /* TJpgDec API functions */
+/* The ESP32, ESP32-S3 and ESP32-C3 have TJpgDec in ROM, linked as jd_prepare() and jd_decomp(). This one is
+   linked besides it under its own names */
+#define jd_prepare	jd_prepare_sw
+#define jd_decomp	jd_decomp_sw
+
 JRESULT jd_prepare (JDEC*, UINT(*)(JDEC*,BYTE*,UINT), void*, UINT, void*);
+JRESULT jd_prepare_mem (JDEC*, const BYTE*, UINT, void*, UINT, void*);
 JRESULT jd_decomp (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE);
+JRESULT jd_decomp_fmt (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, BYTE);
+JRESULT jd_decomp_roi (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, BYTE, const JRECT*, UINT);
+JRESULT jd_prepare_copy (JDEC*, const JDEC*, void*, UINT);
+JRESULT jd_decomp_rst (JDEC*, UINT(*)(JDEC*,void*,JRECT*), BYTE, BYTE, UINT, const BYTE*, UINT);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,51 @@
+/*----------------------------------------------------------------------------/
+/ TJpgDec - Inverse DCT and colour conversion kernels
+/-----------------------------------------------------------------------------/
+/ The scalar kernels are the original TJpgDec code, every other kernel set
+/ must produce bit-exact output. The set is selected at run time, by what the
+/ CPU supports.
+/----------------------------------------------------------------------------*/
+#ifndef _TJPGDEC_DSP
+#define _TJPGDEC_DSP
+
+#include "tjpgd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Inverse DCT of a block, de-quantized and pre-scaled for Arai algorithm, into
+   64 bytes in raster order. The input block is used as working memory. */
+typedef void (*jd_idct_func_t)(LONG* src, BYTE* dst);
+
+/* Converts a row of an MCU to RGB888. py points to the Y row in the first
+   block (the second block, for 16 pixel wide MCUs, follows 64 bytes later),
+   pc to the Cb row (Cr follows 64 bytes later), subsampled horizontally when
+   the MCU is 16 pixels wide. All input of the row is read before rgb is
+   written, which may overlap it. */
+typedef void (*jd_ycc_row_func_t)(BYTE* rgb, const BYTE* py, const BYTE* pc, UINT mx);
+
+typedef enum {
+	JD_DSP_SCALAR = 0,
+	JD_DSP_SSE2,
+	JD_DSP_AVX2,
+	JD_DSP_KERNEL_COUNT
+} jd_dsp_kernel_id_t;
+
+typedef struct jd_dsp_kernels {
+	const char* name;
+	jd_idct_func_t idct;
+	jd_ycc_row_func_t ycc_row;
+} jd_dsp_kernels;
+
+/* Returns the kernel set with the given id, NULL if it is not built in or not supported by this CPU */
+const jd_dsp_kernels* jd_dsp_get_kernels (jd_dsp_kernel_id_t id);
+
+/* Returns the fastest kernel set supported by this CPU */
+const jd_dsp_kernels* jd_dsp_select_kernels (void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TJPGDEC_DSP */
@@ -140,6 +140,14 @@ typedef struct {
 #endif
     uint32_t fb_size;
 
+#if CONFIG_CAMERA_STREAM_JPEG
+    //for stream JPEG mode
+    bool stream_mode;
+    bool stream_ovf;
+    jpg_stream_encoder_t *stream_enc;
+    uint8_t *stream_buf;
+#endif
+
     cam_state_t state;
 } cam_obj_t;
 
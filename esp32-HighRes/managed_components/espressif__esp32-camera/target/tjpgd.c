@@ -19,6 +19,8 @@
 /----------------------------------------------------------------------------*/
 
 #include "tjpgd.h"
+#include "tjpgd_dsp.h"
+#include <string.h>
 
 #define SUPPORT_JPEG 1
 
@@ -248,226 +250,175 @@ UINT create_huffman_tbl (	/* 0:OK, !0:Failed */
 
 
 /*-----------------------------------------------------------------------*/
-/* Extract N bits from input stream                                      */
+/* Create a huffman lookup table for the codes up to JD_HUFF_LUT bits    */
 /*-----------------------------------------------------------------------*/
 
+#if JD_HUFF_LUT
 static
-INT bitext (	/* >=0: extracted data, <0: error code */
-	JDEC* jd,	/* Pointer to the decompressor object */
-	UINT nbit	/* Number of bits to extract (1 to 11) */
+WORD* create_huffman_lut (	/* Pointer to the table (NULL:no memory available) */
+	JDEC* jd,				/* Pointer to the decompressor object */
+	const BYTE* hbits,		/* Pointer to the bit distribution table */
+	const WORD* hcode,		/* Pointer to the code word table */
+	const BYTE* hdata		/* Pointer to the data table */
 )
 {
-	BYTE msk, s, *dp;
-	UINT dc, v, f;
-
-
-	msk = jd->dmsk; dc = jd->dctr; dp = jd->dptr;	/* Bit mask, number of data available, read ptr */
-	s = *dp; v = f = 0;
-	do {
-		if (!msk) {				/* Next byte? */
-			if (!dc) {			/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
-				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
-			} else {
-				dp++;			/* Next data ptr */
-			}
-			dc--;				/* Decrement number of available bytes */
-			if (f) {			/* In flag sequence? */
-				f = 0;			/* Exit flag sequence */
-				if (*dp != 0) return 0 - (INT)JDR_FMT1;	/* Err: unexpected flag is detected (may be collapted data) */
-				*dp = s = 0xFF;			/* The flag is a data 0xFF */
-			} else {
-				s = *dp;				/* Get next data byte */
-				if (s == 0xFF) {		/* Is start of flag sequence? */
-					f = 1; continue;	/* Enter flag sequence */
-				}
-			}
-			msk = 0x80;		/* Read from MSB */
+	UINT bl, nd, i, n;
+	WORD *lut, *p;
+
+
+	lut = alloc_pool(jd, (1 << JD_HUFF_LUT) * sizeof (WORD));
+	if (!lut) return 0;
+	for (i = 0; i < (1 << JD_HUFF_LUT); i++) lut[i] = 0;	/* Longer codes are not in the table */
+
+	for (bl = 1; bl <= JD_HUFF_LUT; bl++) {
+		for (nd = *hbits++; nd; nd--) {	/* Every entry with the code word as leading bits */
+			n = 1 << (JD_HUFF_LUT - bl);
+			p = lut + (((UINT)*hcode++ << (JD_HUFF_LUT - bl)) & ((1 << JD_HUFF_LUT) - 1));
+			for (i = 0; i < n; i++) p[i] = (WORD)(bl << 8 | *hdata);
+			hdata++;
 		}
-		v <<= 1;	/* Get a bit */
-		if (s & msk) v++;
-		msk >>= 1;
-		nbit--;
-	} while (nbit);
-	jd->dmsk = msk; jd->dctr = dc; jd->dptr = dp;
+	}
 
-	return (INT)v;
+	return lut;
 }
+#endif
 
 
 
 
 /*-----------------------------------------------------------------------*/
-/* Extract a huffman decoded data from input stream                      */
+/* Get a byte from input stream                                          */
 /*-----------------------------------------------------------------------*/
 
 static
-INT huffext (			/* >=0: decoded data, <0: error code */
-	JDEC* jd,			/* Pointer to the decompressor object */
-	const BYTE* hbits,	/* Pointer to the bit distribution table */
-	const WORD* hcode,	/* Pointer to the code word table */
-	const BYTE* hdata	/* Pointer to the data table */
+INT getbyte (	/* >=0: data byte, <0: end of input */
+	JDEC* jd	/* Pointer to the decompressor object */
 )
 {
-	BYTE msk, s, *dp;
-	UINT dc, v, f, bl, nd;
-
-
-	msk = jd->dmsk; dc = jd->dctr; dp = jd->dptr;	/* Bit mask, number of data available, read ptr */
-	s = *dp; v = f = 0;
-	bl = 16;	/* Max code length */
-	do {
-		if (!msk) {		/* Next byte? */
-			if (!dc) {	/* No input data is available, re-fill input buffer */
-				dp = jd->inbuf;	/* Top of input buffer */
-				dc = jd->infunc(jd, dp, JD_SZBUF);
-				if (!dc) return 0 - (INT)JDR_INP;	/* Err: read error or wrong stream termination */
-			} else {
-				dp++;	/* Next data ptr */
-			}
-			dc--;		/* Decrement number of available bytes */
-			if (f) {		/* In flag sequence? */
-				f = 0;		/* Exit flag sequence */
-				if (*dp != 0)
-					return 0 - (INT)JDR_FMT1;	/* Err: unexpected flag is detected (may be collapted data) */
-				*dp = s = 0xFF;			/* The flag is a data 0xFF */
-			} else {
-				s = *dp;				/* Get next data byte */
-				if (s == 0xFF) {		/* Is start of flag sequence? */
-					f = 1; continue;	/* Enter flag sequence, get trailing byte */
-				}
-			}
-			msk = 0x80;		/* Read from MSB */
-		}
-		v <<= 1;	/* Get a bit */
-		if (s & msk) v++;
-		msk >>= 1;
+	if (!jd->dctr) {	/* No input data is available, re-fill input buffer */
+		jd->dptr = jd->inbuf;
+		jd->dctr = jd->infunc(jd, jd->dptr, JD_SZBUF);
+		if (!jd->dctr) return -1;
+	} else {
+		jd->dptr++;		/* Next data ptr */
+	}
+	jd->dctr--;			/* Decrement number of available bytes */
 
-		for (nd = *hbits++; nd; nd--) {	/* Search the code word in this bit length */
-			if (v == *hcode++) {		/* Matched? */
-				jd->dmsk = msk; jd->dctr = dc; jd->dptr = dp;
-				return *hdata;			/* Return the decoded data */
+	return *jd->dptr;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read ahead the bit stream up to a marker or the end of input          */
+/*-----------------------------------------------------------------------*/
+
+static
+void fill (
+	JDEC* jd	/* Pointer to the decompressor object */
+)
+{
+	DWORD w = jd->wreg;
+	UINT n = jd->dbit;
+	INT d;
+
+
+	while (n <= 24 && !jd->marker) {
+		d = getbyte(jd);
+		if (d == 0xFF) {			/* Is start of flag sequence? */
+			d = getbyte(jd);
+			if (d > 0) {			/* Not a stuffed data 0xFF, leave the marker to restart() */
+				jd->marker = 0xFF00 | d;
+				break;
 			}
-			hdata++;
+			if (!d) d = 0xFF;		/* The flag is a data 0xFF, the stream is never written */
+		}
+		if (d < 0) {				/* Read error or wrong stream termination */
+			jd->marker = 1;
+			break;
 		}
-		bl--;
-	} while (bl);
+		w |= (DWORD)d << (24 - n);
+		n += 8;
+	}
+	jd->wreg = w; jd->dbit = (BYTE)n;
+}
 
-	return 0 - (INT)JDR_FMT1;	/* Err: code not found (may be collapted data) */
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Extract N bits from input stream                                      */
+/*-----------------------------------------------------------------------*/
+
+static
+INT bitext (	/* >=0: extracted data, <0: error code */
+	JDEC* jd,	/* Pointer to the decompressor object */
+	UINT nbit	/* Number of bits to extract (1 to 11) */
+)
+{
+	UINT v;
+
+
+	if (jd->dbit < nbit) {
+		fill(jd);
+		if (jd->dbit < nbit)	/* Err: read error, wrong stream termination or unexpected flag (may be collapted data) */
+			return 0 - (INT)(jd->marker == 1 ? JDR_INP : JDR_FMT1);
+	}
+	v = jd->wreg >> (32 - nbit);
+	jd->wreg <<= nbit; jd->dbit -= nbit;
+
+	return (INT)v;
 }
 
 
 
 
 /*-----------------------------------------------------------------------*/
-/* Apply Inverse-DCT in Arai Algorithm (see also aa_idct.png)            */
+/* Extract a huffman decoded data from input stream                      */
 /*-----------------------------------------------------------------------*/
 
 static
-void block_idct (
-	LONG* src,	/* Input block data (de-quantized and pre-scaled for Arai Algorithm) */
-	BYTE* dst	/* Pointer to the destination to store the block as byte array */
+INT huffext (			/* >=0: decoded data, <0: error code */
+	JDEC* jd,			/* Pointer to the decompressor object */
+	const BYTE* hbits,	/* Pointer to the bit distribution table */
+	const WORD* hcode,	/* Pointer to the code word table */
+	const BYTE* hdata,	/* Pointer to the data table */
+	const WORD* hlut	/* Pointer to the lookup table, NULL if there is none */
 )
 {
-	const LONG M13 = (LONG)(1.41421*4096), M2 = (LONG)(1.08239*4096), M4 = (LONG)(2.61313*4096), M5 = (LONG)(1.84776*4096);
-	LONG v0, v1, v2, v3, v4, v5, v6, v7;
-	LONG t10, t11, t12, t13;
-	UINT i;
+	DWORD w;
+	UINT v, bl, nd;
 
-	/* Process columns */
-	for (i = 0; i < 8; i++) {
-		v0 = src[8 * 0];	/* Get even elements */
-		v1 = src[8 * 2];
-		v2 = src[8 * 4];
-		v3 = src[8 * 6];
-
-		t10 = v0 + v2;		/* Process the even elements */
-		t12 = v0 - v2;
-		t11 = (v1 - v3) * M13 >> 12;
-		v3 += v1;
-		t11 -= v3;
-		v0 = t10 + v3;
-		v3 = t10 - v3;
-		v1 = t11 + t12;
-		v2 = t12 - t11;
-
-		v4 = src[8 * 7];	/* Get odd elements */
-		v5 = src[8 * 1];
-		v6 = src[8 * 5];
-		v7 = src[8 * 3];
-
-		t10 = v5 - v4;		/* Process the odd elements */
-		t11 = v5 + v4;
-		t12 = v6 - v7;
-		v7 += v6;
-		v5 = (t11 - v7) * M13 >> 12;
-		v7 += t11;
-		t13 = (t10 + t12) * M5 >> 12;
-		v4 = t13 - (t10 * M2 >> 12);
-		v6 = t13 - (t12 * M4 >> 12) - v7;
-		v5 -= v6;
-		v4 -= v5;
-
-		src[8 * 0] = v0 + v7;	/* Write-back transformed values */
-		src[8 * 7] = v0 - v7;
-		src[8 * 1] = v1 + v6;
-		src[8 * 6] = v1 - v6;
-		src[8 * 2] = v2 + v5;
-		src[8 * 5] = v2 - v5;
-		src[8 * 3] = v3 + v4;
-		src[8 * 4] = v3 - v4;
-
-		src++;	/* Next column */
+
+	if (jd->dbit < 16) fill(jd);	/* Longest code word, missing bits are read as zeros */
+	w = jd->wreg;
+
+#if JD_HUFF_LUT
+	if (hlut && (v = hlut[w >> (32 - JD_HUFF_LUT)]) != 0) {	/* Short code word found by its leading bits? */
+		bl = v >> 8;
+		if (bl <= jd->dbit) {
+			jd->wreg = w << bl; jd->dbit -= bl;
+			return v & 0xFF;		/* Return the decoded data */
+		}
+		return 0 - (INT)(jd->marker == 1 ? JDR_INP : JDR_FMT1);	/* Err: stream ends in the code word */
 	}
+#endif
 
-	/* Process rows */
-	src -= 8;
-	for (i = 0; i < 8; i++) {
-		v0 = src[0] + (128L << 8);	/* Get even elements (remove DC offset (-128) here) */
-		v1 = src[2];
-		v2 = src[4];
-		v3 = src[6];
-
-		t10 = v0 + v2;				/* Process the even elements */
-		t12 = v0 - v2;
-		t11 = (v1 - v3) * M13 >> 12;
-		v3 += v1;
-		t11 -= v3;
-		v0 = t10 + v3;
-		v3 = t10 - v3;
-		v1 = t11 + t12;
-		v2 = t12 - t11;
-
-		v4 = src[7];				/* Get odd elements */
-		v5 = src[1];
-		v6 = src[5];
-		v7 = src[3];
-
-		t10 = v5 - v4;				/* Process the odd elements */
-		t11 = v5 + v4;
-		t12 = v6 - v7;
-		v7 += v6;
-		v5 = (t11 - v7) * M13 >> 12;
-		v7 += t11;
-		t13 = (t10 + t12) * M5 >> 12;
-		v4 = t13 - (t10 * M2 >> 12);
-		v6 = t13 - (t12 * M4 >> 12) - v7;
-		v5 -= v6;
-		v4 -= v5;
-
-		dst[0] = BYTECLIP((v0 + v7) >> 8);	/* Descale the transformed values 8 bits and output */
-		dst[7] = BYTECLIP((v0 - v7) >> 8);
-		dst[1] = BYTECLIP((v1 + v6) >> 8);
-		dst[6] = BYTECLIP((v1 - v6) >> 8);
-		dst[2] = BYTECLIP((v2 + v5) >> 8);
-		dst[5] = BYTECLIP((v2 - v5) >> 8);
-		dst[3] = BYTECLIP((v3 + v4) >> 8);
-		dst[4] = BYTECLIP((v3 - v4) >> 8);
-		dst += 8;
-
-		src += 8;	/* Next row */
+	for (bl = 1; bl <= 16; bl++) {	/* Search the code word by its length */
+		v = w >> (32 - bl);
+		for (nd = *hbits++; nd; nd--) {	/* Search the code word in this bit length */
+			if (v == *hcode++) {		/* Matched? */
+				if (bl > jd->dbit) break;
+				jd->wreg = w << bl; jd->dbit -= bl;
+				return *hdata;			/* Return the decoded data */
+			}
+			hdata++;
+		}
+		if (bl > jd->dbit) return 0 - (INT)(jd->marker == 1 ? JDR_INP : JDR_FMT1);	/* Err: stream ends in the code word */
 	}
+
+	return 0 - (INT)JDR_FMT1;	/* Err: code not found (may be collapted data) */
 }
 
 
@@ -479,15 +430,16 @@ void block_idct (
 
 static
 JRESULT mcu_load (
-	JDEC* jd		/* Pointer to the decompressor object */
+	JDEC* jd,		/* Pointer to the decompressor object */
+	UINT parse		/* Only decode the stream, the MCU is not output */
 )
 {
 	LONG *tmp = (LONG*)jd->workbuf;	/* Block working buffer for de-quantize and IDCT */
-	UINT blk, nby, nbc, i, z, id, cmp;
+	UINT blk, nby, nbc, i, z, id, cmp, skip;
 	INT b, d, e;
 	BYTE *bp;
 	const BYTE *hb, *hd;
-	const WORD *hc;
+	const WORD *hc, *hl;
 	const LONG *dqf;
 
 
@@ -498,12 +450,13 @@ JRESULT mcu_load (
 	for (blk = 0; blk < nby + nbc; blk++) {
 		cmp = (blk < nby) ? 0 : blk - nby + 1;	/* Component number 0:Y, 1:Cb, 2:Cr */
 		id = cmp ? 1 : 0;						/* Huffman table ID of the component */
+		skip = parse || (cmp && jd->outfmt == JD_OUT_GRAY);	/* Only parse the chroma blocks for gray output */
 
 		/* Extract a DC element from input stream */
 		hb = jd->huffbits[id][0];				/* Huffman table for the DC element */
 		hc = jd->huffcode[id][0];
 		hd = jd->huffdata[id][0];
-		b = huffext(jd, hb, hc, hd);			/* Extract a huffman coded data (bit length) */
+		b = huffext(jd, hb, hc, hd, jd->hufflut[id][0]);	/* Extract a huffman coded data (bit length) */
 		if (b < 0) return 0 - b;				/* Err: invalid code or input */
 		d = jd->dcv[cmp];						/* DC value of previous block */
 		if (b) {								/* If there is any difference from previous block */
@@ -518,13 +471,15 @@ JRESULT mcu_load (
 		tmp[0] = d * dqf[0] >> 8;				/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
 
 		/* Extract following 63 AC elements from input stream */
-		for (i = 1; i < 64; i++) tmp[i] = 0;	/* Clear rest of elements */
+		if (!skip)
+			for (i = 1; i < 64; i++) tmp[i] = 0;	/* Clear rest of elements */
 		hb = jd->huffbits[id][1];				/* Huffman table for the AC elements */
 		hc = jd->huffcode[id][1];
 		hd = jd->huffdata[id][1];
+		hl = jd->hufflut[id][1];
 		i = 1;					/* Top of the AC elements */
 		do {
-			b = huffext(jd, hb, hc, hd);		/* Extract a huffman coded value (zero runs and bit length) */
+			b = huffext(jd, hb, hc, hd, hl);	/* Extract a huffman coded value (zero runs and bit length) */
 			if (b == 0) break;					/* EOB? */
 			if (b < 0) return 0 - b;			/* Err: invalid code or input error */
 			z = (UINT)b >> 4;					/* Number of leading zero elements */
@@ -538,14 +493,17 @@ JRESULT mcu_load (
 				b = 1 << (b - 1);				/* MSB position */
 				if (!(d & b)) d -= (b << 1) - 1;/* Restore negative value if needed */
 				z = ZIG(i);						/* Zigzag-order to raster-order converted index */
-				tmp[z] = d * dqf[z] >> 8;		/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+				if (!skip)
+					tmp[z] = d * dqf[z] >> 8;	/* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
 			}
 		} while (++i < 64);		/* Next AC element */
 
-		if (JD_USE_SCALE && jd->scale == 3)
+		if (skip)
+			;							/* Block not output */
+		else if (JD_USE_SCALE && jd->scale == 3)
 			*bp = (*tmp / 256) + 128;	/* If scale ratio is 1/8, IDCT can be ommited and only DC element is used */
 		else
-			block_idct(tmp, bp);		/* Apply IDCT and store the block to the MCU buffer */
+			jd->dsp->idct(tmp, bp);		/* Apply IDCT and store the block to the MCU buffer */
 
 		bp += 64;				/* Next block */
 	}
@@ -557,7 +515,7 @@ JRESULT mcu_load (
 
 
 /*-----------------------------------------------------------------------*/
-/* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
+/* Output an MCU: Convert YCrCb to the output format and output it      */
 /*-----------------------------------------------------------------------*/
 
 static
@@ -569,7 +527,7 @@ JRESULT mcu_output (
 )
 {
 	const INT CVACC = (sizeof (INT) > 2) ? 1024 : 128;
-	UINT ix, iy, mx, my, rx, ry;
+	UINT ix, iy, mx, my, rx, ry, n;
 	INT yy, cb, cr;
 	BYTE *py, *pc, *rgb24;
 	JRECT rect;
@@ -585,6 +543,7 @@ JRESULT mcu_output (
 	}
 	rect.left = x; rect.right = x + rx - 1;				/* Rectangular area in the frame buffer */
 	rect.top = y; rect.bottom = y + ry - 1;
+	n = (jd->outfmt == JD_OUT_GRAY) ? 1 : 3;			/* Bytes per pixel */
 
 
 	if (!JD_USE_SCALE || jd->scale != 3) {	/* Not for 1/8 scaling */
@@ -600,49 +559,46 @@ JRESULT mcu_output (
 			} else {			/* Single block height */
 				pc += mx * 8 + iy * 8;
 			}
-			for (ix = 0; ix < mx; ix++) {
-				cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
-				cr = pc[64] - 128;
-				if (mx == 16) {					/* Double block width? */
-					if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
-					pc += ix & 1;				/* Increase chroma pointer every two pixels */
-				} else {						/* Single block width */
-					pc++;						/* Increase chroma pointer every pixel */
+			if (jd->outfmt == JD_OUT_GRAY) {		/* Copy Y */
+				memcpy(rgb24, py, 8);
+				if (mx == 16) memcpy(rgb24 + 8, py + 64, 8);
+			} else if (jd->outfmt == JD_OUT_YCC) {	/* Interleave Y, Cb and Cr */
+				BYTE *d = rgb24;
+				for (ix = 0; ix < mx; ix += 8, py += 64) {
+					for (yy = 0; yy < 8; yy++) {
+						cb = (mx == 16) ? ((INT)ix + yy) >> 1 : yy;
+						*d++ = py[yy];
+						*d++ = pc[cb];
+						*d++ = pc[cb + 64];
+					}
 				}
-				yy = *py++;			/* Get Y component */
-
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb) / CVACC);
+			} else {
+				jd->dsp->ycc_row(rgb24, py, pc, mx);	/* Convert YCbCr to RGB */
 			}
+			rgb24 += mx * n;
 		}
 
 		/* Descale the MCU rectangular if needed */
 		if (JD_USE_SCALE && jd->scale) {
-			UINT x, y, r, g, b, s, w, a;
+			UINT x, y, c, s, w, a, sum[3];
 			BYTE *op;
 
-			/* Get averaged RGB value of each square correcponds to a pixel */
+			/* Get averaged value of each square correcponds to a pixel */
 			s = jd->scale * 2;	/* Bumber of shifts for averaging */
 			w = 1 << jd->scale;	/* Width of square */
-			a = (mx - w) * 3;	/* Bytes to skip for next line in the square */
+			a = (mx - w) * n;	/* Bytes to skip for next line in the square */
 			op = (BYTE*)jd->workbuf;
 			for (iy = 0; iy < my; iy += w) {
 				for (ix = 0; ix < mx; ix += w) {
-					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * 3;
-					r = g = b = 0;
-					for (y = 0; y < w; y++) {	/* Accumulate RGB value in the square */
+					rgb24 = (BYTE*)jd->workbuf + (iy * mx + ix) * n;
+					sum[0] = sum[1] = sum[2] = 0;
+					for (y = 0; y < w; y++) {	/* Accumulate the components in the square */
 						for (x = 0; x < w; x++) {
-							r += *rgb24++;
-							g += *rgb24++;
-							b += *rgb24++;
+							for (c = 0; c < n; c++) sum[c] += *rgb24++;
 						}
 						rgb24 += a;
-					}							/* Put the averaged RGB value as a pixel */
-					*op++ = (BYTE)(r >> s);
-					*op++ = (BYTE)(g >> s);
-					*op++ = (BYTE)(b >> s);
+					}							/* Put the averaged value as a pixel */
+					for (c = 0; c < n; c++) *op++ = (BYTE)(sum[c] >> s);
 				}
 			}
 		}
@@ -661,10 +617,18 @@ JRESULT mcu_output (
 				yy = *py;	/* Get Y component */
 				py += 64;
 
-				/* Convert YCbCr to RGB */
-				*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
-				*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
-				*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb / CVACC));
+				if (jd->outfmt == JD_OUT_GRAY) {
+					*rgb24++ = (BYTE)yy;
+				} else if (jd->outfmt == JD_OUT_YCC) {
+					*rgb24++ = (BYTE)yy;
+					*rgb24++ = pc[0];
+					*rgb24++ = pc[64];
+				} else {
+					/* Convert YCbCr to RGB */
+					*rgb24++ = /* R */ BYTECLIP(yy + ((INT)(1.402 * CVACC) * cr / CVACC));
+					*rgb24++ = /* G */ BYTECLIP(yy - ((INT)(0.344 * CVACC) * cb + (INT)(0.714 * CVACC) * cr) / CVACC);
+					*rgb24++ = /* B */ BYTECLIP(yy + ((INT)(1.772 * CVACC) * cb / CVACC));
+				}
 			}
 		}
 	}
@@ -677,17 +641,15 @@ JRESULT mcu_output (
 
 		s = d = (BYTE*)jd->workbuf;
 		for (y = 0; y < ry; y++) {
-			for (x = 0; x < rx; x++) {	/* Copy effective pixels */
-				*d++ = *s++;
-				*d++ = *s++;
+			for (x = 0; x < rx * n; x++) {	/* Copy effective pixels */
 				*d++ = *s++;
 			}
-			s += (mx - rx) * 3;	/* Skip truncated pixels */
+			s += (mx - rx) * n;	/* Skip truncated pixels */
 		}
 	}
 
 	/* Convert RGB888 to RGB565 if needed */
-	if (JD_FORMAT == 1) {
+	if (JD_FORMAT == 1 && jd->outfmt == JD_OUT_RGB) {
 		BYTE *s = (BYTE*)jd->workbuf;
 		WORD w, *d = (WORD*)s;
 		UINT n = rx * ry;
@@ -717,26 +679,25 @@ JRESULT restart (
 	WORD rstn	/* Expected restert sequense number */
 )
 {
-	UINT i, dc;
+	INT b;
 	WORD d;
-	BYTE *dp;
-
-
-	/* Discard padding bits and get two bytes from the input stream */
-	dp = jd->dptr; dc = jd->dctr;
-	d = 0;
-	for (i = 0; i < 2; i++) {
-		if (!dc) {	/* No input data is available, re-fill input buffer */
-			dp = jd->inbuf;
-			dc = jd->infunc(jd, dp, JD_SZBUF);
-			if (!dc) return JDR_INP;
-		} else {
-			dp++;
-		}
-		dc--;
-		d = (d << 8) | *dp;	/* Get a byte */
+
+
+	/* Discard padding bits and get the marker, from the read ahead or the input stream */
+	if (jd->dbit >= 8) return JDR_FMT1;	/* Err: more than padding bits before the marker */
+	d = jd->marker;
+	if (d == 1) return JDR_INP;
+	if (!d) {					/* The read ahead ended before the marker */
+		b = getbyte(jd);
+		if (b < 0) return JDR_INP;
+		d = (WORD)b;
+	}
+	while (d == 0xFF || d == 0xFFFF) {	/* Get the byte after the flag and its fill bytes */
+		b = getbyte(jd);
+		if (b < 0) return JDR_INP;
+		d = 0xFF00 | b;
 	}
-	jd->dptr = dp; jd->dctr = dc; jd->dmsk = 0;
+	jd->wreg = 0; jd->dbit = 0; jd->marker = 0;
 
 	/* Check the marker */
 	if ((d & 0xFFD8) != 0xFFD0 || (d & 7) != (rstn & 7))
@@ -751,6 +712,62 @@ JRESULT restart (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Skip the rest of a restart interval without decoding it               */
+/*-----------------------------------------------------------------------*/
+
+static
+JRESULT skip_interval (
+	JDEC* jd	/* Pointer to the decompressor object */
+)
+{
+	INT b;
+
+
+	jd->wreg = 0; jd->dbit = 0;		/* Drop the read ahead */
+	while (!jd->marker) {			/* Search the marker that ends the interval, unless the read ahead stopped at it */
+		b = getbyte(jd);
+		if (b < 0) return JDR_INP;
+		if (b != 0xFF) continue;
+		do {
+			b = getbyte(jd);
+			if (b < 0) return JDR_INP;
+		} while (b == 0xFF);		/* Fill bytes */
+		if (b) jd->marker = 0xFF00 | b;	/* Not a stuffed data 0xFF */
+	}
+	if (jd->marker == 1) return JDR_INP;
+
+	return JDR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Check if an MCU is to be output                                       */
+/*-----------------------------------------------------------------------*/
+
+static
+UINT mcu_in_roi (	/* 1:output, 0:only parsed */
+	JDEC* jd,		/* Pointer to the decompressor object */
+	UINT x,			/* MCU position in the image (left of the MCU) */
+	UINT y			/* MCU position in the image (top of the MCU) */
+)
+{
+	const JRECT *r;
+	UINT i;
+
+
+	if (!jd->nroi) return 1;
+	for (i = 0, r = jd->roi; i < jd->nroi; i++, r++) {
+		if (x <= r->right && x + jd->msx * 8 > r->left && y <= r->bottom && y + jd->msy * 8 > r->top) return 1;
+	}
+	return 0;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Analyze the JPEG image and Initialize decompressor object             */
 /*-----------------------------------------------------------------------*/
@@ -758,6 +775,21 @@ JRESULT restart (
 #define	LDB_WORD(ptr)		(WORD)(((WORD)*((BYTE*)(ptr))<<8)|(WORD)*(BYTE*)((ptr)+1))
 
 
+/* Input function of jd_prepare_mem(), only used for the segments before the bit stream */
+static
+UINT mem_input (
+	JDEC* jd,	/* Pointer to the decompressor object */
+	BYTE* buff,	/* Pointer to the read buffer, NULL to skip */
+	UINT nd		/* Number of bytes to read or skip */
+)
+{
+	if (nd > jd->mem_len - jd->mem_ofs) nd = jd->mem_len - jd->mem_ofs;
+	if (buff) memcpy(buff, jd->mem + jd->mem_ofs, nd);
+	jd->mem_ofs += nd;
+	return nd;
+}
+
+
 JRESULT jd_prepare (
 	JDEC* jd,			/* Blank decompressor object */
 	UINT (*infunc)(JDEC*, BYTE*, UINT),	/* JPEG strem input function */
@@ -778,14 +810,18 @@ JRESULT jd_prepare (
 	jd->pool = pool;		/* Work memroy */
 	jd->sz_pool = sz_pool;	/* Size of given work memory */
 	jd->infunc = infunc;	/* Stream input function */
+	if (infunc != mem_input) jd->mem = 0;
 	jd->device = dev;		/* I/O device identifier */
 	jd->nrst = 0;			/* No restart interval (default) */
+	jd->dsp = jd_dsp_select_kernels();
+	jd->wreg = 0; jd->dbit = 0; jd->marker = 0;
 
 	for (i = 0; i < 2; i++) {	/* Nulls pointers */
 		for (j = 0; j < 2; j++) {
 			jd->huffbits[i][j] = 0;
 			jd->huffcode[i][j] = 0;
 			jd->huffdata[i][j] = 0;
+			jd->hufflut[i][j] = 0;
 		}
 	}
 	for (i = 0; i < 4; i++) jd->qttbl[i] = 0;
@@ -889,10 +925,19 @@ JRESULT jd_prepare (
 			if (!jd->workbuf) return JDR_MEM1;			/* Err: not enough memory */
 			jd->mcubuf = alloc_pool(jd, (n + 2) * 64);	/* Allocate MCU working buffer */
 			if (!jd->mcubuf) return JDR_MEM1;			/* Err: not enough memory */
+#if JD_HUFF_LUT
+			for (i = 0; i < 4; i++) {					/* Huffman lookup tables from what is left, decode code by code without */
+				jd->hufflut[i >> 1][i & 1] = create_huffman_lut(jd, jd->huffbits[i >> 1][i & 1], jd->huffcode[i >> 1][i & 1], jd->huffdata[i >> 1][i & 1]);
+			}
+#endif
 
 			/* Pre-load the JPEG data to extract it from the bit stream */
-			jd->dptr = seg; jd->dctr = 0; jd->dmsk = 0;	/* Prepare to read bit stream */
-			if (ofs %= JD_SZBUF) {						/* Align read offset to JD_SZBUF */
+			jd->dptr = seg; jd->dctr = 0;				/* Prepare to read bit stream */
+			if (jd->mem) {								/* Read the rest of the buffer in place */
+				jd->dptr = (BYTE*)jd->mem + jd->mem_ofs - 1;
+				jd->dctr = jd->mem_len - jd->mem_ofs;
+				jd->mem_ofs = jd->mem_len;				/* A refill finds the end of the data */
+			} else if (ofs %= JD_SZBUF) {						/* Align read offset to JD_SZBUF */
 				jd->dctr = jd->infunc(jd, seg + ofs, JD_SZBUF - (UINT)ofs);
 				jd->dptr = seg + ofs - 1;
 			}
@@ -925,6 +970,30 @@ JRESULT jd_prepare (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Analyze a JPEG image held in memory, whose bit stream is then read in */
+/* place: no input function is called and no data copied while decoding */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_prepare_mem (
+	JDEC* jd,			/* Blank decompressor object */
+	const BYTE* data,	/* JPEG data, must stay valid until the decompression is done */
+	UINT len,			/* Size of the JPEG data */
+	void* pool,			/* Working buffer for the decompression session */
+	UINT sz_pool,		/* Size of working buffer */
+	void* dev			/* I/O device identifier for the session */
+)
+{
+	if (!data) return JDR_PAR;
+	jd->mem = data;
+	jd->mem_len = len;
+	jd->mem_ofs = 0;
+	return jd_prepare(jd, mem_input, pool, sz_pool, dev);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Start to decompress the JPEG picture                                  */
 /*-----------------------------------------------------------------------*/
@@ -935,29 +1004,71 @@ JRESULT jd_decomp (
 	BYTE scale								/* Output de-scaling factor (0 to 3) */
 )
 {
-	UINT x, y, mx, my;
-	WORD rst, rsc;
+	return jd_decomp_fmt(jd, outfunc, scale, JD_OUT_RGB);
+}
+
+
+JRESULT jd_decomp_fmt (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* Output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	BYTE fmt								/* Output format (JD_OUT_*) */
+)
+{
+	return jd_decomp_roi(jd, outfunc, scale, fmt, 0, 0);
+}
+
+
+JRESULT jd_decomp_roi (
+	JDEC* jd,								/* Initialized decompression object */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* Output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	BYTE fmt,								/* Output format (JD_OUT_*) */
+	const JRECT* roi,						/* Rectangles to output (image pixels, before de-scaling) */
+	UINT nroi								/* Number of rectangles, 0 to output the whole image */
+)
+{
+	UINT x, y, mx, my, nx, n, i, j, bottom;
 	JRESULT rc;
 
 
-	if (scale > (JD_USE_SCALE ? 3 : 0)) return JDR_PAR;
+	if (scale > (JD_USE_SCALE ? 3 : 0) || fmt > JD_OUT_YCC || (nroi && !roi)) return JDR_PAR;
 	jd->scale = scale;
+	jd->outfmt = fmt;
+	jd->roi = roi; jd->nroi = nroi;
 
 	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
+	nx = (jd->width + mx - 1) / mx;				/* Number of MCUs in a row and in the image */
+	n = nx * ((jd->height + my - 1) / my);
+	for (i = bottom = 0; i < nroi; i++) {		/* Bottom of the lowest rectangle */
+		if (roi[i].bottom > bottom) bottom = roi[i].bottom;
+	}
 
 	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;	/* Initialize DC values */
-	rst = rsc = 0;
 
 	rc = JDR_OK;
-	for (y = 0; y < jd->height; y += my) {		/* Vertical loop of MCUs */
-		for (x = 0; x < jd->width; x += mx) {	/* Horizontal loop of MCUs */
-			if (jd->nrst && rst++ == jd->nrst) {	/* Process restart interval if enabled */
-				rc = restart(jd, rsc++);
+	for (i = 0; i < n; i++) {					/* Loop of MCUs in raster order */
+		x = (i % nx) * mx; y = (i / nx) * my;
+		if (nroi && y > bottom) break;			/* All rectangles are done, the rest of the stream is not needed */
+		if (jd->nrst && i % jd->nrst == 0) {	/* Process restart interval if enabled */
+			if (i) {
+				rc = restart(jd, (WORD)(i / jd->nrst - 1));
 				if (rc != JDR_OK) return rc;
-				rst = 1;
 			}
-			rc = mcu_load(jd);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
-			if (rc != JDR_OK) return rc;
+			if (nroi && i + jd->nrst < n) {		/* Skip to the next interval by its marker if no MCU of this one is output */
+				for (j = i; j < i + jd->nrst && !mcu_in_roi(jd, (j % nx) * mx, (j / nx) * my); j++) ;
+				if (j == i + jd->nrst) {
+					rc = skip_interval(jd);
+					if (rc != JDR_OK) return rc;
+					i += jd->nrst - 1;
+					continue;
+				}
+			}
+		}
+		j = mcu_in_roi(jd, x, y);
+		rc = mcu_load(jd, !j);					/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+		if (rc != JDR_OK) return rc;
+		if (j) {
 			rc = mcu_output(jd, outfunc, x, y);	/* Output the MCU (color space conversion, scaling and output) */
 			if (rc != JDR_OK) return rc;
 		}
@@ -965,6 +1076,86 @@ JRESULT jd_decomp (
 
 	return rc;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Share a prepared decompression object with another task: the tables   */
+/* are shared read only, only the IDCT and MCU buffers are its own       */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_prepare_copy (
+	JDEC* jd,			/* Decompressor object to set up */
+	const JDEC* src,	/* Object prepared by jd_prepare_mem(), must stay valid while jd is used */
+	void* pool,			/* Working buffer of jd, JD_COPY_POOL bytes are enough for any MCU */
+	UINT sz_pool		/* Size of working buffer */
+)
+{
+	UINT n, len;
+
+
+	if (!pool || !src->mem || !src->mcubuf) return JDR_PAR;	/* Only an in memory stream can be read by several tasks */
+
+	*jd = *src;
+	jd->pool = pool;
+	jd->sz_pool = sz_pool;
+
+	n = jd->msy * jd->msx;						/* Same buffers as jd_prepare(), in the same order */
+	len = n * 64 * 2 + 64;
+	if (len < 256) len = 256;
+	jd->workbuf = alloc_pool(jd, len);
+	if (!jd->workbuf) return JDR_MEM1;
+	jd->mcubuf = alloc_pool(jd, (n + 2) * 64);
+	if (!jd->mcubuf) return JDR_MEM1;
+
+	return JDR_OK;
+}
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress one restart interval of an in memory JPEG                  */
+/*-----------------------------------------------------------------------*/
+
+JRESULT jd_decomp_rst (
+	JDEC* jd,								/* Object of jd_prepare_mem() or jd_prepare_copy() */
+	UINT (*outfunc)(JDEC*, void*, JRECT*),	/* Output function */
+	BYTE scale,								/* Output de-scaling factor (0 to 3) */
+	BYTE fmt,								/* Output format (JD_OUT_*) */
+	UINT rst,								/* Restart interval, 0 for the MCUs before the first RST marker */
+	const BYTE* data,						/* Its bit stream, from the SOS segment or RST marker before it */
+	UINT len								/* Number of bytes of it, up to the next marker */
+)
+{
+	UINT mx, my, nx, n, i, end;
+	JRESULT rc;
+
+
+	if (!jd->mem || !jd->nrst || !data || scale > (JD_USE_SCALE ? 3 : 0) || fmt > JD_OUT_YCC) return JDR_PAR;
+	jd->scale = scale;
+	jd->outfmt = fmt;
+	jd->roi = 0; jd->nroi = 0;
+
+	mx = jd->msx * 8; my = jd->msy * 8;			/* Size of the MCU (pixel) */
+	nx = (jd->width + mx - 1) / mx;				/* Number of MCUs in a row and in the image */
+	n = nx * ((jd->height + my - 1) / my);
+	i = rst * jd->nrst;							/* MCUs of the interval */
+	if (i >= n) return JDR_PAR;
+	end = (n - i > jd->nrst) ? i + jd->nrst : n;
+
+	jd->dptr = (BYTE*)data - 1; jd->dctr = len;	/* Read the interval in place, the end of it ends the input */
+	jd->mem_ofs = jd->mem_len;
+	jd->wreg = 0; jd->dbit = 0; jd->marker = 0;
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;	/* The DC predictions start over at each interval */
+
+	for (rc = JDR_OK; rc == JDR_OK && i < end; i++) {
+		rc = mcu_load(jd, 0);
+		if (rc == JDR_OK) rc = mcu_output(jd, outfunc, (i % nx) * mx, (i / nx) * my);
+	}
+
+	return rc;
+}
 #endif//SUPPORT_JPEG
 
 
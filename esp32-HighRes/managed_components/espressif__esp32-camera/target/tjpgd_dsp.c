@@ -0,0 +1,596 @@
+/*----------------------------------------------------------------------------/
+/ TJpgDec - Inverse DCT and colour conversion kernels
+/-----------------------------------------------------------------------------/
+/ The scalar kernels are block_idct() and the colour conversion loop of
+/ mcu_output() of TJpgDec R0.01b. The SIMD kernels perform the exact same
+/ integer arithmetic, 32-bit wrap around of the IDCT products included, so all
+/ kernel sets produce bit-identical pixels.
+/
+/ On Xtensa only the scalar kernels are built: the ESP32-S2 has no SIMD
+/ extension, and there are no kernels for the PIE extension of the ESP32-S3
+/ yet.
+/----------------------------------------------------------------------------*/
+
+#include "tjpgd_dsp.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define JD_DSP_X86 1
+#include <immintrin.h>
+#else
+#define JD_DSP_X86 0
+#endif
+
+/* IDCT multipliers, scaled up 12 bits */
+#define M13	((LONG)(1.41421*4096))
+#define M2	((LONG)(1.08239*4096))
+#define M4	((LONG)(2.61313*4096))
+#define M5	((LONG)(1.84776*4096))
+
+/* YCbCr to RGB multipliers, scaled up 10 bits */
+#define CVACC	1024
+#define CV_RCR	((INT)(1.402 * CVACC))
+#define CV_GCB	((INT)(0.344 * CVACC))
+#define CV_GCR	((INT)(0.714 * CVACC))
+#define CV_BCB	((INT)(1.772 * CVACC))
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Scalar kernels                                                        */
+/*-----------------------------------------------------------------------*/
+
+#if JD_TBLCLIP
+/* Same as the clip table of tjpgd.c: saturated within -512..511, wrapped around outside */
+#define BYTECLIP(v) clip_tbl((UINT)(v) & 0x3FF)
+
+static inline
+BYTE clip_tbl (
+	UINT m
+)
+{
+	return m < 256 ? (BYTE)m : (m < 512 ? 255 : 0);
+}
+#else
+#define BYTECLIP(v) clip_sat(v)
+
+static inline
+BYTE clip_sat (
+	INT val
+)
+{
+	if (val < 0) val = 0;
+	if (val > 255) val = 255;
+
+	return (BYTE)val;
+}
+#endif
+
+
+static
+void idct_scalar (
+	LONG* src,	/* Input block data (de-quantized and pre-scaled for Arai Algorithm) */
+	BYTE* dst	/* Pointer to the destination to store the block as byte array */
+)
+{
+	LONG v0, v1, v2, v3, v4, v5, v6, v7;
+	LONG t10, t11, t12, t13;
+	UINT i;
+
+	/* Process columns */
+	for (i = 0; i < 8; i++) {
+		v0 = src[8 * 0];	/* Get even elements */
+		v1 = src[8 * 2];
+		v2 = src[8 * 4];
+		v3 = src[8 * 6];
+
+		t10 = v0 + v2;		/* Process the even elements */
+		t12 = v0 - v2;
+		t11 = (v1 - v3) * M13 >> 12;
+		v3 += v1;
+		t11 -= v3;
+		v0 = t10 + v3;
+		v3 = t10 - v3;
+		v1 = t11 + t12;
+		v2 = t12 - t11;
+
+		v4 = src[8 * 7];	/* Get odd elements */
+		v5 = src[8 * 1];
+		v6 = src[8 * 5];
+		v7 = src[8 * 3];
+
+		t10 = v5 - v4;		/* Process the odd elements */
+		t11 = v5 + v4;
+		t12 = v6 - v7;
+		v7 += v6;
+		v5 = (t11 - v7) * M13 >> 12;
+		v7 += t11;
+		t13 = (t10 + t12) * M5 >> 12;
+		v4 = t13 - (t10 * M2 >> 12);
+		v6 = t13 - (t12 * M4 >> 12) - v7;
+		v5 -= v6;
+		v4 -= v5;
+
+		src[8 * 0] = v0 + v7;	/* Write-back transformed values */
+		src[8 * 7] = v0 - v7;
+		src[8 * 1] = v1 + v6;
+		src[8 * 6] = v1 - v6;
+		src[8 * 2] = v2 + v5;
+		src[8 * 5] = v2 - v5;
+		src[8 * 3] = v3 + v4;
+		src[8 * 4] = v3 - v4;
+
+		src++;	/* Next column */
+	}
+
+	/* Process rows */
+	src -= 8;
+	for (i = 0; i < 8; i++) {
+		v0 = src[0] + (128L << 8);	/* Get even elements (remove DC offset (-128) here) */
+		v1 = src[2];
+		v2 = src[4];
+		v3 = src[6];
+
+		t10 = v0 + v2;				/* Process the even elements */
+		t12 = v0 - v2;
+		t11 = (v1 - v3) * M13 >> 12;
+		v3 += v1;
+		t11 -= v3;
+		v0 = t10 + v3;
+		v3 = t10 - v3;
+		v1 = t11 + t12;
+		v2 = t12 - t11;
+
+		v4 = src[7];				/* Get odd elements */
+		v5 = src[1];
+		v6 = src[5];
+		v7 = src[3];
+
+		t10 = v5 - v4;				/* Process the odd elements */
+		t11 = v5 + v4;
+		t12 = v6 - v7;
+		v7 += v6;
+		v5 = (t11 - v7) * M13 >> 12;
+		v7 += t11;
+		t13 = (t10 + t12) * M5 >> 12;
+		v4 = t13 - (t10 * M2 >> 12);
+		v6 = t13 - (t12 * M4 >> 12) - v7;
+		v5 -= v6;
+		v4 -= v5;
+
+		dst[0] = BYTECLIP((v0 + v7) >> 8);	/* Descale the transformed values 8 bits and output */
+		dst[7] = BYTECLIP((v0 - v7) >> 8);
+		dst[1] = BYTECLIP((v1 + v6) >> 8);
+		dst[6] = BYTECLIP((v1 - v6) >> 8);
+		dst[2] = BYTECLIP((v2 + v5) >> 8);
+		dst[5] = BYTECLIP((v2 - v5) >> 8);
+		dst[3] = BYTECLIP((v3 + v4) >> 8);
+		dst[4] = BYTECLIP((v3 - v4) >> 8);
+		dst += 8;
+
+		src += 8;	/* Next row */
+	}
+}
+
+
+static
+void ycc_row_scalar (
+	BYTE* rgb,		/* RGB888 output of the row */
+	const BYTE* py,	/* Y row */
+	const BYTE* pc,	/* Cb row, Cr row 64 bytes later */
+	UINT mx			/* MCU width (8 or 16 pixels) */
+)
+{
+	BYTE out[16 * 3], *rgb24 = out;
+	UINT ix;
+	INT yy, cb, cr;
+
+	for (ix = 0; ix < mx; ix++) {
+		cb = pc[0] - 128; 	/* Get Cb/Cr component and restore right level */
+		cr = pc[64] - 128;
+		if (mx == 16) {					/* Double block width? */
+			if (ix == 8) py += 64 - 8;	/* Jump to next block if double block heigt */
+			pc += ix & 1;				/* Increase chroma pointer every two pixels */
+		} else {						/* Single block width */
+			pc++;						/* Increase chroma pointer every pixel */
+		}
+		yy = *py++;			/* Get Y component */
+
+		/* Convert YCbCr to RGB */
+		*rgb24++ = /* R */ BYTECLIP(yy + (CV_RCR * cr) / CVACC);
+		*rgb24++ = /* G */ BYTECLIP(yy - (CV_GCB * cb + CV_GCR * cr) / CVACC);
+		*rgb24++ = /* B */ BYTECLIP(yy + (CV_BCB * cb) / CVACC);
+	}
+	memcpy(rgb, out, mx * 3);
+}
+
+static const jd_dsp_kernels s_scalar_kernels = { "scalar", idct_scalar, ycc_row_scalar };
+
+
+
+#if JD_DSP_X86
+/*-----------------------------------------------------------------------*/
+/* SIMD kernels                                                          */
+/*-----------------------------------------------------------------------*/
+
+/* Vector form of one 1-D pass of idct_scalar(), every lane carries an independent transform.
+   s[k] holds element k on input and output. MULS(v, c) is (v * c) >> 12 on 32-bit lanes, wrapping like LONG does. */
+#define IDCT1D_VEC(VEC, ADD, SUB, MULS, s) { \
+	VEC v0 = s[0], v1 = s[2], v2 = s[4], v3 = s[6], v4, v5, v6, v7, t10, t11, t12, t13; \
+	t10 = ADD(v0, v2); t12 = SUB(v0, v2); \
+	t11 = MULS(SUB(v1, v3), M13); \
+	v3 = ADD(v3, v1); t11 = SUB(t11, v3); \
+	v0 = ADD(t10, v3); v3 = SUB(t10, v3); v1 = ADD(t11, t12); v2 = SUB(t12, t11); \
+	v4 = s[7]; v5 = s[1]; v6 = s[5]; v7 = s[3]; \
+	t10 = SUB(v5, v4); t11 = ADD(v5, v4); t12 = SUB(v6, v7); v7 = ADD(v7, v6); \
+	v5 = MULS(SUB(t11, v7), M13); v7 = ADD(v7, t11); \
+	t13 = MULS(ADD(t10, t12), M5); \
+	v4 = SUB(t13, MULS(t10, M2)); \
+	v6 = SUB(SUB(t13, MULS(t12, M4)), v7); \
+	v5 = SUB(v5, v6); v4 = SUB(v4, v5); \
+	s[0] = ADD(v0, v7); s[7] = SUB(v0, v7); s[1] = ADD(v1, v6); s[6] = SUB(v1, v6); \
+	s[2] = ADD(v2, v5); s[5] = SUB(v2, v5); s[3] = ADD(v3, v4); s[4] = SUB(v3, v4); \
+}
+
+/* Low 32 bits of the products, SSE2 has no pmulld */
+__attribute__((target("sse2")))
+static inline
+__m128i mulshr12_sse2 (
+	__m128i a,
+	LONG c
+)
+{
+	__m128i b = _mm_set1_epi32(c);
+	__m128i e = _mm_mul_epu32(a, b), o = _mm_mul_epu32(_mm_srli_epi64(a, 32), b);
+	return _mm_srai_epi32(_mm_unpacklo_epi32(_mm_shuffle_epi32(e, 0x08), _mm_shuffle_epi32(o, 0x08)), 12);
+}
+
+__attribute__((target("sse2")))
+static inline
+void transpose_4x4_sse2 (
+	__m128i* a, __m128i* b, __m128i* c, __m128i* d
+)
+{
+	__m128i t0 = _mm_unpacklo_epi32(*a, *b), t1 = _mm_unpacklo_epi32(*c, *d);
+	__m128i t2 = _mm_unpackhi_epi32(*a, *b), t3 = _mm_unpackhi_epi32(*c, *d);
+	*a = _mm_unpacklo_epi64(t0, t1); *b = _mm_unpackhi_epi64(t0, t1);
+	*c = _mm_unpacklo_epi64(t2, t3); *d = _mm_unpackhi_epi64(t2, t3);
+}
+
+/* v[h][row] <-> v[h][col], half 0 holds elements 0..3 and half 1 elements 4..7 */
+__attribute__((target("sse2")))
+static inline
+void transpose_8x8_sse2 (
+	__m128i v[2][8]
+)
+{
+	__m128i t;
+	UINT i;
+
+	transpose_4x4_sse2(&v[0][0], &v[0][1], &v[0][2], &v[0][3]);
+	transpose_4x4_sse2(&v[1][4], &v[1][5], &v[1][6], &v[1][7]);
+	transpose_4x4_sse2(&v[1][0], &v[1][1], &v[1][2], &v[1][3]);
+	transpose_4x4_sse2(&v[0][4], &v[0][5], &v[0][6], &v[0][7]);
+	for (i = 0; i < 4; i++) {
+		t = v[1][i]; v[1][i] = v[0][i + 4]; v[0][i + 4] = t;
+	}
+}
+
+/* Two rows of 4+4 descaled 32-bit values into 16 bytes, clipped like BYTECLIP() */
+__attribute__((target("sse2")))
+static inline
+__m128i clip_rows_sse2 (
+	__m128i a0, __m128i a1, __m128i b0, __m128i b1
+)
+{
+#if JD_TBLCLIP
+	const __m128i m10 = _mm_set1_epi32(0x3FF);
+	__m128i a = _mm_packs_epi32(_mm_and_si128(a0, m10), _mm_and_si128(a1, m10));
+	__m128i b = _mm_packs_epi32(_mm_and_si128(b0, m10), _mm_and_si128(b1, m10));
+	a = _mm_andnot_si128(_mm_cmpgt_epi16(a, _mm_set1_epi16(511)), _mm_min_epi16(a, _mm_set1_epi16(255)));
+	b = _mm_andnot_si128(_mm_cmpgt_epi16(b, _mm_set1_epi16(511)), _mm_min_epi16(b, _mm_set1_epi16(255)));
+	return _mm_packus_epi16(a, b);
+#else
+	return _mm_packus_epi16(_mm_packs_epi32(a0, a1), _mm_packs_epi32(b0, b1));
+#endif
+}
+
+__attribute__((target("sse2")))
+static
+void idct_sse2 (
+	LONG* src,
+	BYTE* dst
+)
+{
+	__m128i v[2][8];
+	UINT h, k;
+
+	/* Columns: v[h][k] holds row k, every lane a column */
+	for (k = 0; k < 8; k++) {
+		v[0][k] = _mm_loadu_si128((const __m128i*)(src + k * 8));
+		v[1][k] = _mm_loadu_si128((const __m128i*)(src + k * 8 + 4));
+	}
+	for (h = 0; h < 2; h++) {
+		IDCT1D_VEC(__m128i, _mm_add_epi32, _mm_sub_epi32, mulshr12_sse2, v[h]);
+	}
+
+	/* Rows: after the transpose v[h][k] holds element k of rows 4h..4h+3 */
+	transpose_8x8_sse2(v);
+	for (h = 0; h < 2; h++) {
+		v[h][0] = _mm_add_epi32(v[h][0], _mm_set1_epi32(128L << 8));	/* Remove DC offset (-128) */
+		IDCT1D_VEC(__m128i, _mm_add_epi32, _mm_sub_epi32, mulshr12_sse2, v[h]);
+		for (k = 0; k < 8; k++) v[h][k] = _mm_srai_epi32(v[h][k], 8);
+	}
+
+	/* Back in raster order, two rows per 16 bytes */
+	transpose_8x8_sse2(v);
+	for (k = 0; k < 8; k += 2) {
+		_mm_storeu_si128((__m128i*)(dst + k * 8), clip_rows_sse2(v[0][k], v[1][k], v[0][k + 1], v[1][k + 1]));
+	}
+}
+
+/* (c1 * a + c2 * b) / CVACC on eight 16-bit lanes, truncated toward zero like the C division */
+__attribute__((target("sse2")))
+static inline
+__m128i ycc_term_sse2 (
+	__m128i a, __m128i b, INT c1, INT c2
+)
+{
+	const __m128i c = _mm_set1_epi32((c2 << 16) | (c1 & 0xFFFF));
+	__m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), c);
+	__m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), c);
+	lo = _mm_srai_epi32(_mm_add_epi32(lo, _mm_and_si128(_mm_srai_epi32(lo, 31), _mm_set1_epi32(CVACC - 1))), 10);
+	hi = _mm_srai_epi32(_mm_add_epi32(hi, _mm_and_si128(_mm_srai_epi32(hi, 31), _mm_set1_epi32(CVACC - 1))), 10);
+	return _mm_packs_epi32(lo, hi);
+}
+
+/* R, G, B of eight pixels as 16-bit lanes. The sums stay within -512..511, where saturation equals BYTECLIP() */
+__attribute__((target("sse2")))
+static inline
+void ycc_8_sse2 (
+	__m128i y, __m128i cb, __m128i cr, __m128i* r, __m128i* g, __m128i* b
+)
+{
+	const __m128i z = _mm_setzero_si128();
+
+	*r = _mm_add_epi16(y, ycc_term_sse2(cr, z, CV_RCR, 0));
+	*g = _mm_sub_epi16(y, ycc_term_sse2(cb, cr, CV_GCB, CV_GCR));
+	*b = _mm_add_epi16(y, ycc_term_sse2(cb, z, CV_BCB, 0));
+}
+
+__attribute__((target("sse2")))
+static
+void ycc_row_sse2 (
+	BYTE* rgb,
+	const BYTE* py,
+	const BYTE* pc,
+	UINT mx
+)
+{
+	const __m128i z = _mm_setzero_si128(), c128 = _mm_set1_epi16(128);
+	__m128i y, cb, cr, r[2], g[2], b[2], rg, b0;
+	BYTE out[16 * 4];
+	UINT i;
+
+	y = _mm_loadl_epi64((const __m128i*)py);
+	cb = _mm_loadl_epi64((const __m128i*)pc);
+	cr = _mm_loadl_epi64((const __m128i*)(pc + 64));
+	if (mx == 16) {
+		y = _mm_unpacklo_epi64(y, _mm_loadl_epi64((const __m128i*)(py + 64)));
+		cb = _mm_unpacklo_epi8(cb, cb);		/* Every chroma sample for two pixels */
+		cr = _mm_unpacklo_epi8(cr, cr);
+	}
+	ycc_8_sse2(_mm_unpacklo_epi8(y, z), _mm_sub_epi16(_mm_unpacklo_epi8(cb, z), c128), _mm_sub_epi16(_mm_unpacklo_epi8(cr, z), c128), &r[0], &g[0], &b[0]);
+	if (mx == 16) {
+		ycc_8_sse2(_mm_unpackhi_epi8(y, z), _mm_sub_epi16(_mm_unpackhi_epi8(cb, z), c128), _mm_sub_epi16(_mm_unpackhi_epi8(cr, z), c128), &r[1], &g[1], &b[1]);
+	}
+
+	/* RGBx per pixel, then packed to RGB888. SSE2 has no byte shuffle. */
+	for (i = 0; i < mx / 8; i++) {
+		__m128i r8 = _mm_packus_epi16(r[i], z), g8 = _mm_packus_epi16(g[i], z), b8 = _mm_packus_epi16(b[i], z);
+		rg = _mm_unpacklo_epi8(r8, g8);
+		b0 = _mm_unpacklo_epi8(b8, z);
+		_mm_storeu_si128((__m128i*)(out + i * 32), _mm_unpacklo_epi16(rg, b0));
+		_mm_storeu_si128((__m128i*)(out + i * 32 + 16), _mm_unpackhi_epi16(rg, b0));
+	}
+	for (i = 0; i < mx; i++) {
+		rgb[i * 3 + 0] = out[i * 4 + 0];
+		rgb[i * 3 + 1] = out[i * 4 + 1];
+		rgb[i * 3 + 2] = out[i * 4 + 2];
+	}
+}
+
+__attribute__((target("avx2")))
+static inline
+__m256i mulshr12_avx2 (
+	__m256i a,
+	LONG c
+)
+{
+	return _mm256_srai_epi32(_mm256_mullo_epi32(a, _mm256_set1_epi32(c)), 12);
+}
+
+__attribute__((target("avx2")))
+static inline
+void transpose_8x8_avx2 (
+	__m256i v[8]
+)
+{
+	__m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]), t1 = _mm256_unpackhi_epi32(v[0], v[1]);
+	__m256i t2 = _mm256_unpacklo_epi32(v[2], v[3]), t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+	__m256i t4 = _mm256_unpacklo_epi32(v[4], v[5]), t5 = _mm256_unpackhi_epi32(v[4], v[5]);
+	__m256i t6 = _mm256_unpacklo_epi32(v[6], v[7]), t7 = _mm256_unpackhi_epi32(v[6], v[7]);
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+	v[0] = _mm256_permute2x128_si256(u0, u4, 0x20); v[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	v[1] = _mm256_permute2x128_si256(u1, u5, 0x20); v[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	v[2] = _mm256_permute2x128_si256(u2, u6, 0x20); v[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	v[3] = _mm256_permute2x128_si256(u3, u7, 0x20); v[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/* Four rows of descaled 32-bit values into 32 bytes, clipped like BYTECLIP() */
+__attribute__((target("avx2")))
+static inline
+__m256i clip_rows_avx2 (
+	__m256i a, __m256i b, __m256i c, __m256i d
+)
+{
+	__m256i ab, cd;
+#if JD_TBLCLIP
+	const __m256i m10 = _mm256_set1_epi32(0x3FF);
+	ab = _mm256_packs_epi32(_mm256_and_si256(a, m10), _mm256_and_si256(b, m10));
+	cd = _mm256_packs_epi32(_mm256_and_si256(c, m10), _mm256_and_si256(d, m10));
+	ab = _mm256_andnot_si256(_mm256_cmpgt_epi16(ab, _mm256_set1_epi16(511)), _mm256_min_epi16(ab, _mm256_set1_epi16(255)));
+	cd = _mm256_andnot_si256(_mm256_cmpgt_epi16(cd, _mm256_set1_epi16(511)), _mm256_min_epi16(cd, _mm256_set1_epi16(255)));
+#else
+	ab = _mm256_packs_epi32(a, b);
+	cd = _mm256_packs_epi32(c, d);
+#endif
+	/* The packs work per 128-bit lane, put the dwords of the rows back in order */
+	return _mm256_permutevar8x32_epi32(_mm256_packus_epi16(ab, cd), _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+__attribute__((target("avx2")))
+static
+void idct_avx2 (
+	LONG* src,
+	BYTE* dst
+)
+{
+	__m256i v[8];
+	UINT k;
+
+	for (k = 0; k < 8; k++) v[k] = _mm256_loadu_si256((const __m256i*)(src + k * 8));
+	IDCT1D_VEC(__m256i, _mm256_add_epi32, _mm256_sub_epi32, mulshr12_avx2, v);
+
+	transpose_8x8_avx2(v);
+	v[0] = _mm256_add_epi32(v[0], _mm256_set1_epi32(128L << 8));	/* Remove DC offset (-128) */
+	IDCT1D_VEC(__m256i, _mm256_add_epi32, _mm256_sub_epi32, mulshr12_avx2, v);
+	for (k = 0; k < 8; k++) v[k] = _mm256_srai_epi32(v[k], 8);
+
+	transpose_8x8_avx2(v);
+	_mm256_storeu_si256((__m256i*)dst, clip_rows_avx2(v[0], v[1], v[2], v[3]));
+	_mm256_storeu_si256((__m256i*)(dst + 32), clip_rows_avx2(v[4], v[5], v[6], v[7]));
+}
+
+/* (c1 * a + c2 * b) / CVACC on sixteen 16-bit lanes, truncated toward zero like the C division */
+__attribute__((target("avx2")))
+static inline
+__m256i ycc_term_avx2 (
+	__m256i a, __m256i b, INT c1, INT c2
+)
+{
+	const __m256i c = _mm256_set1_epi32((c2 << 16) | (c1 & 0xFFFF)), rnd = _mm256_set1_epi32(CVACC - 1);
+	__m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), c);
+	__m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), c);
+	lo = _mm256_srai_epi32(_mm256_add_epi32(lo, _mm256_and_si256(_mm256_srai_epi32(lo, 31), rnd)), 10);
+	hi = _mm256_srai_epi32(_mm256_add_epi32(hi, _mm256_and_si256(_mm256_srai_epi32(hi, 31), rnd)), 10);
+	return _mm256_packs_epi32(lo, hi);	/* Per 128-bit lane as the unpacks, so the order is kept */
+}
+
+/* Sixteen 16-bit lanes to sixteen bytes in order, saturated */
+__attribute__((target("avx2")))
+static inline
+__m128i pack16_avx2 (
+	__m256i v
+)
+{
+	return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2")))
+static
+void ycc_row_avx2 (
+	BYTE* rgb,
+	const BYTE* py,
+	const BYTE* pc,
+	UINT mx
+)
+{
+	/* Byte shuffles of the R, G and B planes into 48 bytes of RGB888 */
+	static const BYTE s_shuf[3][3][16] = {
+		{ { 0,0x80,0x80,1,0x80,0x80,2,0x80,0x80,3,0x80,0x80,4,0x80,0x80,5 },
+		  { 0x80,0,0x80,0x80,1,0x80,0x80,2,0x80,0x80,3,0x80,0x80,4,0x80,0x80 },
+		  { 0x80,0x80,0,0x80,0x80,1,0x80,0x80,2,0x80,0x80,3,0x80,0x80,4,0x80 } },
+		{ { 0x80,0x80,6,0x80,0x80,7,0x80,0x80,8,0x80,0x80,9,0x80,0x80,10,0x80 },
+		  { 5,0x80,0x80,6,0x80,0x80,7,0x80,0x80,8,0x80,0x80,9,0x80,0x80,10 },
+		  { 0x80,5,0x80,0x80,6,0x80,0x80,7,0x80,0x80,8,0x80,0x80,9,0x80,0x80 } },
+		{ { 0x80,11,0x80,0x80,12,0x80,0x80,13,0x80,0x80,14,0x80,0x80,15,0x80,0x80 },
+		  { 0x80,0x80,11,0x80,0x80,12,0x80,0x80,13,0x80,0x80,14,0x80,0x80,15,0x80 },
+		  { 10,0x80,0x80,11,0x80,0x80,12,0x80,0x80,13,0x80,0x80,14,0x80,0x80,15 } }
+	};
+	__m128i y8, cb8, cr8, r8, g8, b8, o[3];
+	__m256i y, cb, cr, c128 = _mm256_set1_epi16(128);
+	UINT j;
+
+	y8 = _mm_loadl_epi64((const __m128i*)py);
+	cb8 = _mm_loadl_epi64((const __m128i*)pc);
+	cr8 = _mm_loadl_epi64((const __m128i*)(pc + 64));
+	if (mx == 16) {
+		y8 = _mm_unpacklo_epi64(y8, _mm_loadl_epi64((const __m128i*)(py + 64)));
+		cb8 = _mm_unpacklo_epi8(cb8, cb8);		/* Every chroma sample for two pixels */
+		cr8 = _mm_unpacklo_epi8(cr8, cr8);
+	}
+	y = _mm256_cvtepu8_epi16(y8);
+	cb = _mm256_sub_epi16(_mm256_cvtepu8_epi16(cb8), c128);
+	cr = _mm256_sub_epi16(_mm256_cvtepu8_epi16(cr8), c128);
+
+	/* The sums stay within -512..511, where saturation equals BYTECLIP() */
+	r8 = pack16_avx2(_mm256_add_epi16(y, ycc_term_avx2(cr, _mm256_setzero_si256(), CV_RCR, 0)));
+	g8 = pack16_avx2(_mm256_sub_epi16(y, ycc_term_avx2(cb, cr, CV_GCB, CV_GCR)));
+	b8 = pack16_avx2(_mm256_add_epi16(y, ycc_term_avx2(cb, _mm256_setzero_si256(), CV_BCB, 0)));
+
+	for (j = 0; j < 3; j++) {
+		o[j] = _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(r8, _mm_loadu_si128((const __m128i*)s_shuf[j][0])),
+			_mm_shuffle_epi8(g8, _mm_loadu_si128((const __m128i*)s_shuf[j][1]))),
+			_mm_shuffle_epi8(b8, _mm_loadu_si128((const __m128i*)s_shuf[j][2])));
+	}
+	_mm_storeu_si128((__m128i*)rgb, o[0]);
+	if (mx == 16) {
+		_mm_storeu_si128((__m128i*)(rgb + 16), o[1]);
+		_mm_storeu_si128((__m128i*)(rgb + 32), o[2]);
+	} else {
+		_mm_storel_epi64((__m128i*)(rgb + 16), o[1]);
+	}
+}
+
+static const jd_dsp_kernels s_sse2_kernels = { "sse2", idct_sse2, ycc_row_sse2 };
+static const jd_dsp_kernels s_avx2_kernels = { "avx2", idct_avx2, ycc_row_avx2 };
+#endif /* JD_DSP_X86 */
+
+
+
+const jd_dsp_kernels* jd_dsp_get_kernels (
+	jd_dsp_kernel_id_t id
+)
+{
+	switch (id) {
+	case JD_DSP_SCALAR:
+		return &s_scalar_kernels;
+#if JD_DSP_X86
+	case JD_DSP_SSE2:
+		return __builtin_cpu_supports("sse2") ? &s_sse2_kernels : 0;
+	case JD_DSP_AVX2:
+		return __builtin_cpu_supports("avx2") ? &s_avx2_kernels : 0;
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+const jd_dsp_kernels* jd_dsp_select_kernels (void)
+{
+	const jd_dsp_kernels* k;
+	INT id;
+
+	for (id = JD_DSP_KERNEL_COUNT - 1; id > JD_DSP_SCALAR; id--) {
+		k = jd_dsp_get_kernels((jd_dsp_kernel_id_t)id);
+		if (k) return k;
+	}
+
+	return &s_scalar_kernels;
+}
@@ -0,0 +1,69 @@
+// Soak of the converters with and without the buffer pool: a stream of frames of changing sizes is encoded to
+// JPEG and decoded to BMP while other code keeps allocating small, long lived blocks, as on a busy device.
+// The C heap is kept as one arena like the ESP32 heap, and its size and free (fragmented) part are reported.
+// Usage: bench_img_buf_pool [pool_kb] [frames] (defaults: 1024, 500; pool_kb 0 frees every buffer)
+// Output is CSV: pool_kb,frames,ms_per_frame,hits,misses,high_water_kb,heap_kb,heap_free_kb,free_pct
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+
+int main(int argc, char **argv)
+{
+    size_t pool_kb = argc > 1 ? atoi(argv[1]) : 1024;
+    int frames = argc > 2 ? atoi(argv[2]) : 500;
+    mallopt(M_MMAP_THRESHOLD, 256 * 1024 * 1024);
+    mallopt(M_TRIM_THRESHOLD, 256 * 1024 * 1024);
+    img_buf_pool_set_limit(pool_kb * 1024);
+
+    static const uint16_t s_sizes[][2] = { { 320, 240 }, { 640, 480 }, { 800, 600 }, { 1024, 768 } };
+    const int num_sizes = sizeof(s_sizes) / sizeof(s_sizes[0]);
+    std::vector<uint8_t> src[num_sizes];
+    for (int s = 0; s < num_sizes; s++) {
+        src[s].resize((size_t)s_sizes[s][0] * s_sizes[s][1] * 2);
+        unsigned seed = s;
+        for (size_t i = 0; i < src[s].size(); i++) {
+            src[s][i] = (uint8_t)((i / 5) ^ (i / 1931) ^ (rand_r(&seed) & 7));
+        }
+    }
+
+    // small blocks of other tasks, each living for a few frames
+    std::vector<void *> others(64, (void *)NULL);
+    unsigned seed = 1;
+    double ms = 0;
+    for (int f = 0; f < frames; f++) {
+        int s = rand_r(&seed) % num_sizes;
+        for (int i = 0; i < 4; i++) {
+            size_t k = rand_r(&seed) % others.size();
+            free(others[k]);
+            others[k] = malloc(64 + rand_r(&seed) % 4096);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        uint8_t *jpg = NULL, *bmp = NULL;
+        size_t jpg_len = 0, bmp_len = 0;
+        if (!fmt2jpg(src[s].data(), src[s].size(), s_sizes[s][0], s_sizes[s][1], PIXFORMAT_YUV422, 80, &jpg, &jpg_len)
+                || !fmt2bmp(jpg, jpg_len, s_sizes[s][0], s_sizes[s][1], PIXFORMAT_JPEG, &bmp, &bmp_len)) {
+            fprintf(stderr, "conversion failed\n");
+            return 1;
+        }
+        img_buf_release(jpg, jpg_len);
+        img_buf_release(bmp, bmp_len);
+        ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    img_buf_pool_stats_t stats;
+    img_buf_pool_get_stats(&stats);
+    struct mallinfo2 heap = mallinfo2();
+    // free bytes inside the arena that the pool does not account for are fragments between live blocks
+    size_t heap_free = heap.fordblks;
+    printf("pool_kb,frames,ms_per_frame,hits,misses,high_water_kb,heap_kb,heap_free_kb,free_pct\n");
+    printf("%zu,%d,%.3f,%u,%u,%zu,%zu,%zu,%.1f\n", pool_kb, frames, ms / frames, stats.hits, stats.misses,
+           stats.high_water_bytes / 1024, heap.arena / 1024, heap_free / 1024, 100.0 * heap_free / heap.arena);
+    for (size_t k = 0; k < others.size(); k++) {
+        free(others[k]);
+    }
+    return 0;
+}
@@ -0,0 +1,175 @@
+// Software decoder throughput on SVGA frames as the camera sends them: images of the detector training set scaled
+// to 800x600 and encoded from YUV422, plus a synthetic frame. Each frame is decoded to each output format of the
+// decoder with a pooled workspace and with a caller workspace of ESP_JPG_DECODE_WORK_SIZE bytes, the smallest
+// accepted, then by the jpg2 converters into a frame buffer.
+// Usage: bench_jpg_decode [--images DIR] [--max-images N] [--min-ms MS]
+//        (defaults: the training set validation images, 8 images, 300 ms per point)
+// Output is CSV: source,quality,bytes,output,workspace,frames,ms_per_frame,mcu_s
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static const uint16_t s_width = 800, s_height = 600;
+static const uint8_t s_qualities[] = { 60, 90 };
+
+static const struct {
+    const char *name;
+    jpg_output_t output;
+} s_outputs[] = {
+    { "rgb888", JPG_OUT_RGB888 },
+    { "gray", JPG_OUT_GRAY },
+    { "ycbcr", JPG_OUT_YCBCR },
+};
+
+static const struct {
+    const char *name;
+    pixformat_t format;
+} s_converters[] = {
+    { "jpg2rgb888", PIXFORMAT_RGB888 },
+    { "jpg2rgb565", PIXFORMAT_RGB565 },
+    { "jpg2gray", PIXFORMAT_GRAYSCALE },
+    { "jpg2yuv422", PIXFORMAT_YUV422 },
+    { "jpg2yuv420", PIXFORMAT_YUV420 },
+};
+
+// Only what the decoder itself costs is timed, the output is dropped.
+static bool null_write(void *, uint16_t, uint16_t, uint16_t, uint16_t, uint8_t *)
+{
+    return true;
+}
+
+// The frame as YUV422 from the sensor, limited range BT.601 with the chroma of the even pixel of each pair.
+static void to_yuv422(const bgr_image_t &img, std::vector<uint8_t> &out)
+{
+    size_t pixels = (size_t)img.width * img.height;
+    out.resize(pixels * 2);
+    for (size_t i = 0; i < pixels; i++) {
+        const uint8_t *p = &img.bgr[(i & ~(size_t)1) * 3];
+        int b = img.bgr[i * 3], g = img.bgr[i * 3 + 1], r = img.bgr[i * 3 + 2];
+        out[i * 2] = (uint8_t)(16 + ((r * 66 + g * 129 + b * 25 + 128) >> 8));
+        if (!(i & 1)) {
+            out[i * 2 + 1] = (uint8_t)(128 + ((-p[2] * 38 - p[1] * 74 + p[0] * 112 + 128) >> 8));
+        } else {
+            out[i * 2 + 1] = (uint8_t)(128 + ((p[2] * 112 - p[1] * 94 - p[0] * 18 + 128) >> 8));
+        }
+    }
+}
+
+// Returns the mean decode time in ms, -1 if a decode failed. With a frame buffer the frame is decoded by
+// jpg2fmt(), else only by the decoder.
+static double bench(const std::vector<uint8_t> &jpg, jpg_output_t output, void *work, size_t work_len,
+                    pixformat_t format, uint8_t *frame_buf, double min_ms, int *frames)
+{
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    *frames = 0;
+    while (*frames < 3 || elapsed < min_ms) {
+        if (frame_buf ? !jpg2fmt(jpg.data(), jpg.size(), format, JPG_SCALE_NONE, frame_buf)
+                : esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), JPG_SCALE_NONE, output, null_write, NULL, work,
+                                         work_len) != ESP_OK) {
+            return -1;
+        }
+        (*frames)++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed / *frames;
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = BENCH_DATASET_DIR;
+    size_t max_images = 8;
+    double min_ms = 300;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--images") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "--max-images") && i + 1 < argc) {
+            max_images = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--min-ms") && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--images DIR] [--max-images N] [--min-ms MS]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<std::string> names;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name.size() > 4 && !strcasecmp(name.c_str() + name.size() - 4, ".jpg")) {
+                names.push_back(name);
+            }
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+    if (names.size() > max_images) {
+        names.resize(max_images);
+    }
+
+    std::vector<std::pair<std::string, bgr_image_t> > frames(1);
+    frames[0].first = "synthetic";
+    synthetic_image(frames[0].second, s_width, s_height);
+    for (size_t i = 0; i < names.size(); i++) {
+        bgr_image_t img, frame;
+        if (load_image(dir + "/" + names[i], img, s_width, s_height)) {
+            resample(img, frame, s_width, s_height);
+            frames.push_back(std::make_pair(names[i].substr(0, names[i].find('_')), frame));
+        } else {
+            fprintf(stderr, "skipped %s\n", names[i].c_str());
+        }
+    }
+
+    // 4:2:2 MCUs of 16x8 pixels
+    const double mcus = (double)((s_width + 15) / 16) * ((s_height + 7) / 8);
+    std::vector<uint8_t> small_work(ESP_JPG_DECODE_WORK_SIZE);
+    std::vector<uint8_t> yuv, frame_buf((size_t)s_width * s_height * 3);
+    printf("source,quality,bytes,output,workspace,frames,ms_per_frame,mcu_s\n");
+    for (size_t f = 0; f < frames.size(); f++) {
+        to_yuv422(frames[f].second, yuv);
+        for (size_t q = 0; q < sizeof(s_qualities); q++) {
+            uint8_t *out = NULL;
+            size_t out_len = 0;
+            if (!fmt2jpg(yuv.data(), yuv.size(), s_width, s_height, PIXFORMAT_YUV422, s_qualities[q], &out, &out_len)) {
+                fprintf(stderr, "encode failed\n");
+                return 1;
+            }
+            std::vector<uint8_t> jpg(out, out + out_len);
+            free(out);
+
+            for (size_t o = 0; o < sizeof(s_outputs) / sizeof(s_outputs[0]); o++) {
+                for (int w = 0; w < 2; w++) {
+                    int n = 0;
+                    double ms = w ? bench(jpg, s_outputs[o].output, small_work.data(), small_work.size(), PIXFORMAT_JPEG, NULL, min_ms, &n)
+                                  : bench(jpg, s_outputs[o].output, NULL, 0, PIXFORMAT_JPEG, NULL, min_ms, &n);
+                    if (ms < 0) {
+                        fprintf(stderr, "decode failed\n");
+                        return 1;
+                    }
+                    printf("%s,%u,%zu,%s,%s,%d,%.3f,%.0f\n", frames[f].first.c_str(), s_qualities[q], jpg.size(),
+                           s_outputs[o].name, w ? "minimal" : "pooled", n, ms, mcus * 1000 / ms);
+                }
+            }
+            for (size_t c = 0; c < sizeof(s_converters) / sizeof(s_converters[0]); c++) {
+                int n = 0;
+                double ms = bench(jpg, JPG_OUT_RGB888, NULL, 0, s_converters[c].format, frame_buf.data(), min_ms, &n);
+                if (ms < 0) {
+                    fprintf(stderr, "%s failed\n", s_converters[c].name);
+                    return 1;
+                }
+                printf("%s,%u,%zu,%s,pooled,%d,%.3f,%.0f\n", frames[f].first.c_str(), s_qualities[q], jpg.size(),
+                       s_converters[c].name, n, ms, mcus * 1000 / ms);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+// Restart-interval parallel decoding throughput for the large OV5640 frames at 1..N workers. Frames are encoded
+// with restart markers between 64 slices, as 16 encoder workers write them, and once without any, which always
+// decodes on one task. The output is written to an RGB888 frame buffer.
+// Usage: bench_jpg_decode_parallel [max_workers] (default: 16)
+// Output is CSV: framesize,width,height,intervals,bytes,workers,ms_per_frame,speedup
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+struct bench_frame_t {
+    const char *name;
+    uint16_t width, height;
+};
+
+static const bench_frame_t s_framesizes[] = {
+    { "FHD", 1920, 1080 },
+    { "QXGA", 2048, 1536 },
+    { "QSXGA", 2560, 1920 },
+};
+
+struct frame_buffer_t {
+    std::vector<uint8_t> rgb;
+    uint16_t width;
+};
+
+static bool fb_write_cb(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    frame_buffer_t *fb = static_cast<frame_buffer_t *>(arg);
+    if (!data) {
+        if (!x && !y) {
+            fb->width = w;
+            fb->rgb.resize((size_t)w * h * 3);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++) {
+        memcpy(&fb->rgb[((size_t)(y + iy) * fb->width + x) * 3], data + (size_t)iy * w * 3, (size_t)w * 3);
+    }
+    return true;
+}
+
+// Number of restart intervals: the RST markers plus one, 0 without any.
+static int count_intervals(const std::vector<uint8_t> &jpg)
+{
+    int markers = 0;
+    for (size_t i = 0; i + 1 < jpg.size(); i++) {
+        markers += jpg[i] == 0xFF && jpg[i + 1] >= 0xD0 && jpg[i + 1] <= 0xD7;
+    }
+    return markers ? markers + 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int max_workers = argc > 1 ? atoi(argv[1]) : 16;
+
+    printf("framesize,width,height,intervals,bytes,workers,ms_per_frame,speedup\n");
+    for (size_t f = 0; f < sizeof(s_framesizes) / sizeof(s_framesizes[0]); f++) {
+        const bench_frame_t &fs = s_framesizes[f];
+        std::vector<uint8_t> src((size_t)fs.width * fs.height * 2);
+        unsigned seed = 1;
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = (uint8_t)((i / 5 + (i / (fs.width * 2)) + (rand_r(&seed) & 15)) & 0xFF);
+        }
+
+        for (int encode_workers = 16; encode_workers >= 1; encode_workers -= 15) {
+            jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+            config.workers = encode_workers;
+            std::vector<uint8_t> jpg;
+            if (!fmt2jpg_cb_ex(src.data(), src.size(), fs.width, fs.height, PIXFORMAT_YUV422, &config, collect_cb, &jpg)) {
+                fprintf(stderr, "encode failed\n");
+                return 1;
+            }
+            int intervals = count_intervals(jpg);
+
+            frame_buffer_t fb;
+            double base_ms = 0;
+            for (int workers = 1; workers <= max_workers; workers = workers < 4 ? workers + 1 : workers + 4) {
+                int frames = 0;
+                auto start = std::chrono::steady_clock::now();
+                double elapsed = 0;
+                // at least 3 frames and half a second per point
+                while (frames < 3 || elapsed < 0.5) {
+                    if (esp_jpg_decode_mem_parallel(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, fb_write_cb,
+                                                    &fb, workers) != ESP_OK) {
+                        fprintf(stderr, "decode failed\n");
+                        return 1;
+                    }
+                    frames++;
+                    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                }
+                double ms = elapsed * 1000 / frames;
+                if (workers == 1) {
+                    base_ms = ms;
+                }
+                printf("%s,%u,%u,%d,%zu,%d,%.2f,%.2f\n", fs.name, fs.width, fs.height, intervals, jpg.size(), workers,
+                       ms, base_ms / ms);
+            }
+        }
+    }
+    return 0;
+}
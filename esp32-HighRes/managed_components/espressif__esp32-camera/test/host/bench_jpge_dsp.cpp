@@ -0,0 +1,64 @@
+// Throughput of the jpge forward DCT and quantization kernels, in 8x8 blocks per second.
+// Output is CSV: kernel,stage,blocks_per_s
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "jpge_dsp.h"
+
+using namespace jpge;
+
+// The encoder transforms one block at a time out of L1, keep the working set cache resident too.
+enum { NUM_BLOCKS = 64, ROUNDS = 12800 };
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    std::vector<int32> src(NUM_BLOCKS * 64), work(NUM_BLOCKS * 64);
+    std::vector<int16> coeffs(NUM_BLOCKS * 64);
+    int32 quant[64];
+    unsigned seed = 1;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (int32)(rand_r(&seed) % 256) - 128;
+    }
+    for (int i = 0; i < 64; i++) {
+        quant[i] = 2 + i;
+    }
+
+    printf("kernel,stage,blocks_per_s\n");
+    for (int id = DSP_SCALAR; id < DSP_KERNEL_COUNT; id++) {
+        const dsp_kernels *k = dsp_get_kernels(static_cast<dsp_kernel_id_t>(id));
+        if (!k) {
+            continue;
+        }
+
+        double t_fdct = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            memcpy(work.data(), src.data(), src.size() * sizeof(int32));
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int b = 0; b < NUM_BLOCKS; b++) {
+                k->fdct(&work[b * 64]);
+            }
+            t_fdct += seconds_since(start);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int b = 0; b < NUM_BLOCKS; b++) {
+                k->quantize(&coeffs[b * 64], &work[b * 64], quant);
+            }
+        }
+        double t_quant = seconds_since(start);
+
+        double blocks = (double)NUM_BLOCKS * ROUNDS;
+        printf("%s,fdct,%.0f\n", k->name, blocks / t_fdct);
+        printf("%s,quantize,%.0f\n", k->name, blocks / t_quant);
+        printf("%s,fdct+quantize,%.0f\n", k->name, blocks / (t_fdct + t_quant));
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+// Optimized against standard Huffman tables for QVGA to UXGA YUV422 frames: bytes saved and extra encode time.
+// Usage: bench_jpge_huffman [quality] (default: 80)
+// Output is CSV: framesize,width,height,std_bytes,opt_bytes,saved_pct,std_ms,opt_ms,extra_cpu_pct
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+struct bench_frame_t {
+    const char *name;
+    uint16_t width, height;
+};
+
+static const bench_frame_t s_framesizes[] = {
+    { "QVGA", 320, 240 },
+    { "VGA", 640, 480 },
+    { "SVGA", 800, 600 },
+    { "XGA", 1024, 768 },
+    { "HD", 1280, 720 },
+    { "UXGA", 1600, 1200 },
+};
+
+// Returns the mean encode time in ms, the size of the last frame in bytes.
+static double bench(std::vector<uint8_t> &src, const bench_frame_t &fs, jpg_encode_config_t &config, size_t *bytes)
+{
+    int frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    // at least 3 frames and half a second per point
+    while (frames < 3 || elapsed < 0.5) {
+        if (!fmt2jpg_cb_ex(src.data(), src.size(), fs.width, fs.height, PIXFORMAT_YUV422, &config, count_cb, bytes)) {
+            return -1;
+        }
+        frames++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed * 1000 / frames;
+}
+
+int main(int argc, char **argv)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    if (argc > 1) {
+        config.quality = atoi(argv[1]);
+    }
+
+    printf("framesize,width,height,std_bytes,opt_bytes,saved_pct,std_ms,opt_ms,extra_cpu_pct\n");
+    for (size_t f = 0; f < sizeof(s_framesizes) / sizeof(s_framesizes[0]); f++) {
+        const bench_frame_t &fs = s_framesizes[f];
+        // smooth gradients with some sensor noise, roughly what a table top scene compresses like
+        std::vector<uint8_t> src((size_t)fs.width * fs.height * 2);
+        unsigned seed = 1;
+        for (int y = 0; y < fs.height; y++) {
+            for (int x = 0; x < fs.width; x++) {
+                uint8_t *p = &src[((size_t)y * fs.width + x) * 2];
+                p[0] = (uint8_t)(16 + ((x * 150) / fs.width + (y * 50) / fs.height + ((x / 64 + y / 64) & 1) * 20 + (rand_r(&seed) & 7)));
+                p[1] = (uint8_t)((x & 1) ? 128 + (y * 60) / fs.height : 100 + (x * 40) / fs.width);
+            }
+        }
+
+        size_t std_bytes = 0, opt_bytes = 0;
+        config.optimize_huffman = false;
+        double std_ms = bench(src, fs, config, &std_bytes);
+        config.optimize_huffman = true;
+        double opt_ms = bench(src, fs, config, &opt_bytes);
+        if (std_ms < 0 || opt_ms < 0) {
+            fprintf(stderr, "encode failed\n");
+            return 1;
+        }
+        printf("%s,%u,%u,%zu,%zu,%.2f,%.2f,%.2f,%.1f\n", fs.name, fs.width, fs.height, std_bytes, opt_bytes,
+               100.0 * (1.0 - (double)opt_bytes / std_bytes), std_ms, opt_ms, 100.0 * (opt_ms / std_ms - 1.0));
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Output path cost of SVGA RGB565 frames: calls to the output callback and encode time for several output
+// block sizes. The noisy source at high quality makes entropy coding and output the larger part of the time.
+// Usage: bench_jpge_output [runs] (default: 50, the fastest run is reported)
+// Output is CSV: quality,block_size,bytes,callbacks,min_ms
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+
+struct sink_t {
+    size_t calls, bytes;
+};
+
+static size_t count_cb(void *arg, size_t, const void *data, size_t len)
+{
+    sink_t *sink = static_cast<sink_t *>(arg);
+    if (data) {
+        sink->calls++;
+        sink->bytes += len;
+    }
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    const uint16_t w = 800, h = 600;
+    static const uint8_t s_qualities[] = { 50, 80, 95, 100 };
+    static const size_t s_block_sizes[] = { 512, 4096, 16384 };
+    int runs = argc > 1 ? atoi(argv[1]) : 50;
+
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = 1;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 5 + (i / (w * 2)) + (rand_r(&seed) & 15)) & 0xFF);
+    }
+
+    printf("quality,block_size,bytes,callbacks,min_ms\n");
+    for (size_t q = 0; q < sizeof(s_qualities) / sizeof(s_qualities[0]); q++) {
+        for (size_t b = 0; b < sizeof(s_block_sizes) / sizeof(s_block_sizes[0]); b++) {
+            jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+            config.quality = s_qualities[q];
+            config.out_block_size = s_block_sizes[b];
+            sink_t sink = { 0, 0 };
+            double best = 0;
+            for (int r = 0; r < runs; r++) {
+                sink.calls = sink.bytes = 0;
+                auto start = std::chrono::steady_clock::now();
+                if (!fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_RGB565, &config, count_cb, &sink)) {
+                    fprintf(stderr, "encode failed\n");
+                    return 1;
+                }
+                double ms = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000;
+                if (!r || ms < best) {
+                    best = ms;
+                }
+            }
+            printf("%u,%zu,%zu,%zu,%.2f\n", config.quality, config.out_block_size, sink.bytes, sink.calls, best);
+        }
+    }
+    return 0;
+}
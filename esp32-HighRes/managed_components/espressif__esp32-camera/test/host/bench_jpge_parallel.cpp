@@ -0,0 +1,69 @@
+// Slice-parallel encoding throughput for SVGA to UXGA RGB565 frames at 1..N workers.
+// Usage: bench_jpge_parallel [max_workers] (default: number of CPUs, at least 8)
+// Output is CSV: framesize,width,height,workers,bytes,fps,speedup
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+struct bench_frame_t {
+    const char *name;
+    uint16_t width, height;
+};
+
+static const bench_frame_t s_framesizes[] = {
+    { "SVGA", 800, 600 },
+    { "XGA", 1024, 768 },
+    { "HD", 1280, 720 },
+    { "SXGA", 1280, 1024 },
+    { "UXGA", 1600, 1200 },
+};
+
+int main(int argc, char **argv)
+{
+    int max_workers = (int)std::thread::hardware_concurrency();
+    if (max_workers < 8) {
+        max_workers = 8;
+    }
+    if (argc > 1) {
+        max_workers = atoi(argv[1]);
+    }
+
+    printf("framesize,width,height,workers,bytes,fps,speedup\n");
+    for (size_t f = 0; f < sizeof(s_framesizes) / sizeof(s_framesizes[0]); f++) {
+        const bench_frame_t &fs = s_framesizes[f];
+        std::vector<uint8_t> src((size_t)fs.width * fs.height * 2);
+        unsigned seed = 1;
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = (uint8_t)((i / 5 + (i / (fs.width * 2)) + (rand_r(&seed) & 15)) & 0xFF);
+        }
+
+        double base_fps = 0;
+        for (int workers = 1; workers <= max_workers; workers *= 2) {
+            jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+            config.workers = workers;
+            size_t bytes = 0;
+            int frames = 0;
+            auto start = std::chrono::steady_clock::now();
+            double elapsed = 0;
+            // at least 3 frames and half a second per point
+            while (frames < 3 || elapsed < 0.5) {
+                if (!fmt2jpg_cb_ex(src.data(), src.size(), fs.width, fs.height, PIXFORMAT_RGB565, &config, count_cb, &bytes)) {
+                    fprintf(stderr, "encode failed\n");
+                    return 1;
+                }
+                frames++;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            double fps = frames / elapsed;
+            if (workers == 1) {
+                base_fps = fps;
+            }
+            printf("%s,%u,%u,%d,%zu,%.2f,%.2f\n", fs.name, fs.width, fs.height, workers, bytes, fps, fps / base_fps);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Per-frame encoder setup cost (init up to the end of the header, then deinit) with the header cache warm and
+// with it cleared before every frame, next to the cost of a whole frame, at QVGA and VGA.
+// Output is CSV: framesize,width,height,setup_cold_us,setup_cached_us,frame_us,setup_saved_pct_of_frame
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "jpge.h"
+
+class null_stream : public jpge::output_stream {
+    public:
+        virtual bool put_buf(const void *, int) { return true; }
+        virtual jpge::uint get_size() const { return 0; }
+};
+
+struct bench_frame_t {
+    const char *name;
+    uint16_t width, height;
+};
+
+static const bench_frame_t s_framesizes[] = {
+    { "QQVGA", 160, 120 },
+    { "QVGA", 320, 240 },
+    { "VGA", 640, 480 },
+};
+
+// Mean time in us of one call of fn, over at least half a second.
+template <typename F> static double bench_us(F fn)
+{
+    long calls = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (calls < 100 || elapsed < 0.5) {
+        for (int i = 0; i < 100; i++) {
+            if (!fn()) {
+                return -1;
+            }
+        }
+        calls += 100;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    return elapsed * 1e6 / calls;
+}
+
+int main()
+{
+    null_stream stream;
+    jpge::params comp_params;
+    comp_params.m_quality = 80;
+    jpge::jpeg_encoder enc;
+
+    printf("framesize,width,height,setup_cold_us,setup_cached_us,frame_us,setup_saved_pct_of_frame\n");
+    for (size_t f = 0; f < sizeof(s_framesizes) / sizeof(s_framesizes[0]); f++) {
+        const bench_frame_t &fs = s_framesizes[f];
+        std::vector<uint8_t> src((size_t)fs.width * fs.height * 2);
+        unsigned seed = 1;
+        for (size_t i = 0; i < src.size(); i++) {
+            src[i] = (uint8_t)(i / 7 + (rand_r(&seed) & 7));
+        }
+
+        double cold = bench_us([&] {
+            jpge::clear_header_cache();
+            bool ok = enc.init(&stream, fs.width, fs.height, jpge::SRC_YUYV, comp_params);
+            enc.deinit();
+            return ok;
+        });
+        double cached = bench_us([&] {
+            bool ok = enc.init(&stream, fs.width, fs.height, jpge::SRC_YUYV, comp_params);
+            enc.deinit();
+            return ok;
+        });
+        double frame = bench_us([&] {
+            bool ok = enc.init(&stream, fs.width, fs.height, jpge::SRC_YUYV, comp_params)
+                      && enc.process_scanlines(src.data(), fs.width * 2, fs.height) && enc.process_scanline(NULL);
+            enc.deinit();
+            return ok;
+        });
+        if (cold < 0 || cached < 0 || frame < 0) {
+            fprintf(stderr, "encode failed\n");
+            return 1;
+        }
+        printf("%s,%u,%u,%.2f,%.2f,%.1f,%.2f\n", fs.name, fs.width, fs.height, cold, cached, frame, 100.0 * (cold - cached) / frame);
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+// Encoder benchmark over the whole parameter space: synthetic and real frames (images of the detector training set,
+// scaled to each framesize) in every source format, subsampling, quality 10-95 and framesize QQVGA to UXGA.
+// Linked with the profiling build of jpge, which times colour conversion, DCT, quantization and Huffman coding.
+// Throughput is measured with profiling off, the stage times by one more pass over the frames with it on.
+// Usage: bench_jpge_suite [--quick] [--images DIR] [--max-images N] [--min-ms MS]
+//        (defaults: the training set validation images, 4 images, 100 ms per point; --quick runs 3 qualities and
+//        framesizes at 20 ms per point)
+// Output is CSV: source,format,subsampling,quality,framesize,width,height,frames,ms_per_frame,mpix_s,bytes_per_frame,
+//                colour_ms,dct_ms,quantize_ms,huffman_ms
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "jpge.h"
+#include "test_util.h"
+
+struct bench_frame_t {
+    const char *name;
+    uint16_t width, height;
+};
+
+static const bench_frame_t s_framesizes[] = {
+    { "QQVGA", 160, 120 },
+    { "QVGA", 320, 240 },
+    { "CIF", 400, 296 },
+    { "VGA", 640, 480 },
+    { "SVGA", 800, 600 },
+    { "XGA", 1024, 768 },
+    { "HD", 1280, 720 },
+    { "SXGA", 1280, 1024 },
+    { "UXGA", 1600, 1200 },
+};
+
+struct bench_format_t {
+    const char *name;
+    pixformat_t format;
+    size_t bpp;
+};
+
+static const bench_format_t s_formats[] = {
+    { "GRAYSCALE", PIXFORMAT_GRAYSCALE, 1 },
+    { "YUV422", PIXFORMAT_YUV422, 2 },
+    { "RGB565", PIXFORMAT_RGB565, 2 },
+    { "RGB888", PIXFORMAT_RGB888, 3 },
+};
+
+static const struct {
+    const char *name;
+    jpg_subsampling_t subsampling;
+} s_subsamplings[] = {
+    { "420", JPG_SUBSAMPLING_420 },
+    { "422", JPG_SUBSAMPLING_422 },
+    { "444", JPG_SUBSAMPLING_444 },
+};
+
+static const uint8_t s_qualities[] = { 10, 30, 50, 70, 80, 90, 95 };
+static const uint8_t s_quick_qualities[] = { 10, 50, 95 };
+
+// The image as the camera would send it in the given format.
+static void to_format(const bgr_image_t &img, const bench_format_t &fmt, std::vector<uint8_t> &out)
+{
+    size_t pixels = (size_t)img.width * img.height;
+    out.resize(pixels * fmt.bpp);
+    for (size_t i = 0; i < pixels; i++) {
+        int b = img.bgr[i * 3], g = img.bgr[i * 3 + 1], r = img.bgr[i * 3 + 2];
+        switch (fmt.format) {
+            case PIXFORMAT_GRAYSCALE:
+                out[i] = (uint8_t)((r * 77 + g * 150 + b * 29 + 128) >> 8);
+                break;
+            case PIXFORMAT_YUV422: {
+                // limited range BT.601, chroma of the even pixel of each pair
+                out[i * 2] = (uint8_t)(16 + ((r * 66 + g * 129 + b * 25 + 128) >> 8));
+                if (!(i & 1)) {
+                    out[i * 2 + 1] = (uint8_t)(128 + ((-r * 38 - g * 74 + b * 112 + 128) >> 8));
+                } else {
+                    int pb = img.bgr[(i - 1) * 3], pg = img.bgr[(i - 1) * 3 + 1], pr = img.bgr[(i - 1) * 3 + 2];
+                    out[i * 2 + 1] = (uint8_t)(128 + ((pr * 112 - pg * 94 - pb * 18 + 128) >> 8));
+                }
+                break;
+            }
+            case PIXFORMAT_RGB565: {
+                uint16_t c = (uint16_t)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+                out[i * 2] = (uint8_t)(c >> 8);
+                out[i * 2 + 1] = (uint8_t)c;
+                break;
+            }
+            default:
+                memcpy(&out[i * 3], &img.bgr[i * 3], 3);
+                break;
+        }
+    }
+}
+
+struct bench_result_t {
+    int frames;
+    double ms_per_frame;
+    double bytes_per_frame;
+    double stage_ms[jpge::PROFILE_STAGES];
+};
+
+// Encodes the frames in turn for at least min_ms and two rounds, then once more each with the stages timed.
+static bool bench(std::vector<std::vector<uint8_t> > &frames, const bench_frame_t &fs, pixformat_t format,
+                  const jpg_encode_config_t &config, double min_ms, bench_result_t *res)
+{
+    size_t total_bytes = 0, bytes = 0;
+    res->frames = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while (res->frames < 2 * (int)frames.size() || elapsed < min_ms) {
+        std::vector<uint8_t> &src = frames[res->frames % frames.size()];
+        if (!fmt2jpg_cb_ex(src.data(), src.size(), fs.width, fs.height, format, &config, count_cb, &bytes)) {
+            return false;
+        }
+        total_bytes += bytes;
+        res->frames++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    res->ms_per_frame = elapsed / res->frames;
+    res->bytes_per_frame = (double)total_bytes / res->frames;
+
+    jpge::set_profiling(true);
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (!fmt2jpg_cb_ex(frames[i].data(), frames[i].size(), fs.width, fs.height, format, &config, count_cb, &bytes)) {
+            jpge::set_profiling(false);
+            return false;
+        }
+    }
+    jpge::set_profiling(false);
+    jpge::profile_stats stats;
+    jpge::get_profile(&stats);
+    for (int s = 0; s < jpge::PROFILE_STAGES; s++) {
+        res->stage_ms[s] = stats.ns[s] / 1e6 / frames.size();
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool quick = false;
+    const char *dir = BENCH_DATASET_DIR;
+    size_t max_images = 4;
+    double min_ms = 100;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--quick")) {
+            quick = true;
+            min_ms = 20;
+        } else if (!strcmp(argv[i], "--images") && i + 1 < argc) {
+            dir = argv[++i];
+        } else if (!strcmp(argv[i], "--max-images") && i + 1 < argc) {
+            max_images = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--min-ms") && i + 1 < argc) {
+            min_ms = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--images DIR] [--max-images N] [--min-ms MS]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // real frames: the first images of the directory, in name order
+    std::vector<std::string> names;
+    if (DIR *d = opendir(dir)) {
+        while (struct dirent *e = readdir(d)) {
+            std::string name = e->d_name;
+            if (name.size() > 4 && (name.compare(name.size() - 4, 4, ".jpg") == 0 || name.compare(name.size() - 4, 4, ".JPG") == 0)) {
+                names.push_back(name);
+            }
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+    std::vector<bgr_image_t> images;
+    for (size_t i = 0; i < names.size() && images.size() < max_images; i++) {
+        bgr_image_t img;
+        if (load_image(std::string(dir) + "/" + names[i], img, 1600, 1200)) {
+            images.push_back(img);
+        }
+    }
+    if (images.empty()) {
+        fprintf(stderr, "no images in %s, only synthetic frames are encoded\n", dir);
+    }
+    if (!jpge::set_profiling(false)) {
+        fprintf(stderr, "jpge is built without JPGE_PROFILE, stage times are 0\n");
+    }
+
+    const uint8_t *qualities = quick ? s_quick_qualities : s_qualities;
+    size_t num_qualities = quick ? sizeof(s_quick_qualities) : sizeof(s_qualities);
+    printf("source,format,subsampling,quality,framesize,width,height,frames,ms_per_frame,mpix_s,bytes_per_frame,"
+           "colour_ms,dct_ms,quantize_ms,huffman_ms\n");
+    for (size_t f = 0; f < sizeof(s_framesizes) / sizeof(s_framesizes[0]); f++) {
+        const bench_frame_t &fs = s_framesizes[f];
+        if (quick && strcmp(fs.name, "QQVGA") && strcmp(fs.name, "VGA") && strcmp(fs.name, "UXGA")) {
+            continue;
+        }
+        std::vector<bgr_image_t> sources[2];
+        sources[0].resize(1);
+        synthetic_image(sources[0][0], fs.width, fs.height);
+        sources[1].resize(images.size());
+        for (size_t i = 0; i < images.size(); i++) {
+            resample(images[i], sources[1][i], fs.width, fs.height);
+        }
+
+        for (int s = 0; s < 2; s++) {
+            if (sources[s].empty()) {
+                continue;
+            }
+            for (size_t p = 0; p < sizeof(s_formats) / sizeof(s_formats[0]); p++) {
+                const bench_format_t &fmt = s_formats[p];
+                std::vector<std::vector<uint8_t> > frames(sources[s].size());
+                for (size_t i = 0; i < frames.size(); i++) {
+                    to_format(sources[s][i], fmt, frames[i]);
+                }
+                // grayscale sources are always coded as luma only
+                size_t num_subsamplings = fmt.format == PIXFORMAT_GRAYSCALE ? 1 : sizeof(s_subsamplings) / sizeof(s_subsamplings[0]);
+                for (size_t ss = 0; ss < num_subsamplings; ss++) {
+                    for (size_t q = 0; q < num_qualities; q++) {
+                        jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+                        config.subsampling = s_subsamplings[ss].subsampling;
+                        config.quality = qualities[q];
+                        bench_result_t res;
+                        if (!bench(frames, fs, fmt.format, config, min_ms, &res)) {
+                            fprintf(stderr, "encode failed\n");
+                            return 1;
+                        }
+                        printf("%s,%s,%s,%u,%s,%u,%u,%d,%.3f,%.2f,%.0f,%.3f,%.3f,%.3f,%.3f\n", s ? "real" : "synthetic",
+                               fmt.name, fmt.format == PIXFORMAT_GRAYSCALE ? "gray" : s_subsamplings[ss].name, qualities[q],
+                               fs.name, fs.width, fs.height, res.frames, res.ms_per_frame,
+                               (double)fs.width * fs.height / 1000.0 / res.ms_per_frame, res.bytes_per_frame,
+                               res.stage_ms[jpge::PROFILE_COLOUR], res.stage_ms[jpge::PROFILE_DCT],
+                               res.stage_ms[jpge::PROFILE_QUANTIZE], res.stage_ms[jpge::PROFILE_HUFFMAN]);
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
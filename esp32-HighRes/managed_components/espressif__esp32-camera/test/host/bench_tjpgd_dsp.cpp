@@ -0,0 +1,70 @@
+// Throughput of the tjpgd inverse DCT and colour conversion kernels, in 8x8 blocks per second. A colour converted
+// block is 64 RGB888 pixels, eight rows of a 4:4:4 MCU or four of a 4:2:0 one.
+// Output is CSV: kernel,stage,blocks_per_s
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "tjpgd_dsp.h"
+
+// The decoder transforms one block at a time out of L1, keep the working set cache resident too.
+enum { NUM_BLOCKS = 64, ROUNDS = 12800 };
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main()
+{
+    std::vector<LONG> src(NUM_BLOCKS * 64), work(NUM_BLOCKS * 64);
+    std::vector<BYTE> pixels(NUM_BLOCKS * 64), mcu(64 * 6), rgb(16 * 3);
+    unsigned seed = 1;
+    // a handful of coefficients per block, as quantized camera frames have
+    for (int b = 0; b < NUM_BLOCKS; b++) {
+        src[b * 64] = (LONG)(rand_r(&seed) % 8192) - 4096;
+        for (int n = 0; n < 6; n++) {
+            src[b * 64 + 1 + rand_r(&seed) % 63] = (LONG)(rand_r(&seed) % 4096) - 2048;
+        }
+    }
+    for (size_t i = 0; i < mcu.size(); i++) {
+        mcu[i] = (BYTE)rand_r(&seed);
+    }
+
+    printf("kernel,stage,blocks_per_s\n");
+    for (int id = JD_DSP_SCALAR; id < JD_DSP_KERNEL_COUNT; id++) {
+        const jd_dsp_kernels *k = jd_dsp_get_kernels(static_cast<jd_dsp_kernel_id_t>(id));
+        if (!k) {
+            continue;
+        }
+
+        double t_idct = 0;
+        for (int r = 0; r < ROUNDS; r++) {
+            memcpy(work.data(), src.data(), src.size() * sizeof(LONG));
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            for (int b = 0; b < NUM_BLOCKS; b++) {
+                k->idct(&work[b * 64], &pixels[b * 64]);
+            }
+            t_idct += seconds_since(start);
+        }
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int r = 0; r < ROUNDS; r++) {
+            for (int b = 0; b < NUM_BLOCKS; b++) {
+                // 4:2:0 rows of the MCU buffer: Y blocks at 0..255, Cb at 256, Cr at 320
+                for (int iy = 0; iy < 4; iy++) {
+                    int row = (b * 4 + iy) & 15;
+                    k->ycc_row(rgb.data(), &mcu[(row & 7) * 8 + (row >> 3) * 128], &mcu[256 + (row >> 1) * 8], 16);
+                }
+            }
+        }
+        double t_ycc = seconds_since(start);
+
+        double blocks = (double)NUM_BLOCKS * ROUNDS;
+        printf("%s,idct,%.0f\n", k->name, blocks / t_idct);
+        printf("%s,ycc_rgb,%.0f\n", k->name, blocks / t_ycc);
+        printf("%s,idct+ycc_rgb,%.0f\n", k->name, blocks / (t_idct + t_ycc));
+    }
+    return 0;
+}
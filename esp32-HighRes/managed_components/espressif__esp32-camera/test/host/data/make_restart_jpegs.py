@@ -0,0 +1,44 @@
+#!/usr/bin/env python3
+"""Writes the JPEGs of test_jpg_decode_restart to restart/: one synthetic frame encoded by libjpeg (through OpenCV)
+at 4:2:0, 4:2:2 and 4:4:4, without restart markers and with intervals of 1, 7 and 64 MCUs. The intervals only
+change the entropy coding, all files of one subsampling decode to the same pixels. The frame is noisy and encoded
+at quality 100, so that many blocks end on their last coefficient, without end of block code: intervals then end
+with the bit reader before the marker instead of stopped at it.
+
+    python3 make_restart_jpegs.py
+"""
+
+import os
+
+import cv2
+import numpy as np
+
+SAMPLING = {"420": cv2.IMWRITE_JPEG_SAMPLING_FACTOR_420, "422": cv2.IMWRITE_JPEG_SAMPLING_FACTOR_422,
+            "444": cv2.IMWRITE_JPEG_SAMPLING_FACTOR_444}
+INTERVALS = (0, 1, 7, 64)
+WIDTH, HEIGHT = 176, 144
+
+
+def frame():
+    rng = np.random.default_rng(1)
+    y, x = np.mgrid[0:HEIGHT, 0:WIDTH]
+    base = x * 150 // WIDTH + y * 50 // HEIGHT + ((x // 32 + y // 32) & 1) * 30
+    img = np.stack([40 + base, 30 + base + y * 40 // HEIGHT, 20 + base + x * 60 // WIDTH], axis=-1)
+    return np.clip(img + rng.integers(0, 24, img.shape), 0, 255).astype(np.uint8)
+
+
+def main():
+    out = os.path.join(os.path.dirname(os.path.abspath(__file__)), "restart")
+    os.makedirs(out, exist_ok=True)
+    img = frame()
+    for name, sampling in SAMPLING.items():
+        for rst in INTERVALS:
+            ok, jpg = cv2.imencode(".jpg", img, [cv2.IMWRITE_JPEG_QUALITY, 100, cv2.IMWRITE_JPEG_SAMPLING_FACTOR,
+                                                 sampling, cv2.IMWRITE_JPEG_RST_INTERVAL, rst])
+            assert ok
+            with open(os.path.join(out, "%s_rst%d.jpg" % (name, rst)), "wb") as f:
+                f.write(jpg.tobytes())
+
+
+if __name__ == "__main__":
+    main()
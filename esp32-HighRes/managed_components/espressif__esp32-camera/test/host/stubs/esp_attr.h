@@ -0,0 +1,6 @@
+// Host stand-in for esp_attr.h: placement attributes have no meaning off target.
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
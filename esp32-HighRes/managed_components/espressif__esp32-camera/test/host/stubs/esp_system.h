@@ -0,0 +1,6 @@
+// Host stand-in for esp_system.h.
+#pragma once
+
+#include "esp_err.h"
+
+#define ESP_IDF_VERSION_MAJOR 5
@@ -0,0 +1,4 @@
+// Host configuration: no camera, no SPIRAM.
+#pragma once
+
+#define CONFIG_CAMERA_CONVERTER_ENABLED 0
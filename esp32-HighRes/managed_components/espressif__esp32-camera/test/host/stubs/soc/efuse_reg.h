@@ -0,0 +1,2 @@
+// Host stand-in for soc/efuse_reg.h, which the conversions include but do not use.
+#pragma once
@@ -0,0 +1,132 @@
+// Checks the image buffer pool: classes leave at most a quarter of a buffer unused, a sixteenth from 64KB, and
+// larger sizes than the classes get exact buffers; buffers are reused within their size class and with smaller
+// release sizes, shrunk buffers keep their bytes and go back to their new class, the limit is kept, and a stream of conversions of changing frame sizes is served from the pool once warm.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+
+static int check_classes()
+{
+    int failures = 0;
+    img_buf_pool_stats_t before, after;
+    img_buf_pool_get_stats(&before);
+
+    void *a = img_buf_acquire(1000);
+    img_buf_release(a, 1000);
+    void *b = img_buf_acquire(900);
+    // released with the length of what it now holds, a smaller class
+    img_buf_release(b, 300);
+    void *c = img_buf_acquire(260);
+    img_buf_pool_get_stats(&after);
+    if (a != b || b != c || after.hits != before.hits + 2 || after.misses != before.misses + 1) {
+        printf("FAIL classes: buffers not reused\n");
+        failures++;
+    }
+    img_buf_release(c, 260);
+
+    img_buf_pool_get_stats(&before);
+    uint8_t *e = (uint8_t *)img_buf_acquire(100000);
+    memset(e, 0x5A, 5000);
+    e = (uint8_t *)img_buf_shrink_to(e, 100000, 5000);
+    img_buf_pool_get_stats(&after);
+    bool kept = e && img_buf_capacity(5000) >= 5000 && img_buf_capacity(5000) < img_buf_capacity(100000);
+    for (int i = 0; kept && i < 5000; i++) {
+        kept = e[i] == 0x5A;
+    }
+    img_buf_release(e, 5000);
+    void *f = img_buf_acquire(img_buf_capacity(5000));
+    if (!kept || f != e || after.in_use_bytes != before.in_use_bytes + img_buf_capacity(5000)) {
+        printf("FAIL shrink: bytes lost or buffer not in its new class\n");
+        failures++;
+    }
+    img_buf_release(f, img_buf_capacity(5000));
+
+    for (size_t size = 1000; size < ((size_t)128 << 20); size = size * 9 / 8 + 7) {
+        size_t cap = img_buf_capacity(size);
+        size_t most = size <= 64 * 1024 ? size + size / 4 : size + size / 16;
+        if (cap < size || cap > most || img_buf_capacity(cap) != cap) {
+            printf("FAIL classes: %zu bytes get a buffer of %zu\n", size, cap);
+            failures++;
+            break;
+        }
+    }
+    const size_t huge = ((size_t)64 << 20) + 1;
+    img_buf_pool_get_stats(&before);
+    void *g = img_buf_acquire(huge);
+    img_buf_release(g, huge);
+    img_buf_pool_get_stats(&after);
+    if (!g || img_buf_capacity(huge) != huge || after.cached_bytes != before.cached_bytes
+            || after.drops != before.drops + 1 || after.in_use_bytes != before.in_use_bytes) {
+        printf("FAIL classes: a buffer above the classes is not exact or stays in the pool\n");
+        failures++;
+    }
+
+    img_buf_pool_set_limit(0);
+    img_buf_pool_get_stats(&after);
+    void *d = img_buf_acquire(1000);
+    img_buf_release(d, 1000);
+    img_buf_pool_get_stats(&before);
+    if (after.cached_bytes != 0 || before.cached_bytes != 0 || before.drops != after.drops + 1) {
+        printf("FAIL limit: %zu bytes cached with pooling off\n", before.cached_bytes);
+        failures++;
+    }
+    img_buf_pool_set_limit(1024 * 1024);
+    return failures;
+}
+
+static int check_conversions()
+{
+    static const uint16_t s_sizes[][2] = { { 320, 240 }, { 640, 480 }, { 800, 600 } };
+    std::vector<uint8_t> src[3];
+    for (int s = 0; s < 3; s++) {
+        src[s].resize((size_t)s_sizes[s][0] * s_sizes[s][1] * 2);
+        for (size_t i = 0; i < src[s].size(); i++) {
+            src[s][i] = (uint8_t)((i / 5) ^ (i / 1931));
+        }
+    }
+
+    img_buf_pool_set_limit(8 * 1024 * 1024);
+    img_buf_pool_stats_t warm, done;
+    int failures = 0;
+    for (int f = 0; f < 60; f++) {
+        if (f == 12) {
+            img_buf_pool_get_stats(&warm);
+        }
+        int s = (f * 7 + f / 3) % 3;
+        uint8_t *jpg = NULL, *bmp = NULL;
+        size_t jpg_len = 0, bmp_len = 0;
+        if (!fmt2jpg(src[s].data(), src[s].size(), s_sizes[s][0], s_sizes[s][1], PIXFORMAT_YUV422, 80, &jpg, &jpg_len)
+                || !fmt2bmp(jpg, jpg_len, s_sizes[s][0], s_sizes[s][1], PIXFORMAT_JPEG, &bmp, &bmp_len)) {
+            printf("FAIL frame %d: conversion\n", f);
+            failures++;
+        }
+        img_buf_release(jpg, jpg_len);
+        img_buf_release(bmp, bmp_len);
+    }
+    img_buf_pool_get_stats(&done);
+    uint32_t hits = done.hits - warm.hits, misses = done.misses - warm.misses;
+    printf("after warm up: %u hits, %u misses, %zu bytes cached, %zu bytes in use, high water %zu bytes\n",
+           hits, misses, done.cached_bytes, done.in_use_bytes, done.high_water_bytes);
+    // outputs released with their length rather than their capacity leave a few bytes counted as in use
+    if (misses || done.in_use_bytes > 64 * 1024 || done.cached_bytes > 8 * 1024 * 1024) {
+        printf("FAIL conversions: buffers not reused or not given back\n");
+        failures++;
+    }
+    img_buf_pool_trim();
+    img_buf_pool_get_stats(&done);
+    if (done.cached_bytes) {
+        printf("FAIL trim: %zu bytes left\n", done.cached_bytes);
+        failures++;
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check_classes();
+    failures += check_conversions();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,144 @@
+// Checks batch decoding: frames of mixed sizes, with and without restart markers, must come out as jpg2fmt()
+// decodes them one by one, for every format and several worker counts, with their sizes set. A bad frame must
+// fail alone, without stopping the others, and batches started from several threads at once must all decode.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static bool make_jpg(uint16_t w, uint16_t h, uint8_t encode_workers, std::vector<uint8_t> &jpg)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 80;
+    config.workers = encode_workers;
+    return make_jpg(w, h, config, w * 7 + h, jpg);
+}
+
+static size_t out_size(uint16_t w, uint16_t h, pixformat_t format)
+{
+    switch (format) {
+    case PIXFORMAT_RGB888:
+        return (size_t)w * h * 3;
+    case PIXFORMAT_GRAYSCALE:
+        return (size_t)w * h;
+    case PIXFORMAT_YUV420:
+        return (size_t)w * h + 2 * (size_t)((w + 1) / 2) * ((h + 1) / 2);
+    default:
+        return (size_t)w * h * 2;
+    }
+}
+
+int main()
+{
+    // ESP32 frames, a laptop camera and a UVC camera
+    static const struct {
+        uint16_t width, height;
+        uint8_t encode_workers;
+    } s_frames[] = {
+        { 800, 600, 1 }, { 1280, 720, 4 }, { 640, 480, 1 }, { 320, 240, 2 }, { 1600, 1200, 8 }, { 333, 251, 1 },
+        { 800, 600, 3 }, { 96, 64, 1 },
+    };
+    static const pixformat_t s_formats[] = {
+        PIXFORMAT_RGB888, PIXFORMAT_RGB565, PIXFORMAT_GRAYSCALE, PIXFORMAT_YUV422, PIXFORMAT_YUV420,
+    };
+    const size_t n = sizeof(s_frames) / sizeof(s_frames[0]);
+    std::vector<std::vector<uint8_t> > jpgs(n);
+    for (size_t i = 0; i < n; i++) {
+        if (!make_jpg(s_frames[i].width, s_frames[i].height, s_frames[i].encode_workers, jpgs[i])) {
+            printf("FAIL encode %zu\n", i);
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    for (size_t f = 0; f < sizeof(s_formats) / sizeof(s_formats[0]); f++) {
+        for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale += 2) {
+            std::vector<std::vector<uint8_t> > ref(n);
+            for (size_t i = 0; i < n; i++) {
+                uint16_t w = s_frames[i].width >> scale, h = s_frames[i].height >> scale;
+                ref[i].assign(out_size(w, h, s_formats[f]), 0);
+                if (!jpg2fmt(jpgs[i].data(), jpgs[i].size(), s_formats[f], (jpg_scale_t)scale, ref[i].data())) {
+                    printf("FAIL format %d frame %zu: jpg2fmt\n", s_formats[f], i);
+                    failures++;
+                }
+            }
+            for (uint8_t workers = 1; workers <= 16; workers *= 2) {
+                std::vector<std::vector<uint8_t> > out(n);
+                std::vector<jpg_batch_frame_t> frames(n);
+                for (size_t i = 0; i < n; i++) {
+                    out[i].assign(ref[i].size(), 0);
+                    memset(&frames[i], 0, sizeof(frames[i]));
+                    frames[i].src = jpgs[i].data();
+                    frames[i].src_len = jpgs[i].size();
+                    frames[i].out = out[i].data();
+                }
+                bool ok = jpg2fmt_batch(frames.data(), n, s_formats[f], (jpg_scale_t)scale, workers);
+                int bad = !ok;
+                for (size_t i = 0; i < n; i++) {
+                    bad += !frames[i].ok || out[i] != ref[i] || frames[i].width != s_frames[i].width >> scale
+                           || frames[i].height != s_frames[i].height >> scale;
+                }
+                if (bad) {
+                    printf("FAIL format %d 1/%d, %d workers: %d frames differ\n", s_formats[f], 1 << scale, workers, bad);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    // a cut frame and one without output fail, the frames around them decode
+    std::vector<uint8_t> cut(jpgs[0].begin(), jpgs[0].begin() + jpgs[0].size() / 2);
+    std::vector<uint8_t> a(out_size(1280, 720, PIXFORMAT_GRAYSCALE)), b(out_size(800, 600, PIXFORMAT_GRAYSCALE));
+    jpg_batch_frame_t frames[4] = {};
+    frames[0].src = jpgs[1].data();
+    frames[0].src_len = jpgs[1].size();
+    frames[0].out = a.data();
+    frames[1].src = cut.data();
+    frames[1].src_len = cut.size();
+    frames[1].out = b.data();
+    frames[2].src = jpgs[2].data();
+    frames[2].src_len = jpgs[2].size();
+    frames[3].src = jpgs[0].data();
+    frames[3].src_len = jpgs[0].size();
+    frames[3].out = b.data();
+    if (jpg2fmt_batch(frames, 4, PIXFORMAT_GRAYSCALE, JPG_SCALE_NONE, 2) || !frames[0].ok || frames[1].ok
+            || frames[2].ok || !frames[3].ok || frames[1].width || frames[2].height) {
+        printf("FAIL bad frames\n");
+        failures++;
+    }
+    if (jpg2fmt_batch(NULL, 1, PIXFORMAT_RGB888, JPG_SCALE_NONE, 1) || jpg2fmt_batch(frames, 0, PIXFORMAT_RGB888, JPG_SCALE_NONE, 1)) {
+        printf("FAIL empty batch accepted\n");
+        failures++;
+    }
+
+    // the workers are shared, batches from other threads wait for them
+    std::vector<std::thread> threads;
+    std::vector<int> bad(4, 0);
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            for (int it = 0; it < 10; it++) {
+                std::vector<uint8_t> gray(out_size(1280, 720, PIXFORMAT_GRAYSCALE)), ref(gray.size());
+                jpg_batch_frame_t frame = {};
+                frame.src = jpgs[1 + t % 2].data();
+                frame.src_len = jpgs[1 + t % 2].size();
+                frame.out = gray.data();
+                jpg_batch_frame_t same[2] = { frame, frame };
+                same[1].out = ref.data();
+                bad[t] += !jpg2fmt_batch(same, 2, PIXFORMAT_GRAYSCALE, JPG_SCALE_NONE, 1 + (t + it) % 3) || gray != ref;
+            }
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+        if (bad[t]) {
+            printf("FAIL thread %zu: %d batches differ\n", t, bad[t]);
+            failures++;
+        }
+    }
+    printf("%s %zu frames\n", failures ? "FAIL" : "ok", n);
+    return failures ? 1 : 0;
+}
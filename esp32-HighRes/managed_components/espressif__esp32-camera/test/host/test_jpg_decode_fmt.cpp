@@ -0,0 +1,204 @@
+// Checks decoding to other formats than RGB: the gray decode must give the exact luma of the YCbCr decode, which
+// must match the RGB decode, YUYV and I420 must be the limited range of the YCbCr decode, a YUV422 frame must
+// survive an encode and decode, and jpg2fmt() must give what the format specific converters give. All must fail
+// without an output buffer.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static bool decode(const std::vector<uint8_t> &jpg, int scale, jpg_output_t output, decode_t &dec)
+{
+    dec.bpp = output == JPG_OUT_GRAY ? 1 : 3;
+    return esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), (jpg_scale_t)scale, output, write_cb, &dec, NULL, 0) == ESP_OK;
+}
+
+static uint8_t limited_y(uint8_t y)
+{
+    return 16 + ((y * 220 + 128) >> 8);
+}
+
+static uint8_t limited_c(uint8_t c)
+{
+    return (c * 225 + 4096) >> 8;
+}
+
+// Smooth colours with some noise, YUYV in limited range.
+static void make_yuyv(std::vector<uint8_t> &src, uint16_t w, uint16_t h, unsigned seed)
+{
+    src.resize((size_t)w * h * 2);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &src[((size_t)y * w + x) * 2];
+            p[0] = (uint8_t)(40 + (x * 120) / w + (y * 40) / h + (rand_r(&seed) & 15));
+            p[1] = (uint8_t)((x & 1) ? 100 + (y * 60) / h : 150 - (x * 40) / w);
+        }
+    }
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, jpg_subsampling_t subsampling)
+{
+    std::vector<uint8_t> src;
+    make_yuyv(src, w, h, w * h);
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 90;
+    config.subsampling = subsampling;
+    std::vector<uint8_t> jpg;
+    if (!fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &jpg)) {
+        printf("FAIL %s: encode\n", name);
+        return 1;
+    }
+
+    int failures = 0;
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        decode_t gray, ycc, rgb;
+        if (!decode(jpg, scale, JPG_OUT_GRAY, gray) || !decode(jpg, scale, JPG_OUT_YCBCR, ycc)
+                || !decode(jpg, scale, JPG_OUT_RGB888, rgb)) {
+            printf("FAIL %s 1/%d: decode\n", name, 1 << scale);
+            failures++;
+            continue;
+        }
+        const size_t pixels = (size_t)ycc.width * ycc.height;
+        if (gray.width != ycc.width || gray.height != ycc.height || rgb.width != ycc.width || !pixels) {
+            printf("FAIL %s 1/%d: size\n", name, 1 << scale);
+            failures++;
+            continue;
+        }
+
+        // the luma of gray and YCbCr is the same IDCT, the RGB is converted from the same samples. When scaling by
+        // 1/2 and 1/4 RGB is averaged after conversion and YCbCr before, that rounds differently
+        int y_diff = 0, rgb_diff = 0;
+        for (size_t i = 0; i < pixels; i++) {
+            const uint8_t *c = &ycc.out[i * 3], *p = &rgb.out[i * 3];
+            y_diff = std::max(y_diff, abs(gray.out[i] - c[0]));
+            int r = c[0] + (1435 * (c[2] - 128)) / 1024;
+            int g = c[0] - (352 * (c[1] - 128) + 731 * (c[2] - 128)) / 1024;
+            int b = c[0] + (1814 * (c[1] - 128)) / 1024;
+            r = r < 0 ? 0 : r > 255 ? 255 : r;
+            g = g < 0 ? 0 : g > 255 ? 255 : g;
+            b = b < 0 ? 0 : b > 255 ? 255 : b;
+            rgb_diff = std::max(rgb_diff, std::max(abs(r - p[0]), std::max(abs(g - p[1]), abs(b - p[2]))));
+        }
+        if (y_diff || rgb_diff > ((scale == JPG_SCALE_2X || scale == JPG_SCALE_4X) ? 4 : 1)) {
+            printf("FAIL %s 1/%d: luma differs by %d, RGB by %d\n", name, 1 << scale, y_diff, rgb_diff);
+            failures++;
+        }
+
+        // the converters against the YCbCr decode
+        const size_t cw = (ycc.width + 1) / 2, ch = (ycc.height + 1) / 2;
+        std::vector<uint8_t> g1(pixels), yuyv(pixels * 2), i420(pixels + cw * ch * 2);
+        if (!jpg2gray(jpg.data(), jpg.size(), g1.data(), (jpg_scale_t)scale)
+                || !jpg2yuv422(jpg.data(), jpg.size(), yuyv.data(), (jpg_scale_t)scale)
+                || !jpg2yuv420(jpg.data(), jpg.size(), i420.data(), (jpg_scale_t)scale)) {
+            printf("FAIL %s 1/%d: converters\n", name, 1 << scale);
+            failures++;
+            continue;
+        }
+        int bad = g1 != gray.out;
+        for (size_t y = 0; y < ycc.height; y++) {
+            for (size_t x = 0; x < ycc.width; x++) {
+                const uint8_t *c = &ycc.out[(y * ycc.width + x) * 3];
+                const uint8_t *o = &yuyv[(y * ycc.width + x) * 2];
+                bad += o[0] != limited_y(c[0]) || o[1] != limited_c(c[(x & 1) ? 2 : 1]);
+                bad += i420[y * ycc.width + x] != limited_y(c[0]);
+                if (!((x | y) & 1)) {
+                    bad += i420[pixels + (y / 2) * cw + x / 2] != limited_c(c[1]);
+                    bad += i420[pixels + cw * ch + (y / 2) * cw + x / 2] != limited_c(c[2]);
+                }
+            }
+        }
+        if (bad) {
+            printf("FAIL %s 1/%d: %d converted samples differ\n", name, 1 << scale, bad);
+            failures++;
+        }
+    }
+
+    // YUV422 in, YUYV out at full scale: no more than the compression loss
+    std::vector<uint8_t> yuyv(src.size());
+    if (!jpg2yuv422(jpg.data(), jpg.size(), yuyv.data(), JPG_SCALE_NONE)) {
+        printf("FAIL %s: round trip decode\n", name);
+        return failures + 1;
+    }
+    double y_err = 0, c_err = 0;
+    for (size_t i = 0; i < src.size(); i += 2) {
+        y_err += abs(src[i] - yuyv[i]);
+        c_err += abs(src[i + 1] - yuyv[i + 1]);
+    }
+    y_err /= src.size() / 2;
+    c_err /= src.size() / 2;
+    if (y_err > 4 || c_err > 4) {
+        printf("FAIL %s: round trip error Y %.2f, UV %.2f\n", name, y_err, c_err);
+        failures++;
+    }
+
+    printf("%s %s: round trip error Y %.2f, UV %.2f\n", failures ? "FAIL" : "ok", name, y_err, c_err);
+    return failures;
+}
+
+static int check_fmt(void)
+{
+    const uint16_t w = 96, h = 64;
+    std::vector<uint8_t> src;
+    make_yuyv(src, w, h, 7);
+    uint8_t *jpg = NULL;
+    size_t len = 0;
+    if (!fmt2jpg(src.data(), src.size(), w, h, PIXFORMAT_YUV422, 80, &jpg, &len)) {
+        printf("FAIL jpg2fmt: encode\n");
+        return 1;
+    }
+
+    int failures = 0;
+    const size_t pixels = (size_t)w * h;
+    struct {
+        pixformat_t format;
+        size_t bytes;
+        bool (*convert)(const uint8_t *, size_t, uint8_t *, jpg_scale_t);
+    } formats[] = {
+        { PIXFORMAT_RGB888, pixels * 3, jpg2rgb888 },
+        { PIXFORMAT_RGB565, pixels * 2, jpg2rgb565 },
+        { PIXFORMAT_GRAYSCALE, pixels, jpg2gray },
+        { PIXFORMAT_YUV422, pixels * 2, jpg2yuv422 },
+        { PIXFORMAT_YUV420, pixels * 3 / 2, jpg2yuv420 },
+    };
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        std::vector<uint8_t> a(formats[i].bytes), b(formats[i].bytes);
+        if (!jpg2fmt(jpg, len, formats[i].format, JPG_SCALE_NONE, a.data())
+                || !formats[i].convert(jpg, len, b.data(), JPG_SCALE_NONE) || a != b) {
+            printf("FAIL jpg2fmt: format %d\n", formats[i].format);
+            failures++;
+        }
+    }
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        if (jpg2fmt(jpg, len, formats[i].format, JPG_SCALE_NONE, NULL)
+                || formats[i].convert(jpg, len, NULL, JPG_SCALE_NONE)) {
+            printf("FAIL jpg2fmt: format %d without output buffer accepted\n", formats[i].format);
+            failures++;
+        }
+    }
+    std::vector<uint8_t> out(pixels * 3);
+    if (jpg2fmt(jpg, len, PIXFORMAT_JPEG, JPG_SCALE_NONE, out.data())
+            || jpg2fmt(jpg, len, PIXFORMAT_RAW, JPG_SCALE_NONE, out.data())) {
+        printf("FAIL jpg2fmt: unsupported format accepted\n");
+        failures++;
+    }
+    free(jpg);
+    printf("%s jpg2fmt\n", failures ? "FAIL" : "ok");
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("320x240 4:2:0", 320, 240, JPG_SUBSAMPLING_420);
+    failures += check("320x240 4:2:2", 320, 240, JPG_SUBSAMPLING_422);
+    failures += check("320x240 4:4:4", 320, 240, JPG_SUBSAMPLING_444);
+    failures += check("333x155 4:2:0", 333, 155, JPG_SUBSAMPLING_420);
+    failures += check("101x37 4:2:2", 101, 37, JPG_SUBSAMPLING_422);
+    failures += check("45x29 4:4:4", 45, 29, JPG_SUBSAMPLING_444);
+    failures += check_fmt();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+// Checks decoding from memory: the output must match the reader callback path for every scale, with and without
+// restart markers, the JPEG buffer must not be written (byte stuffing used to be undone in place), and a
+// truncated JPEG must fail without reading past its end. Prints the time of both paths.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static int check(const char *name, uint16_t w, uint16_t h, uint8_t quality, uint8_t workers)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = quality;
+    config.workers = workers;
+    std::vector<uint8_t> jpg;
+    if (!make_jpg(w, h, config, w + quality, jpg)) {
+        printf("FAIL %s: encode\n", name);
+        return 1;
+    }
+    const std::vector<uint8_t> copy = jpg;
+
+    int failures = 0;
+    double cb_ms = 0, mem_ms = 0;
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        decode_t by_cb, by_mem;
+        by_cb.jpg = by_mem.jpg = &jpg;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = esp_jpg_decode(jpg.size(), (jpg_scale_t)scale, read_cb, write_cb, &by_cb) == ESP_OK;
+        cb_ms += ms_since(start);
+        start = std::chrono::steady_clock::now();
+        ok = ok && esp_jpg_decode_mem(jpg.data(), jpg.size(), (jpg_scale_t)scale, write_cb, &by_mem, NULL, 0) == ESP_OK;
+        mem_ms += ms_since(start);
+        if (!ok || by_mem.out.empty() || by_mem.out != by_cb.out || jpg != copy) {
+            printf("FAIL %s scale %d: in memory decode differs or wrote its input\n", name, scale);
+            failures++;
+        }
+    }
+
+    // the end of the bit stream is missing: must fail, reading only the given bytes
+    std::vector<uint8_t> truncated(jpg.begin(), jpg.begin() + jpg.size() / 2);
+    decode_t dec;
+    dec.jpg = &truncated;
+    if (esp_jpg_decode_mem(truncated.data(), truncated.size(), JPG_SCALE_NONE, write_cb, &dec, NULL, 0) == ESP_OK) {
+        printf("FAIL %s: truncated JPEG decoded\n", name);
+        failures++;
+    }
+
+    // the converters decode from memory too
+    std::vector<uint8_t> rgb((size_t)w * h * 3);
+    if (!fmt2rgb888(jpg.data(), jpg.size(), PIXFORMAT_JPEG, rgb.data()) || jpg != copy) {
+        printf("FAIL %s: fmt2rgb888\n", name);
+        failures++;
+    }
+    printf("%s %ux%u q%u: %zu bytes, callback %.2f ms, in memory %.2f ms (all scales)\n", name, w, h, quality,
+           jpg.size(), cb_ms, mem_ms);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("plain", 320, 240, 80, 1);
+    failures += check("stuffed", 333, 250, 98, 1);
+    failures += check("restarts", 800, 600, 90, 4);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+// Checks decoding restart intervals in parallel: every pixel must be written once, with the value of the serial
+// decode, at every scale and output format and for several worker counts, also with more workers than intervals.
+// JPEGs without restart markers must decode serially, damaged ones must fail.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+// encode_workers > 1 puts restart markers between the slices of the encoder
+static bool make_jpg(uint16_t w, uint16_t h, uint8_t encode_workers, jpg_subsampling_t subsampling,
+                     std::vector<uint8_t> &jpg)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 85;
+    config.workers = encode_workers;
+    config.subsampling = subsampling;
+    return make_jpg(w, h, config, w + h + encode_workers, jpg);
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, uint8_t encode_workers, jpg_subsampling_t subsampling)
+{
+    std::vector<uint8_t> jpg;
+    if (!make_jpg(w, h, encode_workers, subsampling, jpg)) {
+        printf("FAIL %s: encode\n", name);
+        return 1;
+    }
+
+    int failures = 0;
+    static const uint8_t s_workers[] = { 1, 2, 3, 8, 16, 255 };
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        for (int output = JPG_OUT_RGB888; output <= JPG_OUT_YCBCR; output++) {
+            decode_t serial;
+            serial.bpp = output == JPG_OUT_GRAY ? 1 : 3;
+            if (esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), (jpg_scale_t)scale, (jpg_output_t)output, write_cb,
+                                       &serial, NULL, 0) != ESP_OK) {
+                printf("FAIL %s 1/%d output %d: serial decode\n", name, 1 << scale, output);
+                failures++;
+                continue;
+            }
+            for (size_t k = 0; k < sizeof(s_workers); k++) {
+                decode_t par;
+                par.bpp = serial.bpp;
+                if (esp_jpg_decode_mem_parallel(jpg.data(), jpg.size(), (jpg_scale_t)scale, (jpg_output_t)output,
+                                                write_cb, &par, s_workers[k]) != ESP_OK) {
+                    printf("FAIL %s 1/%d output %d, %d workers: decode\n", name, 1 << scale, output, s_workers[k]);
+                    failures++;
+                    continue;
+                }
+                int bad = par.width != serial.width || par.height != serial.height || par.out != serial.out;
+                for (size_t i = 0; !bad && i < par.written.size(); i++) {
+                    bad = par.written[i] != 1;
+                }
+                if (bad) {
+                    printf("FAIL %s 1/%d output %d, %d workers: output differs\n", name, 1 << scale, output,
+                           s_workers[k]);
+                    failures++;
+                }
+            }
+        }
+    }
+    printf("%s %s %ux%u\n", failures ? "FAIL" : "ok", name, w, h);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("420 intervals", 320, 240, 4, JPG_SUBSAMPLING_420);
+    failures += check("422 intervals", 333, 251, 8, JPG_SUBSAMPLING_422);
+    failures += check("444 intervals", 321, 239, 2, JPG_SUBSAMPLING_444);
+    failures += check("one row per interval", 64, 400, 16, JPG_SUBSAMPLING_420);
+    failures += check("no restart markers", 320, 240, 1, JPG_SUBSAMPLING_420);
+
+    // damaged: a restart marker out of sequence, and the stream cut in the middle
+    std::vector<uint8_t> jpg;
+    make_jpg(320, 240, 8, JPG_SUBSAMPLING_420, jpg);
+    std::vector<uint8_t> cut(jpg.begin(), jpg.begin() + jpg.size() / 2), swapped(jpg);
+    for (size_t i = swapped.size() / 2; i + 1 < swapped.size(); i++) {
+        if (swapped[i] == 0xFF && swapped[i + 1] >= 0xD0 && swapped[i + 1] <= 0xD7) {
+            swapped[i + 1] = 0xD0 + ((swapped[i + 1] + 3) & 7);
+            break;
+        }
+    }
+    decode_t dec;
+    dec.bpp = 3;
+    if (esp_jpg_decode_mem_parallel(swapped.data(), swapped.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, write_cb, &dec, 4) == ESP_OK
+            || esp_jpg_decode_mem_parallel(cut.data(), cut.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, write_cb, &dec, 4) == ESP_OK) {
+        printf("FAIL damaged JPEG accepted\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,85 @@
+// Checks decoding JPEGs with restart markers written by another encoder (libjpeg through OpenCV, see
+// data/make_restart_jpegs.py), at 4:2:0, 4:2:2 and 4:4:4 with intervals of 1, 7 and 64 MCUs: the reader callback,
+// memory, region and parallel paths must give the pixels of the same frame encoded without restart markers.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static bool load(const char *name, std::vector<uint8_t> &jpg)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TEST_DATA_DIR, name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        printf("FAIL %s: cannot open\n", path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    jpg.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    bool ok = fread(jpg.data(), 1, jpg.size(), f) == jpg.size();
+    fclose(f);
+    return ok;
+}
+
+static int check(const char *subsampling)
+{
+    static const int s_intervals[] = { 1, 7, 64 };
+    char name[64];
+    std::vector<uint8_t> jpg;
+    snprintf(name, sizeof(name), "restart/%s_rst0.jpg", subsampling);
+    decode_t ref;
+    ref.jpg = &jpg;
+    if (!load(name, jpg) || esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, write_cb,
+                                                   &ref, NULL, 0) != ESP_OK) {
+        printf("FAIL %s: reference decode\n", name);
+        return 1;
+    }
+
+    int failures = 0;
+    for (size_t k = 0; k < sizeof(s_intervals) / sizeof(s_intervals[0]); k++) {
+        snprintf(name, sizeof(name), "restart/%s_rst%d.jpg", subsampling, s_intervals[k]);
+        if (!load(name, jpg)) {
+            failures++;
+            continue;
+        }
+        // the lower half, the region decode skips the intervals above it
+        const jpg_rect_t roi = { 0, (uint16_t)(ref.height / 2), 0, 0 };
+        const size_t half = (size_t)(ref.height / 2) * ref.width * 3;
+        decode_t cb, mem, part, par;
+        cb.jpg = mem.jpg = part.jpg = par.jpg = &jpg;
+        const char *bad = NULL;
+        if (esp_jpg_decode(jpg.size(), JPG_SCALE_NONE, read_cb, write_cb, &cb) != ESP_OK || cb.out != ref.out) {
+            bad = "reader callback";
+        } else if (esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, write_cb, &mem,
+                                          NULL, 0) != ESP_OK || mem.out != ref.out) {
+            bad = "memory";
+        } else if (esp_jpg_decode_mem_roi(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, &roi, 1, write_cb,
+                                          &part, NULL, 0) != ESP_OK || part.out.size() != ref.out.size()
+                   || memcmp(part.out.data() + half, ref.out.data() + half, ref.out.size() - half)) {
+            bad = "region";
+        } else if (esp_jpg_decode_mem_parallel(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, write_cb, &par,
+                                               4) != ESP_OK || par.out != ref.out) {
+            bad = "parallel";
+        }
+        if (bad) {
+            printf("FAIL %s: %s decode\n", name, bad);
+            failures++;
+        }
+    }
+    printf("%s %s %ux%u\n", failures ? "FAIL" : "ok", subsampling, ref.width, ref.height);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("420");
+    failures += check("422");
+    failures += check("444");
+    return failures ? 1 : 0;
+}
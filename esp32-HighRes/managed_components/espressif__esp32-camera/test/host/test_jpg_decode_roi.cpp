@@ -0,0 +1,134 @@
+// Checks decoding rectangles of a JPEG: the writer must get exactly the MCUs touching a rectangle, with the pixels of
+// the full decode, at every scale and output format, with and without restart markers (then whole intervals are
+// skipped). Rectangles outside the image, reaching to its edges or overlapping must work, bad arguments must fail.
+// Prints the time of a full decode and of a small rectangle.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+// Whether the MCU of output pixel (x, y) touches one of the rectangles.
+static bool in_rois(int x, int y, int scale, int mcu_w, int mcu_h, uint16_t w, uint16_t h, const jpg_rect_t *rois,
+                    size_t n)
+{
+    int mx = ((x << scale) / mcu_w) * mcu_w, my = ((y << scale) / mcu_h) * mcu_h;
+    for (size_t i = 0; i < n; i++) {
+        int right = rois[i].width ? rois[i].x + rois[i].width : w;
+        int bottom = rois[i].height ? rois[i].y + rois[i].height : h;
+        if (rois[i].x < w && rois[i].y < h && mx < right && mx + mcu_w > rois[i].x && my < bottom
+                && my + mcu_h > rois[i].y) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, uint8_t workers, jpg_subsampling_t subsampling,
+                 const jpg_rect_t *rois, size_t n)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 85;
+    config.workers = workers;
+    config.subsampling = subsampling;
+    std::vector<uint8_t> jpg;
+    if (!make_jpg(w, h, config, w + h + workers, jpg)) {
+        printf("FAIL %s: encode\n", name);
+        return 1;
+    }
+    const int mcu_w = subsampling == JPG_SUBSAMPLING_444 ? 8 : 16;
+    const int mcu_h = subsampling == JPG_SUBSAMPLING_420 ? 16 : 8;
+
+    int failures = 0;
+    for (int scale = JPG_SCALE_NONE; scale <= JPG_SCALE_MAX; scale++) {
+        for (int output = JPG_OUT_RGB888; output <= JPG_OUT_YCBCR; output++) {
+            decode_t full, part;
+            full.bpp = part.bpp = output == JPG_OUT_GRAY ? 1 : 3;
+            if (esp_jpg_decode_mem_fmt(jpg.data(), jpg.size(), (jpg_scale_t)scale, (jpg_output_t)output, write_cb,
+                                       &full, NULL, 0) != ESP_OK
+                    || esp_jpg_decode_mem_roi(jpg.data(), jpg.size(), (jpg_scale_t)scale, (jpg_output_t)output, rois,
+                                              n, write_cb, &part, NULL, 0) != ESP_OK) {
+                printf("FAIL %s 1/%d output %d: decode\n", name, 1 << scale, output);
+                failures++;
+                continue;
+            }
+            int bad = part.width != full.width || part.height != full.height;
+            for (int y = 0; !bad && y < part.height; y++) {
+                for (int x = 0; x < part.width; x++) {
+                    size_t i = (size_t)y * part.width + x;
+                    bool want = in_rois(x, y, scale, mcu_w, mcu_h, w, h, rois, n);
+                    bad += part.written[i] != want;
+                    bad += want && memcmp(&part.out[i * part.bpp], &full.out[i * part.bpp], part.bpp);
+                }
+            }
+            if (bad) {
+                printf("FAIL %s 1/%d output %d: %d pixels differ\n", name, 1 << scale, output, bad);
+                failures++;
+            }
+        }
+    }
+    printf("%s %s %ux%u, %d workers\n", failures ? "FAIL" : "ok", name, w, h, workers);
+    return failures;
+}
+
+// Time of a full decode against one of a small rectangle high up in the image.
+static void timing(uint8_t workers)
+{
+    const uint16_t w = 800, h = 600;
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = 5;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 5 + (rand_r(&seed) & 31)) & 0xFF);
+    }
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.workers = workers;
+    std::vector<uint8_t> jpg;
+    fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &jpg);
+    const jpg_rect_t roi = { 500, 150, 96, 64 };
+    decode_t dec;
+    dec.bpp = 3;
+    double full_ms = 0, roi_ms = 0;
+    for (int i = 0; i < 20; i++) {
+        auto start = std::chrono::steady_clock::now();
+        esp_jpg_decode_mem(jpg.data(), jpg.size(), JPG_SCALE_NONE, write_cb, &dec, NULL, 0);
+        full_ms += ms_since(start);
+        start = std::chrono::steady_clock::now();
+        esp_jpg_decode_mem_roi(jpg.data(), jpg.size(), JPG_SCALE_NONE, JPG_OUT_RGB888, &roi, 1, write_cb, &dec, NULL, 0);
+        roi_ms += ms_since(start);
+    }
+    printf("800x600, %d workers: full %.2f ms, 96x64 rectangle %.2f ms\n", workers, full_ms / 20, roi_ms / 20);
+}
+
+int main()
+{
+    int failures = 0;
+    const jpg_rect_t one[] = { { 40, 30, 50, 20 } };
+    const jpg_rect_t several[] = { { 0, 0, 1, 1 }, { 200, 100, 0, 0 }, { 210, 110, 30, 30 }, { 5000, 10, 5, 5 } };
+    const jpg_rect_t edges[] = { { 300, 0, 0, 8 }, { 0, 230, 17, 0 } };
+    const jpg_rect_t outside[] = { { 400, 0, 10, 10 }, { 0, 300, 0, 0 } };
+    for (uint8_t workers = 1; workers <= 8; workers += 7) {
+        failures += check("one", 320, 240, workers, JPG_SUBSAMPLING_420, one, 1);
+        failures += check("several", 333, 251, workers, JPG_SUBSAMPLING_422, several, 4);
+        failures += check("edges", 321, 239, workers, JPG_SUBSAMPLING_444, edges, 2);
+        failures += check("outside", 320, 240, workers, JPG_SUBSAMPLING_420, outside, 2);
+    }
+
+    uint8_t junk = 0;
+    decode_t dec;
+    dec.bpp = 3;
+    jpg_rect_t many[ESP_JPG_DECODE_MAX_ROIS + 1] = {};
+    if (esp_jpg_decode_mem_roi(&junk, 1, JPG_SCALE_NONE, JPG_OUT_RGB888, NULL, 1, write_cb, &dec, NULL, 0) != ESP_ERR_INVALID_ARG
+            || esp_jpg_decode_mem_roi(&junk, 1, JPG_SCALE_NONE, JPG_OUT_RGB888, many, 0, write_cb, &dec, NULL, 0) != ESP_ERR_INVALID_ARG
+            || esp_jpg_decode_mem_roi(&junk, 1, JPG_SCALE_NONE, JPG_OUT_RGB888, many, ESP_JPG_DECODE_MAX_ROIS + 1,
+                                      write_cb, &dec, NULL, 0) != ESP_ERR_INVALID_ARG) {
+        printf("FAIL bad rectangles accepted\n");
+        failures++;
+    }
+
+    timing(1);
+    timing(8);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,140 @@
+// Decodes a set of JPEG frames from several threads at once and checks that every output matches a serial
+// reference. Threads use both the pooled workspace of esp_jpg_decode() (through the converters) and workspaces
+// of their own, so a decoder state shared between decodes shows up as a mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+
+struct frame_t {
+    uint16_t width, height;
+    std::vector<uint8_t> jpg;
+    std::vector<uint8_t> rgb;       // serial reference, as fmt2rgb888() decodes it
+};
+
+struct rgb_writer_t {
+    std::vector<uint8_t> *out;
+    uint16_t width;
+};
+
+static size_t read_cb(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    const std::vector<uint8_t> *jpg = static_cast<const std::vector<uint8_t> *>(arg);
+    if (buf) {
+        memcpy(buf, jpg->data() + index, len);
+    }
+    return len;
+}
+
+struct decode_arg_t {
+    const std::vector<uint8_t> *jpg;
+    rgb_writer_t writer;
+};
+
+static size_t read_arg_cb(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    return read_cb((void *)static_cast<decode_arg_t *>(arg)->jpg, index, buf, len);
+}
+
+// Stores the blocks as B, G, R like fmt2rgb888().
+static bool write_cb(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    rgb_writer_t *writer = &static_cast<decode_arg_t *>(arg)->writer;
+    if (!data) {
+        if (!x && !y) {
+            writer->width = w;
+            writer->out->assign((size_t)w * h * 3, 0);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++) {
+        uint8_t *o = &(*writer->out)[((size_t)(y + iy) * writer->width + x) * 3];
+        for (int ix = 0; ix < w; ix++, o += 3, data += 3) {
+            o[0] = data[2];
+            o[1] = data[1];
+            o[2] = data[0];
+        }
+    }
+    return true;
+}
+
+static bool decode_own_workspace(const frame_t &frame, std::vector<uint8_t> &out, uint8_t *work)
+{
+    decode_arg_t arg = { &frame.jpg, { &out, 0 } };
+    return esp_jpg_decode_ex(frame.jpg.size(), JPG_SCALE_NONE, read_arg_cb, write_cb, &arg, work, ESP_JPG_DECODE_WORK_SIZE) == ESP_OK;
+}
+
+int main()
+{
+    static const uint16_t s_sizes[][2] = { { 160, 120 }, { 320, 240 }, { 333, 250 }, { 640, 480 } };
+    static const uint8_t s_qualities[] = { 15, 60, 90 };
+    const int num_threads = 8, iterations = 40;
+
+    std::vector<frame_t> frames;
+    unsigned seed = 1;
+    for (size_t s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++) {
+        for (size_t q = 0; q < sizeof(s_qualities); q++) {
+            frame_t frame;
+            frame.width = s_sizes[s][0];
+            frame.height = s_sizes[s][1];
+            std::vector<uint8_t> src((size_t)frame.width * frame.height * 2);
+            for (size_t i = 0; i < src.size(); i++) {
+                src[i] = (uint8_t)((i / 3 + (i / (frame.width * 2)) * (s + 1) + (rand_r(&seed) & 31)) & 0xFF);
+            }
+            uint8_t *jpg = NULL;
+            size_t jpg_len = 0;
+            if (!fmt2jpg(src.data(), src.size(), frame.width, frame.height, PIXFORMAT_YUV422, s_qualities[q], &jpg, &jpg_len)) {
+                printf("FAIL encode\n");
+                return 1;
+            }
+            frame.jpg.assign(jpg, jpg + jpg_len);
+            free(jpg);
+            frame.rgb.resize((size_t)frame.width * frame.height * 3);
+            if (!fmt2rgb888(frame.jpg.data(), frame.jpg.size(), PIXFORMAT_JPEG, frame.rgb.data())) {
+                printf("FAIL reference decode\n");
+                return 1;
+            }
+            frames.push_back(frame);
+        }
+    }
+
+    // a too small workspace is refused
+    std::vector<uint8_t> out;
+    decode_arg_t arg = { &frames[0].jpg, { &out, 0 } };
+    uint8_t small[64];
+    int failures = esp_jpg_decode_ex(frames[0].jpg.size(), JPG_SCALE_NONE, read_arg_cb, write_cb, &arg, small, sizeof(small)) == ESP_OK;
+
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            std::vector<uint8_t> work(ESP_JPG_DECODE_WORK_SIZE), rgb;
+            for (int i = 0; i < iterations; i++) {
+                const frame_t &frame = frames[(t * 7 + i) % frames.size()];
+                rgb.assign(frame.rgb.size(), 0);
+                bool ok;
+                if ((t + i) & 1) {
+                    ok = decode_own_workspace(frame, rgb, work.data());
+                } else {
+                    ok = fmt2rgb888(frame.jpg.data(), frame.jpg.size(), PIXFORMAT_JPEG, rgb.data());
+                }
+                if (!ok || rgb != frame.rgb) {
+                    mismatches++;
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+    printf("%d threads x %d decodes of %zu frames: %d mismatches\n", num_threads, iterations, frames.size(), mismatches.load());
+    if (mismatches) {
+        printf("FAIL concurrent decodes differ from the serial reference\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
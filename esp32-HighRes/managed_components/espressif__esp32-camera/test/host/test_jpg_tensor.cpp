@@ -0,0 +1,165 @@
+// Checks jpg2tensor() against the same pipeline done in separate passes: a full RGB decode at the decoder scaling it
+// chose, a bilinear resize of the whole image and the letterbox, for every layout and type, several aspect ratios and
+// tensor sizes. Also checks the placement it reports and that bad input fails.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "test_util.h"
+
+static int src_pos(int d, int src, int dst)
+{
+    long long p = ((long long)(2 * d + 1) * src * 256) / (2 * dst) - 128;
+    return p < 0 ? 0 : (int)p;
+}
+
+// The tensor as R, G, B bytes, NHWC, from a decode to RGB888 and a resize of the whole image.
+static bool reference(const std::vector<uint8_t> &jpg, uint16_t w, uint16_t h, const jpg_tensor_config_t &config,
+                      const jpg_letterbox_t &lb, std::vector<uint8_t> &out)
+{
+    int sw = w >> lb.decode_scale, sh = h >> lb.decode_scale;
+    std::vector<uint8_t> bgr((size_t)sw * sh * 3);
+    if (!jpg2rgb888(jpg.data(), jpg.size(), bgr.data(), lb.decode_scale)) {
+        return false;
+    }
+    out.assign((size_t)config.width * config.height * 3, config.pad_value);
+    for (int dy = 0; dy < lb.height; dy++) {
+        int sy = src_pos(dy, sh, lb.height), y0 = sy >> 8, fy = sy & 255, y1 = y0 + 1;
+        if (y1 >= sh) {
+            y0 = y1 = sh - 1;
+            fy = 0;
+        }
+        for (int dx = 0; dx < lb.width; dx++) {
+            int sx = src_pos(dx, sw, lb.width), x0 = sx >> 8, fx = sx & 255, x1 = x0 + 1;
+            if (x1 >= sw) {
+                x0 = x1 = sw - 1;
+                fx = 0;
+            }
+            for (int c = 0; c < 3; c++) {
+                // RGB888 converters write B, G, R
+                int a = bgr[((size_t)y0 * sw + x0) * 3 + 2 - c], b = bgr[((size_t)y0 * sw + x1) * 3 + 2 - c];
+                int d = bgr[((size_t)y1 * sw + x0) * 3 + 2 - c], e = bgr[((size_t)y1 * sw + x1) * 3 + 2 - c];
+                unsigned top = a * (256 - fx) + b * fx, bottom = d * (256 - fx) + e * fx;
+                out[((size_t)(lb.top + dy) * config.width + lb.left + dx) * 3 + c] =
+                    (uint8_t)((top * (256 - fy) + bottom * fy + 32768) >> 16);
+            }
+        }
+    }
+    return true;
+}
+
+static int check(uint16_t w, uint16_t h, uint16_t tw, uint16_t th, int exp_scale)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "%ux%u in %ux%u", w, h, tw, th);
+    jpg_encode_config_t encode = JPG_ENCODE_CONFIG_DEFAULT();
+    encode.quality = 85;
+    std::vector<uint8_t> jpg;
+    if (!make_jpg(w, h, encode, w * 3 + h, jpg)) {
+        printf("FAIL %s: encode\n", name);
+        return 1;
+    }
+
+    int failures = 0;
+    std::vector<uint8_t> ref;
+    jpg_letterbox_t placed = {};
+    for (int variant = 0; variant < 8; variant++) {
+        jpg_tensor_config_t config = JPG_TENSOR_CONFIG_DEFAULT();
+        config.width = tw;
+        config.height = th;
+        config.layout = (variant & 1) ? JPG_TENSOR_NHWC : JPG_TENSOR_NCHW;
+        config.type = (variant & 2) ? JPG_TENSOR_UINT8 : JPG_TENSOR_FLOAT32;
+        config.bgr = variant & 4;
+        if (variant == 4) {
+            config.mean[0] = 0.485f;
+            config.mean[1] = 0.456f;
+            config.mean[2] = 0.406f;
+            config.std[0] = 0.229f;
+            config.std[1] = 0.224f;
+            config.std[2] = 0.225f;
+        }
+        size_t elems = (size_t)tw * th * 3;
+        std::vector<float> f(elems, -100);
+        std::vector<uint8_t> u(elems, 0);
+        void *out = config.type == JPG_TENSOR_FLOAT32 ? (void *)f.data() : (void *)u.data();
+        jpg_letterbox_t lb;
+        if (!jpg2tensor(jpg.data(), jpg.size(), &config, out, &lb)) {
+            printf("FAIL %s variant %d: decode\n", name, variant);
+            failures++;
+            continue;
+        }
+
+        if (variant == 0) {
+            placed = lb;
+            // the image fits one side and is centred on the other
+            float s = std::min((float)tw / w, (float)th / h);
+            int ew = (int)(w * s + 0.5f), eh = (int)(h * s + 0.5f);
+            if (lb.decode_scale != exp_scale || lb.scale != s || abs(lb.width - ew) > 1 || abs(lb.height - eh) > 1
+                    || (lb.width != tw && lb.height != th) || lb.left != (tw - lb.width) / 2
+                    || lb.top != (th - lb.height) / 2) {
+                printf("FAIL %s: placed %ux%u at %u,%u, scale %f, decoder 1/%d\n", name, lb.width, lb.height,
+                       lb.left, lb.top, lb.scale, 1 << lb.decode_scale);
+                failures++;
+            }
+            if (!reference(jpg, w, h, config, lb, ref)) {
+                printf("FAIL %s: reference decode\n", name);
+                return failures + 1;
+            }
+        }
+
+        int bad = 0;
+        for (int y = 0; y < th; y++) {
+            for (int x = 0; x < tw; x++) {
+                for (int c = 0; c < 3; c++) {
+                    int oc = config.bgr ? 2 - c : c;
+                    uint8_t v = ref[((size_t)y * tw + x) * 3 + c];
+                    size_t i = config.layout == JPG_TENSOR_NCHW ? ((size_t)oc * th + y) * tw + x
+                                                                : ((size_t)y * tw + x) * 3 + oc;
+                    if (config.type == JPG_TENSOR_UINT8) {
+                        bad += u[i] != v;
+                    } else {
+                        bad += f[i] != (v / 255.0f - config.mean[oc]) / config.std[oc];
+                    }
+                }
+            }
+        }
+        if (bad) {
+            printf("FAIL %s variant %d: %d elements differ\n", name, variant, bad);
+            failures++;
+        }
+    }
+    printf("%s %s: %ux%u at %u,%u, decoder 1/%d\n", failures ? "FAIL" : "ok", name, placed.width, placed.height,
+           placed.left, placed.top, 1 << placed.decode_scale);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check(800, 600, 640, 640, 0);
+    failures += check(1600, 1200, 640, 640, 1);
+    failures += check(1600, 1200, 320, 320, 2);
+    failures += check(1600, 1200, 160, 160, 3);
+    failures += check(600, 800, 640, 640, 0);
+    failures += check(640, 640, 640, 640, 0);
+    failures += check(333, 155, 640, 640, 0);
+    failures += check(40, 30, 64, 64, 0);
+    failures += check(1280, 720, 320, 256, 2);
+    failures += check(101, 37, 100, 30, 0);
+
+    jpg_encode_config_t encode = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> jpg;
+    make_jpg(64, 48, encode, 1, jpg);
+    jpg_tensor_config_t config = JPG_TENSOR_CONFIG_DEFAULT();
+    std::vector<float> out((size_t)config.width * config.height * 3);
+    std::vector<uint8_t> cut(jpg.begin(), jpg.begin() + jpg.size() / 2), junk(100, 0x55);
+    if (jpg2tensor(cut.data(), cut.size(), &config, out.data(), NULL)
+            || jpg2tensor(junk.data(), junk.size(), &config, out.data(), NULL)) {
+        printf("FAIL truncated or bad JPEG accepted\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+// Checks that every DSP kernel set built for this CPU matches the scalar kernels bit for bit.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "jpge_dsp.h"
+
+using namespace jpge;
+
+static void fill_block(int32 *blk, int pattern, unsigned *seed)
+{
+    for (int i = 0; i < 64; i++) {
+        switch (pattern) {
+            case 0: blk[i] = -128; break;
+            case 1: blk[i] = 127; break;
+            case 2: blk[i] = ((i ^ (i >> 3)) & 1) ? 127 : -128; break;
+            case 3: blk[i] = (i & 8) ? -128 : 127; break;
+            default: blk[i] = (int32)(rand_r(seed) % 256) - 128; break;
+        }
+    }
+}
+
+int main()
+{
+    const dsp_kernels *ref = dsp_get_kernels(DSP_SCALAR);
+    unsigned seed = 1;
+    int failures = 0;
+
+    for (int id = DSP_SCALAR + 1; id < DSP_KERNEL_COUNT; id++) {
+        const dsp_kernels *k = dsp_get_kernels(static_cast<dsp_kernel_id_t>(id));
+        if (!k) {
+            printf("kernel %d: not supported, skipped\n", id);
+            continue;
+        }
+        for (int n = 0; n < 200000; n++) {
+            int32 a[64], b[64], quant[64];
+            int16 qa[64], qb[64];
+            fill_block(a, n < 4 ? n : 4, &seed);
+            memcpy(b, a, sizeof(a));
+            for (int i = 0; i < 64; i++) {
+                quant[i] = (n & 1) ? 1 + (int32)(rand_r(&seed) % 255) : 1 + (n / 2) % 255;
+            }
+            ref->fdct(a);
+            k->fdct(b);
+            if (memcmp(a, b, sizeof(a))) {
+                printf("%s: fdct mismatch on block %d\n", k->name, n);
+                failures++;
+                break;
+            }
+            ref->quantize(qa, a, quant);
+            k->quantize(qb, a, quant);
+            if (memcmp(qa, qb, sizeof(qa))) {
+                printf("%s: quantize mismatch on block %d\n", k->name, n);
+                failures++;
+                break;
+            }
+        }
+        printf("%s: %s\n", k->name, failures ? "FAIL" : "ok");
+    }
+    printf("selected: %s\n", dsp_select_kernels()->name);
+    return failures ? 1 : 0;
+}
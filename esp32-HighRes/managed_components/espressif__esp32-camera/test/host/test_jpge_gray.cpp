@@ -0,0 +1,75 @@
+// Checks luma only encoding of YUV422 frames: MCU rows coded straight from the Y bytes of the frame must give
+// the same JPEG as the line buffer path (rows fed one by one through the stream encoder), for any image size,
+// and be smaller and faster than the colour encode.
+// tjpgd only decodes YCbCr images, so the output is compared byte for byte instead of decoded.
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+static double encode_ms(std::vector<uint8_t> &src, uint16_t w, uint16_t h, jpg_encode_config_t &config, std::vector<uint8_t> &out)
+{
+    auto start = std::chrono::steady_clock::now();
+    out.clear();
+    if (!fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &out)) {
+        return -1;
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int check(uint16_t w, uint16_t h)
+{
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = w + h;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &src[((size_t)y * w + x) * 2];
+            p[0] = (uint8_t)(16 + ((x * 150) / w + (y * 50) / h + ((x / 32 + y / 32) & 1) * 20 + rand_r(&seed) % 16));
+            p[1] = (uint8_t)((x & 1) ? 128 + (y * 60) / h : 100 + (x * 40) / w);
+        }
+    }
+
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> colour, gray, parallel, lines;
+    double colour_ms = encode_ms(src, w, h, config, colour);
+    config.grayscale = true;
+    double gray_ms = encode_ms(src, w, h, config, gray);
+    config.workers = 3;
+    double parallel_ms = encode_ms(src, w, h, config, parallel);
+    config.workers = 1;
+    if (colour_ms < 0 || gray_ms < 0 || parallel_ms < 0) {
+        printf("FAIL %ux%u: encode\n", w, h);
+        return 1;
+    }
+
+    // writes of just over a row never hold a whole MCU row, so every row goes through the line buffer
+    jpg_stream_encoder_t *enc = jpg_stream_encoder_create(w, h, PIXFORMAT_YUV422, &config);
+    bool ok = enc && jpg_stream_encoder_start(enc, collect_cb, &lines);
+    for (size_t pos = 0, chunk = (size_t)w * 2 + 1; ok && pos < src.size(); pos += chunk) {
+        ok = jpg_stream_encoder_write(enc, &src[pos], src.size() - pos < chunk ? src.size() - pos : chunk);
+    }
+    ok = ok && jpg_stream_encoder_end(enc);
+    jpg_stream_encoder_delete(enc);
+
+    ok = ok && gray == lines && gray.size() < colour.size()
+         && parallel[0] == 0xFF && parallel[1] == 0xD8 && parallel[parallel.size() - 2] == 0xFF && parallel[parallel.size() - 1] == 0xD9;
+    printf("%ux%u: colour %zu bytes %.2f ms, luma only %zu bytes %.2f ms (%.0f%% of the bytes)\n", w, h,
+           colour.size(), colour_ms, gray.size(), gray_ms, 100.0 * gray.size() / colour.size());
+    if (!ok) {
+        printf("FAIL %ux%u: luma only encode is wrong\n", w, h);
+        return 1;
+    }
+    return 0;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check(320, 240);
+    // partial blocks on the right and a partial MCU row at the bottom
+    failures += check(333, 250);
+    failures += check(800, 600);
+    return failures ? 1 : 0;
+}
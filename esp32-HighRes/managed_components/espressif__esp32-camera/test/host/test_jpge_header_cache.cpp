@@ -0,0 +1,69 @@
+// Checks the header cache: with more encode parameter sets than cache entries, used in a mixed order, every
+// encode must give exactly the output of an encode with an empty cache. Sliced and optimized Huffman encodes
+// are mixed in, as they use the cache partly or not at all.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "img_converters.h"
+#include "jpge.h"
+#include "test_util.h"
+
+struct encode_case_t {
+    uint16_t width, height;
+    uint8_t quality, workers;
+    jpg_subsampling_t subsampling;
+    bool optimize_huffman;
+};
+
+static const encode_case_t s_cases[] = {
+    { 320, 240, 80, 1, JPG_SUBSAMPLING_420, false },
+    { 320, 240, 60, 1, JPG_SUBSAMPLING_420, false },
+    { 320, 240, 80, 1, JPG_SUBSAMPLING_422, false },
+    { 160, 120, 80, 1, JPG_SUBSAMPLING_444, false },
+    { 320, 240, 80, 3, JPG_SUBSAMPLING_420, false },
+    { 176, 144, 95, 1, JPG_SUBSAMPLING_420, false },
+    { 320, 240, 80, 1, JPG_SUBSAMPLING_420, true },
+};
+
+static bool encode(const std::vector<uint8_t> &src, const encode_case_t &c, std::vector<uint8_t> &out)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = c.quality;
+    config.workers = c.workers;
+    config.subsampling = c.subsampling;
+    config.optimize_huffman = c.optimize_huffman;
+    out.clear();
+    return fmt2jpg_cb_ex((uint8_t *)src.data(), src.size(), c.width, c.height, PIXFORMAT_YUV422, &config, collect_cb, &out);
+}
+
+int main()
+{
+    const size_t num_cases = sizeof(s_cases) / sizeof(s_cases[0]);
+    std::vector<uint8_t> src(320 * 240 * 2);
+    unsigned seed = 5;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)(i / 13 + (rand_r(&seed) & 15));
+    }
+
+    std::vector<std::vector<uint8_t> > ref(num_cases);
+    for (size_t i = 0; i < num_cases; i++) {
+        jpge::clear_header_cache();
+        if (!encode(src, s_cases[i], ref[i])) {
+            printf("FAIL case %zu: encode\n", i);
+            return 1;
+        }
+    }
+
+    int failures = 0;
+    jpge::clear_header_cache();
+    for (int n = 0; n < 200; n++) {
+        size_t i = rand_r(&seed) % num_cases;
+        std::vector<uint8_t> out;
+        if (!encode(src, s_cases[i], out) || out != ref[i]) {
+            printf("FAIL case %zu, encode %d: output differs from the uncached encode\n", i, n);
+            failures++;
+        }
+    }
+    jpge::clear_header_cache();
+    return failures ? 1 : 0;
+}
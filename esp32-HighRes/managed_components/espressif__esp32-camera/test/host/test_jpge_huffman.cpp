@@ -0,0 +1,119 @@
+// Checks optimized Huffman tables: the output must decode to exactly the same pixels as with the standard
+// tables (only the entropy coding changes), be smaller, and be the same for any worker count.
+// tjpgd only decodes YCbCr images, so grayscale output is checked for size only.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+#include "jpge.h"
+#include "test_util.h"
+
+static bool encode(std::vector<uint8_t> &src, uint16_t w, uint16_t h, pixformat_t format, uint8_t workers, bool optimize, std::vector<uint8_t> &out)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.workers = workers;
+    config.optimize_huffman = optimize;
+    out.clear();
+    return fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &config, collect_cb, &out);
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, pixformat_t format)
+{
+    size_t bpp = format == PIXFORMAT_GRAYSCALE ? 1 : 2;
+    std::vector<uint8_t> src((size_t)w * h * bpp);
+    unsigned seed = w + h;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 9 + (i / (w * bpp)) * 2 + (rand_r(&seed) & 15)) & 0xFF);
+    }
+
+    bool decode = format != PIXFORMAT_GRAYSCALE;
+    int failures = 0;
+    for (uint8_t workers = 1; workers <= 4; workers += 3) {
+        std::vector<uint8_t> std_jpg, opt_jpg, again;
+        std::vector<uint8_t> std_rgb((size_t)w * h * 3), opt_rgb((size_t)w * h * 3);
+        if (!encode(src, w, h, format, workers, false, std_jpg) || !encode(src, w, h, format, workers, true, opt_jpg)
+                || !encode(src, w, h, format, workers, true, again)) {
+            printf("FAIL %s workers=%u: encode\n", name, workers);
+            failures++;
+            continue;
+        }
+        bool ok = opt_jpg.size() < std_jpg.size() && opt_jpg == again
+                  && opt_jpg[0] == 0xFF && opt_jpg[1] == 0xD8
+                  && opt_jpg[opt_jpg.size() - 2] == 0xFF && opt_jpg[opt_jpg.size() - 1] == 0xD9;
+        if (ok && decode) {
+            ok = fmt2rgb888(std_jpg.data(), std_jpg.size(), PIXFORMAT_JPEG, std_rgb.data())
+                 && fmt2rgb888(opt_jpg.data(), opt_jpg.size(), PIXFORMAT_JPEG, opt_rgb.data())
+                 && opt_rgb == std_rgb;
+        }
+        if (!ok) {
+            printf("FAIL %s workers=%u: optimized output is wrong\n", name, workers);
+            failures++;
+        }
+        printf("%s %ux%u workers=%u: standard %zu bytes, optimized %zu bytes (%.1f%% smaller)\n", name, w, h, workers,
+               std_jpg.size(), opt_jpg.size(), 100.0 * (1.0 - (double)opt_jpg.size() / std_jpg.size()));
+    }
+    return failures;
+}
+
+class vector_stream : public jpge::output_stream {
+    public:
+        std::vector<uint8_t> data;
+        virtual bool put_buf(const void *buf, int len)
+        {
+            if (buf) {
+                data.insert(data.end(), (const uint8_t *)buf, (const uint8_t *)buf + len);
+            }
+            return true;
+        }
+        virtual jpge::uint get_size() const { return data.size(); }
+};
+
+// Single pass encoding from the counts of a first pass must give the two pass output.
+static int check_counts()
+{
+    const int w = 160, h = 120;
+    std::vector<uint8_t> rgb((size_t)w * h * 3);
+    for (size_t i = 0; i < rgb.size(); i++) {
+        rgb[i] = (uint8_t)((i * 7 / 5) ^ (i / (w * 3)));
+    }
+
+    jpge::params comp_params;
+    comp_params.m_two_pass_flag = true;
+    vector_stream two_pass;
+    jpge::jpeg_encoder enc;
+    bool ok = enc.init(&two_pass, w, h, jpge::SRC_RGB, comp_params) && enc.get_total_passes() == 2;
+    for (jpge::uint pass = 0; ok && pass < enc.get_total_passes(); pass++) {
+        ok = enc.process_scanlines(rgb.data(), w * 3, h) && enc.process_scanline(NULL);
+        if (pass == 0) {
+            ok = ok && two_pass.data.empty() && enc.get_huffman_counts();
+        }
+    }
+    jpge::huffman_counts counts = *enc.get_huffman_counts();
+    enc.deinit();
+
+    comp_params.m_two_pass_flag = false;
+    comp_params.m_pHuff_counts = &counts;
+    vector_stream one_pass;
+    ok = ok && enc.init(&one_pass, w, h, jpge::SRC_RGB, comp_params) && enc.get_total_passes() == 1
+         && enc.process_scanlines(rgb.data(), w * 3, h) && enc.process_scanline(NULL);
+    ok = ok && !one_pass.data.empty() && one_pass.data == two_pass.data;
+
+    // two pass encoding and supplied counts are exclusive
+    comp_params.m_two_pass_flag = true;
+    ok = ok && !comp_params.check();
+    if (!ok) {
+        printf("FAIL huffman counts: single pass encode from counts differs from the two pass encode\n");
+    }
+    return ok ? 0 : 1;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("gray", 320, 240, PIXFORMAT_GRAYSCALE);
+    failures += check("rgb565", 333, 250, PIXFORMAT_RGB565);
+    failures += check("yuv422", 800, 600, PIXFORMAT_YUV422);
+    failures += check_counts();
+    return failures ? 1 : 0;
+}
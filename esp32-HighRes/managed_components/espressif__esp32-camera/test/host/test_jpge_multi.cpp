@@ -0,0 +1,96 @@
+// Checks multi-rendition encoding: every rendition must be byte-identical to a separate encode at its quality,
+// for all subsamplings, luma only, regions of interest and crops. The time of the shared pass is printed next
+// to that of encoding each quality on its own.
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+static int check(const char *name, uint16_t w, uint16_t h, pixformat_t format, const jpg_encode_config_t &config)
+{
+    static const uint8_t s_qualities[] = { 30, 90, 60 };
+    const size_t num = sizeof(s_qualities) / sizeof(s_qualities[0]);
+    size_t bpp = format == PIXFORMAT_GRAYSCALE ? 1 : (format == PIXFORMAT_RGB888 ? 3 : 2);
+    std::vector<uint8_t> src((size_t)w * h * bpp);
+    unsigned seed = w * 3 + h;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 7 + (i / (w * bpp)) * 3 + (rand_r(&seed) & 31)) & 0xFF);
+    }
+
+    std::vector<uint8_t> multi[num], single[num];
+    jpg_rendition_t renditions[num];
+    for (size_t i = 0; i < num; i++) {
+        renditions[i].quality = s_qualities[i];
+        renditions[i].cb = collect_cb;
+        renditions[i].arg = &multi[i];
+    }
+    auto start = std::chrono::steady_clock::now();
+    bool ok = fmt2jpg_multi_cb(src.data(), src.size(), w, h, format, &config, renditions, num);
+    double multi_ms = ms_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; ok && i < num; i++) {
+        jpg_encode_config_t single_config = config;
+        single_config.quality = s_qualities[i];
+        ok = fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &single_config, collect_cb, &single[i]);
+    }
+    double single_ms = ms_since(start);
+
+    int failures = 0;
+    for (size_t i = 0; ok && i < num; i++) {
+        if (multi[i].empty() || multi[i] != single[i]) {
+            printf("FAIL %s: rendition at quality %u differs from a separate encode\n", name, s_qualities[i]);
+            failures++;
+        }
+    }
+    if (!ok) {
+        printf("FAIL %s: encode\n", name);
+        failures++;
+    }
+    printf("%s %ux%u: %zu/%zu/%zu bytes, renditions %.2f ms, separate encodes %.2f ms\n", name, w, h,
+           multi[0].size(), multi[1].size(), multi[2].size(), multi_ms, single_ms);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    failures += check("yuv422 420", 800, 600, PIXFORMAT_YUV422, config);
+    failures += check("rgb888 420", 333, 250, PIXFORMAT_RGB888, config);
+    config.subsampling = JPG_SUBSAMPLING_422;
+    failures += check("rgb565 422", 320, 240, PIXFORMAT_RGB565, config);
+    config.subsampling = JPG_SUBSAMPLING_444;
+    failures += check("yuv422 444", 176, 144, PIXFORMAT_YUV422, config);
+    config.subsampling = JPG_SUBSAMPLING_420;
+    config.grayscale = true;
+    failures += check("yuv422 gray", 640, 480, PIXFORMAT_YUV422, config);
+    config.grayscale = false;
+    const jpg_rect_t roi = { 100, 80, 200, 120 };
+    config.rois = &roi;
+    config.num_rois = 1;
+    config.crop = { 16, 8, 400, 300 };
+    failures += check("yuv422 roi crop", 640, 480, PIXFORMAT_YUV422, config);
+
+    // buffers, and what the shared pass cannot do
+    config = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> src(320 * 240 * 2, 0x80);
+    const uint8_t qualities[2] = { 20, 95 };
+    uint8_t *outs[2] = { NULL, NULL };
+    size_t out_lens[2] = { 0, 0 };
+    if (!fmt2jpg_multi(src.data(), src.size(), 320, 240, PIXFORMAT_YUV422, &config, qualities, 2, outs, out_lens)
+            || !out_lens[0] || out_lens[0] >= out_lens[1]) {
+        printf("FAIL buffers: %zu and %zu bytes\n", out_lens[0], out_lens[1]);
+        failures++;
+    }
+    img_buf_release(outs[0], out_lens[0]);
+    img_buf_release(outs[1], out_lens[1]);
+    config.optimize_huffman = true;
+    if (fmt2jpg_multi(src.data(), src.size(), 320, 240, PIXFORMAT_YUV422, &config, qualities, 2, outs, out_lens)) {
+        printf("FAIL optimized Huffman tables accepted\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+// Checks the buffer converters against the callback ones: fmt2jpg must return the whole JPEG, sized exactly,
+// from QVGA up to busy UXGA frames far larger than any fixed output buffer, serial and sliced. The next frame of
+// the same size must be encoded straight into the buffer it is returned in, without a second one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+static int check(const char *name, uint16_t w, uint16_t h, int noise)
+{
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = w;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)(i / 11 + (noise ? rand_r(&seed) % noise : 0));
+    }
+
+    int failures = 0;
+    for (uint8_t workers = 1; workers <= 4; workers += 3) {
+        jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+        config.quality = 90;
+        config.workers = workers;
+        std::vector<uint8_t> ref;
+        uint8_t *jpg = NULL;
+        size_t jpg_len = 0;
+        bool ok = fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_RGB565, &config, collect_cb, &ref)
+                  && fmt2jpg_ex(src.data(), src.size(), w, h, PIXFORMAT_RGB565, &config, &jpg, &jpg_len);
+        ok = ok && jpg_len == ref.size() && std::vector<uint8_t>(jpg, jpg + jpg_len) == ref
+             && jpg[jpg_len - 2] == 0xFF && jpg[jpg_len - 1] == 0xD9;
+        printf("%s %ux%u workers=%u: %zu bytes\n", name, w, h, workers, jpg_len);
+        if (!ok) {
+            printf("FAIL %s workers=%u: buffer output differs from the callback output\n", name, workers);
+            failures++;
+        }
+        free(jpg);
+    }
+    return failures;
+}
+
+static uint32_t acquired(const img_buf_pool_stats_t &before)
+{
+    img_buf_pool_stats_t after;
+    img_buf_pool_get_stats(&after);
+    return after.hits + after.misses - before.hits - before.misses;
+}
+
+// Encodes a frame twice: the second time its output must take one buffer of the pool more than the callback
+// encoder, which only takes the encoder's own.
+static int check_one_buffer(uint16_t w, uint16_t h)
+{
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = h;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)(i / 7 + rand_r(&seed) % 16);
+    }
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> ref;
+    img_buf_pool_stats_t stats;
+    img_buf_pool_get_stats(&stats);
+    bool ok = fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &ref);
+    uint32_t encoder_buffers = acquired(stats);
+
+    uint8_t *jpg[2] = {};
+    size_t jpg_len[2] = {};
+    uint32_t buffers = 0;
+    for (int n = 0; n < 2; n++) {
+        img_buf_pool_get_stats(&stats);
+        ok = ok && fmt2jpg_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, &jpg[n], &jpg_len[n]);
+        buffers = acquired(stats);
+        ok = ok && std::vector<uint8_t>(jpg[n], jpg[n] + jpg_len[n]) == ref;
+    }
+    printf("%ux%u again: %zu bytes, %u buffers besides the encoder's\n", w, h, jpg_len[1], buffers - encoder_buffers);
+    int failures = 0;
+    if (!ok || buffers != encoder_buffers + 1) {
+        printf("FAIL %ux%u: second frame not encoded into the buffer it is returned in\n", w, h);
+        failures++;
+    }
+    img_buf_release(jpg[0], jpg_len[0]);
+    img_buf_release(jpg[1], jpg_len[1]);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("QVGA", 320, 240, 0);
+    failures += check("SVGA", 800, 600, 32);
+    failures += check("UXGA", 1600, 1200, 256);
+    failures += check_one_buffer(640, 480);
+    failures += check_one_buffer(1280, 720);
+    return failures ? 1 : 0;
+}
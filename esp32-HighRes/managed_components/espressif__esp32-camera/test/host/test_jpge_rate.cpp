@@ -0,0 +1,100 @@
+// Checks rate-controlled encoding over a stream whose scene content changes: every frame must fit the
+// budget and decode, re-encodes must stay within the limit, steady scenes must settle on one encode per
+// frame, and a budget no quality can meet must fail cleanly. Budgets smaller than the headers must be refused, a
+// tiny frame must fit a small budget.
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "img_converters.h"
+
+// YUYV scene: gradients and blocks, plus noise of the given amplitude (0..255) for the clutter.
+static void make_scene(std::vector<uint8_t> &yuyv, int w, int h, int noise, unsigned seed)
+{
+    yuyv.resize((size_t)w * h * 2);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &yuyv[((size_t)y * w + x) * 2];
+            p[0] = (uint8_t)(16 + ((x * 150) / w + (y * 50) / h + ((x / 64 + y / 64) & 1) * 20 + (noise ? rand_r(&seed) % noise : 0)) % 200);
+            p[1] = (uint8_t)((x & 1) ? 128 + (y * 60) / h : 100 + (x * 40) / w);
+        }
+    }
+}
+
+int main()
+{
+    const int w = 800, h = 600;
+    const size_t budget = 60 * 1024;
+    // a still scene, clutter arriving, staying, and leaving again
+    static const int s_noise[] = { 8, 8, 8, 8, 48, 48, 64, 64, 16, 8, 8, 8 };
+    const int num_frames = sizeof(s_noise) / sizeof(s_noise[0]);
+
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    jpg_rate_control_t rc = JPG_RATE_CONTROL_DEFAULT(budget);
+    std::vector<uint8_t> src, rgb((size_t)w * h * 3);
+    int failures = 0;
+
+    for (int f = 0; f < num_frames; f++) {
+        make_scene(src, w, h, s_noise[f], f + 1);
+        uint8_t *jpg = NULL;
+        size_t jpg_len = 0;
+        bool ok = fmt2jpg_rc(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, &rc, &jpg, &jpg_len);
+        ok = ok && jpg_len == rc.bytes && jpg_len <= budget && rc.encodes <= rc.max_encodes
+             && rc.quality >= rc.min_quality && rc.quality <= rc.max_quality
+             && fmt2rgb888(jpg, jpg_len, PIXFORMAT_JPEG, rgb.data());
+        // the last frames repeat a still scene, the model must have settled by then
+        if (f == num_frames - 1) {
+            ok = ok && rc.encodes == 1;
+        }
+        printf("frame %d noise %d: quality %u, %zu bytes, %u encodes\n", f, s_noise[f], rc.quality, jpg_len, rc.encodes);
+        if (!ok) {
+            printf("FAIL frame %d\n", f);
+            failures++;
+        }
+        free(jpg);
+    }
+
+    // nothing fits 2KB at SVGA: must fail at the lowest quality or after the allowed encodes, with the last attempt reported
+    jpg_rate_control_t tiny = JPG_RATE_CONTROL_DEFAULT(2048);
+    uint8_t *jpg = NULL;
+    size_t jpg_len = 0;
+    make_scene(src, w, h, 64, 1);
+    if (fmt2jpg_rc(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, &tiny, &jpg, &jpg_len)
+            || tiny.encodes > tiny.max_encodes || (tiny.encodes < tiny.max_encodes && tiny.quality != tiny.min_quality)
+            || tiny.bytes <= 2048) {
+        printf("FAIL impossible budget: encodes %u, %zu bytes\n", tiny.encodes, tiny.bytes);
+        free(jpg);
+        failures++;
+    }
+
+    jpg_rate_control_t bad = JPG_RATE_CONTROL_DEFAULT(budget);
+    bad.min_quality = 80;
+    bad.max_quality = 20;
+    if (fmt2jpg_rc(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, &bad, &jpg, &jpg_len)) {
+        printf("FAIL inverted quality range accepted\n");
+        free(jpg);
+        failures++;
+    }
+
+    // budgets below the headers are refused before encoding, a tiny frame fits a small one
+    static const size_t s_small[] = { 1, 99, JPG_RATE_CONTROL_MIN_BYTES - 1 };
+    for (size_t i = 0; i < sizeof(s_small) / sizeof(s_small[0]); i++) {
+        jpg_rate_control_t small = JPG_RATE_CONTROL_DEFAULT(s_small[i]);
+        if (fmt2jpg_rc(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, &small, &jpg, &jpg_len) || small.encodes) {
+            printf("FAIL budget of %zu bytes accepted\n", s_small[i]);
+            free(jpg);
+            failures++;
+        }
+    }
+    std::vector<uint8_t> gray(8 * 8, 128);
+    jpg_encode_config_t gray_config = JPG_ENCODE_CONFIG_DEFAULT();
+    gray_config.optimize_huffman = true;
+    jpg_rate_control_t small = JPG_RATE_CONTROL_DEFAULT(400);
+    if (!fmt2jpg_rc(gray.data(), gray.size(), 8, 8, PIXFORMAT_GRAYSCALE, &gray_config, &small, &jpg, &jpg_len)
+            || jpg_len > 400) {
+        printf("FAIL 8x8 frame in 400 bytes: %u encodes, %zu bytes\n", small.encodes, small.bytes);
+        failures++;
+    } else {
+        free(jpg);
+    }
+    return failures ? 1 : 0;
+}
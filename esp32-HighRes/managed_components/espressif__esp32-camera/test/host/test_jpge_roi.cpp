@@ -0,0 +1,78 @@
+// Checks region of interest weighted encoding: a full quality background must not change the output, a low one
+// must shrink it while the MCUs of the regions decode to the same pixels as a normal encode, for any worker count.
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+static bool encode(std::vector<uint8_t> &src, uint16_t w, uint16_t h, jpg_encode_config_t &config, std::vector<uint8_t> &out)
+{
+    out.clear();
+    return fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &out);
+}
+
+int main()
+{
+    const int w = 640, h = 480;
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    unsigned seed = 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &src[((size_t)y * w + x) * 2];
+            p[0] = (uint8_t)(16 + ((x * 150) / w + (y * 50) / h + ((x / 32 + y / 32) & 1) * 40 + rand_r(&seed) % 24));
+            p[1] = (uint8_t)((x & 1) ? 128 + (y * 60) / h : 100 + (x * 40) / w);
+        }
+    }
+    // two detection boxes, one not aligned to MCUs and one running off the image
+    static const jpg_rect_t s_rois[] = { { 100, 70, 90, 120 }, { 560, 400, 200, 200 } };
+    // the MCUs (16x16 for YUV422 at the default subsampling) covered by the boxes, in pixels
+    static const jpg_rect_t s_roi_mcus[] = { { 96, 64, 96, 128 }, { 560, 400, 80, 80 } };
+
+    int failures = 0;
+    for (uint8_t workers = 1; workers <= 3; workers += 2) {
+        jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+        config.workers = workers;
+        std::vector<uint8_t> plain, same, roi;
+        std::vector<uint8_t> plain_rgb((size_t)w * h * 3), roi_rgb((size_t)w * h * 3);
+        bool ok = encode(src, w, h, config, plain);
+
+        config.rois = s_rois;
+        config.num_rois = 2;
+        config.roi_background = 255;
+        ok = ok && encode(src, w, h, config, same) && same == plain;
+        if (!ok) {
+            printf("FAIL workers=%u: full quality background changed the output\n", workers);
+            failures++;
+            continue;
+        }
+
+        config.roi_background = 0;
+        ok = encode(src, w, h, config, roi) && roi.size() < plain.size() / 2
+             && fmt2rgb888(plain.data(), plain.size(), PIXFORMAT_JPEG, plain_rgb.data())
+             && fmt2rgb888(roi.data(), roi.size(), PIXFORMAT_JPEG, roi_rgb.data());
+        for (int r = 0; ok && r < 2; r++) {
+            const jpg_rect_t &m = s_roi_mcus[r];
+            for (int y = m.y; ok && y < m.y + m.height; y++) {
+                const size_t ofs = ((size_t)y * w + m.x) * 3;
+                ok = std::equal(&plain_rgb[ofs], &plain_rgb[ofs + m.width * 3], &roi_rgb[ofs]);
+            }
+        }
+        if (!ok) {
+            printf("FAIL workers=%u: region of interest encode is wrong\n", workers);
+            failures++;
+        }
+        printf("workers=%u: full %zu bytes, background 0 %zu bytes (%.1f%% smaller)\n", workers, plain.size(), roi.size(),
+               100.0 * (1.0 - (double)roi.size() / plain.size()));
+    }
+
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.num_rois = 1;
+    std::vector<uint8_t> out;
+    if (encode(src, w, h, config, out)) {
+        printf("FAIL missing regions of interest accepted\n");
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
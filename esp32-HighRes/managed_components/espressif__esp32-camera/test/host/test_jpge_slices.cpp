@@ -0,0 +1,102 @@
+// Checks slice-parallel encoding: the output must be a single valid JPEG with restart markers that
+// decodes to exactly the same pixels as the serial encode, for any worker count.
+// tjpgd only decodes YCbCr images, so grayscale output is checked for structure only.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+#include "jpge.h"
+#include "test_util.h"
+
+static bool encode(std::vector<uint8_t> &src, uint16_t w, uint16_t h, pixformat_t format, uint8_t workers, std::vector<uint8_t> &out)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 75;
+    config.workers = workers;
+    out.clear();
+    return fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &config, collect_cb, &out);
+}
+
+static bool has_marker(const std::vector<uint8_t> &jpg, uint8_t marker)
+{
+    for (size_t i = 0; i + 1 < jpg.size(); i++) {
+        if (jpg[i] == 0xFF && jpg[i + 1] == marker) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, pixformat_t format)
+{
+    size_t bpp = format == PIXFORMAT_GRAYSCALE ? 1 : 2;
+    std::vector<uint8_t> src((size_t)w * h * bpp);
+    unsigned seed = w * h;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 7 + (i / (w * bpp)) * 3 + (rand_r(&seed) & 31)) & 0xFF);
+    }
+
+    bool decode = format != PIXFORMAT_GRAYSCALE;
+    std::vector<uint8_t> ref, ref_rgb((size_t)w * h * 3), out, out_rgb((size_t)w * h * 3);
+    if (!encode(src, w, h, format, 1, ref) || (decode && !fmt2rgb888(ref.data(), ref.size(), PIXFORMAT_JPEG, ref_rgb.data()))) {
+        printf("FAIL %s: serial encode/decode\n", name);
+        return 1;
+    }
+
+    int failures = 0;
+    for (uint8_t workers = 2; workers <= 8; workers++) {
+        std::vector<uint8_t> again;
+        if (!encode(src, w, h, format, workers, out) || !encode(src, w, h, format, workers, again)) {
+            printf("FAIL %s workers=%u: encode\n", name, workers);
+            failures++;
+            continue;
+        }
+        bool ok = out.size() > 4 && out[0] == 0xFF && out[1] == 0xD8
+                  && out[out.size() - 2] == 0xFF && out[out.size() - 1] == 0xD9
+                  && has_marker(out, 0xDD) && out == again;
+        memset(out_rgb.data(), 0, out_rgb.size());
+        if (!ok || (decode && (!fmt2rgb888(out.data(), out.size(), PIXFORMAT_JPEG, out_rgb.data()) || out_rgb != ref_rgb))) {
+            printf("FAIL %s workers=%u: output differs from the serial encode\n", name, workers);
+            failures++;
+        }
+    }
+    printf("%s %ux%u: serial %zu bytes, 8 workers %zu bytes\n", name, w, h, ref.size(), out.size());
+    return failures;
+}
+
+// A slice may only start on a restart interval boundary.
+static int check_slice_alignment()
+{
+    class null_stream : public jpge::output_stream {
+        public:
+            virtual bool put_buf(const void *, int) { return true; }
+            virtual jpge::uint get_size() const { return 0; }
+    } stream;
+    jpge::params comp_params;
+    jpge::jpeg_encoder enc;
+    int failures = 0;
+
+    // 320x240 H2V2 has 20 MCUs per row
+    comp_params.m_restart_interval = 40;
+    failures += !enc.init_slice(&stream, 320, 240, 3, comp_params, 2, 2);
+    failures += enc.init_slice(&stream, 320, 240, 3, comp_params, 1, 2);
+    failures += enc.init_slice(&stream, 320, 240, 3, comp_params, 14, 2);
+    comp_params.m_restart_interval = 0;
+    failures += enc.init_slice(&stream, 320, 240, 3, comp_params, 2, 2);
+    if (failures) {
+        printf("FAIL slice alignment checks: %d\n", failures);
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("gray", 320, 240, PIXFORMAT_GRAYSCALE);
+    failures += check("rgb565", 333, 250, PIXFORMAT_RGB565);
+    failures += check("yuv422", 800, 600, PIXFORMAT_YUV422);
+    failures += check("rgb565-tall", 48, 1000, PIXFORMAT_RGB565);
+    failures += check_slice_alignment();
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+// Checks the stream encoder against a simulated capture: the frame arrives as DMA half buffers that do not
+// line up with rows, VSYNC ends it, and the JPEG must be identical to encoding the finished frame buffer.
+// Frames cut short or running long must fail without upsetting the next one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+// Capture of one frame: VSYNC, one EOF event per half buffer of the first `bytes` of src, VSYNC.
+// Returns the result of ending the frame, the time from the last EOF to the finished JPEG in *tail_ms.
+static bool capture(jpg_stream_encoder_t *enc, const std::vector<uint8_t> &src, size_t bytes, size_t half_buffer,
+                    std::vector<uint8_t> &jpg, double *tail_ms)
+{
+    jpg.clear();
+    if (!jpg_stream_encoder_start(enc, collect_cb, &jpg)) {
+        return false;
+    }
+    for (size_t pos = 0; pos < bytes; pos += half_buffer) {
+        if (!jpg_stream_encoder_write(enc, &src[pos], bytes - pos < half_buffer ? bytes - pos : half_buffer)) {
+            jpg_stream_encoder_end(enc);
+            return false;
+        }
+    }
+    auto vsync = std::chrono::steady_clock::now();
+    bool ok = jpg_stream_encoder_end(enc);
+    *tail_ms = ms_since(vsync);
+    return ok;
+}
+
+static int check(const char *name, uint16_t w, uint16_t h, pixformat_t format, size_t bpp)
+{
+    std::vector<uint8_t> src((size_t)w * h * bpp);
+    unsigned seed = w + h;
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 7 + (i / (w * bpp)) * 3 + (rand_r(&seed) & 15)) & 0xFF);
+    }
+
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> expected, jpg;
+    auto start = std::chrono::steady_clock::now();
+    if (!fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &config, collect_cb, &expected)) {
+        printf("FAIL %s: reference encode\n", name);
+        return 1;
+    }
+    double frame_ms = ms_since(start);
+
+    jpg_stream_encoder_t *enc = jpg_stream_encoder_create(w, h, format, &config);
+    if (!enc) {
+        printf("FAIL %s: create\n", name);
+        return 1;
+    }
+    int failures = 0;
+    double tail_ms = 0;
+    // half buffer sizes: single bytes, odd sizes straddling rows, typical DMA sizes, the whole frame at once
+    static const size_t s_half_buffers[] = { 1, 997, 3840, 16384 };
+    for (size_t i = 0; i <= sizeof(s_half_buffers) / sizeof(s_half_buffers[0]); i++) {
+        size_t half_buffer = i < sizeof(s_half_buffers) / sizeof(s_half_buffers[0]) ? s_half_buffers[i] : src.size();
+        if (!capture(enc, src, src.size(), half_buffer, jpg, &tail_ms) || jpg != expected) {
+            printf("FAIL %s: half buffers of %zu bytes\n", name, half_buffer);
+            failures++;
+        }
+    }
+    printf("%s %ux%u: %zu bytes, JPEG done %.3f ms after the last line, encoding the frame buffer takes %.3f ms\n",
+           name, w, h, jpg.size(), tail_ms, frame_ms);
+
+    // VSYNC before the whole frame arrived: dropped, and the next frame is fine
+    if (capture(enc, src, src.size() - 5 * w * bpp, 3840, jpg, &tail_ms)
+            || !capture(enc, src, src.size(), 3840, jpg, &tail_ms) || jpg != expected) {
+        printf("FAIL %s: short frame\n", name);
+        failures++;
+    }
+    // more bytes than a frame: refused
+    std::vector<uint8_t> longer(src);
+    longer.resize(src.size() + 100);
+    if (capture(enc, longer, longer.size(), 3840, jpg, &tail_ms)
+            || !capture(enc, src, src.size(), 3840, jpg, &tail_ms) || jpg != expected) {
+        printf("FAIL %s: long frame\n", name);
+        failures++;
+    }
+    // writes outside a frame are refused
+    if (jpg_stream_encoder_write(enc, src.data(), 16) || jpg_stream_encoder_end(enc)) {
+        printf("FAIL %s: write without start\n", name);
+        failures++;
+    }
+    jpg_stream_encoder_delete(enc);
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    failures += check("gray", 320, 240, PIXFORMAT_GRAYSCALE, 1);
+    failures += check("rgb565", 333, 250, PIXFORMAT_RGB565, 2);
+    failures += check("yuv422", 800, 600, PIXFORMAT_YUV422, 2);
+
+    // the slice parallel and two pass encoders need the whole frame
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.workers = 2;
+    jpg_stream_encoder_t *enc = jpg_stream_encoder_create(320, 240, PIXFORMAT_YUV422, &config);
+    if (enc) {
+        printf("FAIL parallel stream encoder accepted\n");
+        jpg_stream_encoder_delete(enc);
+        failures++;
+    }
+    return failures ? 1 : 0;
+}
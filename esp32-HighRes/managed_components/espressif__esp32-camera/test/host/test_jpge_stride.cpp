@@ -0,0 +1,88 @@
+// Checks strided and cropped encoding: encoding a rectangle of a padded frame buffer in place must give
+// exactly the same JPEG as encoding a tightly packed copy of that rectangle.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "img_converters.h"
+#include "test_util.h"
+
+static bool encode(std::vector<uint8_t> &src, uint16_t w, uint16_t h, pixformat_t format, jpg_encode_config_t &config, std::vector<uint8_t> &out)
+{
+    out.clear();
+    return fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &config, collect_cb, &out);
+}
+
+int main()
+{
+    static const struct {
+        pixformat_t format;
+        size_t bpp;
+        const char *name;
+    } formats[] = {
+        { PIXFORMAT_GRAYSCALE, 1, "gray" },
+        { PIXFORMAT_RGB565, 2, "rgb565" },
+        { PIXFORMAT_RGB888, 3, "rgb888" },
+        { PIXFORMAT_YUV422, 2, "yuv422" },
+    };
+    const uint16_t w = 320, h = 240, pad = 24;
+    const jpg_rect_t crop = { 42, 17, 201, 150 };
+    int failures = 0;
+
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        size_t bpp = formats[f].bpp, stride = w * bpp + pad;
+        std::vector<uint8_t> frame(stride * h), packed((size_t)crop.width * crop.height * bpp);
+        unsigned seed = 3;
+        for (size_t i = 0; i < frame.size(); i++) {
+            frame[i] = (uint8_t)(((i % stride) / 3 + (i / stride) + (rand_r(&seed) & 31)) & 0xFF);
+        }
+        for (int y = 0; y < crop.height; y++) {
+            memcpy(&packed[y * crop.width * bpp], &frame[(crop.y + y) * stride + crop.x * bpp], crop.width * bpp);
+        }
+
+        for (uint8_t workers = 1; workers <= 3; workers += 2) {
+            jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+            config.workers = workers;
+            std::vector<uint8_t> ref, out;
+            bool ok = encode(packed, crop.width, crop.height, formats[f].format, config, ref);
+            config.stride = stride;
+            config.crop = crop;
+            ok = ok && encode(frame, w, h, formats[f].format, config, out);
+            if (!ok || ref.empty() || out != ref) {
+                printf("FAIL %s workers=%u: cropped encode differs from the packed copy\n", formats[f].name, workers);
+                failures++;
+            }
+        }
+
+        // invalid requests are rejected
+        jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+        std::vector<uint8_t> out;
+        config.stride = stride;
+        config.crop.x = w;
+        failures += encode(frame, w, h, formats[f].format, config, out);
+        config.crop.x = 0;
+        config.crop.width = w + 1;
+        failures += encode(frame, w, h, formats[f].format, config, out);
+        config.crop.width = 0;
+        config.stride = w * bpp - 1;
+        failures += encode(frame, w, h, formats[f].format, config, out);
+        config.stride = stride;
+        frame.resize(stride * (h - 1));
+        failures += encode(frame, w, h, formats[f].format, config, out);
+    }
+
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    std::vector<uint8_t> frame((size_t)w * h * 2), out;
+    config.crop.x = 1;
+    if (encode(frame, w, h, PIXFORMAT_YUV422, config, out)) {
+        printf("FAIL yuv422: odd crop column accepted\n");
+        failures++;
+    }
+    if (encode(frame, w, h, PIXFORMAT_JPEG, config, out)) {
+        printf("FAIL jpeg source accepted\n");
+        failures++;
+    }
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,119 @@
+// Encodes the same set of frames from several threads at once and checks that every output is
+// byte-identical to a serial reference. The jobs mix quality, subsampling and pixel format so that
+// any state shared between encoder instances shows up as a mismatch.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "img_converters.h"
+
+struct job_t {
+    pixformat_t format;
+    uint16_t width, height;
+    uint8_t quality;
+    std::vector<uint8_t> src;
+    std::vector<uint8_t> ref;
+};
+
+static size_t bytes_per_pixel(pixformat_t format)
+{
+    switch (format) {
+        case PIXFORMAT_GRAYSCALE: return 1;
+        case PIXFORMAT_RGB888: return 3;
+        default: return 2;
+    }
+}
+
+static void make_frame(job_t &job, unsigned seed)
+{
+    size_t bpp = bytes_per_pixel(job.format);
+    job.src.resize((size_t)job.width * job.height * bpp);
+    for (size_t y = 0; y < job.height; y++) {
+        for (size_t x = 0; x < job.width; x++) {
+            uint8_t *p = &job.src[(y * job.width + x) * bpp];
+            for (size_t c = 0; c < bpp; c++) {
+                // A smooth gradient with some noise gives realistic Huffman statistics.
+                p[c] = (uint8_t)((x * (c + 1) + y * 2 + (rand_r(&seed) & 15)) & 0xFF);
+            }
+        }
+    }
+}
+
+static bool encode(const job_t &job, std::vector<uint8_t> &out)
+{
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    if (!fmt2jpg(const_cast<uint8_t *>(job.src.data()), job.src.size(), job.width, job.height, job.format, job.quality, &buf, &len)) {
+        return false;
+    }
+    out.assign(buf, buf + len);
+    free(buf);
+    return true;
+}
+
+static size_t collect_cb(void *arg, size_t index, const void *data, size_t len)
+{
+    std::vector<uint8_t> *out = static_cast<std::vector<uint8_t> *>(arg);
+    if (out->size() != index) {
+        return 0;
+    }
+    out->insert(out->end(), (const uint8_t *)data, (const uint8_t *)data + len);
+    return len;
+}
+
+static bool encode_cb(const job_t &job, std::vector<uint8_t> &out)
+{
+    out.clear();
+    return fmt2jpg_cb(const_cast<uint8_t *>(job.src.data()), job.src.size(), job.width, job.height, job.format, job.quality, collect_cb, &out);
+}
+
+int main()
+{
+    static const pixformat_t formats[] = { PIXFORMAT_GRAYSCALE, PIXFORMAT_RGB565, PIXFORMAT_RGB888, PIXFORMAT_YUV422 };
+    static const uint8_t qualities[] = { 12, 50, 80, 95 };
+    const int num_threads = 8, iterations = 20;
+
+    std::vector<job_t> jobs;
+    unsigned seed = 1;
+    for (size_t f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        for (size_t q = 0; q < sizeof(qualities) / sizeof(qualities[0]); q++) {
+            job_t job;
+            job.format = formats[f];
+            job.width = 160 + 16 * (uint16_t)q;
+            job.height = 120 + 8 * (uint16_t)f;
+            job.quality = qualities[q];
+            make_frame(job, seed++);
+            if (!encode(job, job.ref)) {
+                printf("FAIL: serial encode of job %zu\n", jobs.size());
+                return 1;
+            }
+            jobs.push_back(job);
+        }
+    }
+
+    std::atomic<int> mismatches(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&, t] {
+            std::vector<uint8_t> out;
+            for (int it = 0; it < iterations; it++) {
+                for (size_t n = 0; n < jobs.size(); n++) {
+                    // Every thread walks the jobs in a different order, alternating both entry points.
+                    const job_t &job = jobs[(n * (2 * t + 1) + it) % jobs.size()];
+                    bool ok = ((it + t) & 1) ? encode_cb(job, out) : encode(job, out);
+                    if (!ok || out != job.ref) {
+                        mismatches++;
+                    }
+                }
+            }
+        });
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    printf("%d threads x %d iterations x %zu jobs: %d mismatches\n", num_threads, iterations, jobs.size(), mismatches.load());
+    return mismatches.load() ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+// Compares the native YUYV encode path with the old YUYV -> RGB -> YCbCr round trip: the native
+// path must be at least as accurate (PSNR against the camera's own YUV -> RGB conversion) and it
+// should be faster. Timings are printed but not checked.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+#include "img_converters.h"
+#include "yuv.h"
+#include "test_util.h"
+
+static uint8_t clamp8(double v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : (uint8_t)(v + 0.5));
+}
+
+// A synthetic scene with gradients, hard edges and saturated colours, as limited range YUYV.
+static void make_yuyv(std::vector<uint8_t> &yuyv, int w, int h)
+{
+    yuyv.resize((size_t)w * h * 2);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x += 2) {
+            double ys[2], cb = 0, cr = 0;
+            for (int k = 0; k < 2; k++) {
+                int px = x + k;
+                double r = (px * 255.0) / w, g = (y * 255.0) / h, b = ((px / 40 + y / 40) & 1) ? 220 : 30;
+                if ((px - w / 2) * (px - w / 2) + (y - h / 2) * (y - h / 2) < (h / 5) * (h / 5)) {
+                    r = 250; g = 20; b = 40;
+                }
+                ys[k] = 16 + (65.481 * r + 128.553 * g + 24.966 * b) / 255;
+                cb += (128 + (-37.797 * r - 74.203 * g + 112.0 * b) / 255) / 2;
+                cr += (128 + (112.0 * r - 93.786 * g - 18.214 * b) / 255) / 2;
+            }
+            uint8_t *p = &yuyv[((size_t)y * w + x) * 2];
+            p[0] = clamp8(ys[0]); p[1] = clamp8(cb); p[2] = clamp8(ys[1]); p[3] = clamp8(cr);
+        }
+    }
+}
+
+static double psnr(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    double se = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        double d = (double)a[i] - b[i];
+        se += d * d;
+    }
+    return 10 * log10(255.0 * 255.0 * a.size() / se);
+}
+
+static double encode(std::vector<uint8_t> &src, int w, int h, pixformat_t format, jpg_subsampling_t subsampling, std::vector<uint8_t> &out)
+{
+    jpg_encode_config_t config = JPG_ENCODE_CONFIG_DEFAULT();
+    config.quality = 90;
+    config.subsampling = subsampling;
+    const int rounds = 10;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        out.clear();
+        if (!fmt2jpg_cb_ex(src.data(), src.size(), w, h, format, &config, collect_cb, &out)) {
+            return -1;
+        }
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000 / rounds;
+}
+
+int main()
+{
+    const int w = 640, h = 480;
+    std::vector<uint8_t> yuyv, bgr((size_t)w * h * 3);
+    make_yuyv(yuyv, w, h);
+
+    // What the old path fed the encoder, and the reference the decoded images are compared to.
+    for (size_t i = 0, o = 0; i < yuyv.size(); i += 4, o += 6) {
+        uint8_t r, g, b;
+        yuv2rgb(yuyv[i], yuyv[i + 1], yuyv[i + 3], &r, &g, &b);
+        bgr[o + 0] = b; bgr[o + 1] = g; bgr[o + 2] = r;
+        yuv2rgb(yuyv[i + 2], yuyv[i + 1], yuyv[i + 3], &r, &g, &b);
+        bgr[o + 3] = b; bgr[o + 4] = g; bgr[o + 5] = r;
+    }
+
+    static const struct {
+        jpg_subsampling_t subsampling;
+        const char *name;
+    } modes[] = { { JPG_SUBSAMPLING_420, "4:2:0" }, { JPG_SUBSAMPLING_422, "4:2:2" } };
+
+    int failures = 0;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        std::vector<uint8_t> jpg_native, jpg_rgb, dec_native((size_t)w * h * 3), dec_rgb((size_t)w * h * 3);
+        double ms_native = encode(yuyv, w, h, PIXFORMAT_YUV422, modes[m].subsampling, jpg_native);
+        double ms_rgb = encode(bgr, w, h, PIXFORMAT_RGB888, modes[m].subsampling, jpg_rgb);
+        if (ms_native < 0 || ms_rgb < 0
+            || !fmt2rgb888(jpg_native.data(), jpg_native.size(), PIXFORMAT_JPEG, dec_native.data())
+            || !fmt2rgb888(jpg_rgb.data(), jpg_rgb.size(), PIXFORMAT_JPEG, dec_rgb.data())) {
+            printf("FAIL %s: encode/decode\n", modes[m].name);
+            failures++;
+            continue;
+        }
+        double p_native = psnr(bgr, dec_native), p_rgb = psnr(bgr, dec_rgb);
+        printf("%s native: %.2f ms %zu bytes %.2f dB | via RGB: %.2f ms %zu bytes %.2f dB\n", modes[m].name,
+               ms_native, jpg_native.size(), p_native, ms_rgb, jpg_rgb.size(), p_rgb);
+        if (p_native < p_rgb - 0.05) {
+            printf("FAIL %s: native path is less accurate than the RGB round trip\n", modes[m].name);
+            failures++;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+// Checks that every tjpgd IDCT and colour conversion kernel set built for this CPU matches the scalar kernels bit
+// for bit, clipping of out of range IDCT output included.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tjpgd_dsp.h"
+
+// De-quantized coefficients as mcu_load() leaves them: mostly sparse, sometimes dense or out of the pixel range.
+static void fill_block(LONG *blk, int pattern, unsigned *seed)
+{
+    memset(blk, 0, 64 * sizeof(LONG));
+    switch (pattern) {
+        case 0: blk[0] = -128 * 256; break;
+        case 1: blk[0] = 127 * 256; break;
+        case 2:
+            for (int i = 0; i < 64; i++) {
+                blk[i] = (LONG)(rand_r(seed) % 65536) - 32768;
+            }
+            break;
+        default:
+            for (int n = rand_r(seed) % 12; n >= 0; n--) {
+                blk[rand_r(seed) % 64] = (LONG)(rand_r(seed) % 16384) - 8192;
+            }
+            break;
+    }
+}
+
+int main()
+{
+    const jd_dsp_kernels *ref = jd_dsp_get_kernels(JD_DSP_SCALAR);
+    unsigned seed = 1;
+    int failures = 0;
+
+    for (int id = JD_DSP_SCALAR + 1; id < JD_DSP_KERNEL_COUNT; id++) {
+        const jd_dsp_kernels *k = jd_dsp_get_kernels(static_cast<jd_dsp_kernel_id_t>(id));
+        if (!k) {
+            printf("kernel %d: not supported, skipped\n", id);
+            continue;
+        }
+        int failed = 0;
+        for (int n = 0; n < 200000 && !failed; n++) {
+            LONG a[64], b[64];
+            BYTE pa[64], pb[64];
+            fill_block(a, n < 2 ? n : 2 + n % 3, &seed);
+            memcpy(b, a, sizeof(a));
+            ref->idct(a, pa);
+            k->idct(b, pb);
+            if (memcmp(pa, pb, sizeof(pa))) {
+                printf("%s: idct mismatch on block %d\n", k->name, n);
+                failed = 1;
+            }
+        }
+        // Y blocks, then Cb and Cr, laid out as in the MCU buffer
+        for (int n = 0; n < 100000 && !failed; n++) {
+            BYTE mcu[64 * 4], ra[16 * 3], rb[16 * 3];
+            for (size_t i = 0; i < sizeof(mcu); i++) {
+                mcu[i] = (n & 1) ? (BYTE)rand_r(&seed) : (BYTE)((n >> 1) + i * 7);
+            }
+            UINT mx = (n & 2) ? 16 : 8;
+            const BYTE *py = mcu + (n % 8) * 8, *pc = mcu + 128 + (n % 8) * 8;
+            ref->ycc_row(ra, py, pc, mx);
+            k->ycc_row(rb, py, pc, mx);
+            if (memcmp(ra, rb, mx * 3)) {
+                printf("%s: ycc_row mismatch on row %d (%u pixels)\n", k->name, n, mx);
+                failed = 1;
+            }
+        }
+        printf("%s: %s\n", k->name, failed ? "FAIL" : "ok");
+        failures += failed;
+    }
+    printf("selected: %s\n", jd_dsp_select_kernels()->name);
+    return failures ? 1 : 0;
+}
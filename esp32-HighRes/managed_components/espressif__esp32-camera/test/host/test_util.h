@@ -0,0 +1,180 @@
+// Helpers shared by the host tests and benchmarks: collecting or counting encoder output, making test JPEGs,
+// decoding into a frame through the writer callback, and the source images of the benchmarks.
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+
+// Appends the output of the callback encoders to the std::vector<uint8_t> in arg.
+static inline size_t collect_cb(void *arg, size_t, const void *data, size_t len)
+{
+    std::vector<uint8_t> *out = static_cast<std::vector<uint8_t> *>(arg);
+    if (data) {
+        out->insert(out->end(), (const uint8_t *)data, (const uint8_t *)data + len);
+    }
+    return len;
+}
+
+// Keeps only the size of the output of the callback encoders, in the size_t in arg.
+static inline size_t count_cb(void *arg, size_t index, const void *, size_t len)
+{
+    *static_cast<size_t *>(arg) = index + len;
+    return len;
+}
+
+static inline double ms_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Encodes a YUV422 frame of ramps with noise, the seed picks the noise.
+static inline bool make_jpg(uint16_t w, uint16_t h, const jpg_encode_config_t &config, unsigned seed,
+                            std::vector<uint8_t> &jpg)
+{
+    std::vector<uint8_t> src((size_t)w * h * 2);
+    for (size_t i = 0; i < src.size(); i++) {
+        src[i] = (uint8_t)((i / 3 + (i / (w * 2)) * 2 + (rand_r(&seed) & 63)) & 0xFF);
+    }
+    return fmt2jpg_cb_ex(src.data(), src.size(), w, h, PIXFORMAT_YUV422, &config, collect_cb, &jpg);
+}
+
+// A decode through write_cb: the MCUs copied into a frame of bpp bytes per pixel, with the times each pixel was
+// written. read_cb reads jpg.
+struct decode_t {
+    const std::vector<uint8_t> *jpg;
+    std::vector<uint8_t> out;
+    std::vector<uint8_t> written;
+    uint16_t width, height;
+    int bpp;
+
+    decode_t() : jpg(NULL), width(0), height(0), bpp(3) {}
+};
+
+static inline size_t read_cb(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+    const std::vector<uint8_t> *jpg = static_cast<decode_t *>(arg)->jpg;
+    if (buf) {
+        memcpy(buf, jpg->data() + index, len);
+    }
+    return len;
+}
+
+// Writes of the parallel decoders never overlap, the counts need no lock.
+static inline bool write_cb(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    decode_t *dec = static_cast<decode_t *>(arg);
+    if (!data) {
+        if (!x && !y) {
+            dec->width = w;
+            dec->height = h;
+            dec->out.assign((size_t)w * h * dec->bpp, 0);
+            dec->written.assign((size_t)w * h, 0);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++) {
+        memcpy(&dec->out[((size_t)(y + iy) * dec->width + x) * dec->bpp], data + (size_t)iy * w * dec->bpp,
+               (size_t)w * dec->bpp);
+        for (int ix = 0; ix < w; ix++) {
+            dec->written[(size_t)(y + iy) * dec->width + x + ix]++;
+        }
+    }
+    return true;
+}
+
+// An image as B, G, R bytes per pixel, the byte order of PIXFORMAT_RGB888.
+struct bgr_image_t {
+    uint16_t width, height;
+    std::vector<uint8_t> bgr;
+};
+
+// Decoder writer filling the bgr_image_t in arg.
+static inline bool bgr_write_cb(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+    bgr_image_t &img = *static_cast<bgr_image_t *>(arg);
+    if (!data) {
+        if (!x && !y) {
+            img.width = w;
+            img.height = h;
+            img.bgr.resize((size_t)w * h * 3);
+        }
+        return true;
+    }
+    for (int iy = 0; iy < h; iy++) {
+        uint8_t *o = &img.bgr[((size_t)(y + iy) * img.width + x) * 3];
+        for (int ix = 0; ix < w; ix++, o += 3, data += 3) {
+            o[0] = data[2];
+            o[1] = data[1];
+            o[2] = data[0];
+        }
+    }
+    return true;
+}
+
+// Decodes a baseline JPEG file, scaled down by the decoder as far as it stays at least min_w x min_h.
+static inline bool load_image(const std::string &path, bgr_image_t &img, uint16_t min_w, uint16_t min_h)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f) {
+        return false;
+    }
+    std::vector<uint8_t> jpg;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        jpg.insert(jpg.end(), buf, buf + n);
+    }
+    fclose(f);
+
+    int w = 0, h = 0;
+    for (size_t i = 2; i + 9 < jpg.size(); i++) {
+        if (jpg[i] == 0xFF && jpg[i + 1] == 0xC0) {
+            h = (jpg[i + 5] << 8) | jpg[i + 6];
+            w = (jpg[i + 7] << 8) | jpg[i + 8];
+            break;
+        }
+    }
+    int scale = JPG_SCALE_NONE;
+    while (scale < JPG_SCALE_MAX && (w >> (scale + 1)) >= min_w && (h >> (scale + 1)) >= min_h) {
+        scale++;
+    }
+    return w && h && esp_jpg_decode_mem(jpg.data(), jpg.size(), (jpg_scale_t)scale, bgr_write_cb, &img, NULL, 0) == ESP_OK;
+}
+
+// Nearest neighbour scaling of the whole image to w x h.
+static inline void resample(const bgr_image_t &src, bgr_image_t &dst, uint16_t w, uint16_t h)
+{
+    dst.width = w;
+    dst.height = h;
+    dst.bgr.resize((size_t)w * h * 3);
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = &src.bgr[(size_t)(y * src.height / h) * src.width * 3];
+        for (int x = 0; x < w; x++) {
+            memcpy(&dst.bgr[((size_t)y * w + x) * 3], row + (size_t)(x * src.width / w) * 3, 3);
+        }
+    }
+}
+
+// Smooth gradients with some sensor noise, roughly what a table top scene compresses like.
+static inline void synthetic_image(bgr_image_t &img, uint16_t w, uint16_t h)
+{
+    img.width = w;
+    img.height = h;
+    img.bgr.resize((size_t)w * h * 3);
+    unsigned seed = 1;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &img.bgr[((size_t)y * w + x) * 3];
+            int base = (x * 150) / w + (y * 50) / h + ((x / 64 + y / 64) & 1) * 20 + (rand_r(&seed) & 7);
+            p[0] = (uint8_t)(40 + base);
+            p[1] = (uint8_t)(30 + base + (y * 40) / h);
+            p[2] = (uint8_t)(20 + base + (x * 60) / w);
+        }
+    }
+}